@@ -44,6 +44,123 @@ extern "C" {
 LIBMEMCACHED_API
 memcached_return_t memcached_sched_set(memcached_st *ptr, double alpha, double beta);
 
+/* jinho added: how the dynamic distribution moves its boundaries, see types/sched_policy.h */
+LIBMEMCACHED_API
+memcached_return_t memcached_sched_set_policy(memcached_st *ptr, memcached_sched_policy_t policy);
+
+LIBMEMCACHED_API
+memcached_sched_policy_t memcached_sched_get_policy(memcached_st *ptr);
+
+/* jinho added: half-life of the dynamic statistics in scheduler ticks, 0 resets them after every move */
+LIBMEMCACHED_API
+memcached_return_t memcached_sched_set_half_life(memcached_st *ptr, double half_life);
+
+LIBMEMCACHED_API
+double memcached_sched_get_half_life(memcached_st *ptr);
+
+/*
+  jinho added: what the (1 - alpha) load share of the cost is made of, as
+  weights of the request count, the bytes stored and fetched, and the time
+  spent waiting for replies of every server. The default is 1, 0, 0.
+*/
+LIBMEMCACHED_API
+memcached_return_t memcached_sched_set_load(memcached_st *ptr, double ops, double bytes, double latency);
+
+/*
+  jinho added: weight of the eviction pressure in the cost. The servers
+  report it to the thread of memcached_sched_start(), see
+  memcached_sched_set_feedback(), or to memcached_sched_feedback().
+*/
+LIBMEMCACHED_API
+memcached_return_t memcached_sched_set_pressure(memcached_st *ptr, double weight);
+
+/*
+  jinho added: the thread of memcached_sched_start() asks every server of
+  ptr for its evictions and memory use before every so many of its ticks,
+  on a connection of its own; the default is MEMCACHED_SCHED_FEEDBACK, 0
+  leaves it to memcached_sched_feedback(). The servers are those of the
+  last handle that set them, or this one.
+*/
+LIBMEMCACHED_API
+memcached_return_t memcached_sched_set_feedback(memcached_st *ptr, uint32_t every);
+
+/*
+  jinho added: remember up to hot_keys (at most 2^20) recently hit keys,
+  and when a move hands one to another server queue it for
+  memcached_sched_migrate(). The copies expire after ttl; a key written or
+  deleted through a handle after it was queued is not copied. The table
+  size is fixed by the first call that turns migration on; hot_keys 0
+  turns it off.
+*/
+LIBMEMCACHED_API
+memcached_return_t memcached_sched_set_migration(memcached_st *ptr, uint32_t hot_keys, time_t ttl);
+
+/*
+  jinho added: keep the dynamic ring from before each move, server addition
+  or removal for grace seconds, the last SCHED_KEPT_MAX (4) of them; a
+  memcached_get() that misses asks the key's owners in those rings, the
+  latest first, and writes a value it finds back with expiration ttl.
+  Writes, deletes, increments and decrements drop the key from those
+  owners too. grace 0 (the default) turns it off.
+*/
+LIBMEMCACHED_API
+memcached_return_t memcached_sched_set_handoff(memcached_st *ptr, time_t grace, time_t ttl);
+
+/*
+  jinho added: count the most requested keys, see memcached_sched_hot_keys().
+  One in sample keys routed by each handle is counted, in a table of the
+  given number of keys, at most 2^20; a key counted more than 1/keys of all
+  samples is sure to be in it. A call with another size than the table has
+  builds it anew, and the counts start over; keys 0 turns it off and keeps
+  the size.
+*/
+LIBMEMCACHED_API
+memcached_return_t memcached_sched_set_hot_keys(memcached_st *ptr, uint32_t keys, uint32_t sample);
+
+/*
+  jinho added: a hot key, one counted at least share (0 < share <= 1) of all
+  samples by memcached_sched_set_hot_keys(), is kept on replicas servers,
+  its owner and the next ones clockwise: sets also go to the copies, which
+  expire after ttl (> 0), and memcached_get() reads any of them. Only handles that
+  neither buffer, use noreply, encrypt nor set number_of_replicas take part.
+  The table size is fixed by the first call; replicas 1 turns it off.
+*/
+LIBMEMCACHED_API
+memcached_return_t memcached_sched_set_replication(memcached_st *ptr, uint32_t replicas, double share, time_t ttl);
+
+/*
+  jinho added: keep what memcached_get() returns in the process, in at most
+  bytes, for ttl_ms milliseconds; a get of the key within that time is
+  answered without asking a server. Writes and flushes through this process
+  take effect at once, those of other clients after up to ttl_ms. Only
+  handles with a dynamic distribution, the cluster of the shared ring, use
+  the cache. Gets by group key are not cached, and memcached_mget() and
+  memcached_fetch() neither read nor fill it: every key of an mget asks its
+  server. The table size is fixed by the first call; bytes 0 turns it off.
+*/
+LIBMEMCACHED_API
+memcached_return_t memcached_sched_set_near_cache(memcached_st *ptr, size_t bytes, uint32_t ttl_ms);
+
+/*
+  jinho added: with MEMCACHED_DISTRIBUTION_CONSISTENT_BOUNDED a server that
+  took more than 1 + epsilon times the mean of the requests the handle
+  routed lately is full: a key for it goes to the next one clockwise that is
+  not, and stays there. Its gets, writes, deletes and incr/decr all follow,
+  until the server list changes; the first get there misses. Handles place
+  keys each on their own, a clone starting from the keys its source placed.
+  The default is MEMCACHED_SCHED_BOUND; clones keep it.
+*/
+LIBMEMCACHED_API
+memcached_return_t memcached_sched_set_bound(memcached_st *ptr, double epsilon);
+
+/*
+  jinho added: memcached_sched_save() to path every so many scheduler ticks;
+  NULL or 0 stops it. How the writes went is counted anew for every call,
+  see memcached_sched_snapshot_stat().
+*/
+LIBMEMCACHED_API
+memcached_return_t memcached_sched_set_snapshot(memcached_st *ptr, const char *path, uint32_t every);
+
 LIBMEMCACHED_API
 memcached_return_t memcached_behavior_set(memcached_st *ptr, const memcached_behavior_t flag, uint64_t data);
 
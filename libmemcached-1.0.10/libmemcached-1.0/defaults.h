@@ -57,4 +57,9 @@
 
 // jinho added 
 #define MEMCACHED_DYNAMIC_SET_REPETITION    1 /* repete the whole list this many times */
+#define MEMCACHED_CONTINUUM_JUMP_POINTS     512 /* continuum size from which lookups use a hash-prefix jump table */
+#define MEMCACHED_SCHED_HALF_LIFE           4.0 /* scheduler ticks until a request weighs half in the dynamic statistics */
+#define MEMCACHED_SCHED_PRESSURE            0.5 /* weight of server eviction pressure in the dynamic cost */
+#define MEMCACHED_SCHED_FEEDBACK            8 /* ticks of the scheduler thread between asking the servers for eviction pressure */
+#define MEMCACHED_SCHED_BOUND               0.25 /* a bounded server takes up to 1 + this times the mean load */
 
@@ -54,6 +54,19 @@ memcached_return_t memcached_set_hashkit(memcached_st *ptr, hashkit_st *hashk);
 LIBMEMCACHED_API
 uint32_t memcached_generate_hash(memcached_st *ptr, const char *key, size_t key_length, uint32_t cmd);
 
+/*
+  Hashes and routes number_of_keys keys in one go, checking auto eject once
+  for the whole batch. server_key[x] receives the server of keys[x], as
+  memcached_generate_hash() would return it.
+*/
+LIBMEMCACHED_API
+memcached_return_t memcached_generate_hash_batch(memcached_st *ptr,
+                                                 const char * const *keys,
+                                                 const size_t *key_length,
+                                                 size_t number_of_keys,
+                                                 uint32_t *server_key,
+                                                 uint32_t cmd);
+
 LIBMEMCACHED_API
 void memcached_autoeject(memcached_st *ptr);
 
@@ -67,6 +67,7 @@
 #include <libmemcached-1.0/types/connection.h>
 #include <libmemcached-1.0/types/hash.h>
 #include <libmemcached-1.0/types/return.h>
+#include <libmemcached-1.0/types/sched_policy.h>
 #include <libmemcached-1.0/types/server_distribution.h>
 
 #include <libmemcached-1.0/return.h>
@@ -86,6 +87,7 @@
 #include <libmemcached-1.0/struct/memcached.h>
 #include <libmemcached-1.0/struct/server.h>
 #include <libmemcached-1.0/struct/stat.h>
+#include <libmemcached-1.0/struct/sched_hot_key.h>
 
 #include <libmemcached-1.0/basic_string.h>
 #include <libmemcached-1.0/error.h>
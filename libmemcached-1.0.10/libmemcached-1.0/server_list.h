@@ -57,6 +57,73 @@ LIBMEMCACHED_API
 LIBMEMCACHED_API
   void mem_hs_sched_dynamic(void);
 
+/* jinho added: copies at most max_keys queued hot keys from their old
+ * owner to the new one, see memcached_sched_set_migration(). Call it with
+ * a handle of its own, as often as the servers can take the extra load.
+ */
+LIBMEMCACHED_API
+  memcached_return_t memcached_sched_migrate(memcached_st *ptr, uint32_t max_keys, uint32_t *migrated);
+
+/* keys copied, hits on copies (misses avoided), and moves still queued */
+LIBMEMCACHED_API
+  memcached_return_t memcached_sched_migration_stat(memcached_st *ptr, uint64_t *migrated, uint64_t *avoided, uint64_t *pending);
+
+/* misses retried on the previous owner, and how many of them found the key there */
+LIBMEMCACHED_API
+  memcached_return_t memcached_sched_handoff_stat(memcached_st *ptr, uint64_t *tries, uint64_t *hits);
+
+/* jinho added: up to max of the most requested keys, most requested first,
+ * with their hash and current server; count is how many were filled in
+ */
+LIBMEMCACHED_API
+  memcached_return_t memcached_sched_hot_keys(memcached_st *ptr, memcached_sched_hot_key_st *keys, uint32_t max, uint32_t *count);
+
+/* keys replicated right now, gets answered by a copy, and copies filled after a miss */
+LIBMEMCACHED_API
+  memcached_return_t memcached_sched_replication_stat(memcached_st *ptr, uint32_t *hot, uint64_t *spread, uint64_t *filled);
+
+/* gets answered by the near cache, gets that had to ask a server, and bytes cached */
+LIBMEMCACHED_API
+  memcached_return_t memcached_sched_near_stat(memcached_st *ptr, uint64_t *hits, uint64_t *misses, uint64_t *bytes);
+
+/* requests routed with MEMCACHED_DISTRIBUTION_CONSISTENT_BOUNDED, and how many went to another server than their own */
+LIBMEMCACHED_API
+  memcached_return_t memcached_sched_bound_stat(memcached_st *ptr, uint64_t *requests, uint64_t *overflowed);
+
+/* jinho added: writes the dynamic continuum with its statistics and alpha,
+ * beta and half-life to path, atomically (a sibling file renamed over it)
+ */
+LIBMEMCACHED_API
+  memcached_return_t memcached_sched_save(memcached_st *ptr, const char *path);
+
+/* routes as the client that saved path did; call it after pushing the same
+ * servers, in any order
+ */
+LIBMEMCACHED_API
+  memcached_return_t memcached_sched_load(memcached_st *ptr, const char *path);
+
+/* snapshots memcached_sched_set_snapshot() wrote to its path, writes that
+ * failed, and the errno of the last failure (0 if none); all 0 without one
+ */
+LIBMEMCACHED_API
+  memcached_return_t memcached_sched_snapshot_stat(memcached_st *ptr, uint64_t *written, uint64_t *failed, int *error);
+
+/* jinho added: runs mem_hs_sched_dynamic() with policy on a thread of its
+ * own, waiting between min_interval and max_interval milliseconds: less
+ * while the ring keeps moving, more once it is stable or idle. Calling it
+ * again restarts the thread with the new settings.
+ */
+LIBMEMCACHED_API
+  memcached_return_t memcached_sched_start(memcached_st *ptr, memcached_sched_policy_t policy,
+                                           uint32_t min_interval, uint32_t max_interval);
+
+LIBMEMCACHED_API
+  memcached_return_t memcached_sched_stop(memcached_st *ptr);
+
+/* ticks run, runs skipped for too few requests, and the current wait in milliseconds */
+LIBMEMCACHED_API
+  memcached_return_t memcached_sched_thread_stat(memcached_st *ptr, uint64_t *ticks, uint64_t *skipped, uint32_t *interval);
+
 /* Server List Public functions */
 LIBMEMCACHED_API
   void memcached_server_list_free(memcached_server_list_st ptr);
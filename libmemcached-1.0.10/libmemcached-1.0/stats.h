@@ -64,6 +64,16 @@ char ** memcached_stat_get_keys(memcached_st *ptr, memcached_stat_st *memc_stat,
 LIBMEMCACHED_API
 memcached_return_t memcached_stat_execute(memcached_st *memc, const char *args,  memcached_stat_fn func, void *context);
 
+/*
+  jinho added: asks every server for its stats and hands evictions and
+  memory use to the dynamic scheduler. It talks to the servers on memc, so
+  call it from a handle (and thread) of its own, not from the request path.
+  The thread of memcached_sched_start() does the same on its own, see
+  memcached_sched_set_feedback().
+*/
+LIBMEMCACHED_API
+memcached_return_t memcached_sched_feedback(memcached_st *memc);
+
 #ifdef __cplusplus
 } // extern "C"
 #endif
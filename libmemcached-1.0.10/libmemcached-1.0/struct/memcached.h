@@ -105,6 +105,7 @@ struct memcached_st {
     uint32_t continuum_points_counter; // Ketama
     time_t next_distribution_rebuild; // Ketama
     struct memcached_continuum_item_st *continuum; // Ketama
+    struct memcached_continuum_search_st *search; // Ketama: lookup order of continuum
   } ketama;
 
   // jinho added : ketama help to get statistics
@@ -112,6 +113,9 @@ struct memcached_st {
 
   // jinho added : common data structure for all the memcached_st
   struct sched_dynamic *dynamic;
+  struct sched_reader *sched_reader; // this handle's epoch record in dynamic
+  struct sched_bounded *bounded; // MEMCACHED_DISTRIBUTION_CONSISTENT_BOUNDED, this handle's own
+  struct sched_table *table; // MEMCACHED_DISTRIBUTION_MAGLEV and _JUMP, likewise
 
   struct memcached_virtual_bucket_t *virtual_bucket;
 
@@ -0,0 +1,16 @@
+/*
+ * sched_hot_key.h
+ *
+ * One of the most requested keys, as memcached_sched_hot_keys() reports it.
+ */
+
+#pragma once
+
+struct memcached_sched_hot_key_st {
+  char key[MEMCACHED_MAX_KEY];
+  size_t key_length;
+  uint32_t hash;    // where the key falls on the dynamic continuum
+  uint32_t server;  // the server it is routed to now
+  double count;     // sampled requests, faded with the scheduler half-life
+  double error;     // count may be over by at most this much
+};
@@ -45,6 +45,7 @@ namespace org { namespace libmemcached { struct Instance; } }
 struct memcached_st;
 struct memcached_stat_st;
 struct memcached_analysis_st;
+struct memcached_sched_hot_key_st;
 struct memcached_result_st;
 struct memcached_array_st;
 struct memcached_error_t;
@@ -61,12 +62,14 @@ struct memcached_callback_st;
 struct memcached_string_st;
 struct memcached_string_t;
 struct memcached_continuum_item_st;
+struct memcached_continuum_search_st;
 
 #else
 
 typedef struct memcached_st memcached_st;
 typedef struct memcached_stat_st memcached_stat_st;
 typedef struct memcached_analysis_st memcached_analysis_st;
+typedef struct memcached_sched_hot_key_st memcached_sched_hot_key_st;
 typedef struct memcached_result_st memcached_result_st;
 typedef struct memcached_array_st memcached_array_st;
 typedef struct memcached_error_t memcached_error_t;
@@ -0,0 +1,17 @@
+/*
+ * sched_policy.h
+ *
+ * How mem_hs_sched_dynamic() moves the boundaries of the dynamic continuum.
+ */
+
+#pragma once
+
+enum memcached_sched_policy_t {
+  MEMCACHED_SCHED_POLICY_PAIR, // default: one boundary between the most and least loaded server
+  MEMCACHED_SCHED_POLICY_GRADIENT, // every boundary, in proportion to the cost difference across it
+  MEMCACHED_SCHED_POLICY_MAX
+};
+
+#ifndef __cplusplus
+typedef enum memcached_sched_policy_t memcached_sched_policy_t;
+#endif
@@ -48,6 +48,9 @@ enum memcached_server_distribution_t {
   MEMCACHED_DISTRIBUTION_VIRTUAL_BUCKET,
   MEMCACHED_DISTRIBUTION_DYNAMIC, // jinho added
   MEMCACHED_DISTRIBUTION_DYNAMIC_WEIGHTED, // jinho added
+  MEMCACHED_DISTRIBUTION_CONSISTENT_BOUNDED, // jinho added: ketama, with a cap on each server's load
+  MEMCACHED_DISTRIBUTION_MAGLEV, // jinho added: a lookup table, weighted
+  MEMCACHED_DISTRIBUTION_JUMP, // jinho added: jump consistent hashing, weighted; append servers, no sort_hosts
   MEMCACHED_DISTRIBUTION_CONSISTENT_MAX
 };
 
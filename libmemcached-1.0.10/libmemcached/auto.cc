@@ -200,6 +200,9 @@ static memcached_return_t increment_decrement_by_key(const protocol_binary_comma
 
   auto_response(instance, reply, rc, value);
 
+  // jinho added
+  memcached_sched_after_write(memc, group_key, group_key_length, key, key_length, rc, NULL, 0, 0, 0, false);
+
   return rc;
 }
 
@@ -258,6 +261,9 @@ static memcached_return_t increment_decrement_with_initial_by_key(const protocol
 
   auto_response(instance, reply, rc, value);
 
+  // jinho added
+  memcached_sched_after_write(memc, group_key, group_key_length, key, key_length, rc, NULL, 0, 0, 0, false);
+
   return rc;
 }
 
@@ -55,6 +55,9 @@ bool memcached_is_consistent_distribution(const memcached_st* memc)
   // jinho added
   case MEMCACHED_DISTRIBUTION_DYNAMIC:
   case MEMCACHED_DISTRIBUTION_DYNAMIC_WEIGHTED:
+  case MEMCACHED_DISTRIBUTION_CONSISTENT_BOUNDED:
+  case MEMCACHED_DISTRIBUTION_MAGLEV:
+  case MEMCACHED_DISTRIBUTION_JUMP:
     return true;
 
   case MEMCACHED_DISTRIBUTION_MODULA:
@@ -86,6 +89,110 @@ memcached_return_t memcached_sched_set(memcached_st *ptr, double alpha, double b
   return MEMCACHED_SUCCESS;
 }
 
+memcached_return_t memcached_sched_set_policy(memcached_st *ptr, memcached_sched_policy_t policy)
+{
+  if (ptr == NULL or ptr->dynamic == NULL)
+  {
+    return MEMCACHED_INVALID_ARGUMENTS;
+  }
+
+  const struct sched_policy *sched_policy= sched_policy_get(policy);
+  if (sched_policy == NULL)
+  {
+    return MEMCACHED_INVALID_ARGUMENTS;
+  }
+
+  (void)pthread_mutex_lock(&ptr->dynamic->lock);
+  ptr->dynamic->policy= sched_policy;
+  (void)pthread_mutex_unlock(&ptr->dynamic->lock);
+
+  return MEMCACHED_SUCCESS;
+}
+
+memcached_sched_policy_t memcached_sched_get_policy(memcached_st *ptr)
+{
+  if (ptr == NULL or ptr->dynamic == NULL or ptr->dynamic->policy == NULL)
+  {
+    return MEMCACHED_SCHED_POLICY_PAIR;
+  }
+
+  return (memcached_sched_policy_t)(ptr->dynamic->policy - sched_policy_get(MEMCACHED_SCHED_POLICY_PAIR));
+}
+
+memcached_return_t memcached_sched_set_half_life(memcached_st *ptr, double half_life)
+{
+  if (ptr == NULL or ptr->dynamic == NULL or half_life < 0)
+  {
+    return MEMCACHED_INVALID_ARGUMENTS;
+  }
+
+  (void)pthread_mutex_lock(&ptr->dynamic->lock);
+  ptr->dynamic->half_life= half_life;
+  (void)pthread_mutex_unlock(&ptr->dynamic->lock);
+
+  return MEMCACHED_SUCCESS;
+}
+
+double memcached_sched_get_half_life(memcached_st *ptr)
+{
+  if (ptr == NULL or ptr->dynamic == NULL)
+  {
+    return 0;
+  }
+
+  return ptr->dynamic->half_life;
+}
+
+memcached_return_t memcached_sched_set_load(memcached_st *ptr, double ops, double bytes, double latency)
+{
+  if (ptr == NULL or ptr->dynamic == NULL)
+  {
+    return MEMCACHED_INVALID_ARGUMENTS;
+  }
+
+  if (ops < 0 or bytes < 0 or latency < 0 or ops + bytes + latency <= 0)
+  {
+    return MEMCACHED_INVALID_ARGUMENTS;
+  }
+
+  (void)pthread_mutex_lock(&ptr->dynamic->lock);
+  ptr->dynamic->load_ops= ops;
+  ptr->dynamic->load_bytes= bytes;
+  ptr->dynamic->load_latency= latency;
+  (void)pthread_mutex_unlock(&ptr->dynamic->lock);
+
+  return MEMCACHED_SUCCESS;
+}
+
+memcached_return_t memcached_sched_set_pressure(memcached_st *ptr, double weight)
+{
+  if (ptr == NULL or ptr->dynamic == NULL or weight < 0)
+  {
+    return MEMCACHED_INVALID_ARGUMENTS;
+  }
+
+  (void)pthread_mutex_lock(&ptr->dynamic->lock);
+  ptr->dynamic->gamma= weight;
+  (void)pthread_mutex_unlock(&ptr->dynamic->lock);
+
+  return MEMCACHED_SUCCESS;
+}
+
+memcached_return_t memcached_sched_set_feedback(memcached_st *ptr, uint32_t every)
+{
+  if (ptr == NULL or ptr->dynamic == NULL)
+  {
+    return MEMCACHED_INVALID_ARGUMENTS;
+  }
+
+  (void)pthread_mutex_lock(&ptr->dynamic->lock);
+  ptr->dynamic->feedback_every= every;
+  sched_feedback_renumber(ptr->dynamic, ptr);
+  (void)pthread_mutex_unlock(&ptr->dynamic->lock);
+
+  return MEMCACHED_SUCCESS;
+}
+
 /*
   This function is used to modify the behavior of running client.
 
@@ -576,10 +683,17 @@ memcached_return_t memcached_behavior_set_distribution(memcached_st *ptr, memcac
 
   // jinho added
   case MEMCACHED_DISTRIBUTION_DYNAMIC:
+    memcached_set_weighted_dynamic(ptr, false);
     break;
   case MEMCACHED_DISTRIBUTION_DYNAMIC_WEIGHTED:
     memcached_set_weighted_dynamic(ptr, true);
     break;
+  case MEMCACHED_DISTRIBUTION_CONSISTENT_BOUNDED:
+    memcached_set_weighted_ketama(ptr, false);
+    break;
+  case MEMCACHED_DISTRIBUTION_MAGLEV:
+  case MEMCACHED_DISTRIBUTION_JUMP:
+    break;
 
   case MEMCACHED_DISTRIBUTION_VIRTUAL_BUCKET:
     break;
@@ -693,6 +807,9 @@ const char *libmemcached_string_distribution(const memcached_server_distribution
   case MEMCACHED_DISTRIBUTION_VIRTUAL_BUCKET: return "MEMCACHED_DISTRIBUTION_VIRTUAL_BUCKET";
   case MEMCACHED_DISTRIBUTION_DYNAMIC: return "MEMCACHED_DISTRIBUTION_DYNAMIC"; // jinho added
   case MEMCACHED_DISTRIBUTION_DYNAMIC_WEIGHTED: return "MEMCACHED_DISTRIBUTION_DYNAMIC_WEIGHTED"; // jinho added
+  case MEMCACHED_DISTRIBUTION_CONSISTENT_BOUNDED: return "MEMCACHED_DISTRIBUTION_CONSISTENT_BOUNDED"; // jinho added
+  case MEMCACHED_DISTRIBUTION_MAGLEV: return "MEMCACHED_DISTRIBUTION_MAGLEV"; // jinho added
+  case MEMCACHED_DISTRIBUTION_JUMP: return "MEMCACHED_DISTRIBUTION_JUMP"; // jinho added
   default:
   case MEMCACHED_DISTRIBUTION_CONSISTENT_MAX: return "INVALID memcached_server_distribution_t";
   }
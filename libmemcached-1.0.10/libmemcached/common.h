@@ -99,6 +99,7 @@ typedef memcached_return_t (*memcached_server_execute_fn)(memcached_st *ptr, mem
 
 #ifdef __cplusplus
 org::libmemcached::Instance* memcached_instance_fetch(memcached_st *ptr, uint32_t server_key);
+uint32_t memcached_instance_position(const org::libmemcached::Instance* instance);
 #endif
 
 memcached_return_t memcached_server_execute(memcached_st *ptr,
@@ -189,5 +190,6 @@ org::libmemcached::Instance* memcached_instance_by_position(const memcached_st *
 #endif
 
 /* jinho added */
-#define get_hitrate(_g, _s) (1.0 - (double)(((double)_s)/((double)_g - (double)_s)))
+/* hits are counted from responses (memcached_sched_account()), gets when routed */
+#define get_hitrate(_g, _h) ((_h) < (_g) ? (double)(_h) / (double)(_g) : 1.0)
 #define scost(_h) (get_dynamic()->alpha * (1.0 - (_h)->nhitrate) + (1 - get_dynamic()->alpha) * (_h)->usagerate)
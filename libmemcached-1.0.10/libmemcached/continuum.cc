@@ -0,0 +1,247 @@
+/*
+ * continuum.cc
+ *
+ * Eytzinger ordered search over a continuum, used by dispatch_host() for
+ * ketama and the dynamic distribution. Rebuilt whenever the continuum it
+ * mirrors changes: update_continuum() for ketama, update_dynamic() for a
+ * new dynamic layout. A scheduler move only patches it.
+ */
+
+#include <libmemcached/common.h>
+
+static void continuum_jump_release(continuum_jump_block *block)
+{
+  if (block and __sync_sub_and_fetch(&block->refs, 1) == 0)
+  {
+    free(block); // posix_memalign()
+  }
+}
+
+// page p for writing: a page from another block is first copied into ours
+static uint32_t *continuum_jump_own(memcached_continuum_search_st *search, uint32_t p, bool keep)
+{
+  if (search->from[p] != search->own)
+  {
+    continuum_jump_page *page= search->own->page + p;
+    if (keep)
+    {
+      memcpy(page->first, search->jump[p]->first, sizeof(page->first));
+    }
+
+    (void)__sync_fetch_and_add(&search->own->refs, 1);
+    continuum_jump_release(search->from[p]);
+    search->jump[p]= page;
+    search->from[p]= search->own;
+  }
+
+  return search->jump[p]->first;
+}
+
+// bucket CONTINUUM_JUMP_BUCKETS is the last page's first[PAGE]
+static void continuum_jump_set(memcached_continuum_search_st *search, uint64_t bucket, uint32_t position)
+{
+  uint32_t p= (uint32_t)(bucket >> CONTINUUM_JUMP_PAGE_SHIFT);
+  uint32_t b= (uint32_t)(bucket & (CONTINUUM_JUMP_PAGE - 1));
+
+  if (p == CONTINUUM_JUMP_PAGES)
+  {
+    p--;
+    b= CONTINUUM_JUMP_PAGE;
+  }
+  else if (b == 0 and p > 0)
+  {
+    continuum_jump_own(search, p - 1, true)[CONTINUUM_JUMP_PAGE]= position;
+  }
+
+  continuum_jump_own(search, p, true)[b]= position;
+}
+
+memcached_continuum_search_st *continuum_search_create(uint32_t capacity)
+{
+  memcached_continuum_search_st *search= libmemcached_xcalloc(NULL, 1, memcached_continuum_search_st);
+  if (search == NULL)
+  {
+    return NULL;
+  }
+  search->capacity= capacity;
+
+  void *mem;
+  if (capacity >= MEMCACHED_CONTINUUM_JUMP_POINTS)
+  {
+    if (posix_memalign(&mem, SCHED_CACHELINE, sizeof(continuum_jump_block)))
+    {
+      libmemcached_free(NULL, search);
+      return NULL;
+    }
+    search->own= (continuum_jump_block *)mem;
+    search->own->refs= 1 + CONTINUUM_JUMP_PAGES;
+
+    for (uint32_t p= 0; p < CONTINUUM_JUMP_PAGES; p++)
+    {
+      search->jump[p]= search->own->page + p;
+      search->from[p]= search->own;
+    }
+
+    return search;
+  }
+
+  if (posix_memalign(&mem, SCHED_CACHELINE, sizeof(uint32_t) * (capacity + 1)))
+  {
+    libmemcached_free(NULL, search);
+    return NULL;
+  }
+  search->tree= (uint32_t *)mem;
+
+  search->point= libmemcached_xcalloc(NULL, capacity + 1, uint32_t);
+  search->slot= libmemcached_xcalloc(NULL, capacity + 1, uint32_t);
+  if (search->point == NULL or search->slot == NULL)
+  {
+    continuum_search_free(search);
+    return NULL;
+  }
+
+  return search;
+}
+
+void continuum_search_free(memcached_continuum_search_st *search)
+{
+  if (search)
+  {
+    for (uint32_t p= 0; p < CONTINUUM_JUMP_PAGES; p++)
+    {
+      continuum_jump_release(search->from[p]);
+    }
+    continuum_jump_release(search->own);
+    free(search->tree); // posix_memalign()
+    libmemcached_free(NULL, search->point);
+    libmemcached_free(NULL, search->slot);
+    libmemcached_free(NULL, search);
+  }
+}
+
+// in-order walk of the implicit tree hands out the sorted points in order
+static uint32_t continuum_search_fill(memcached_continuum_search_st *search,
+                                      uint32_t position, uint32_t k)
+{
+  if (k <= search->size)
+  {
+    position= continuum_search_fill(search, position, 2 * k);
+    search->tree[k]= search->values[position * search->stride];
+    search->point[k]= position;
+    search->slot[position]= k;
+    position= continuum_search_fill(search, position + 1, 2 * k + 1);
+  }
+
+  return position;
+}
+
+static uint32_t continuum_search_lower_bound(const memcached_continuum_search_st *search, uint64_t hash)
+{
+  uint32_t left= 0;
+  uint32_t right= search->size;
+
+  while (left < right)
+  {
+    uint32_t middle= left + (right - left) / 2;
+    if (search->values[middle * search->stride] < hash)
+      left= middle + 1;
+    else
+      right= middle;
+  }
+
+  return left;
+}
+
+void continuum_search_build(memcached_continuum_search_st *search,
+                            const uint32_t *values, size_t stride, uint32_t size)
+{
+  WATCHPOINT_ASSERT(size <= search->capacity);
+
+  search->size= size;
+  search->values= values;
+  search->stride= stride;
+
+  if (search->jump[0])
+  {
+    uint32_t position= 0;
+    for (uint32_t p= 0; p < CONTINUUM_JUMP_PAGES; p++)
+    {
+      uint32_t *first= continuum_jump_own(search, p, false);
+      for (uint32_t b= 0; b <= CONTINUUM_JUMP_PAGE; b++)
+      {
+        uint64_t start= ((uint64_t)p * CONTINUUM_JUMP_PAGE + b) << CONTINUUM_JUMP_SHIFT;
+        while (position < size and values[position * stride] < start)
+        {
+          position++;
+        }
+        first[b]= position;
+      }
+    }
+
+    return;
+  }
+
+  search->point[0]= 0;
+  (void)continuum_search_fill(search, 0, 1);
+}
+
+void continuum_search_copy(memcached_continuum_search_st *dst,
+                           const memcached_continuum_search_st *src,
+                           const uint32_t *values)
+{
+  WATCHPOINT_ASSERT(dst->capacity == src->capacity);
+
+  dst->size= src->size;
+  dst->values= values;
+  dst->stride= src->stride;
+
+  if (src->jump[0])
+  {
+    for (uint32_t p= 0; p < CONTINUUM_JUMP_PAGES; p++)
+    {
+      (void)__sync_fetch_and_add(&src->from[p]->refs, 1);
+      continuum_jump_release(dst->from[p]);
+      dst->jump[p]= src->jump[p];
+      dst->from[p]= src->from[p];
+    }
+  }
+  else
+  {
+    memcpy(dst->tree, src->tree, sizeof(uint32_t) * (src->size + 1));
+    memcpy(dst->point, src->point, sizeof(uint32_t) * (src->size + 1));
+    memcpy(dst->slot, src->slot, sizeof(uint32_t) * (src->size + 1));
+  }
+}
+
+void continuum_search_move(memcached_continuum_search_st *search,
+                           uint32_t position, uint32_t old_value)
+{
+  if (position >= search->size)
+  {
+    return; // not searched
+  }
+
+  uint32_t new_value= search->values[position * search->stride];
+
+  if ((position > 0 and search->values[(position - 1) * search->stride] > new_value) or
+      (position + 1 < search->size and search->values[(position + 1) * search->stride] < new_value))
+  {
+    continuum_search_build(search, search->values, search->stride, search->size);
+    return;
+  }
+
+  if (search->jump[0] == NULL)
+  {
+    search->tree[search->slot[position]]= new_value;
+    return;
+  }
+
+  // only buckets starting in (low, high] can see the point on the other side now
+  uint32_t low= old_value < new_value ? old_value : new_value;
+  uint32_t high= old_value < new_value ? new_value : old_value;
+
+  for (uint64_t bucket= ((uint64_t)low >> CONTINUUM_JUMP_SHIFT) + 1; bucket <= (high >> CONTINUUM_JUMP_SHIFT); bucket++)
+  {
+    continuum_jump_set(search, bucket, continuum_search_lower_bound(search, bucket << CONTINUUM_JUMP_SHIFT));
+  }
+}
@@ -41,12 +41,30 @@
 struct sched_context {
   uint32_t get;
   uint32_t set;
+  uint32_t hit; /* gets answered with a value */
   uint32_t psum; // keep previous sum 
   uint32_t sum;
   double nhitrate;  /* normalized hit rate */
   double hitrate;  /* hit rate */
   double usagerate; /* usage rate */
   uint32_t hashsize; /* hash size */
+  uint32_t bytes; /* key and value bytes stored or fetched */
+  uint32_t usec; /* time spent waiting for replies */
+  double byterate; /* bytes, relative to the busiest */
+  double latencyrate; /* usec, relative to the slowest */
+  double rget; /* decayed get/set/hit/bytes/usec, see sched_stats_decay() */
+  double rset;
+  double rhit;
+  double rbytes;
+  double rusec;
+  /* servers only: what the server last reported, see sched_servers_feedback() */
+  uint32_t feedback; /* reports seen */
+  uint64_t evictions;
+  uint64_t evicted_unfetched;
+  double fill; /* bytes / limit_maxbytes */
+  double pressure; /* evictions since the previous report, per item held, at least SCHED_FILL_PRESSURE when full */
+  double pressurerate; /* pressure, relative to the worst; copied to the points */
+  double capacity; /* weight relative to the mean, 1 unless DYNAMIC_WEIGHTED */
 };
 
 /* string value */
@@ -54,6 +72,123 @@ struct memcached_continuum_item_st
 {
   uint32_t index;
   uint32_t value;
+};
+
+/*
+ * Lookup copy of a sorted continuum in Eytzinger (breadth first) order:
+ * the children of tree[k] are tree[2k] and tree[2k+1], so the first
+ * levels of every search share a few cache lines and the descent needs
+ * no data dependent branch.
+ *
+ * From MEMCACHED_CONTINUUM_JUMP_POINTS points up there is also a jump
+ * table over the top 16 bits of the hash: every key in bucket b resolves
+ * to a sorted position in [first[b], first[b + 1]], so a bucket without a
+ * boundary in it needs no search at all and the others only a step or two
+ * over the original values.
+ *
+ * The table is cut into pages that a copy shares with its source, so a
+ * ring clone costs no 256KB memcpy. Every search still allocates a block
+ * with room for all its pages, but only the pages it writes are touched:
+ * the first move into a shared page copies that page alone into the
+ * block, so moves never allocate. A block is freed once no search points
+ * into it.
+ */
+#define CONTINUUM_JUMP_SHIFT 16
+#define CONTINUUM_JUMP_BUCKETS (1U << (32 - CONTINUUM_JUMP_SHIFT))
+#define CONTINUUM_JUMP_PAGE_SHIFT 10
+#define CONTINUUM_JUMP_PAGE (1U << CONTINUUM_JUMP_PAGE_SHIFT)
+#define CONTINUUM_JUMP_PAGES (CONTINUUM_JUMP_BUCKETS / CONTINUUM_JUMP_PAGE)
+
+struct continuum_jump_page
+{
+  uint32_t first[CONTINUUM_JUMP_PAGE + 1]; /* first[PAGE] repeats the next page's first[0], the last page's is size */
+};
 
-  struct sched_context sched;
+struct continuum_jump_block
+{
+  uint32_t refs;     /* pages pointed to, plus one for the search it belongs to; changed atomically */
+  struct continuum_jump_page page[CONTINUUM_JUMP_PAGES];
 };
+
+struct memcached_continuum_search_st
+{
+  uint32_t size;     /* points searched */
+  uint32_t capacity;
+  uint32_t *tree;    /* tree[1 .. size], cache line aligned */
+  uint32_t *point;   /* point[k]: sorted position of tree[k]; point[0] = 0 */
+  uint32_t *slot;    /* slot[x]: where sorted position x sits in tree[] */
+
+  /* jump table, all NULL below MEMCACHED_CONTINUUM_JUMP_POINTS */
+  struct continuum_jump_page *jump[CONTINUUM_JUMP_PAGES]; /* bucket b is jump[b / PAGE]->first[b % PAGE] */
+  struct continuum_jump_block *from[CONTINUUM_JUMP_PAGES]; /* the block jump[p] lies in */
+  struct continuum_jump_block *own;
+  const uint32_t *values; /* the sorted continuum itself, values[x * stride] */
+  size_t stride;
+};
+
+struct memcached_continuum_search_st *continuum_search_create(uint32_t capacity);
+void continuum_search_free(struct memcached_continuum_search_st *search);
+
+/*
+ * values[x * stride] for x < size must be sorted and stay in place until
+ * the next build; size must not exceed the capacity of the search.
+ */
+void continuum_search_build(struct memcached_continuum_search_st *search,
+                            const uint32_t *values, size_t stride, uint32_t size);
+
+/*
+ * dst must have src's capacity; values is the copy of src's continuum.
+ * Jump pages are shared with src rather than copied, so src must not be
+ * built or moved again, as a published ring is not.
+ */
+void continuum_search_copy(struct memcached_continuum_search_st *dst,
+                           const struct memcached_continuum_search_st *src,
+                           const uint32_t *values);
+
+/*
+ * values[position * stride] was changed from old_value; patches the tree
+ * slot and only the jump buckets in between, or rebuilds if the point
+ * passed a neighbour.
+ */
+void continuum_search_move(struct memcached_continuum_search_st *search,
+                           uint32_t position, uint32_t old_value);
+
+/*
+ * Sorted position of the first point >= hash, or 0 when hash is past the
+ * last one (the continuum wraps).
+ */
+static inline uint32_t continuum_search_find(const struct memcached_continuum_search_st *search, uint32_t hash)
+{
+  if (search->jump[0])
+  {
+    const uint32_t *values= search->values;
+    const uint32_t *first= search->jump[hash >> (CONTINUUM_JUMP_SHIFT + CONTINUUM_JUMP_PAGE_SHIFT)]->first;
+    uint32_t bucket= (hash >> CONTINUUM_JUMP_SHIFT) & (CONTINUUM_JUMP_PAGE - 1);
+    uint32_t left= first[bucket];
+    uint32_t right= first[bucket + 1];
+
+    while (left < right)
+    {
+      uint32_t middle= left + (right - left) / 2;
+      if (values[middle * search->stride] < hash)
+        left= middle + 1;
+      else
+        right= middle;
+    }
+
+    return (left == search->size) ? 0 : left;
+  }
+
+  const uint32_t *tree= search->tree;
+  uint32_t size= search->size;
+  uint32_t k= 1;
+
+  while (k <= size)
+  {
+    __builtin_prefetch(tree + k * 16); // four levels down: 16 children per 64 byte line
+    k= 2 * k + (tree[k] < hash);
+  }
+  k>>= __builtin_ffs(~k);
+
+  return search->point[k];
+}
@@ -213,6 +213,40 @@ memcached_return_t memcached_delete_by_key(memcached_st *memc,
     }
   }
 
+  // jinho added
+  memcached_sched_after_write(memc, group_key, group_key_length, key, key_length, rc, NULL, 0, 0, 0, false);
+
   LIBMEMCACHED_MEMCACHED_DELETE_END();
   return rc;
 }
+
+memcached_return_t memcached_instance_delete(org::libmemcached::Instance* instance,
+                                             const char *key, size_t key_length)
+{
+  if (memcached_sched_instance_busy(instance))
+  {
+    return MEMCACHED_IN_PROGRESS;
+  }
+
+  memcached_return_t rc;
+  if (memcached_is_binary(instance->root))
+  {
+    rc= binary_delete(instance, 0, key, key_length, true, false);
+  }
+  else
+  {
+    rc= ascii_delete(instance, 0, key, key_length, true, false);
+  }
+
+  if (rc == MEMCACHED_SUCCESS)
+  {
+    char buffer[MEMCACHED_DEFAULT_COMMAND_SIZE];
+    rc= memcached_response(instance, buffer, MEMCACHED_DEFAULT_COMMAND_SIZE, NULL);
+    if (rc == MEMCACHED_DELETED)
+    {
+      rc= MEMCACHED_SUCCESS;
+    }
+  }
+
+  return rc;
+}
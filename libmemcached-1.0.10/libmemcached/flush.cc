@@ -168,5 +168,8 @@ memcached_return_t memcached_flush(memcached_st *ptr, time_t expiration)
   }
   LIBMEMCACHED_MEMCACHED_FLUSH_END();
 
+  // jinho added: nothing cached from before the flush may answer after it
+  memcached_sched_near_clear(ptr);
+
   return rc;
 }
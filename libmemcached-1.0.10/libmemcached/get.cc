@@ -58,6 +58,14 @@ static memcached_return_t memcached_mget_by_key_real(memcached_st *ptr,
                                                      size_t number_of_keys,
                                                      bool mget_mode);
 
+/* jinho added: a get of ptr may be answered by the near cache or the copies of a hot key */
+static inline bool memcached_sched_reads(const memcached_st *ptr)
+{
+  return (ptr->distribution == MEMCACHED_DISTRIBUTION_DYNAMIC or
+          ptr->distribution == MEMCACHED_DISTRIBUTION_DYNAMIC_WEIGHTED) and
+         (ptr->dynamic->near or ptr->dynamic->replication);
+}
+
 char *memcached_get_by_key(memcached_st *ptr,
                            const char *group_key,
                            size_t group_key_length,
@@ -72,12 +80,46 @@ char *memcached_get_by_key(memcached_st *ptr,
     error= &unused;
   }
 
+  size_t unused_length;
+  uint32_t unused_flags;
+  if (value_length == NULL)
+  {
+    value_length= &unused_length;
+  }
+  if (flags == NULL)
+  {
+    flags= &unused_flags;
+  }
+
   uint64_t query_id= 0;
   if (ptr)
   {
     query_id= ptr->query_id;
   }
 
+  // jinho added: a key may be in the near cache, or, if hot, read from one of its copies
+  uint32_t missed= UINT32_MAX;
+  bool near= false;
+  uint64_t generation= 0;
+  if (ptr and group_key_length == 0 and memcached_sched_reads(ptr) and
+      memcached_success(initialize_query(ptr, false)) and
+      memcached_success(memcached_key_test(*ptr, (const char **)&key, &key_length, 1)))
+  {
+    near= true;
+    char *value= memcached_sched_near_get(ptr, key, key_length, value_length, flags, &generation);
+    if (value == NULL and (value= memcached_sched_spread(ptr, key, key_length, value_length, flags, error, &missed)))
+    {
+      memcached_sched_near_store(ptr, key, key_length, value, *value_length, *flags, generation);
+    }
+
+    if (value)
+    {
+      *error= MEMCACHED_SUCCESS;
+      ptr->query_id++; // one get all the same
+      return value;
+    }
+  }
+
   /* Request the key */
   *error= memcached_mget_by_key_real(ptr, group_key, group_key_length,
                                      (const char * const *)&key, &key_length, 
@@ -115,6 +157,21 @@ char *memcached_get_by_key(memcached_st *ptr,
     *error= MEMCACHED_NOTFOUND;
   }
 
+  // jinho added: right after the ring changed the key may still sit on its old owner
+  if (value == NULL and *error == MEMCACHED_NOTFOUND and group_key_length == 0)
+  {
+    value= memcached_sched_handoff(ptr, key, key_length, value_length, flags, error);
+  }
+
+  if (value and missed != UINT32_MAX)
+  {
+    memcached_sched_fill(ptr, missed, key, key_length, value, *value_length, *flags);
+  }
+  if (value and near)
+  {
+    memcached_sched_near_store(ptr, key, key_length, value, *value_length, *flags, generation);
+  }
+
   if (value == NULL)
   {
     if (ptr->get_key_failure and *error == MEMCACHED_NOTFOUND)
@@ -193,6 +250,61 @@ static memcached_return_t binary_mget_by_key(memcached_st *ptr,
                                              size_t number_of_keys,
                                              bool mget_mode);
 
+/*
+  Routes the keys of a get: the server of key x goes to (*server_keys)[x],
+  the point it was routed to, for memcached_sched_sent(), to
+  (*server_keys)[number_of_keys + x]. Up to MGET_STACK_KEYS keys are routed
+  into stack_keys, only larger gets allocate; a single key takes the
+  per-key path. Release *server_keys with mget_server_keys_free().
+*/
+#define MGET_STACK_KEYS 64
+
+static memcached_return_t mget_server_keys(memcached_st *ptr,
+                                           const char * const *keys,
+                                           const size_t *key_length,
+                                           size_t number_of_keys,
+                                           uint32_t *stack_keys,
+                                           uint32_t **server_keys)
+{
+  *server_keys= stack_keys;
+
+  if (number_of_keys == 1)
+  {
+    stack_keys[0]= memcached_generate_hash_with_redistribution(ptr, keys[0], key_length[0], MEMCACHED_CMD_GET);
+    stack_keys[1]= memcached_sched_routed(ptr);
+    return MEMCACHED_SUCCESS;
+  }
+
+  if (number_of_keys > MGET_STACK_KEYS)
+  {
+    if ((*server_keys= libmemcached_xvalloc(ptr, number_of_keys * 2, uint32_t)) == NULL)
+    {
+      return MEMCACHED_MEMORY_ALLOCATION_FAILURE;
+    }
+  }
+
+  memcached_return_t rc= memcached_generate_hash_routes(ptr, keys, key_length, number_of_keys,
+                                                        *server_keys, *server_keys + number_of_keys, MEMCACHED_CMD_GET);
+  if (memcached_failed(rc))
+  {
+    if (*server_keys != stack_keys)
+    {
+      libmemcached_free(ptr, *server_keys);
+    }
+    *server_keys= NULL;
+  }
+
+  return rc;
+}
+
+static inline void mget_server_keys_free(memcached_st *ptr, uint32_t *stack_keys, uint32_t *server_keys)
+{
+  if (server_keys != stack_keys)
+  {
+    libmemcached_free(ptr, server_keys);
+  }
+}
+
 static memcached_return_t memcached_mget_by_key_real(memcached_st *ptr,
                                                      const char *group_key,
                                                      size_t group_key_length,
@@ -279,6 +391,17 @@ static memcached_return_t memcached_mget_by_key_real(memcached_st *ptr,
     to the server.
   */
   WATCHPOINT_ASSERT(rc == MEMCACHED_SUCCESS);
+  uint32_t stack_keys[MGET_STACK_KEYS * 2];
+  uint32_t *server_keys= NULL;
+  uint32_t point= memcached_sched_routed(ptr); // the group key's, if set
+  if (is_group_key_set == false)
+  {
+    if (memcached_failed(rc= mget_server_keys(ptr, keys, key_length, number_of_keys, stack_keys, &server_keys)))
+    {
+      return memcached_set_error(*ptr, rc, MEMCACHED_AT);
+    }
+  }
+
   size_t hosts_connected= 0;
   for (uint32_t x= 0; x < number_of_keys; x++)
   {
@@ -290,7 +413,8 @@ static memcached_return_t memcached_mget_by_key_real(memcached_st *ptr,
     }
     else
     {
-      server_key= memcached_generate_hash_with_redistribution(ptr, keys[x], key_length[x], MEMCACHED_CMD_GET);
+      server_key= server_keys[x];
+      point= server_keys[number_of_keys + x];
     }
 
     org::libmemcached::Instance* instance= memcached_instance_fetch(ptr, server_key);
@@ -315,6 +439,7 @@ static memcached_return_t memcached_mget_by_key_real(memcached_st *ptr,
       }
       hosts_connected++;
 
+      memcached_sched_sent(instance, point);
       if ((memcached_io_writev(instance, vector, 4, false)) == false)
       {
         failures_occured_in_sending= true;
@@ -326,6 +451,7 @@ static memcached_return_t memcached_mget_by_key_real(memcached_st *ptr,
     }
     else
     {
+      memcached_sched_sent(instance, point);
       if ((memcached_io_writev(instance, (vector + 1), 3, false)) == false)
       {
         memcached_instance_response_reset(instance);
@@ -334,6 +460,7 @@ static memcached_return_t memcached_mget_by_key_real(memcached_st *ptr,
       }
     }
   }
+  mget_server_keys_free(ptr, stack_keys, server_keys);
 
   if (hosts_connected == 0)
   {
@@ -461,6 +588,18 @@ static memcached_return_t simple_binary_mget(memcached_st *ptr,
 
   bool flush= (number_of_keys == 1);
 
+  uint32_t stack_keys[MGET_STACK_KEYS * 2];
+  uint32_t *server_keys= NULL;
+  uint32_t point= memcached_sched_routed(ptr); // the group key's, if set
+  if (is_group_key_set == false)
+  {
+    memcached_return_t route_rc= mget_server_keys(ptr, keys, key_length, number_of_keys, stack_keys, &server_keys);
+    if (memcached_failed(route_rc))
+    {
+      return route_rc;
+    }
+  }
+
   /*
     If a server fails we warn about errors and start all over with sending keys
     to the server.
@@ -475,7 +614,8 @@ static memcached_return_t simple_binary_mget(memcached_st *ptr,
     }
     else
     {
-      server_key= memcached_generate_hash_with_redistribution(ptr, keys[x], key_length[x], MEMCACHED_CMD_GET);
+      server_key= server_keys[x];
+      point= server_keys[number_of_keys + x];
     }
 
     org::libmemcached::Instance* instance= memcached_instance_fetch(ptr, server_key);
@@ -509,6 +649,7 @@ static memcached_return_t simple_binary_mget(memcached_st *ptr,
       {
         memcached_io_reset(instance);
       }
+      mget_server_keys_free(ptr, stack_keys, server_keys);
 
       return vk;
     }
@@ -524,6 +665,7 @@ static memcached_return_t simple_binary_mget(memcached_st *ptr,
       { keys[x], key_length[x] }
     };
 
+    memcached_sched_sent(instance, point);
     if (memcached_io_writev(instance, vector, 3, flush) == false)
     {
       memcached_server_response_reset(instance);
@@ -539,6 +681,7 @@ static memcached_return_t simple_binary_mget(memcached_st *ptr,
       rc= MEMCACHED_SOME_ERRORS;
     }
   }
+  mget_server_keys_free(ptr, stack_keys, server_keys);
 
   if (mget_mode)
   {
@@ -661,6 +804,7 @@ static memcached_return_t replication_binary_mget(memcached_st *ptr,
         { keys[x], key_length[x] }
       };
 
+      memcached_sched_sent(instance, SCHED_ROUTE_KEY);
       if (memcached_io_writev(instance, vector, 3, true) == false)
       {
         memcached_io_reset(instance);
@@ -715,9 +859,12 @@ static memcached_return_t binary_mget_by_key(memcached_st *ptr,
   }
   else
   {
-    for (size_t x= 0; x < number_of_keys; x++)
+    memcached_return_t rc= memcached_generate_hash_batch(ptr, keys, key_length, number_of_keys, hash, MEMCACHED_CMD_GET);
+    if (memcached_failed(rc))
     {
-      hash[x]= memcached_generate_hash_with_redistribution(ptr, keys[x], key_length[x], MEMCACHED_CMD_GET);
+      libmemcached_free(ptr, hash);
+      libmemcached_free(ptr, dead_servers);
+      return rc;
     }
   }
 
@@ -730,3 +877,86 @@ static memcached_return_t binary_mget_by_key(memcached_st *ptr,
 
   return MEMCACHED_SUCCESS;
 }
+
+memcached_return_t memcached_instance_get(org::libmemcached::Instance* instance,
+                                          const char *key, size_t key_length,
+                                          memcached_result_st *result)
+{
+  memcached_st *ptr= instance->root;
+  memcached_return_t rc;
+
+  if (memcached_is_udp(ptr) or memcached_is_replying(ptr) == false)
+  {
+    return memcached_set_error(*ptr, MEMCACHED_NOT_SUPPORTED, MEMCACHED_AT);
+  }
+
+  if (memcached_failed(rc= memcached_validate_key_length(key_length, memcached_is_binary(ptr))))
+  {
+    return rc;
+  }
+
+  if (memcached_sched_instance_busy(instance))
+  {
+    return MEMCACHED_IN_PROGRESS;
+  }
+
+  // not routed by key, the servers asked this way are not the key's owner
+  memcached_sched_sent(instance, SCHED_ROUTE_NONE);
+
+  if (memcached_is_binary(ptr))
+  {
+    protocol_binary_request_getk request= {};
+    initialize_binary_request(instance, request.message.header);
+    request.message.header.request.opcode= PROTOCOL_BINARY_CMD_GETK;
+    request.message.header.request.keylen= htons((uint16_t)(key_length + memcached_array_size(ptr->_namespace)));
+    request.message.header.request.datatype= PROTOCOL_BINARY_RAW_BYTES;
+    request.message.header.request.bodylen= htonl((uint32_t)(key_length + memcached_array_size(ptr->_namespace)));
+
+    libmemcached_io_vector_st vector[]=
+    {
+      { request.bytes, sizeof(request.bytes) },
+      { memcached_array_string(ptr->_namespace), memcached_array_size(ptr->_namespace) },
+      { key, key_length }
+    };
+
+    if (memcached_failed(rc= memcached_vdo(instance, vector, 3, true)))
+    {
+      return rc;
+    }
+
+    // SUCCESS or NOTFOUND, one answer either way
+    return memcached_read_one_response(instance, result);
+  }
+
+  libmemcached_io_vector_st vector[]=
+  {
+    { memcached_literal_param("get ") },
+    { memcached_array_string(ptr->_namespace), memcached_array_size(ptr->_namespace) },
+    { key, key_length },
+    { memcached_literal_param("\r\n") }
+  };
+
+  if (memcached_failed(rc= memcached_vdo(instance, vector, 4, true)))
+  {
+    return rc;
+  }
+
+  // VALUE ... and END, or END alone
+  rc= memcached_read_one_response(instance, result);
+  if (rc == MEMCACHED_END)
+  {
+    return MEMCACHED_NOTFOUND;
+  }
+
+  if (memcached_success(rc))
+  {
+    char buffer[SMALL_STRING_LEN];
+    memcached_return_t end= memcached_response(instance, buffer, sizeof(buffer), result);
+    if (end != MEMCACHED_END)
+    {
+      memcached_io_reset(instance);
+    }
+  }
+
+  return rc;
+}
@@ -62,126 +62,58 @@ static uint32_t dispatch_host(memcached_st *ptr, uint32_t hash, uint32_t cmd)
   case MEMCACHED_DISTRIBUTION_CONSISTENT_KETAMA_SPY:
     {
       //uint32_t num= ptr->ketama.continuum_points_counter; // bug???
-      uint32_t num= ptr->ketama.continuum_points_counter - 1;
-      WATCHPOINT_ASSERT(ptr->ketama.continuum);
+      // the search covers continuum[0 .. continuum_points_counter - 2]
+      WATCHPOINT_ASSERT(ptr->ketama.search);
 
-      memcached_continuum_item_st *begin, *end, *left, *right, *middle;
-      begin= left= ptr->ketama.continuum;
-      end= right= ptr->ketama.continuum + num;
+      memcached_continuum_item_st *right;
+      right= ptr->ketama.continuum + continuum_search_find(ptr->ketama.search, hash);
 
-      while (left < right)
-      {
-        middle= left + (right - left) / 2;
-        if (middle->value < hash)
-          left= middle + 1;
-        else
-          right= middle;
-      }
-      if (right == end)
-        right= begin;
-
-      // jinho added for stat per server
-      struct ketama_stat *ketama_stat = ptr->ketama_stat;
-      if ( ketama_stat != NULL ) {
-        struct sched_context *server = ptr->ketama_stat->servers + right->index;
-        uint32_t server_num = ptr->ketama_stat->continuum_count;
-        if ( cmd == MEMCACHED_CMD_GET ) {
-          server->get++;
-        } else if ( cmd == MEMCACHED_CMD_SET ) {
-          server->set++;
-        }
-
-        /* moved to hosts.cc
-        server->sum = server->get + server->set;
-        if ( server->get != 0 && server->set <= server->get )
-          server->hitrate = (double)((double)server->set/(double)server->get);
-
-        if ( server->sum > ketama_stat->max ) {
-          uint32_t max = server->sum;
-
-          if ( max > 0 ) {
-            ketama_stat->max = max;
-            ketama_stat->maxid = right->index;
-            for(uint32_t i = 0; i < server_num; i++) {
-              ketama_stat->servers[i].usagerate = (double)((double)ketama_stat->servers[i].sum/(double)max);
-            }
-          }
-        }
-        */
+      // jinho added for stat per server: counted in this handle's own shard,
+      // merged by mem_hs_sched_ketama(), which derives sum, hitrate and usagerate
+      if ( ptr->ketama_stat != NULL ) {
+        sched_reader_count_server(ptr->sched_reader, right->index, memcached_server_count(ptr), cmd);
       }
+      ptr->sched_reader->route = (uint32_t)(right - ptr->ketama.continuum);
 
       return right->index;
     }
   case MEMCACHED_DISTRIBUTION_DYNAMIC: // jinho added..
   case MEMCACHED_DISTRIBUTION_DYNAMIC_WEIGHTED: // jinho added..
     {
-#define trace() printf("%s (%d)\n", __FILE__, __LINE__);
-      // find a continuum
-      uint32_t num = ptr->dynamic->continuum_points_counter - 1; // bug???
-      WATCHPOINT_ASSERT(ptr->dynamic->continuum);
+      // find a continuum; the ring we get stays valid until sched_reader_exit()
+      struct sched_ring *ring = sched_reader_enter(ptr->dynamic, ptr->sched_reader);
+      if ( ring == NULL ) {
+        sched_reader_exit(ptr->sched_reader);
+        ptr->sched_reader->route = SCHED_ROUTE_NONE;
+        return 0;
+      }
 
-//printf("dynamic... cmd = %u \n", cmd);
+      // bug??? - like ketama, the last point is never searched (see sched_ring_index())
+      WATCHPOINT_ASSERT(ring->search);
 
-      memcached_continuum_item_st *begin, *end, *left, *right, *middle;
-      begin = left = ptr->dynamic->continuum;
-      end = right = ptr->dynamic->continuum + num;
-
-      while (left < right)
-      {
-        middle = left + (right - left) / 2;
-        if (middle->value < hash)
-          left = middle + 1;
-        else
-          right = middle;
-      }
-      if (right == end)
-        right = begin;
+      uint32_t right = continuum_search_find(ring->search, hash);
 
       /* 
-       * update scheduling information
+       * update scheduling information: counted in this handle's own shard,
+       * merged by mem_hs_sched_dynamic()
        */
-      if ( cmd == MEMCACHED_CMD_GET ) {
-        right->sched.get++;
-      } else if ( cmd == MEMCACHED_CMD_SET ) {
-        right->sched.set++;
-      }
-
-      right->sched.sum = right->sched.get + right->sched.set;
-
-      if ( (right->sched.get != 0) && ((int32_t)right->sched.set <= (int32_t)(right->sched.get - right->sched.set)) ) {
-        right->sched.hitrate = get_hitrate(right->sched.get, right->sched.set);
-        right->sched.nhitrate = right->sched.hitrate;
-      }
-
-      // max changes
-      if ( right->sched.sum > ptr->dynamic->max ) {
-        uint32_t max = right->sched.sum;
+      sched_reader_count(ptr->sched_reader, ring, right, cmd);
 
-        if ( max > 0 ) {
-          ptr->dynamic->max = max;
-          ptr->dynamic->maxid = right->index;
-          for(uint32_t i = 0; i < num; i++) {
-            ptr->dynamic->continuum[i].sched.usagerate = (double)((double)ptr->dynamic->continuum[i].sched.sum/(double)max);
-          }
-        }
-      }
+      // the reply is attributed to the same point, see memcached_sched_sent()
+      ptr->sched_reader->route = right;
+      ptr->sched_reader->route_layout = ring->layout;
 
-      /* update scheduling information */
+      uint32_t server_key = ring->indices[right];
+      sched_reader_exit(ptr->sched_reader);
 
-      // DEBUG
-      /*
-      printf("cmd(%u), dynamic(%p), num(%u), right(%p), set(%u), get(%u), hit(%f), usage(%f) \n", 
-            cmd, ptr->dynamic, num, right, right->sched.set, right->sched.get, right->sched.hitrate, right->sched.usagerate);
-      */
-
-      // XXX for safety.. I should enable this if the error occurs again..
-      /*
-      if ( right->index > ptr->dynamic->continuum_count ) 
-        return 0;
-      */
-
-      return right->index;
+      return server_key;
     }
+  case MEMCACHED_DISTRIBUTION_CONSISTENT_BOUNDED: // jinho added
+    return sched_bounded_route(ptr, hash, continuum_search_find(ptr->ketama.search, hash));
+  case MEMCACHED_DISTRIBUTION_MAGLEV: // jinho added
+    return sched_maglev_route(ptr, hash);
+  case MEMCACHED_DISTRIBUTION_JUMP: // jinho added
+    return sched_jump_route(ptr, hash);
   case MEMCACHED_DISTRIBUTION_MODULA:
     return hash % memcached_server_count(ptr);
   case MEMCACHED_DISTRIBUTION_RANDOM:
@@ -198,16 +130,9 @@ static uint32_t dispatch_host(memcached_st *ptr, uint32_t hash, uint32_t cmd)
   /* NOTREACHED */
 }
 
-/*
-  One version is public and will not modify the distribution hash, the other will.
-*/
-static inline uint32_t _generate_hash_wrapper(memcached_st *ptr, const char *key, size_t key_length)
+/* jinho added: the hash of key, namespace included, whatever the number of servers */
+static inline uint32_t _generate_key_hash(memcached_st *ptr, const char *key, size_t key_length)
 {
-  WATCHPOINT_ASSERT(memcached_server_count(ptr));
-
-  if (memcached_server_count(ptr) == 1)
-    return 0;
-
   if (ptr->flags.hash_with_namespace)
   {
     size_t temp_length= memcached_array_size(ptr->_namespace) + key_length;
@@ -227,14 +152,35 @@ static inline uint32_t _generate_hash_wrapper(memcached_st *ptr, const char *key
   }
 }
 
+/*
+  One version is public and will not modify the distribution hash, the other will.
+*/
+static inline uint32_t _generate_hash_wrapper(memcached_st *ptr, const char *key, size_t key_length)
+{
+  WATCHPOINT_ASSERT(memcached_server_count(ptr));
+
+  if (memcached_server_count(ptr) == 1)
+    return 0;
+
+  return _generate_key_hash(ptr, key, key_length);
+}
+
 static inline void _regen_for_auto_eject(memcached_st *ptr)
 {
-  if (_is_auto_eject_host(ptr) && ptr->ketama.next_distribution_rebuild)
+  // the dynamic ring keeps its own rebuild time, when a detoured server is due back
+  time_t next_distribution_rebuild= ptr->ketama.next_distribution_rebuild;
+  if (ptr->distribution == MEMCACHED_DISTRIBUTION_DYNAMIC or
+      ptr->distribution == MEMCACHED_DISTRIBUTION_DYNAMIC_WEIGHTED)
+  {
+    next_distribution_rebuild= ptr->dynamic->next_distribution_rebuild;
+  }
+
+  if (_is_auto_eject_host(ptr) && next_distribution_rebuild)
   {
     struct timeval now;
 
     if (gettimeofday(&now, NULL) == 0 and
-        now.tv_sec > ptr->ketama.next_distribution_rebuild)
+        now.tv_sec > next_distribution_rebuild)
     {
       run_distribution(ptr);
     }
@@ -246,12 +192,149 @@ void memcached_autoeject(memcached_st *ptr)
   _regen_for_auto_eject(ptr);
 }
 
+/*
+  Routes a whole batch of hashes. For the dynamic distribution the ring is
+  entered once for the batch instead of once per key. points, if not NULL,
+  gets the point each key was routed to, see memcached_sched_sent().
+*/
+static void dispatch_host_batch(memcached_st *ptr, uint32_t *server_key, uint32_t *points, size_t number_of_keys, uint32_t cmd)
+{
+  if (ptr->distribution != MEMCACHED_DISTRIBUTION_DYNAMIC and
+      ptr->distribution != MEMCACHED_DISTRIBUTION_DYNAMIC_WEIGHTED)
+  {
+    for (size_t x= 0; x < number_of_keys; x++)
+    {
+      server_key[x]= dispatch_host(ptr, server_key[x], cmd);
+      if (points)
+      {
+        points[x]= ptr->sched_reader->route;
+      }
+    }
+    return;
+  }
+
+  struct sched_ring *ring = sched_reader_enter(ptr->dynamic, ptr->sched_reader);
+  if ( ring == NULL ) {
+    sched_reader_exit(ptr->sched_reader);
+    memset(server_key, 0, sizeof(uint32_t) * number_of_keys);
+    for (size_t x= 0; points and x < number_of_keys; x++)
+    {
+      points[x]= SCHED_ROUTE_NONE;
+    }
+    return;
+  }
+
+  WATCHPOINT_ASSERT(ring->search);
+
+  for (size_t x= 0; x < number_of_keys; x++)
+  {
+    uint32_t right = continuum_search_find(ring->search, server_key[x]);
+    sched_reader_count(ptr->sched_reader, ring, right, cmd);
+    server_key[x]= ring->indices[right];
+    if (points)
+    {
+      points[x]= right;
+    }
+  }
+  ptr->sched_reader->route_layout = ring->layout;
+
+  sched_reader_exit(ptr->sched_reader);
+}
+
+memcached_return_t memcached_generate_hash_routes(memcached_st *ptr,
+                                                  const char * const *keys,
+                                                  const size_t *key_length,
+                                                  size_t number_of_keys,
+                                                  uint32_t *server_key,
+                                                  uint32_t *points,
+                                                  uint32_t cmd)
+{
+  if (ptr == NULL or server_key == NULL)
+  {
+    return MEMCACHED_INVALID_ARGUMENTS;
+  }
+
+  if (number_of_keys == 0)
+  {
+    return MEMCACHED_SUCCESS;
+  }
+
+  if (keys == NULL or key_length == NULL)
+  {
+    return MEMCACHED_INVALID_ARGUMENTS;
+  }
+
+  if (memcached_server_count(ptr) == 0)
+  {
+    return MEMCACHED_NO_SERVERS;
+  }
+
+  _regen_for_auto_eject(ptr);
+
+  // hash everything first, the lookups below then run back to back; a lone
+  // server is still dispatched so a dynamic ring counts the gets against it
+  if (memcached_server_count(ptr) == 1)
+  {
+    memset(server_key, 0, sizeof(uint32_t) * number_of_keys);
+  }
+  else if (ptr->flags.hash_with_namespace)
+  {
+    for (size_t x= 0; x < number_of_keys; x++)
+    {
+      server_key[x]= _generate_hash_wrapper(ptr, keys[x], key_length[x]);
+    }
+  }
+  else
+  {
+    for (size_t x= 0; x < number_of_keys; x++)
+    {
+      server_key[x]= generate_hash(ptr, keys[x], key_length[x]);
+    }
+  }
+
+  // jinho added: gets count toward the heavy hitters as much as anything else,
+  // by the hash of the key even where a lone server routes them all by 0
+  if ((ptr->distribution == MEMCACHED_DISTRIBUTION_DYNAMIC or
+       ptr->distribution == MEMCACHED_DISTRIBUTION_DYNAMIC_WEIGHTED) and ptr->dynamic->hitters)
+  {
+    bool lone= memcached_server_count(ptr) == 1;
+    for (size_t x= 0; x < number_of_keys; x++)
+    {
+      uint32_t hash= lone ? _generate_key_hash(ptr, keys[x], key_length[x]) : server_key[x];
+      sched_hitters_route(ptr->dynamic, ptr->sched_reader, hash, keys[x], key_length[x]);
+    }
+  }
+
+  dispatch_host_batch(ptr, server_key, points, number_of_keys, cmd);
+
+  return MEMCACHED_SUCCESS;
+}
+
+memcached_return_t memcached_generate_hash_batch(memcached_st *ptr,
+                                                 const char * const *keys,
+                                                 const size_t *key_length,
+                                                 size_t number_of_keys,
+                                                 uint32_t *server_key,
+                                                 uint32_t cmd)
+{
+  return memcached_generate_hash_routes(ptr, keys, key_length, number_of_keys, server_key, NULL, cmd);
+}
+
 uint32_t memcached_generate_hash_with_redistribution(memcached_st *ptr, const char *key, size_t key_length, uint32_t cmd)
 {
   uint32_t hash= _generate_hash_wrapper(ptr, key, key_length);
 
   _regen_for_auto_eject(ptr);
 
+  // jinho added: heavy hitters, see memcached_sched_set_hot_keys(); a lone
+  // server is routed by 0, the sketch still wants the hash of the key
+  if ((ptr->distribution == MEMCACHED_DISTRIBUTION_DYNAMIC or
+       ptr->distribution == MEMCACHED_DISTRIBUTION_DYNAMIC_WEIGHTED) and ptr->dynamic->hitters)
+  {
+    uint32_t key_hash= memcached_server_count(ptr) == 1 ? _generate_key_hash(ptr, key, key_length) : hash;
+    sched_hitters_route(ptr->dynamic, ptr->sched_reader, key_hash, key, key_length);
+  }
+
   return dispatch_host(ptr, hash, cmd);
 }
 
@@ -260,6 +343,80 @@ uint32_t memcached_generate_hash(memcached_st *ptr, const char *key, size_t key_
   return dispatch_host(ptr, _generate_hash_wrapper(ptr, key, key_length), cmd);
 }
 
+/*
+  A request for key was answered by server_key: hit for a get that came
+  back with a value, bytes of key and value carried, usec waited for it.
+  point and layout are where the request was counted when it was routed,
+  see memcached_sched_sent(); the reply goes to the same point unless the
+  handle has routed on another layout since. Only SCHED_ROUTE_KEY routes
+  the key again, and attributes nothing if it no longer leads to
+  server_key (a replica, or the ring moved in between). Ketama keeps hits
+  only.
+*/
+void memcached_sched_account(memcached_st *ptr, uint32_t server_key, uint32_t point, uint64_t layout,
+                             const char *key, size_t key_length, bool hit, uint32_t bytes, uint32_t usec)
+{
+  if (memcached_server_count(ptr) == 0 or point == SCHED_ROUTE_NONE)
+  {
+    return;
+  }
+
+  switch (ptr->distribution)
+  {
+  case MEMCACHED_DISTRIBUTION_CONSISTENT:
+  case MEMCACHED_DISTRIBUTION_CONSISTENT_WEIGHTED:
+  case MEMCACHED_DISTRIBUTION_CONSISTENT_KETAMA:
+  case MEMCACHED_DISTRIBUTION_CONSISTENT_KETAMA_SPY:
+    if (hit and ptr->ketama_stat and ptr->ketama.search)
+    {
+      if (point == SCHED_ROUTE_KEY)
+      {
+        uint32_t hash= _generate_hash_wrapper(ptr, key, key_length);
+        if (ptr->ketama.continuum[continuum_search_find(ptr->ketama.search, hash)].index != server_key)
+        {
+          break;
+        }
+      }
+      sched_reader_hit_server(ptr->sched_reader, server_key, memcached_server_count(ptr));
+    }
+    break;
+
+  case MEMCACHED_DISTRIBUTION_DYNAMIC:
+  case MEMCACHED_DISTRIBUTION_DYNAMIC_WEIGHTED:
+    if (point == SCHED_ROUTE_KEY)
+    {
+      struct sched_ring *ring= sched_reader_enter(ptr->dynamic, ptr->sched_reader);
+      if (ring)
+      {
+        uint32_t right= continuum_search_find(ring->search, _generate_hash_wrapper(ptr, key, key_length));
+        if (ring->indices[right] == server_key)
+        {
+          point= right;
+          layout= ring->layout;
+        }
+      }
+      sched_reader_exit(ptr->sched_reader);
+    }
+
+    if (sched_reader_reply(ptr->sched_reader, layout, point, hit, bytes, usec) and hit and ptr->dynamic->migrator)
+    {
+      sched_migrator_hit(ptr->dynamic, ptr->sched_reader, _generate_hash_wrapper(ptr, key, key_length),
+                         server_key, key, key_length);
+    }
+    break;
+
+  case MEMCACHED_DISTRIBUTION_CONSISTENT_BOUNDED:
+  case MEMCACHED_DISTRIBUTION_MAGLEV:
+  case MEMCACHED_DISTRIBUTION_JUMP:
+  case MEMCACHED_DISTRIBUTION_MODULA:
+  case MEMCACHED_DISTRIBUTION_RANDOM:
+  case MEMCACHED_DISTRIBUTION_VIRTUAL_BUCKET:
+  case MEMCACHED_DISTRIBUTION_CONSISTENT_MAX:
+  default:
+    break;
+  }
+}
+
 const hashkit_st *memcached_get_hashkit(const memcached_st *ptr)
 {
   return &ptr->hashkit;
@@ -277,3 +434,249 @@ const char * libmemcached_string_hash(memcached_hash_t type)
 {
   return libhashkit_string_hash((hashkit_hash_algorithm_t)type);
 }
+
+static inline bool memcached_sched_timed(const memcached_st *ptr)
+{
+  return ptr->distribution == MEMCACHED_DISTRIBUTION_DYNAMIC or
+         ptr->distribution == MEMCACHED_DISTRIBUTION_DYNAMIC_WEIGHTED;
+}
+
+static uint64_t memcached_sched_clock(void)
+{
+  struct timeval now;
+  if (gettimeofday(&now, NULL))
+  {
+    return 0;
+  }
+
+  return (uint64_t)now.tv_sec * 1000000 + (uint64_t)now.tv_usec;
+}
+
+/*
+  Keeps point, and the layout it belongs to, on instance for the reply, and
+  starts the clock of instance unless it is still waiting for replies to
+  earlier requests: those are timed back to back, so a pipelined batch is
+  charged its total time once, and if they were routed to another point
+  their replies are found again by key. The clock is only read while the
+  load weighs latency.
+*/
+void memcached_sched_sent(org::libmemcached::Instance *instance, uint32_t point)
+{
+  memcached_st *ptr= instance->root;
+  uint64_t layout= ptr->sched_reader->route_layout;
+
+  if (memcached_instance_response_count(instance) == 0)
+  {
+    instance->sched_point= point;
+    instance->sched_layout= layout;
+    instance->sched_clock= 0;
+    if (memcached_sched_timed(ptr) and ptr->dynamic->load_latency > 0)
+    {
+      instance->sched_clock= memcached_sched_clock();
+    }
+  }
+  else if (instance->sched_point != point or instance->sched_layout != layout)
+  {
+    instance->sched_point= SCHED_ROUTE_KEY;
+  }
+}
+
+void memcached_sched_reply(org::libmemcached::Instance *instance, const char *key, size_t key_length,
+                           bool hit, size_t bytes)
+{
+  memcached_st *ptr= instance->root;
+  uint32_t usec= 0;
+
+  if (instance->sched_clock)
+  {
+    uint64_t now= memcached_sched_clock();
+    if (now > instance->sched_clock)
+    {
+      usec= (uint32_t)(now - instance->sched_clock);
+    }
+    instance->sched_clock= now;
+  }
+
+  memcached_sched_account(ptr, memcached_instance_position(instance), instance->sched_point, instance->sched_layout,
+                          key, key_length, hit, bytes > UINT32_MAX ? UINT32_MAX : (uint32_t)bytes, usec);
+}
+
+/*
+  The servers that owned key in the rings kept for hand-off whose grace
+  period still runs, newest first, none twice and not the current owner,
+  *owner; at most max of them. Nothing is counted, the request was counted
+  when it was routed.
+*/
+uint32_t memcached_sched_previous(memcached_st *ptr, const char *key, size_t key_length, uint32_t *owner,
+                                  uint32_t *previous, uint32_t max)
+{
+  uint32_t servers= memcached_server_count(ptr);
+  uint32_t count= 0;
+  *owner= UINT32_MAX;
+
+  if (memcached_sched_timed(ptr) == false or ptr->dynamic->previous == NULL or servers < 2)
+  {
+    return 0;
+  }
+
+  time_t now= time(NULL);
+  uint32_t hash= _generate_hash_wrapper(ptr, key, key_length);
+  struct sched_ring *ring= sched_reader_enter(ptr->dynamic, ptr->sched_reader);
+  if (ring)
+  {
+    *owner= ring->indices[continuum_search_find(ring->search, hash)];
+    for (struct sched_ring *kept= ptr->dynamic->previous; kept and count < max; kept= kept->next_kept)
+    {
+      uint32_t server= kept->indices[continuum_search_find(kept->search, hash)];
+      if (now >= kept->kept_until or server >= servers or server == *owner)
+      {
+        continue;
+      }
+
+      uint32_t x= 0;
+      while (x < count and previous[x] != server)
+      {
+        x++;
+      }
+      if (x == count)
+      {
+        previous[count++]= server;
+      }
+    }
+  }
+  sched_reader_exit(ptr->sched_reader);
+
+  return *owner < servers ? count : 0;
+}
+
+/* only while a migration is queued; the write side never takes the migrator lock */
+void memcached_sched_written(memcached_st *ptr, const char *key, size_t key_length)
+{
+  struct sched_migrator *migrator= memcached_sched_timed(ptr) ? ptr->dynamic->migrator : NULL;
+  if (migrator and migrator->count)
+  {
+    sched_migrator_written(migrator, _generate_hash_wrapper(ptr, key, key_length));
+  }
+}
+
+/*
+  The near cache forgets key whatever rc says. The rest only follows a
+  write that reached the owner, or found nothing there to change: then
+  nothing may be left elsewhere either. Only a key that is its own group
+  key has copies, a previous owner or a migration.
+*/
+void memcached_sched_after_write(memcached_st *ptr, const char *group_key, size_t group_key_length,
+                                 const char *key, size_t key_length, memcached_return_t rc,
+                                 const char *value, size_t value_length, time_t expiration, uint32_t flags, bool set)
+{
+  memcached_sched_near_drop(ptr, key, key_length);
+  if ((memcached_success(rc) or rc == MEMCACHED_NOTFOUND) and
+      group_key_length == key_length and memcmp(group_key, key, key_length) == 0)
+  {
+    memcached_sched_replicate(ptr, key, key_length, value, value_length, expiration, flags, set);
+    memcached_sched_handoff_drop(ptr, key, key_length);
+    memcached_sched_written(ptr, key, key_length);
+  }
+}
+
+/*
+  The servers besides its owner that hold copies of key while it is hot
+  (for a get) or while its copies may still be around (for a write): the
+  next distinct servers clockwise from the owner, and for a write those
+  copies were written to before the ring moved, at most max of them;
+  *hot tells which of the two it is. Nothing is counted. Only a handle
+  that waits for every reply takes part, the copies are written and read
+  one request at a time; a handle that replicates every key already has
+  its own successors.
+*/
+uint32_t memcached_sched_replicas(memcached_st *ptr, const char *key, size_t key_length,
+                                  bool read, uint32_t *servers, uint32_t max, bool *hot)
+{
+  uint32_t count= 0;
+
+  struct sched_replication *replication= memcached_sched_timed(ptr) ? ptr->dynamic->replication : NULL;
+  if (replication == NULL or memcached_server_count(ptr) < 2 or
+      memcached_is_buffering(ptr) or memcached_is_replying(ptr) == false or memcached_is_encrypted(ptr) or
+      ptr->number_of_replicas)
+  {
+    return 0;
+  }
+
+  uint32_t hash= _generate_hash_wrapper(ptr, key, key_length);
+  uint64_t slot= replication->slots[hash & replication->mask];
+  if ((uint32_t)(slot >> 32) != hash or
+      ((slot & SCHED_REPLICA_HOT) == 0 and (read or (slot & SCHED_REPLICA_COOLING) == 0)))
+  {
+    return 0;
+  }
+  if (hot)
+  {
+    *hot= (slot & SCHED_REPLICA_HOT);
+  }
+
+  // writes reach every copy the widest setting so far may have left
+  uint32_t want= (read ? replication->replicas : replication->widest) - 1;
+  if (want > max)
+  {
+    want= max;
+  }
+
+  struct sched_ring *ring= sched_reader_enter(ptr->dynamic, ptr->sched_reader);
+  if (ring and ring->continuum_points_counter)
+  {
+    uint32_t points= ring->continuum_points_counter;
+    uint32_t point= continuum_search_find(ring->search, hash);
+    uint32_t owner= ring->indices[point];
+
+    for (uint32_t step= 1; step < points and count < want; step++)
+    {
+      uint32_t server= ring->indices[(point + step) % points];
+      bool taken= (server == owner);
+      for (uint32_t x= 0; x < count and taken == false; x++)
+      {
+        taken= (servers[x] == server);
+      }
+      if (taken == false and server < memcached_server_count(ptr))
+      {
+        servers[count++]= server;
+      }
+    }
+
+    // never the owner: it has the value itself, a drop would take it
+    const volatile uint32_t *holders= replication->holders + (size_t)(hash & replication->mask) * SCHED_REPLICA_HOLDERS;
+    for (uint32_t x= 0; read == false and x < SCHED_REPLICA_HOLDERS and count < max; x++)
+    {
+      uint32_t server= holders[x];
+      bool taken= (server == 0 or server - 1 == owner or server - 1 >= memcached_server_count(ptr));
+      for (uint32_t y= 0; y < count and taken == false; y++)
+      {
+        taken= (servers[y] == server - 1);
+      }
+      if (taken == false)
+      {
+        servers[count++]= server - 1;
+      }
+    }
+  }
+  sched_reader_exit(ptr->sched_reader);
+
+  return count;
+}
+
+uint32_t memcached_sched_key_hash(memcached_st *ptr, const char *key, size_t key_length)
+{
+  return _generate_hash_wrapper(ptr, key, key_length);
+}
+
+/*
+  a get answered by a copy instead of the owner still counts as a request for
+  key, by the key's own hash like memcached_generate_hash_with_redistribution()
+*/
+void memcached_sched_counted(memcached_st *ptr, const char *key, size_t key_length)
+{
+  if (memcached_sched_timed(ptr))
+  {
+    uint32_t hash= memcached_server_count(ptr) == 1 ? _generate_key_hash(ptr, key, key_length) : _generate_hash_wrapper(ptr, key, key_length);
+    sched_hitters_route(ptr->dynamic, ptr->sched_reader, hash, key, key_length);
+  }
+}
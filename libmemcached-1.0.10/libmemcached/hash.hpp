@@ -38,3 +38,51 @@
 #pragma once
 
 uint32_t memcached_generate_hash_with_redistribution(memcached_st *ptr, const char *key, size_t key_length, uint32_t cmd);
+
+/* memcached_generate_hash_batch(), also keeping the point of every key in points for memcached_sched_sent() */
+memcached_return_t memcached_generate_hash_routes(memcached_st *ptr, const char * const *keys, const size_t *key_length,
+                                                  size_t number_of_keys, uint32_t *server_key, uint32_t *points, uint32_t cmd);
+
+/* the point the last key routed by ptr went to */
+static inline uint32_t memcached_sched_routed(const memcached_st *ptr)
+{
+  return ptr->sched_reader->route;
+}
+
+/* response side feedback for the ketama and dynamic statistics */
+void memcached_sched_account(memcached_st *ptr, uint32_t server_key, uint32_t point, uint64_t layout,
+                             const char *key, size_t key_length, bool hit, uint32_t bytes, uint32_t usec);
+
+/* a request for a key routed to point went out to instance; its reply is attributed by memcached_sched_reply() */
+void memcached_sched_sent(org::libmemcached::Instance *instance, uint32_t point);
+void memcached_sched_reply(org::libmemcached::Instance *instance, const char *key, size_t key_length,
+                           bool hit, size_t bytes);
+
+/* a request by memcached_instance_get(), _store() or _delete() cannot go to instance now */
+bool memcached_sched_instance_busy(org::libmemcached::Instance* instance);
+
+/* owners of key in the dynamic rings kept for hand-off other than the current one, *owner; newest first */
+uint32_t memcached_sched_previous(memcached_st *ptr, const char *key, size_t key_length, uint32_t *owner,
+                                  uint32_t *previous, uint32_t max);
+
+/* a write to key went to its owner: a queued migration of key must not copy over it */
+void memcached_sched_written(memcached_st *ptr, const char *key, size_t key_length);
+
+/*
+  the write paths, after a write to key by group_key came back with rc:
+  copies of it follow the owner, value being set on them if set, and
+  nothing else answers for the old value
+*/
+void memcached_sched_after_write(memcached_st *ptr, const char *group_key, size_t group_key_length,
+                                 const char *key, size_t key_length, memcached_return_t rc,
+                                 const char *value, size_t value_length, time_t expiration, uint32_t flags, bool set);
+
+/* servers with a copy of a hot key besides its owner, see struct sched_replication */
+uint32_t memcached_sched_replicas(memcached_st *ptr, const char *key, size_t key_length,
+                                  bool read, uint32_t *servers, uint32_t max, bool *hot);
+
+/* the hash memcached_sched_replicas() finds the slot of key by */
+uint32_t memcached_sched_key_hash(memcached_st *ptr, const char *key, size_t key_length);
+
+/* key was requested, but not through memcached_generate_hash_with_redistribution() */
+void memcached_sched_counted(memcached_st *ptr, const char *key, size_t key_length);
@@ -43,8 +43,6 @@
 /* Protoypes (static) */
 static memcached_return_t update_continuum(memcached_st *ptr);
 static memcached_return_t update_dynamic(memcached_st *ptr);
-double abs_double(double val);
-uint32_t abs_int(int val);
 uint64_t abs_int64(int64_t val);
 
 uint32_t hs_round(uint32_t small, uint32_t big)
@@ -103,6 +101,16 @@ memcached_return_t run_distribution(memcached_st *ptr)
   case MEMCACHED_DISTRIBUTION_DYNAMIC_WEIGHTED:
     return update_dynamic(ptr);
 
+  case MEMCACHED_DISTRIBUTION_CONSISTENT_BOUNDED:
+    {
+      memcached_return_t rc= update_continuum(ptr);
+      return memcached_success(rc) ? sched_bounded_reset(ptr) : rc;
+    }
+
+  case MEMCACHED_DISTRIBUTION_MAGLEV:
+  case MEMCACHED_DISTRIBUTION_JUMP:
+    return sched_table_build(ptr);
+
   case MEMCACHED_DISTRIBUTION_VIRTUAL_BUCKET:
   case MEMCACHED_DISTRIBUTION_MODULA:
     break;
@@ -152,6 +160,63 @@ static int continuum_item_cmp(const void *t1, const void *t2)
   }
 }
 
+/*
+  jinho added: the ketama statistics are shared by every handle, so the
+  per-server table is sized for the largest server list seen and only
+  grows. mem_hs_sched_ketama() reads its own copy of the continuum last
+  built, never a handle's, which the handle may rebuild or free.
+  Both are only touched under ketama_stat->lock; lookups count in the
+  shard of their handle instead, see sched_reader_count_server().
+*/
+static bool update_ketama_stat(memcached_st *ptr)
+{
+  struct ketama_stat *ketama_stat= ptr->ketama_stat;
+  if (ketama_stat == NULL)
+  {
+    return true;
+  }
+
+  // dispatch_host() counts by server index, ejected servers included
+  uint32_t server_count= memcached_server_count(ptr);
+  uint32_t points= ptr->ketama.continuum_points_counter;
+  bool success= true;
+
+  (void)pthread_mutex_lock(&ketama_stat->lock);
+  if (ketama_stat->servers == NULL or ketama_stat->continuum_count < server_count)
+  {
+    struct sched_context *servers= (struct sched_context*)libmemcached_realloc(NULL, ketama_stat->servers, 1, sizeof(struct sched_context)*server_count);
+    if (servers == NULL)
+    {
+      success= false;
+    }
+    else
+    {
+      uint32_t first= ketama_stat->servers == NULL ? 0 : ketama_stat->continuum_count;
+      memset(servers + first, 0, sizeof(struct sched_context)*(server_count - first));
+      ketama_stat->servers= servers;
+      ketama_stat->continuum_count= server_count;
+    }
+  }
+
+  if (success)
+  {
+    memcached_continuum_item_st *continuum= (memcached_continuum_item_st*)libmemcached_realloc(NULL, ketama_stat->continuum, 1, sizeof(memcached_continuum_item_st)*points);
+    if (continuum == NULL)
+    {
+      success= false;
+    }
+    else
+    {
+      memcpy(continuum, ptr->ketama.continuum, sizeof(memcached_continuum_item_st)*points);
+      ketama_stat->continuum= continuum;
+      ketama_stat->continuum_points_counter= points;
+    }
+  }
+  (void)pthread_mutex_unlock(&ketama_stat->lock);
+
+  return success;
+}
+
 static memcached_return_t update_continuum(memcached_st *ptr)
 {
   uint32_t continuum_index= 0;
@@ -369,25 +434,6 @@ static memcached_return_t update_continuum(memcached_st *ptr)
     }
   }
   */
-  if ( ptr->ketama_stat != NULL ) {
-    if ( ptr->ketama_stat->servers == NULL ) {
-      ptr->ketama_stat->continuum_count = live_servers;
-      ptr->ketama_stat->servers = (struct sched_context*)libmemcached_malloc(NULL, sizeof(struct sched_context)*live_servers);
-
-      ptr->ketama_stat->continuum_points_counter = pointer_counter;
-      ptr->ketama_stat->continuum = ptr->ketama.continuum;
-
-      struct sched_context *servers = ptr->ketama_stat->servers;
-      for (uint32_t sn = 0; sn < live_servers; sn++) {
-        servers[sn].get = 0;
-        servers[sn].set = 0;
-        servers[sn].sum = 0;
-        servers[sn].nhitrate = 0;
-        servers[sn].hitrate = 0;
-        servers[sn].usagerate = 0;
-      }
-    }
-  }
   // jinho added for statistics ----------------------
 
   WATCHPOINT_ASSERT(ptr);
@@ -396,6 +442,30 @@ static memcached_return_t update_continuum(memcached_st *ptr)
   ptr->ketama.continuum_points_counter= pointer_counter;
   qsort(ptr->ketama.continuum, ptr->ketama.continuum_points_counter, sizeof(memcached_continuum_item_st), continuum_item_cmp);
 
+  // jinho added for statistics ----------------------
+  if (update_ketama_stat(ptr) == false)
+  {
+    return MEMCACHED_MEMORY_ALLOCATION_FAILURE;
+  }
+  // jinho added for statistics ----------------------
+
+  // dispatch_host() never searches the last point
+  uint32_t search_size= ptr->ketama.continuum_points_counter - 1;
+  if (ptr->ketama.search == NULL or ptr->ketama.search->capacity < search_size)
+  {
+    uint32_t capacity= ptr->ketama.continuum_count * points_per_server;
+    memcached_continuum_search_st *search= continuum_search_create(capacity > search_size ? capacity : search_size);
+    if (search == NULL)
+    {
+      return MEMCACHED_MEMORY_ALLOCATION_FAILURE;
+    }
+
+    continuum_search_free(ptr->ketama.search);
+    ptr->ketama.search= search;
+  }
+  continuum_search_build(ptr->ketama.search, &ptr->ketama.continuum[0].value,
+                         sizeof(memcached_continuum_item_st) / sizeof(uint32_t), search_size);
+
   if (DEBUG)
   {
     for (uint32_t pointer_index= 0; memcached_server_count(ptr) && pointer_index < ((live_servers * MEMCACHED_POINTS_PER_SERVER) - 1); pointer_index++)
@@ -423,11 +493,16 @@ void mem_hs_sched_ketama(void)
   if ( ketama_stat == NULL )
     return;
 
+  (void)pthread_mutex_lock(&ketama_stat->lock);
+
+  // the requests every handle counted since the last run
+  struct sched_dynamic *dynamic = get_dynamic();
+  if ( dynamic != NULL )
+    sched_counters_merge_ketama(dynamic, ketama_stat);
+
   /*
     uint32_t ref;
     bool initialized_;
-    uint32_t max; // max usage
-    uint32_t maxid; // max usage index
     struct sched_context *ketama_servers;
   */
 
@@ -467,8 +542,8 @@ void mem_hs_sched_ketama(void)
     for (uint32_t i = 0; i < ketama_stat->continuum_count; i++) {
       struct sched_context *host = ketama_stat->servers + i;
 
-      if ( host->get != 0 && (int32_t)host->set <= (int32_t)(host->get - host->set) ) {
-        host->hitrate = get_hitrate(host->get, host->set);
+      if ( host->get != 0 ) {
+        host->hitrate = get_hitrate(host->get, host->hit);
         host->nhitrate = host->hitrate;
       }
 
@@ -486,86 +561,118 @@ void mem_hs_sched_ketama(void)
 #if 1
       host->get = 0;
       host->set = 0;
+      host->hit = 0;
       host->sum = 0;
       host->hitrate = 0;
       host->usagerate = 0;
       host->hashsize = 0;
 #endif
     }
-    ketama_stat->max = 0;
-    ketama_stat->maxid = 0;
 
     fprintf(stderr, "\n");
   }
+  (void)pthread_mutex_unlock(&ketama_stat->lock);
 }
 
 void mem_hs_sched_dynamic(void)
 {
-  struct sched_dynamic *dynamic = get_dynamic();
-  double max_cost=0;
-  double max_cost_i=0, max_cost_j=0, max_cost_k=0;
-  uint32_t max_i=0, max_j=0, max_k=0;
+  (void)sched_dynamic_tick(get_dynamic());
+}
+
+bool sched_dynamic_tick(struct sched_dynamic *dynamic)
+{
   bool schedulable = false;
   bool readiness = true;
 
   double max_hr = 0;
 
-  static uint32_t log_time = 1;
+  if ( dynamic == NULL )
+    return false;
 
-  //fprintf(stderr, "scheduler called.... \n");
+  (void)pthread_mutex_lock(&dynamic->lock);
 
-  if ( dynamic == NULL )
-    return;
+  // the ring readers currently see; a move is applied to a copy of it
+  struct sched_ring *ring = dynamic->ring;
+  struct sched_ring *next = NULL;
+  if ( ring == NULL ) {
+    (void)pthread_mutex_unlock(&dynamic->lock);
+    return false;
+  }
+
+  dynamic->tick++;
+
+  // the hand-off rings go once their grace period is over
+  if ( dynamic->previous != NULL )
+    sched_ring_expire(dynamic, false);
+
+  // per-handle request counters -> decayed per-point get/set/hit -> sum/hitrate/usagerate
+  sched_counters_merge(dynamic, ring);
+  sched_stats_decay(dynamic, ring);
+  sched_hitters_decay(dynamic);
+  sched_replication_update(dynamic);
+
+  const struct sched_policy *policy = dynamic->policy;
   
   //fprintf(stderr, "check alpha = %f, beta = %f\n", dynamic->alpha, dynamic->beta);
 
-  //fprintf(stderr, "dynamic(%p) scheduler called.... %u : %u\n", dynamic, dynamic->continuum_count, dynamic->continuum_points_counter);
+  //fprintf(stderr, "dynamic(%p) scheduler called.... %u : %u\n", dynamic, dynamic->continuum_count, ring->continuum_points_counter);
 
-#define cost(_i) (scost((&(dynamic->continuum[_i].sched))))
-#define hr(_i) (dynamic->continuum[_i].sched.hitrate)
-#define ur(_i) (dynamic->continuum[_i].sched.usagerate)
-
-  if ( dynamic->continuum_points_counter == 1 ) {
+  if ( ring->continuum_points_counter == 1 ) {
     // no scheduling required
   } else {
-    uint32_t max = 0;
+    double max = 0;
+    double max_bytes = 0;
+    double max_usec = 0;
 
     // server sched information update
     for ( uint32_t h = 0; h < dynamic->continuum_count; h++ ) {
       struct sched_context *host = dynamic->servers + h;
-      host->get = 0; host->set = 0; host->sum = 0; 
+      host->get = 0; host->set = 0; host->hit = 0; host->sum = 0; 
+      host->rget = 0; host->rset = 0; host->rhit = 0; host->rbytes = 0; host->rusec = 0;
       //host->nhitrate = 0; host->hitrate = 0; 
       host->usagerate = 0; host->hashsize= 0;
     }
 
     // server statistics... hashsize
-    for(uint32_t j=0; j < dynamic->continuum_points_counter; j++) {
-        uint32_t k = (j + 1) % dynamic->continuum_points_counter;
-        memcached_continuum_item_st *curr = dynamic->continuum + j;
-        struct sched_context *host = dynamic->servers + curr->index;
-
-        host->hashsize += hs_round(dynamic->continuum[j].value, dynamic->continuum[k].value);
-
-        host->get += curr->sched.get;
-        host->set += curr->sched.set;
-        host->sum += curr->sched.sum;
-
-        if ( host->sum > max )
-          max = host->sum;
+    for(uint32_t j=0; j < ring->continuum_points_counter; j++) {
+        uint32_t k = (j + 1) % ring->continuum_points_counter;
+        struct sched_context *curr = ring->stats + j;
+        struct sched_context *host = dynamic->servers + ring->indices[j];
+
+        host->hashsize += hs_round(ring->values[j], ring->values[k]);
+
+        host->rget += curr->rget;
+        host->rset += curr->rset;
+        host->rhit += curr->rhit;
+        host->rbytes += curr->rbytes;
+        host->rusec += curr->rusec;
+        host->sum += curr->sum;
+        curr->pressurerate = host->pressurerate;
+
+        if ( (host->rget + host->rset) / host->capacity > max )
+          max = (host->rget + host->rset) / host->capacity;
+        if ( host->rbytes / host->capacity > max_bytes )
+          max_bytes = host->rbytes / host->capacity;
+        if ( host->rusec > max_usec )
+          max_usec = host->rusec;
     }
 
     // find max hitrate in order to normalize
     for ( uint32_t h = 0; h < dynamic->continuum_count; h++ ) {
       struct sched_context *host = dynamic->servers + h;
 
-      if ( host->get != 0 && (int32_t)host->set <= (int32_t)(host->get - host->set) )
-        host->hitrate = get_hitrate(host->get, host->set);
+      // whole requests for the log; the controller gets sum, the requests of this tick
+      host->get = (uint32_t)(host->rget + 0.5);
+      host->set = (uint32_t)(host->rset + 0.5);
+      host->hit = (uint32_t)(host->rhit + 0.5);
+
+      if ( host->rget > 0 )
+        host->hitrate = get_hitrate(host->rget, host->rhit);
 
       if ( host->hitrate > max_hr )
         max_hr = host->hitrate;
     }
 
-    fprintf(stderr, "%u ---s--- ", log_time++);
     for ( uint32_t h = 0; h < dynamic->continuum_count; h++ ) {
       struct sched_context *host = dynamic->servers + h;
 
@@ -573,33 +680,16 @@ void mem_hs_sched_dynamic(void)
         max_hr = 1;
 
       host->nhitrate = host->hitrate / max_hr; // normalization to make it same as usagerate
-      host->usagerate = (double)((double)host->sum/(double)max);
+      host->usagerate = max ? (host->rget + host->rset) / host->capacity / max : 0;
+      host->byterate = max_bytes ? host->rbytes / host->capacity / max_bytes : 0;
+      host->latencyrate = max_usec ? host->rusec / max_usec : 0;
 
       // for stat
       host->psum = host->sum;
 
-      //fprintf(stderr, "s[%u] hit(%f), usage(%f), cost(%f), set/get(%u/%u) \n", h, host->hitrate, host->usagerate, scost(host), host->set, host->get);
-
-      // hitrate, usagerate, cost, hash_size, set, get
-      fprintf(stderr, "%f %f %f %f %u %u %u ", 
-              host->hitrate, host->nhitrate, host->usagerate, scost(host), host->hashsize, host->set, host->get);
-
       if ( host->nhitrate == 0 || host->usagerate == 0 )
         readiness = false;
     }
-    fprintf(stderr, "\n");
-
-    // XXX DEBUG
-    fprintf(stderr, "%u ---c--- ", log_time);
-    for(uint32_t j=0; j < dynamic->continuum_points_counter; j++) {
-      uint32_t i = (j - 1 + dynamic->continuum_points_counter) % dynamic->continuum_points_counter;
-      memcached_continuum_item_st *one = dynamic->continuum + j;
-      memcached_continuum_item_st *pre = dynamic->continuum + i;
-
-      fprintf(stderr, "%f %f %f %u ", 
-              one->sched.hitrate, one->sched.usagerate, cost(i), hs_round(pre->value, one->value));
-    }
-    fprintf(stderr, "\n");
 
     // if hitrate and usage are not ready, wait until they are ready.... NOT NOW.. 
     // it turns out it never comes back.. so it is better to make it changes
@@ -608,207 +698,399 @@ void mem_hs_sched_dynamic(void)
       return;
 */
 
-    // find min-max
-    uint32_t srv_min_id = 0;
-    uint32_t srv_max_id = 0;
-    double maxcost = 0;
-    double mincost = 1000;
-    bool srv_succ = true;
-
-    // server level: min-max servers
-    for(uint32_t j=0; j < dynamic->continuum_count; j++) {
-        struct sched_context *host = dynamic->servers + j;
-        double cost = scost(host);
-
-        if ( cost > maxcost ) {
-          maxcost = cost;
-          srv_max_id = j;
-        }
-
-        if ( cost < mincost ) {
-          mincost = cost;
-          srv_min_id = j;
-        }
-    }
-
-    //fprintf(stderr, "[min, max] : [%u, %u]\n", srv_min_id, srv_max_id);
-
-    if ( srv_max_id == srv_min_id ) 
-      srv_succ = false;
-
-    // virtual node level: find a location
-    bool cw = true;
-    bool max_cw = true;
-
-    if ( srv_succ ) {
-      // find maxdiff from selected servers
-      for(uint32_t j=0; j < dynamic->continuum_points_counter; j++) {
-        uint32_t i = (j - 1 + dynamic->continuum_points_counter) % dynamic->continuum_points_counter;
-        uint32_t k = (j + 1) % dynamic->continuum_points_counter;
-        double cost;
-        
-        if ( (srv_max_id == dynamic->continuum[j].index && srv_min_id == dynamic->continuum[k].index) || 
-              (srv_min_id == dynamic->continuum[j].index && srv_max_id == dynamic->continuum[k].index) ) {
-          cost = cost(j) - cost(k);
-          //cw = (cost < 0); // true: clockwise, false: counter-
-
-          cw = (srv_min_id == dynamic->continuum[j].index);
-          cost = abs_double(cost);
-
-          if ( cost > max_cost ) {
-            max_cost = cost;
-            max_cost_i = cost(i);
-            max_cost_j = cost(j);
-            max_cost_k = cost(k);
-            max_i = i;
-            max_j = j;
-            max_k = k;
-            max_cw = cw;
-            schedulable = true;
-          }
-        }
-      }
-    } else {
-      // just find maxdiff cost
-      for(uint32_t j=0; j < dynamic->continuum_points_counter; j++) {
-          uint32_t i = (j - 1 + dynamic->continuum_points_counter) % dynamic->continuum_points_counter;
-          uint32_t k = (j + 1) % dynamic->continuum_points_counter;
-          double cost = cost(j) - cost(k);
-          cw = (cost < 0); // true: clockwise, false: counter-
-          cost = abs_double(cost);
-
-          if ( cost > max_cost ) {
-            max_cost = cost;
-            max_cost_i = cost(i);
-            max_cost_j = cost(j);
-            max_cost_k = cost(k);
-            max_i = i;
-            max_j = j;
-            max_k = k;
-            max_cw = cw;
-            schedulable = true;
-          }
+    // the policy decides which boundaries move and by how much
+    uint32_t max_moves = ring->continuum_points_counter;
+    struct sched_move *moves = libmemcached_xcalloc(NULL, max_moves, struct sched_move);
+    uint32_t nmoves = moves ? policy->pick(dynamic, ring, moves, max_moves) : 0;
+
+    // a detoured point belongs to an ejected server; its boundaries wait for it
+    if ( ring->owners != NULL ) {
+      uint32_t kept = 0;
+      for ( uint32_t m = 0; m < nmoves; m++ ) {
+        if ( ring->owners[moves[m].point] == ring->indices[moves[m].point] &&
+             ring->owners[moves[m].peer] == ring->indices[moves[m].peer] )
+          moves[kept++] = moves[m];
       }
+      nmoves = kept;
     }
 
-    // actual move: max_cost_i,j,k, max_i,j,k, max_cw
-    if ( schedulable ) {
-      double rate; uint32_t amount;
-      if ( max_cw ) {
-        rate = (max_cost_k > max_cost_j) ? max_cost_j/max_cost_k : max_cost_k/max_cost_j;
-        amount = dynamic->beta * (1.0 - rate) * 
-                abs_int(dynamic->continuum[max_j].value - dynamic->continuum[max_k].value);
-
-        if ( abs_int(dynamic->continuum[max_k].value - dynamic->continuum[max_j].value) > amount ) {
-              dynamic->continuum[max_j].value += amount;
-
-              fprintf(stderr, "[s:%u -> %u, c:%u -> %u] moving %u of %u \n", 
-                      dynamic->continuum[max_j].index,dynamic->continuum[max_k].index, 
-                      max_j, max_k, amount, 
-                      abs_int(dynamic->continuum[max_k].value - dynamic->continuum[max_j].value));
-        }
-      } else {
-        rate = (max_cost_j > max_cost_i) ? max_cost_i/max_cost_j : max_cost_j/max_cost_i;
-        amount = dynamic->beta * (1.0 - rate) * 
-                abs_int(dynamic->continuum[max_i].value - dynamic->continuum[max_j].value);
-
-        if ( abs_int(dynamic->continuum[max_j].value - dynamic->continuum[max_i].value) > amount ) {
-              dynamic->continuum[max_j].value -= amount;
-
-              fprintf(stderr, "[s:%u -> %u, c:%u -> %u] moving %u of %u\n", 
-                      dynamic->continuum[max_j].index,dynamic->continuum[max_i].index, 
-                      max_j, max_i, amount, 
-                      abs_int(dynamic->continuum[max_j].value - dynamic->continuum[max_i].value));
-        }
+    if ( nmoves ) {
+      next = sched_ring_clone(ring);
+      if ( next != NULL ) {
+        policy->apply(dynamic, ring, next, moves, nmoves);
+        schedulable = true;
       }
     }
-
-    // reset all for safety falling in infinite 0 hitrate
-    if ( schedulable ) {
-      dynamic->max = 0;
-      dynamic->maxid = 0;
-      for ( uint32_t h = 0; h < dynamic->continuum_points_counter; h++ ) {
-        memcached_continuum_item_st *curr = dynamic->continuum + h;
-        struct sched_context *host = dynamic->servers + curr->index;
-
-        curr->sched.get = 0;
-        curr->sched.set = 0;
-        curr->sched.sum = 0;
-        //curr->sched.hitrate = 0; 
-        curr->sched.usagerate = 0;
+    libmemcached_free(NULL, moves);
+
+    // without a half-life, reset all for safety falling in infinite 0 hitrate;
+    // decayed statistics carry over and fade out on their own
+    if ( schedulable && dynamic->half_life <= 0 ) {
+      for ( uint32_t h = 0; h < next->continuum_points_counter; h++ ) {
+        struct sched_context *curr = next->stats + h;
+        struct sched_context *host = dynamic->servers + next->indices[h];
+
+        curr->rget = 0;
+        curr->rset = 0;
+        curr->rhit = 0;
+        curr->rbytes = 0;
+        curr->rusec = 0;
+        curr->sum = 0;
+        //curr->hitrate = 0; 
+        curr->usagerate = 0;
+        curr->byterate = 0;
+        curr->latencyrate = 0;
 
         host->get = 0;
         host->set = 0;
+        host->hit = 0;
         //host->sum = 0; // this number is needed by controller
         // can be 0.. so just inherit from previous one
         // or I can skip this time to schedule wait until it is ready
         //host->hitrate = 0;
         host->usagerate = 0;
+        host->byterate = 0;
+        host->latencyrate = 0;
         host->hashsize = 0;
       }
     }
+
+    if ( schedulable ) {
+      sched_migrator_plan(dynamic, ring, next);
+      sched_ring_publish(dynamic, next);
+    }
   }
 
+  // the file is built under the lock and written after it
+  char *snapshot_path = NULL;
+  size_t snapshot_length = 0;
+  char *snapshot = sched_snapshot_due(dynamic, &snapshot_path, &snapshot_length);
+
+  (void)pthread_mutex_unlock(&dynamic->lock);
+
+  if ( snapshot != NULL )
+    sched_snapshot_flush(dynamic, snapshot_path, snapshot, snapshot_length);
+
   //fprintf(stderr, "max_cost(%f), s(%u), t(%u), dynamic(%p)\n", max_cost, max_cost_s, max_cost_t, dynamic);
+
+  return schedulable;
 }
 
-// jinho added - should be called when hash updated from scheduler...???
-#define trace() printf("%s(%d) \n", __FILE__, __LINE__);
-//#define trace()
-static memcached_return_t update_dynamic(memcached_st *ptr)
+static inline uint32_t dynamic_weight(const org::libmemcached::Instance* list, uint32_t host_index)
 {
-  uint32_t continuum_index= 0;
-  uint32_t pointer_counter= 0;
-  uint32_t pointer_per_server= MEMCACHED_POINTS_PER_SERVER;
-  uint32_t pointer_per_hash= 1;
-  uint32_t live_servers= 0;
-  struct timeval now;
-  uint32_t i,j;
+  return list[host_index].weight ? list[host_index].weight : 1;
+}
 
-  if (gettimeofday(&now, NULL))
+/*
+  Capacity of every server relative to the mean weight, 1 without weights.
+  The cost compares the load a server carries per unit of capacity, so a
+  server twice the weight is as busy as another at twice its requests.
+*/
+static void dynamic_capacity(memcached_st *ptr, uint32_t live_servers)
+{
+  org::libmemcached::Instance* list= memcached_instance_list(ptr);
+  uint64_t total_weight= 0;
+
+  for (uint32_t host_index= 0; host_index < live_servers; ++host_index)
   {
-    return memcached_set_errno(*ptr, errno, MEMCACHED_AT);
+    total_weight+= dynamic_weight(list, host_index);
   }
 
-  // each server information
+  for (uint32_t host_index= 0; host_index < live_servers; ++host_index)
+  {
+    ptr->dynamic->servers[host_index].capacity= memcached_is_weighted_dynamic(ptr) ?
+      (double)dynamic_weight(list, host_index) * live_servers / (double)total_weight : 1;
+  }
+}
+
+/* from's statistics, the decayed counters cut down to share of them */
+static void dynamic_share_stats(struct sched_context *to, const struct sched_context *from, double share)
+{
+  *to= *from;
+  to->rget*= share;
+  to->rset*= share;
+  to->rhit*= share;
+  to->rbytes*= share;
+  to->rusec*= share;
+}
+
+/*
+  Join of servers ptr->dynamic->continuum_count .. live_servers - 1: every
+  point carries a share of the load (decayed requests, with bytes and
+  latency mixed in as in the cost; the hash space before anything was
+  counted). The level t, in load per unit of weight, is where what the
+  servers above it give equals what the newcomers take up to it. A donor
+  hands over whole points while they fit and splits one more for the rest;
+  each piece goes to the newcomer furthest below its share, and is cut
+  short where that share is full, so a join adds at most one point per
+  donor and per newcomer.
+*/
+static struct sched_ring *dynamic_join(memcached_st *ptr, const struct sched_ring *cur, uint32_t live_servers)
+{
+  struct sched_dynamic *dynamic= ptr->dynamic;
   org::libmemcached::Instance* list= memcached_instance_list(ptr);
+  uint32_t old_count= dynamic->continuum_count;
+  // dispatch_host() never reaches the last point, point 0 takes what falls past the one before
+  uint32_t points= cur->continuum_points_counter > 1 ? cur->continuum_points_counter - 1 : 1;
+
+  double *load= libmemcached_xcalloc(NULL, points, double);
+  double *give= libmemcached_xcalloc(NULL, live_servers, double); // owned load, then what is left to give or take
+  double *weight= libmemcached_xcalloc(NULL, live_servers, double);
+  if (load == NULL or give == NULL or weight == NULL)
+  {
+    libmemcached_free(NULL, load);
+    libmemcached_free(NULL, give);
+    libmemcached_free(NULL, weight);
+    return NULL;
+  }
 
-  // check scheduler
-  //if ( ptr->dynamic->initialized_ )
-  //  return MEMCACHED_SUCCESS;
+  for (uint32_t h= 0; h < live_servers; h++)
+  {
+    weight[h]= memcached_is_weighted_dynamic(ptr) ? dynamic_weight(list, h) : 1;
+  }
 
-  /* count live servers (those without a retry delay set) */
-  bool is_auto_ejecting= _is_auto_eject_host(ptr);
-  if (is_auto_ejecting)
+  double ops= 0, bytes= 0, usec= 0;
+  for (uint32_t x= 0; x < points; x++)
   {
-    live_servers= 0;
-    ptr->dynamic->next_distribution_rebuild= 0;
-    for (uint32_t host_index= 0; host_index < memcached_server_count(ptr); ++host_index)
+    ops+= cur->stats[x].rget + cur->stats[x].rset;
+    bytes+= cur->stats[x].rbytes;
+    usec+= cur->stats[x].rusec;
+  }
+
+  double weights= (ops > 0 ? dynamic->load_ops : 0) + (bytes > 0 ? dynamic->load_bytes : 0) +
+                  (usec > 0 ? dynamic->load_latency : 0);
+  for (uint32_t x= 0; x < points; x++)
+  {
+    const struct sched_context *stat= cur->stats + x;
+    if (weights > 0)
     {
-      if (list[host_index].next_retry <= now.tv_sec)
+      load[x]= ((ops > 0 ? dynamic->load_ops * (stat->rget + stat->rset) / ops : 0) +
+                (bytes > 0 ? dynamic->load_bytes * stat->rbytes / bytes : 0) +
+                (usec > 0 ? dynamic->load_latency * stat->rusec / usec : 0)) / weights;
+    }
+    else
+    {
+      load[x]= points == 1 ? 1 : hs_round(cur->values[(x + points - 1) % points], cur->values[x]) / 4294967296.0;
+    }
+
+    if (cur->indices[x] < old_count)
+    {
+      give[cur->indices[x]]+= load[x];
+    }
+  }
+
+  // bisection on t: the donors give more than the newcomers take below it, less above
+  double newcomers= 0, low= 0, high= 0;
+  for (uint32_t h= old_count; h < live_servers; h++)
+  {
+    newcomers+= weight[h];
+  }
+  for (uint32_t h= 0; h < old_count; h++)
+  {
+    if (give[h] / weight[h] > high)
+      high= give[h] / weight[h];
+  }
+  for (uint32_t n= 0; n < 64; n++)
+  {
+    double t= (low + high) / 2, given= 0;
+    for (uint32_t h= 0; h < old_count; h++)
+    {
+      if (give[h] > t * weight[h])
+        given+= give[h] - t * weight[h];
+    }
+
+    if (given > t * newcomers)
+      low= t;
+    else
+      high= t;
+  }
+
+  uint32_t donors= 0;
+  for (uint32_t h= 0; h < live_servers; h++)
+  {
+    if (h >= old_count)
+    {
+      give[h]= low * weight[h];
+    }
+    else if (give[h] > low * weight[h])
+    {
+      give[h]-= low * weight[h];
+      donors++;
+    }
+    else
+    {
+      give[h]= 0;
+    }
+  }
+
+  // every piece but the last of a point ends a donor's or a newcomer's share
+  struct sched_ring *ring= sched_ring_create(points + donors + live_servers - old_count + 1);
+  if (ring == NULL)
+  {
+    libmemcached_free(NULL, load);
+    libmemcached_free(NULL, give);
+    libmemcached_free(NULL, weight);
+    return NULL;
+  }
+
+  uint32_t ccnt= 0;
+  for (uint32_t x= 0; x < points; x++)
+  {
+    uint32_t owner= cur->indices[x];
+    uint32_t prev= cur->values[(x + points - 1) % points];
+    // a lone point spans the whole ring
+    uint64_t span= points == 1 ? (uint64_t)1 << 32 : hs_round(prev, cur->values[x]);
+    double left= load[x];
+    bool whole= false;
+
+    // the lower parts of the segment go, each to the newcomer furthest below its share
+    while (owner < old_count and give[owner] > 0 and left > 0)
+    {
+      uint32_t taker= old_count;
+      for (uint32_t h= old_count + 1; h < live_servers; h++)
       {
-        live_servers++;
+        if (give[h] > give[taker])
+          taker= h;
+      }
+
+      double piece= give[owner] < give[taker] ? give[owner] : give[taker];
+      if (piece <= 0)
+        break;
+
+      if (piece >= left)
+      {
+        piece= left;
+        prev= cur->values[x];
+        whole= true;
       }
       else
       {
-        if (ptr->dynamic->next_distribution_rebuild == 0 or list[host_index].next_retry < ptr->dynamic->next_distribution_rebuild)
-        {
-          ptr->dynamic->next_distribution_rebuild= list[host_index].next_retry;
-        }
+        uint64_t length= (uint64_t)(span * (piece / left));
+        prev+= (uint32_t)length;
+        span-= length;
       }
+
+      ring->indices[ccnt]= taker;
+      ring->values[ccnt]= prev;
+      dynamic_share_stats(ring->stats + ccnt, cur->stats + x, piece / load[x]);
+      ccnt++;
+
+      give[owner]-= piece;
+      give[taker]-= piece;
+      left-= piece;
+    }
+
+    // the rest, statistics and all, stays with the donor
+    if (whole == false)
+    {
+      ring->indices[ccnt]= owner;
+      ring->values[ccnt]= cur->values[x];
+      dynamic_share_stats(ring->stats + ccnt, cur->stats + x, load[x] > 0 ? left / load[x] : 1);
+      ccnt++;
     }
   }
-  else
+
+  // fewer splits than planned: the unused points are dropped
+  ring->continuum_points_counter= ccnt;
+
+  // and the new ring closes the same way, on a last point of the owner of its first
+  if (sched_ring_sort(ring) and ring->indices[ccnt - 1] != ring->indices[0])
   {
-    live_servers= memcached_server_count(ptr);
+    if (ring->values[ccnt - 1] == UINT32_MAX)
+    {
+      ring->values[ccnt - 1]--;
+    }
+    ring->indices[ccnt]= ring->indices[0];
+    ring->values[ccnt]= UINT32_MAX;
+    ring->continuum_points_counter= ++ccnt;
   }
-//printf("current live_servers = %d, ptr->dynamic->continuum_count = %d \n", live_servers, ptr->dynamic->continuum_count);
 
-  // just return when the same number.. # of servers was not changed
-  if ( live_servers == 0 || ptr->dynamic->continuum_count == live_servers ) 
-    return MEMCACHED_SUCCESS;
+  libmemcached_free(NULL, load);
+  libmemcached_free(NULL, give);
+  libmemcached_free(NULL, weight);
+
+  return ring;
+}
+
+/*
+  Sends the points of every server marked in down[] to the next point
+  clockwise whose learned owner is up, in place. Boundaries and statistics
+  are left alone and owners[] remembers the real owners, so a server that
+  comes back gets exactly its segments again. down == NULL puts every point
+  back with its owner.
+*/
+static bool dynamic_detour(struct sched_ring *ring, const bool *down)
+{
+  uint32_t points= ring->continuum_points_counter;
+
+  if (ring->owners == NULL)
+  {
+    if (down == NULL)
+      return true;
+
+    ring->owners= libmemcached_xcalloc(NULL, points ? points : 1, uint32_t);
+    if (ring->owners == NULL)
+      return false;
+
+    memcpy(ring->owners, ring->indices, sizeof(uint32_t) * points);
+  }
+
+  for (uint32_t x= 0; x < points; x++)
+  {
+    uint32_t owner= ring->owners[x];
+
+    if (down != NULL && down[owner]) {
+      for (uint32_t step= 1; step < points; step++) {
+        uint32_t next= ring->owners[(x + step) % points];
+        if ( ! down[next] ) {
+          owner= next;
+          break;
+        }
+      }
+    }
+
+    ring->indices[x]= owner;
+  }
 
-  if ( ptr->dynamic->continuum_points_counter == 0 ) // initial assignment
+  if (down == NULL) {
+    libmemcached_free(NULL, ring->owners);
+    ring->owners= NULL;
+  }
+
+  return true;
+}
+
+// jinho added - should be called when hash updated from scheduler...???
+#define trace() printf("%s(%d) \n", __FILE__, __LINE__);
+//#define trace()
+/*
+  Lays the ring out again for live_servers servers, starting from cur (the
+  learned owners), and publishes it with the points of the servers in
+  down[] detoured.
+*/
+static memcached_return_t dynamic_relayout(memcached_st *ptr, struct sched_ring *cur, uint32_t live_servers, const bool *down)
+{
+  uint32_t continuum_index= 0;
+  uint32_t pointer_counter= 0;
+  uint32_t pointer_per_server= MEMCACHED_POINTS_PER_SERVER;
+  uint32_t pointer_per_hash= 1;
+  uint32_t i,j;
+  struct sched_ring *ring= NULL; // the version we are going to publish
+  bool removal= false;
+
+  // each server information
+  org::libmemcached::Instance* list= memcached_instance_list(ptr);
+
+  /*
+    the removal below takes out the one server memcached_server_remove()
+    noted; a handle that comes with fewer servers any other way starts over
+  */
+  bool removable= live_servers + 1 == ptr->dynamic->continuum_count &&
+                  ptr->dynamic->removing_idx >= 0 &&
+                  (uint32_t)ptr->dynamic->removing_idx < ptr->dynamic->continuum_count;
+
+  if ( cur == NULL || cur->continuum_points_counter == 0 ||
+       (live_servers < ptr->dynamic->continuum_count && ! removable) ) // initial assignment
   {
     //uint32_t points_per_server = (uint32_t) (memcached_is_dynamic(ptr) ? MEMCACHED_POINTS_PER_SERVER_KETAMA : MEMCACHED_POINTS_PER_SERVER);
     uint32_t points_per_server = (live_servers == 1 ) ? 1 : live_servers - 1; // one set
@@ -820,63 +1102,41 @@ static memcached_return_t update_dynamic(memcached_st *ptr)
 
   //printf("live_servers(%d), ptr->dynamic.continuum_count(%d) \n", live_servers, ptr->dynamic.continuum_count);
 
-    // always the case
-    if (live_servers > ptr->dynamic->continuum_count)
-    {
-      memcached_continuum_item_st *new_ptr;
-
   //printf("live_servers(%d) + MEMCACHED_CONTINUUM_ADDITION(%d), points_per_server(%d) \n", live_servers, MEMCACHED_CONTINUUM_ADDITION, points_per_server);
 
-      new_ptr= libmemcached_xrealloc(ptr, ptr->dynamic->continuum, total_points, memcached_continuum_item_st);
+    // weighted: one more point closes the ring, see the incipient assignment
+    bool weighted = memcached_is_weighted_dynamic(ptr) && live_servers > 1;
+    ring= sched_ring_create(weighted ? total_points + 1 : total_points);
 
-      if (new_ptr == 0)
-        return MEMCACHED_MEMORY_ALLOCATION_FAILURE;
+    if (ring == NULL)
+      return MEMCACHED_MEMORY_ALLOCATION_FAILURE;
 
-      ptr->dynamic->continuum= new_ptr;
-      ptr->dynamic->continuum_count= live_servers;
-    }
+    ptr->dynamic->continuum_count= live_servers;
 
     // SERVERS sched_context
     if ( live_servers > 0 ) {
       struct sched_context *new_srv_ptr;
 
-      new_srv_ptr = (struct sched_context*)libmemcached_malloc(NULL, sizeof(struct sched_context) * live_servers);
+      new_srv_ptr = (struct sched_context*)libmemcached_calloc(NULL, live_servers, sizeof(struct sched_context));
 
-      if ( new_srv_ptr == 0 )
+      if ( new_srv_ptr == 0 ) {
+        sched_ring_free(ring);
         return MEMCACHED_MEMORY_ALLOCATION_FAILURE;
+      }
 
+      libmemcached_free(NULL, ptr->dynamic->servers);
       ptr->dynamic->servers = new_srv_ptr;
-
-      for(uint32_t host_index = 0; host_index < live_servers; ++host_index) {
-        struct sched_context *host_pointer = new_srv_ptr + host_index;
-        host_pointer->get = 0;
-        host_pointer->set = 0;
-        host_pointer->sum = 0;
-        host_pointer->hitrate = 0;
-        host_pointer->usagerate = 0;
-      }
     }
 
-    // XXX WEIGHT - I do not consier weights for now...
-    uint64_t total_weight= 0;
-    if (memcached_is_weighted_dynamic(ptr))
-    {
-      for (uint32_t host_index = 0; host_index < memcached_server_count(ptr); ++host_index)
-      {
-        if (is_auto_ejecting == false or list[host_index].next_retry <= now.tv_sec)
-        {
-          total_weight += list[host_index].weight;
-        }
-      }
-    }
+    dynamic_capacity(ptr, live_servers);
 //printf("----- set_size = %d\n", set_size);
 
     // INCIPIENT ALGORITHM
     uint32_t *set = (uint32_t*)libmemcached_malloc(NULL, sizeof(uint32_t)*set_size);
-    if ( set == NULL ) { return MEMCACHED_MEMORY_ALLOCATION_FAILURE; }
+    if ( set == NULL ) { sched_ring_free(ring); return MEMCACHED_MEMORY_ALLOCATION_FAILURE; }
 
     uint32_t **bak = (uint32_t**)libmemcached_malloc(NULL, sizeof(uint32_t*)*live_servers);
-    if ( bak == NULL ) { return MEMCACHED_MEMORY_ALLOCATION_FAILURE; }
+    if ( bak == NULL ) { libmemcached_free(NULL, set); sched_ring_free(ring); return MEMCACHED_MEMORY_ALLOCATION_FAILURE; }
 
     for(i=0; i < live_servers; i++) {
       bak[i] = (uint32_t*)libmemcached_malloc(NULL, sizeof(uint32_t)*live_servers);
@@ -932,24 +1192,41 @@ static memcached_return_t update_dynamic(memcached_st *ptr)
     // incipient assignment
     uint32_t unit = 0xFFFFFFFF / total_points;
     //printf("total_points = %u, unit = %u\n", total_points, unit);
-    ptr->dynamic->max = 0;
-    ptr->dynamic->maxid = 0;
-    for (uint32_t index= 0; index < total_points; ++index)
+    if (weighted)
     {
-        uint32_t value = unit * (index + 1);
+      /*
+        every point covers a share of the ring in proportion to the weight of
+        its owner. The last point is never searched, hashes past the one
+        before it go to point 0, so the set is followed by a point of no
+        width owned like point 0; otherwise the last owner of the set would
+        lose a share to the first.
+      */
+      uint64_t total_weight= 0;
+      for (uint32_t index= 0; index < total_points; ++index)
+      {
+        total_weight+= dynamic_weight(list, set[(index % set_size)]);
+      }
 
-        ptr->dynamic->continuum[continuum_index].sched.get = 0;
-        ptr->dynamic->continuum[continuum_index].sched.set = 0;
-        ptr->dynamic->continuum[continuum_index].sched.sum = 0;
+      uint64_t weight= 0;
+      for (uint32_t index= 0; index < total_points; ++index)
+      {
+        weight+= dynamic_weight(list, set[(index % set_size)]);
 
-        ptr->dynamic->continuum[continuum_index].sched.hitrate = 0;
-        ptr->dynamic->continuum[continuum_index].sched.usagerate = 0;
+        ring->indices[continuum_index]= set[(index % set_size)];
+        ring->values[continuum_index++]= (uint32_t)(((uint64_t)0xFFFFFFFF * weight) / total_weight);
+      }
 
-        ptr->dynamic->continuum[continuum_index].index= set[(index % set_size)];
-        ptr->dynamic->continuum[continuum_index++].value= value;
+      ring->indices[continuum_index]= ring->indices[0];
+      ring->values[continuum_index++]= 0xFFFFFFFF;
     }
+    else
+    for (uint32_t index= 0; index < total_points; ++index)
+    {
+        uint32_t value = unit * (index + 1);
 
-    ptr->dynamic->continuum_points_counter= total_points;
+        ring->indices[continuum_index]= set[(index % set_size)];
+        ring->values[continuum_index++]= value;
+    }
 
     libmemcached_free(NULL, set);
     for(i=0; i < live_servers; i++) {
@@ -958,91 +1235,17 @@ static memcached_return_t update_dynamic(memcached_st *ptr)
     libmemcached_free(NULL, bak);
   } else { // addition / removal
 
-    double max_cost = 0;
-    uint32_t max_id = 0; // default
-
     // live_servers = new index
 
     if ( live_servers > ptr->dynamic->continuum_count ) { // addition
-      // continumm assign...,but do not change the mapping..
-      printf("addition assignment... entered..\n");
-
-      // find the most cost 
-      // FIXME XXX XXX XXX XXX XXX XXX XXX XXX XXX XXX XXX XXX XXX XXX XXX XXX XXX XXX XXX XXX XXX XXX XXX XXX FIXME
-      // it needs to be stable value instead of instant cost... maybe accumulated cost???
-      // scheduler can determine one for this...
-      for(uint32_t host_index = 0; host_index < ptr->dynamic->continuum_count; ++host_index) {
-        struct sched_context *phost = ptr->dynamic->servers + host_index;
-        //double c = scost(phost);
-        double c = phost->usagerate;
-
-        if ( c > max_cost ) {
-          max_cost = c;
-          max_id = host_index;
-        }
-      }
-
-      // find the number of this server
-      uint32_t srv_num = 0;
-      for (uint32_t index= 0; index < ptr->dynamic->continuum_points_counter; ++index)
-      {
-        if ( ptr->dynamic->continuum[index].index == max_id ) {
-          srv_num ++;
-        }
-      }
-
-//printf("max_cost = %f, max_id = %u, srv_num = %d\n", max_cost, max_id, srv_num);
+      // every server above the level the newcomers can share gives its excess
+      ring= dynamic_join(ptr, cur, live_servers);
 
-      uint32_t old_total_points = ptr->dynamic->continuum_points_counter;
-      uint32_t new_total_points = ptr->dynamic->continuum_points_counter + srv_num;
-
-      memcached_continuum_item_st *new_ptr;
-      memcached_continuum_item_st *old_ptr = ptr->dynamic->continuum;
-
-      new_ptr= (memcached_continuum_item_st*)libmemcached_malloc(ptr, new_total_points * sizeof(memcached_continuum_item_st));
-
-      if (new_ptr == 0)
+      if (ring == NULL)
         return MEMCACHED_MEMORY_ALLOCATION_FAILURE;
 
-      int ccnt = 0;
-      for (uint32_t j = 0; j < old_total_points; ++j)
-      {
-        uint32_t i = (j - 1 + ptr->dynamic->continuum_points_counter) % ptr->dynamic->continuum_points_counter;
-        memcached_continuum_item_st *temp;
-
-        if ( old_ptr[j].index == max_id ) {
-          uint32_t hs = hs_round((ptr->dynamic->continuum + i)->value, (ptr->dynamic->continuum + j)->value)/2;
-          uint32_t new_value = hs_round(hs, ptr->dynamic->continuum[j].value);
-
-//printf("%u - (%u - %u)/2 = %u \n", ptr->dynamic->continuum[j].value, ptr->dynamic->continuum[j].value, ptr->dynamic->continuum[i].value, new_value);
-
-          temp = new_ptr + ccnt;
-
-          temp->sched.get = 0;
-          temp->sched.set = 0;
-          temp->sched.sum = 0;
-
-          temp->sched.hitrate = 0;
-          temp->sched.usagerate = 0;
-
-          temp->index = live_servers - 1; // new server at the end..
-          temp->value = new_value;
-
-          ccnt ++;
-        }
-
-        // continuum info + sched info
-        temp = new_ptr + ccnt;
-        memcpy(temp, old_ptr + j, sizeof(memcached_continuum_item_st));
-        ccnt ++;
-      }
-
-      ptr->dynamic->continuum_points_counter= new_total_points;
-      ptr->dynamic->continuum= new_ptr;
       ptr->dynamic->continuum_count= live_servers;
 
-      libmemcached_free(ptr, old_ptr);
-
     } else if ( live_servers < ptr->dynamic->continuum_count ) { // removal
 
 //printf("deletion assignment... entered..\n");
@@ -1050,48 +1253,43 @@ static memcached_return_t update_dynamic(memcached_st *ptr)
 //printf("XXXXXXXXX removing_idx in update = %d \n", ptr->dynamic->removing_idx);
 
       int removing_points = 0;
-      for (uint32_t index= 0; index < ptr->dynamic->continuum_points_counter; ++index)
+      for (uint32_t index= 0; index < cur->continuum_points_counter; ++index)
       {
-        if ( ptr->dynamic->continuum[index].index == ptr->dynamic->removing_idx ) {
+        if ( cur->indices[index] == ptr->dynamic->removing_idx ) {
           removing_points ++;
         }
       }
 
-      uint32_t old_total_points = ptr->dynamic->continuum_points_counter;
-      uint32_t new_total_points = ptr->dynamic->continuum_points_counter - removing_points;
-
-      memcached_continuum_item_st *new_ptr;
-      memcached_continuum_item_st *old_ptr = ptr->dynamic->continuum;
+      uint32_t old_total_points = cur->continuum_points_counter;
+      uint32_t new_total_points = cur->continuum_points_counter - removing_points;
 
       // old_total_points >= removing_points
       WATCHPOINT_ASSERT(old_total_points >= removing_points);
 
-      new_ptr= (memcached_continuum_item_st*)libmemcached_malloc(ptr, new_total_points * sizeof(memcached_continuum_item_st));
+      ring= sched_ring_create(new_total_points);
 
-      if (new_ptr == 0)
+      if (ring == NULL)
         return MEMCACHED_MEMORY_ALLOCATION_FAILURE;
 
       int ccnt = 0;
       for (uint32_t index= 0; index < old_total_points; ++index)
       {
-        if ( old_ptr[index].index != ptr->dynamic->removing_idx ) {
-          memcached_continuum_item_st *temp = new_ptr + ccnt;
-
+        if ( cur->indices[index] != ptr->dynamic->removing_idx ) {
           // continuum info + sched info
-          memcpy(temp, old_ptr + index, sizeof(memcached_continuum_item_st));
-          ccnt ++;
+          ring->indices[ccnt] = cur->indices[index];
+          ring->values[ccnt] = cur->values[index];
+          ring->stats[ccnt] = cur->stats[index];
 
           // only when the index is bigger than the one removed
-          if ( temp->index > ptr->dynamic->removing_idx )
-            temp->index --;
+          if ( ring->indices[ccnt] > ptr->dynamic->removing_idx )
+            ring->indices[ccnt] --;
+
+          ccnt ++;
         }
       }
 
-      ptr->dynamic->continuum_points_counter= new_total_points;
-      ptr->dynamic->continuum= new_ptr;
       ptr->dynamic->continuum_count= live_servers;
-
-      libmemcached_free(ptr, old_ptr);
+      removal= true;
     } 
 
     ptr->dynamic->continuum_count= live_servers;
@@ -1101,43 +1299,212 @@ static memcached_return_t update_dynamic(memcached_st *ptr)
       struct sched_context *new_srv_ptr;
       struct sched_context *old_srv_ptr = ptr->dynamic->servers;
 
-      new_srv_ptr = (struct sched_context*)libmemcached_malloc(NULL, sizeof(struct sched_context) * live_servers);
+      new_srv_ptr = (struct sched_context*)libmemcached_calloc(NULL, live_servers, sizeof(struct sched_context));
 
-      if ( new_srv_ptr == 0 )
+      if ( new_srv_ptr == 0 ) {
+        sched_ring_free(ring);
         return MEMCACHED_MEMORY_ALLOCATION_FAILURE;
+      }
 
       ptr->dynamic->servers = new_srv_ptr;
 
-      for(uint32_t host_index = 0; host_index < live_servers; ++host_index) {
-        struct sched_context *host_pointer = new_srv_ptr + host_index;
-        host_pointer->get = 0;
-        host_pointer->set = 0;
-        host_pointer->sum = 0;
-        host_pointer->hitrate = 0;
-        host_pointer->usagerate = 0;
-      }
-
       libmemcached_free(NULL, old_srv_ptr);
+
+      dynamic_capacity(ptr, live_servers);
     }
 
     // in case we have rounded hash space assignment
-    qsort(ptr->dynamic->continuum, ptr->dynamic->continuum_points_counter, sizeof(memcached_continuum_item_st), continuum_item_cmp);
+    if ( ring != NULL && ! sched_ring_sort(ring) ) {
+      sched_ring_free(ring);
+      return MEMCACHED_MEMORY_ALLOCATION_FAILURE;
+    }
   }
 
-  // XXX DEBUG
-  for(i=0; i < ptr->dynamic->continuum_points_counter; i++) {
-    printf("%u (%u) -> ", ptr->dynamic->continuum[i].index, ptr->dynamic->continuum[i].value);
-  }
-  printf("\n");
+  if ( ring == NULL )
+    return MEMCACHED_SUCCESS;
 
   WATCHPOINT_ASSERT(ptr);
-  WATCHPOINT_ASSERT(ptr->dynamic->continuum);
+  WATCHPOINT_ASSERT(ring->values);
+
+  if ( down != NULL && ! dynamic_detour(ring, down) ) {
+    sched_ring_free(ring);
+    return MEMCACHED_MEMORY_ALLOCATION_FAILURE;
+  }
+
+  sched_ring_index(ring);
+  ring->layout= ++ptr->dynamic->layout;
+  sched_ring_publish(ptr->dynamic, ring);
+  sched_snapshot_renumber(ptr->dynamic, ptr);
+  sched_feedback_renumber(ptr->dynamic, ptr);
+
+  // the kept rings and the copies still number the servers as they were before the removal
+  if ( removal && ptr->dynamic->previous != NULL )
+    sched_ring_renumber_kept(ptr->dynamic, (uint32_t)ptr->dynamic->removing_idx);
+  if ( removal )
+    sched_replication_renumber(ptr->dynamic, (uint32_t)ptr->dynamic->removing_idx);
+  if ( removal )
+    ptr->dynamic->removing_idx = -1;
 
   ptr->dynamic->initialized_ = true;
 
   return MEMCACHED_SUCCESS;
 }
 
+/*
+  Must hold dynamic->lock. Marks the servers of ptr in their retry delay in
+  *down, left NULL if there are none or nobody to detour to, and notes when
+  the first of them is due back.
+*/
+static memcached_return_t dynamic_down(memcached_st *ptr, bool **down_ptr)
+{
+  uint32_t live_servers= memcached_server_count(ptr);
+  struct timeval now;
+  bool *down= NULL;
+
+  *down_ptr= NULL;
+
+  if (gettimeofday(&now, NULL))
+  {
+    return memcached_set_errno(*ptr, errno, MEMCACHED_AT);
+  }
+
+  // each server information
+  org::libmemcached::Instance* list= memcached_instance_list(ptr);
+
+  bool is_auto_ejecting= _is_auto_eject_host(ptr);
+  if (is_auto_ejecting && live_servers > 0)
+  {
+    uint32_t alive= 0;
+
+    down= libmemcached_xcalloc(NULL, live_servers, bool);
+    if (down == NULL)
+      return MEMCACHED_MEMORY_ALLOCATION_FAILURE;
+
+    ptr->dynamic->next_distribution_rebuild= 0;
+    for (uint32_t host_index= 0; host_index < memcached_server_count(ptr); ++host_index)
+    {
+      if (list[host_index].next_retry <= now.tv_sec)
+      {
+        alive++;
+      }
+      else
+      {
+        down[host_index]= true;
+        if (ptr->dynamic->next_distribution_rebuild == 0 or list[host_index].next_retry < ptr->dynamic->next_distribution_rebuild)
+        {
+          ptr->dynamic->next_distribution_rebuild= list[host_index].next_retry;
+        }
+      }
+    }
+
+    // nobody to detour to, or nothing to detour
+    if ( alive == 0 || alive == live_servers ) {
+      libmemcached_free(NULL, down);
+      down= NULL;
+    }
+  }
+
+  *down_ptr= down;
+
+  return MEMCACHED_SUCCESS;
+}
+
+memcached_return_t sched_ring_detour_down(memcached_st *ptr, struct sched_ring *ring)
+{
+  bool *down= NULL;
+  memcached_return_t rc= dynamic_down(ptr, &down);
+
+  if ( memcached_success(rc) && down != NULL && ! dynamic_detour(ring, down) )
+    rc= MEMCACHED_MEMORY_ALLOCATION_FAILURE;
+
+  libmemcached_free(NULL, down);
+
+  return rc;
+}
+
+static memcached_return_t update_dynamic_locked(memcached_st *ptr)
+{
+  uint32_t live_servers= 0;
+  struct sched_ring *ring= NULL;
+  struct sched_ring *cur= ptr->dynamic->ring;
+  struct sched_ring *learned= NULL; // cur with the detours taken out
+  bool *down= NULL;
+
+  // check scheduler
+  //if ( ptr->dynamic->initialized_ )
+  //  return MEMCACHED_SUCCESS;
+
+  /*
+    Unlike ketama, the ring keeps every server: one in its retry delay is
+    only marked in down[] and its points are detoured, so the scheduler's
+    learned segments survive a server that flaps.
+  */
+  live_servers= memcached_server_count(ptr);
+
+  memcached_return_t down_rc= dynamic_down(ptr, &down);
+  if (memcached_failed(down_rc))
+    return down_rc;
+//printf("current live_servers = %d, ptr->dynamic->continuum_count = %d \n", live_servers, ptr->dynamic->continuum_count);
+
+  if ( live_servers == 0 )
+    return MEMCACHED_SUCCESS;
+
+  // the same servers: at most an ejection began or ended
+  if ( ptr->dynamic->continuum_count == live_servers ) {
+    memcached_return_t rc= MEMCACHED_SUCCESS;
+
+    if ( cur != NULL && (cur->owners != NULL || down != NULL) ) {
+      ring= sched_ring_clone(cur);
+
+      if ( ring == NULL || ! dynamic_detour(ring, down) ) {
+        rc= MEMCACHED_MEMORY_ALLOCATION_FAILURE;
+        sched_ring_free(ring);
+      } else if ( memcmp(ring->indices, cur->indices, sizeof(uint32_t) * ring->continuum_points_counter) == 0 ) {
+        sched_ring_free(ring);
+      } else {
+        // same points, same layout: the request counters stay valid
+        sched_ring_publish(ptr->dynamic, ring);
+      }
+    }
+
+    libmemcached_free(NULL, down);
+    return rc;
+  }
+
+  // carry every request counted so far over into the new layout
+  if ( cur != NULL )
+    sched_counters_merge(ptr->dynamic, cur);
+
+  // servers come and go against the learned owners, the detours are redone below
+  if ( cur != NULL && cur->owners != NULL ) {
+    learned= sched_ring_clone(cur);
+
+    if ( learned == NULL || ! dynamic_detour(learned, NULL) ) {
+      sched_ring_free(learned);
+      libmemcached_free(NULL, down);
+      return MEMCACHED_MEMORY_ALLOCATION_FAILURE;
+    }
+
+    cur= learned;
+  }
+
+  memcached_return_t rc= dynamic_relayout(ptr, cur, live_servers, down);
+
+  sched_ring_free(learned);
+  libmemcached_free(NULL, down);
+
+  return rc;
+}
+
+static memcached_return_t update_dynamic(memcached_st *ptr)
+{
+  (void)pthread_mutex_lock(&ptr->dynamic->lock);
+  memcached_return_t rc= update_dynamic_locked(ptr);
+  (void)pthread_mutex_unlock(&ptr->dynamic->lock);
+
+  return rc;
+}
+
 static memcached_return_t server_add(memcached_st *ptr, 
                                      const memcached_string_t& hostname,
                                      in_port_t port,
@@ -1187,6 +1554,7 @@ memcached_return_t get_sched_stat(char *buf, int buf_len)
   if ( dynamic == NULL )
     return MEMCACHED_SUCCESS;
 
+  (void)pthread_mutex_lock(&dynamic->lock);
   for ( uint32_t h = 0; h < dynamic->continuum_count; h++ ) {
       struct sched_context *host = dynamic->servers + h;
 
@@ -1197,6 +1565,7 @@ memcached_return_t get_sched_stat(char *buf, int buf_len)
       if ( (buf_cnt + sprintf(temp, "%u", host->psum)) >= buf_len )
         break;
   }
+  (void)pthread_mutex_unlock(&dynamic->lock);
 //fprintf(stderr, "done...%s \n", buf);
 
   return MEMCACHED_SUCCESS;
@@ -81,6 +81,9 @@ static inline void _server_init(org::libmemcached::Instance* self, memcached_st
     self->version= UINT_MAX;
   }
   self->limit_maxbytes= 0;
+  self->sched_clock= 0;
+  self->sched_layout= 0;
+  self->sched_point= SCHED_ROUTE_NONE;
   memcpy(self->hostname, hostname.c_str, hostname.size);
   self->hostname[hostname.size]= 0;
 }
@@ -125,6 +125,9 @@ struct Instance {
   time_t next_retry;
   struct memcached_st *root;
   uint64_t limit_maxbytes;
+  uint64_t sched_clock; // jinho added: usec of the last request sent or reply read, see memcached_sched_sent()
+  uint64_t sched_layout; // jinho added: ring layout and point the requests in flight were routed to
+  uint32_t sched_point;
   struct memcached_error_t *error_messages;
   char read_buffer[MEMCACHED_MAX_BUFFER];
   char write_buffer[MEMCACHED_MAX_BUFFER];
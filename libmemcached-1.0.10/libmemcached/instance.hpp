@@ -56,3 +56,17 @@ memcached_server_st *memcached_instance_2_server(org::libmemcached::Instance* so
 uint32_t memcached_instance_response_count(const org::libmemcached::Instance* self);
 
 void __instance_free(org::libmemcached::Instance *);
+
+/* jinho added: one get from this very server, whatever the distribution says */
+memcached_return_t memcached_instance_get(org::libmemcached::Instance* self,
+                                          const char *key, size_t key_length,
+                                          memcached_result_st *result);
+
+/* jinho added: likewise one set, or add, waiting for the reply, and one delete */
+memcached_return_t memcached_instance_store(org::libmemcached::Instance* self, bool add,
+                                            const char *key, size_t key_length,
+                                            const char *value, size_t value_length,
+                                            time_t expiration, uint32_t flags);
+
+memcached_return_t memcached_instance_delete(org::libmemcached::Instance* self,
+                                             const char *key, size_t key_length);
@@ -43,6 +43,7 @@
 /* common structure */
 static struct sched_dynamic *dynamic = NULL;
 static struct ketama_stat *ketama_stat = NULL;
+static pthread_mutex_t dynamic_LOCK= PTHREAD_MUTEX_INITIALIZER;
 
 struct sched_dynamic *get_dynamic(void)
 {
@@ -54,7 +55,89 @@ struct ketama_stat *get_ketama_stat(void)
   return ketama_stat;
 }
 
-static inline bool _memcached_init(memcached_st *self)
+/* jinho added: takes a reference on the state every handle of the process shares */
+static inline bool _memcached_share(memcached_st *self)
+{
+  (void)pthread_mutex_lock(&dynamic_LOCK);
+  if ( dynamic == NULL ) {
+    dynamic = (struct sched_dynamic*)libmemcached_malloc(NULL, sizeof(struct sched_dynamic));
+    if ( dynamic == NULL ) {
+      (void)pthread_mutex_unlock(&dynamic_LOCK);
+      return false;
+    }
+    self->dynamic = dynamic;
+
+    // initial here.. originally in memcached.cc
+    self->dynamic->continuum_count= 0;
+    self->dynamic->removing_idx= -1;
+    self->dynamic->servers= NULL;
+    self->dynamic->ring= NULL;
+    self->dynamic->version= 0;
+    self->dynamic->epoch= 1; // 0 means "not reading"
+    self->dynamic->readers= NULL;
+    self->dynamic->retired= NULL;
+    pthread_mutex_init(&self->dynamic->lock, NULL);
+    self->dynamic->next_distribution_rebuild= 0;
+    self->dynamic->weighted_= false;
+    self->dynamic->initialized_ = false;
+
+    // sched set by user
+    self->dynamic->alpha= 0;
+    self->dynamic->beta= 0;
+    self->dynamic->policy= sched_policy_get(MEMCACHED_SCHED_POLICY_PAIR);
+    self->dynamic->half_life= MEMCACHED_SCHED_HALF_LIFE;
+    self->dynamic->load_ops= 1; // op counts only, until told otherwise
+    self->dynamic->load_bytes= 0;
+    self->dynamic->load_latency= 0;
+    self->dynamic->gamma= MEMCACHED_SCHED_PRESSURE;
+    self->dynamic->tick= 0;
+    self->dynamic->migrator= NULL;
+    self->dynamic->previous= NULL;
+    self->dynamic->grace= 0;
+    self->dynamic->handoff_ttl= 0;
+    self->dynamic->handoff_tries= 0;
+    self->dynamic->handoff_hits= 0;
+    self->dynamic->handoff_skip= NULL;
+    self->dynamic->snapshot= NULL;
+    self->dynamic->thread= NULL;
+    self->dynamic->feedback_every= MEMCACHED_SCHED_FEEDBACK;
+    self->dynamic->feedback_servers= NULL;
+    self->dynamic->feedback_layout= 0;
+    self->dynamic->hitters= NULL;
+    self->dynamic->replication= NULL;
+    self->dynamic->near= NULL;
+
+    dynamic->ref = 1;
+  } else {
+    self->dynamic = dynamic; // common structure
+    dynamic->ref ++;
+  }
+
+  // the ketama statistics are optional, a handle goes without them if they can't be had
+  if ( ketama_stat == NULL ) {
+    ketama_stat = (struct ketama_stat*)libmemcached_malloc(NULL, sizeof(struct ketama_stat));
+    if ( ketama_stat != NULL ) {
+      self->ketama_stat = ketama_stat;
+
+      self->ketama_stat->initialized_ = false;
+      pthread_mutex_init(&self->ketama_stat->lock, NULL);
+      self->ketama_stat->continuum_count = 0;
+      self->ketama_stat->servers = NULL;
+      self->ketama_stat->continuum_points_counter = 0;
+      self->ketama_stat->continuum = NULL;
+
+      self->ketama_stat->ref = 1;
+    }
+  } else {
+    self->ketama_stat = ketama_stat; // common structure
+    self->ketama_stat->ref ++;
+  }
+  (void)pthread_mutex_unlock(&dynamic_LOCK);
+
+  return true;
+}
+
+static inline bool _memcached_init(memcached_st *self, bool shared)
 {
   self->state.is_purging= false;
   self->state.is_processing_input= false;
@@ -77,6 +160,11 @@ static inline bool _memcached_init(memcached_st *self)
   self->flags.is_fetching_version= false;
 
   self->virtual_bucket= NULL;
+  self->dynamic= NULL;
+  self->sched_reader= NULL;
+  self->ketama_stat= NULL;
+  self->bounded= NULL;
+  self->table= NULL;
 
   self->distribution= MEMCACHED_DISTRIBUTION_MODULA;
 
@@ -88,6 +176,7 @@ static inline bool _memcached_init(memcached_st *self)
   self->server_info.version= 0;
 
   self->ketama.continuum= NULL;
+  self->ketama.search= NULL;
   self->ketama.continuum_count= 0;
   self->ketama.continuum_points_counter= 0;
   self->ketama.next_distribution_rebuild= 0;
@@ -98,42 +187,8 @@ static inline bool _memcached_init(memcached_st *self)
   // XXX suspect point.. why this is called so many times......
 //fprintf(stderr, "------- _memcached_init.... %s (%d)\n", __FILE__, __LINE__);
 
-  if ( dynamic == NULL ) {
-    dynamic = (struct sched_dynamic*)libmemcached_malloc(NULL, sizeof(struct sched_dynamic));
-    self->dynamic = dynamic;
-
-    // initial here.. originally in memcached.cc
-    self->dynamic->continuum= NULL;
-    self->dynamic->continuum_count= 0;
-    self->dynamic->continuum_points_counter= 0;
-    self->dynamic->next_distribution_rebuild= 0;
-    self->dynamic->weighted_= false;
-    self->dynamic->initialized_ = false;
-
-    // sched set by user
-    self->dynamic->alpha= 0;
-    self->dynamic->beta= 0;
-
-    dynamic->ref = 1;
-  } else {
-    self->dynamic = dynamic; // common structure
-    dynamic->ref ++;
-  }
-
-  if ( ketama_stat == NULL ) {
-    ketama_stat = (struct ketama_stat*)libmemcached_malloc(NULL, sizeof(struct ketama_stat));
-    self->ketama_stat = ketama_stat;
-
-    self->ketama_stat->initialized_ = false;
-    self->ketama_stat->continuum_count = 0;
-    self->ketama_stat->max = 0;
-    self->ketama_stat->maxid = 0;
-    self->ketama_stat->servers = NULL;
-
-    self->ketama_stat->ref = 1;
-  } else {
-    self->ketama_stat = ketama_stat; // common structure
-    self->ketama_stat->ref ++;
+  if ( shared && ! _memcached_share(self) ) {
+    return false;
   }
 
   self->number_of_hosts= 0;
@@ -180,6 +235,14 @@ static inline bool _memcached_init(memcached_st *self)
   self->configure.version= -1;
   self->configure.filename= NULL;
 
+  // jinho added: last, so memcached_free() finds every reference above taken and every field set
+  if ( shared ) {
+    self->sched_reader= sched_reader_register(self->dynamic);
+    if ( self->sched_reader == NULL ) {
+      return false;
+    }
+  }
+
   return true;
 }
 
@@ -200,24 +263,69 @@ static void __memcached_free(memcached_st *ptr, bool release_st)
   }
 
   libmemcached_free(ptr, ptr->ketama.continuum);
+  continuum_search_free(ptr->ketama.search);
+  sched_bounded_free(ptr->bounded);
+  ptr->bounded= NULL;
+  sched_table_free(ptr->table);
+  ptr->table= NULL;
 
   // jinho added - free only once
-  if ( dynamic != NULL ) {
+  sched_reader_unregister(ptr->sched_reader);
+  ptr->sched_reader= NULL;
+
+  // a handle of sched_handle_create() holds no reference, and is freed by
+  // the scheduler thread, which may be joined under dynamic_LOCK
+  bool shared= ptr->dynamic != NULL;
+  if ( shared )
+    (void)pthread_mutex_lock(&dynamic_LOCK);
+  if ( shared and ptr->dynamic == dynamic ) {
+    ptr->dynamic= NULL;
     dynamic->ref --;
     if ( dynamic->ref == 0 ) {
-      libmemcached_free(NULL, dynamic->continuum);
+      sched_thread_stop(dynamic);
+      sched_ring_free(dynamic->ring);
+      while ( dynamic->previous != NULL ) {
+        struct sched_ring *kept= dynamic->previous;
+        dynamic->previous= kept->next_kept;
+        sched_ring_free(kept);
+      }
+      sched_ring_reclaim(dynamic, true);
+
+      struct sched_reader *reader= dynamic->readers;
+      while ( reader != NULL ) {
+        struct sched_reader *next= reader->next;
+        sched_reader_free(reader);
+        reader= next;
+      }
+
+      sched_migrator_free(dynamic->migrator);
+      sched_snapshot_free(dynamic->snapshot);
+      memcached_server_list_free(dynamic->feedback_servers);
+      sched_hitters_free(dynamic->hitters);
+      sched_replication_free(dynamic->replication);
+      sched_near_free(dynamic->near);
+      libmemcached_free(NULL, (void *)dynamic->handoff_skip);
+      pthread_mutex_destroy(&dynamic->lock);
+      libmemcached_free(NULL, dynamic->servers);
       libmemcached_free(NULL, dynamic);
-      dynamic == NULL;
+      dynamic = NULL;
     }
   }
 
-  if ( ketama_stat != NULL ) {
+  // only the reference this handle took, _memcached_init() may have failed before it
+  if ( shared and ketama_stat != NULL and ptr->ketama_stat == ketama_stat ) {
+    ptr->ketama_stat= NULL;
     ketama_stat->ref --;
     if ( ketama_stat->ref == 0 ) {
+      pthread_mutex_destroy(&ketama_stat->lock);
+      libmemcached_free(NULL, ketama_stat->continuum);
+      libmemcached_free(NULL, ketama_stat->servers);
       libmemcached_free(NULL, ketama_stat);
       ketama_stat = NULL;
     }
   }
+  if ( shared )
+    (void)pthread_mutex_unlock(&dynamic_LOCK);
 
   memcached_array_free(ptr->_namespace);
   ptr->_namespace= NULL;
@@ -243,7 +351,7 @@ static void __memcached_free(memcached_st *ptr, bool release_st)
   }
 }
 
-memcached_st *memcached_create(memcached_st *ptr)
+static memcached_st *_memcached_create(memcached_st *ptr, bool shared)
 {
   if (ptr)
   {
@@ -261,7 +369,7 @@ memcached_st *memcached_create(memcached_st *ptr)
     ptr->options.is_allocated= true;
   }
 
-  if (_memcached_init(ptr) == false)
+  if (_memcached_init(ptr, shared) == false)
   {
     memcached_free(ptr);
     return NULL;
@@ -278,6 +386,16 @@ memcached_st *memcached_create(memcached_st *ptr)
   return ptr;
 }
 
+memcached_st *memcached_create(memcached_st *ptr)
+{
+  return _memcached_create(ptr, true);
+}
+
+memcached_st *sched_handle_create(void)
+{
+  return _memcached_create(NULL, false);
+}
+
 memcached_st *memcached(const char *string, size_t length)
 {
   if (length == 0 and string)
@@ -410,6 +528,10 @@ memcached_st *memcached_clone(memcached_st *clone, const memcached_st *source)
   new_clone->retry_timeout= source->retry_timeout;
   new_clone->dead_timeout= source->dead_timeout;
   new_clone->distribution= source->distribution;
+  if (source->bounded)
+  {
+    (void)memcached_sched_set_bound(new_clone, source->bounded->epsilon);
+  }
 
   if (hashkit_clone(&new_clone->hashkit, &source->hashkit) == NULL)
   {
@@ -464,6 +586,7 @@ memcached_st *memcached_clone(memcached_st *clone, const memcached_st *source)
 
     return NULL;
   }
+  sched_bounded_clone(new_clone, source);
 
   if (source->on_clone)
   {
@@ -511,6 +634,12 @@ org::libmemcached::Instance* memcached_instance_fetch(memcached_st *ptr, uint32_
   return &ptr->servers[server_key];
 }
 
+// the inverse of memcached_instance_fetch()
+uint32_t memcached_instance_position(const org::libmemcached::Instance* instance)
+{
+  return uint32_t(instance - instance->root->servers);
+}
+
 memcached_server_instance_st memcached_server_instance_by_position(const memcached_st *ptr, uint32_t server_key)
 {
   if (ptr == NULL)
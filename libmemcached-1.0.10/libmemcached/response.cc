@@ -199,6 +199,12 @@ static memcached_return_t textual_value_fetch(org::libmemcached::Instance* insta
     hashkit_string_free(destination);
   }
 
+  if (memcached_success(rc))
+  {
+    memcached_sched_reply(instance, result->item_key, result->key_length,
+                          true, result->key_length + memcached_result_length(result));
+  }
+
   return rc;
 
 read_error:
@@ -560,6 +566,8 @@ static memcached_return_t binary_read_one_response(org::libmemcached::Instance*
         }
 
         memcached_string_set_length(&result->value, bodylen);
+
+        memcached_sched_reply(instance, result->item_key, result->key_length, true, keylen + bodylen);
       }
       break;
 
@@ -0,0 +1,645 @@
+/*
+ * sched.cc
+ *
+ * Versioned dynamic continuum. dispatch_host() reads the current ring
+ * without locking; writers (update_dynamic(), mem_hs_sched_dynamic()) build
+ * a new ring under dynamic->lock, publish it with a pointer swap and retire
+ * the old one. A retired ring is freed once every reader that could have
+ * picked it up has left its lookup (epoch-based reclamation).
+ */
+
+#include <libmemcached/common.h>
+
+#include <cmath>
+
+struct sched_ring *sched_ring_create(uint32_t points)
+{
+  struct sched_ring *ring= libmemcached_xcalloc(NULL, 1, struct sched_ring);
+  if (ring == NULL)
+  {
+    return NULL;
+  }
+
+  size_t length= sizeof(uint32_t) * (points ? points : 1);
+  void *mem;
+  if (posix_memalign(&mem, SCHED_CACHELINE, length))
+  {
+    libmemcached_free(NULL, ring);
+    return NULL;
+  }
+  memset(mem, 0, length);
+  ring->values= (uint32_t *)mem;
+  ring->continuum_points_counter= points;
+
+  ring->indices= libmemcached_xcalloc(NULL, points ? points : 1, uint32_t);
+  ring->stats= libmemcached_xcalloc(NULL, points ? points : 1, struct sched_context);
+  ring->search= continuum_search_create(points);
+  if (ring->indices == NULL or ring->stats == NULL or ring->search == NULL)
+  {
+    sched_ring_free(ring);
+    return NULL;
+  }
+
+  return ring;
+}
+
+struct sched_ring *sched_ring_clone(const struct sched_ring *ring)
+{
+  struct sched_ring *clone= sched_ring_create(ring->continuum_points_counter);
+  if (clone == NULL)
+  {
+    return NULL;
+  }
+
+  memcpy(clone->values, ring->values, sizeof(uint32_t) * ring->continuum_points_counter);
+  memcpy(clone->indices, ring->indices, sizeof(uint32_t) * ring->continuum_points_counter);
+  memcpy(clone->stats, ring->stats, sizeof(struct sched_context) * ring->continuum_points_counter);
+  continuum_search_copy(clone->search, ring->search, clone->values);
+  clone->layout= ring->layout;
+
+  if (ring->owners)
+  {
+    clone->owners= libmemcached_xcalloc(NULL, ring->continuum_points_counter, uint32_t);
+    if (clone->owners == NULL)
+    {
+      sched_ring_free(clone);
+      return NULL;
+    }
+    memcpy(clone->owners, ring->owners, sizeof(uint32_t) * ring->continuum_points_counter);
+  }
+
+  return clone;
+}
+
+void sched_ring_free(struct sched_ring *ring)
+{
+  if (ring)
+  {
+    free(ring->values); // posix_memalign()
+    libmemcached_free(NULL, ring->indices);
+    libmemcached_free(NULL, ring->owners);
+    libmemcached_free(NULL, ring->stats);
+    continuum_search_free(ring->search);
+    libmemcached_free(NULL, ring);
+  }
+}
+
+struct sched_sort_item {
+  uint32_t value;
+  uint32_t point;
+};
+
+static int sched_sort_item_cmp(const void *t1, const void *t2)
+{
+  const struct sched_sort_item *ct1= (const struct sched_sort_item *)t1;
+  const struct sched_sort_item *ct2= (const struct sched_sort_item *)t2;
+
+  if (ct1->value == ct2->value)
+  {
+    // keep the build order of equal points, qsort() is not stable
+    return (ct1->point > ct2->point) - (ct1->point < ct2->point);
+  }
+
+  return (ct1->value > ct2->value) ? 1 : -1;
+}
+
+bool sched_ring_sort(struct sched_ring *ring)
+{
+  uint32_t points= ring->continuum_points_counter;
+  if (points < 2)
+  {
+    return true;
+  }
+
+  struct sched_sort_item *order= libmemcached_xcalloc(NULL, points, struct sched_sort_item);
+  uint32_t *indices= libmemcached_xcalloc(NULL, points, uint32_t);
+  struct sched_context *stats= libmemcached_xcalloc(NULL, points, struct sched_context);
+  if (order == NULL or indices == NULL or stats == NULL)
+  {
+    libmemcached_free(NULL, order);
+    libmemcached_free(NULL, indices);
+    libmemcached_free(NULL, stats);
+    return false;
+  }
+
+  for (uint32_t x= 0; x < points; x++)
+  {
+    order[x].value= ring->values[x];
+    order[x].point= x;
+  }
+  qsort(order, points, sizeof(struct sched_sort_item), sched_sort_item_cmp);
+
+  memcpy(indices, ring->indices, sizeof(uint32_t) * points);
+  memcpy(stats, ring->stats, sizeof(struct sched_context) * points);
+  for (uint32_t x= 0; x < points; x++)
+  {
+    ring->values[x]= order[x].value;
+    ring->indices[x]= indices[order[x].point];
+    ring->stats[x]= stats[order[x].point];
+  }
+
+  if (ring->owners)
+  {
+    memcpy(indices, ring->owners, sizeof(uint32_t) * points);
+    for (uint32_t x= 0; x < points; x++)
+    {
+      ring->owners[x]= indices[order[x].point];
+    }
+  }
+
+  libmemcached_free(NULL, order);
+  libmemcached_free(NULL, indices);
+  libmemcached_free(NULL, stats);
+
+  return true;
+}
+
+void sched_ring_index(struct sched_ring *ring)
+{
+  // like ketama, dispatch_host() never searches the last point
+  continuum_search_build(ring->search, ring->values, 1, ring->continuum_points_counter ? ring->continuum_points_counter - 1 : 0);
+}
+
+static void sched_ring_retire(struct sched_dynamic *dynamic, struct sched_ring *ring)
+{
+  ring->retired_epoch= dynamic->epoch;
+  ring->next_retired= dynamic->retired;
+  dynamic->retired= ring;
+}
+
+void sched_ring_publish(struct sched_dynamic *dynamic, struct sched_ring *ring)
+{
+  struct sched_ring *old= dynamic->ring;
+
+  ring->version= ++dynamic->version;
+  (void)__sync_val_compare_and_swap(&dynamic->ring, old, ring);
+
+  if (old and dynamic->grace > 0)
+  {
+    sched_ring_keep(dynamic, old);
+  }
+  else if (old)
+  {
+    sched_ring_retire(dynamic, old);
+  }
+
+  // readers entering from now on can only see the new ring
+  (void)__sync_fetch_and_add(&dynamic->epoch, 1);
+
+  sched_ring_reclaim(dynamic, false);
+}
+
+/*
+  The kept rings are read like the current one, inside sched_reader_enter(),
+  so one taken off the list is retired the same way. A reader still on it
+  follows its next_kept to rings that are retired no sooner.
+*/
+void sched_ring_keep(struct sched_dynamic *dynamic, struct sched_ring *ring)
+{
+  ring->kept_until= time(NULL) + dynamic->grace;
+  ring->next_kept= dynamic->previous;
+  (void)__sync_val_compare_and_swap(&dynamic->previous, ring->next_kept, ring);
+
+  // past SCHED_KEPT_MAX the oldest goes before its time
+  sched_ring_expire(dynamic, false);
+}
+
+void sched_ring_expire(struct sched_dynamic *dynamic, bool all)
+{
+  time_t now= time(NULL);
+  uint32_t kept= 0;
+  bool retired= false;
+
+  struct sched_ring *volatile *prev= &dynamic->previous;
+  while (*prev)
+  {
+    struct sched_ring *ring= *prev;
+    if (all or now >= ring->kept_until or kept == SCHED_KEPT_MAX)
+    {
+      *prev= ring->next_kept;
+      sched_ring_retire(dynamic, ring);
+      retired= true;
+    }
+    else
+    {
+      kept++;
+      prev= &ring->next_kept;
+    }
+  }
+
+  if (retired)
+  {
+    (void)__sync_fetch_and_add(&dynamic->epoch, 1);
+    sched_ring_reclaim(dynamic, false);
+  }
+}
+
+/*
+  The kept rings are replaced whole by renumbered clones; the points of the
+  server that went have nobody to ask. Rings that cannot be cloned are
+  dropped with the older ones.
+*/
+void sched_ring_renumber_kept(struct sched_dynamic *dynamic, uint32_t removed)
+{
+  struct sched_ring *kept= NULL;
+  struct sched_ring *volatile *tail= &kept;
+
+  for (struct sched_ring *ring= dynamic->previous; ring; ring= ring->next_kept)
+  {
+    struct sched_ring *clone= sched_ring_clone(ring);
+    if (clone == NULL)
+    {
+      break;
+    }
+
+    for (uint32_t x= 0; x < clone->continuum_points_counter; x++)
+    {
+      if (clone->indices[x] == removed)
+      {
+        clone->indices[x]= UINT32_MAX;
+      }
+      else if (clone->indices[x] > removed and clone->indices[x] != UINT32_MAX)
+      {
+        clone->indices[x]--;
+      }
+    }
+    clone->kept_until= ring->kept_until;
+    *tail= clone;
+    tail= &clone->next_kept;
+  }
+
+  struct sched_ring *old= dynamic->previous;
+  (void)__sync_val_compare_and_swap(&dynamic->previous, old, kept);
+
+  for (struct sched_ring *ring= old; ring; ring= ring->next_kept)
+  {
+    sched_ring_retire(dynamic, ring);
+  }
+  (void)__sync_fetch_and_add(&dynamic->epoch, 1);
+  sched_ring_reclaim(dynamic, false);
+}
+
+void sched_ring_reclaim(struct sched_dynamic *dynamic, bool force)
+{
+  uint64_t oldest= dynamic->epoch;
+
+  if (force == false)
+  {
+    for (struct sched_reader *reader= dynamic->readers; reader; reader= reader->next)
+    {
+      uint64_t epoch= reader->epoch;
+      if (epoch != 0 and epoch < oldest)
+      {
+        oldest= epoch;
+      }
+    }
+  }
+
+  struct sched_ring **prev= &dynamic->retired;
+  while (*prev)
+  {
+    struct sched_ring *ring= *prev;
+    if (force or ring->retired_epoch < oldest)
+    {
+      *prev= ring->next_retired;
+      sched_ring_free(ring);
+    }
+    else
+    {
+      prev= &ring->next_retired;
+    }
+  }
+}
+
+struct sched_reader *sched_reader_register(struct sched_dynamic *dynamic)
+{
+  // records are never unlinked, so the reclaimer can walk the list at any time
+  for (struct sched_reader *reader= dynamic->readers; reader; reader= reader->next)
+  {
+    if (__sync_bool_compare_and_swap(&reader->in_use, 0, 1))
+    {
+      reader->route= SCHED_ROUTE_NONE;
+      return reader;
+    }
+  }
+
+  void *mem;
+  if (posix_memalign(&mem, SCHED_CACHELINE, sizeof(struct sched_reader)))
+  {
+    return NULL;
+  }
+
+  struct sched_reader *reader= (struct sched_reader *)mem;
+  memset(reader, 0, sizeof(struct sched_reader));
+  reader->route= SCHED_ROUTE_NONE;
+  reader->in_use= 1;
+
+  do {
+    reader->next= dynamic->readers;
+  } while (__sync_bool_compare_and_swap(&dynamic->readers, reader->next, reader) == false);
+
+  return reader;
+}
+
+void sched_reader_unregister(struct sched_reader *reader)
+{
+  if (reader)
+  {
+    reader->epoch= 0;
+    __sync_lock_release(&reader->in_use);
+  }
+}
+
+static void sched_counters_free(struct sched_counters *counters)
+{
+  while (counters)
+  {
+    struct sched_counters *next= counters->next_retired;
+    libmemcached_free(NULL, counters->counter);
+    libmemcached_free(NULL, counters->seen);
+    libmemcached_free(NULL, counters);
+    counters= next;
+  }
+}
+
+void sched_reader_free(struct sched_reader *reader)
+{
+  if (reader)
+  {
+    sched_counters_free(reader->counters);
+    sched_counters_free(reader->retired);
+    sched_counters_free(reader->ketama);
+    sched_counters_free(reader->ketama_retired);
+    libmemcached_free(NULL, reader);
+  }
+}
+
+static struct sched_counters *sched_counters_create(uint32_t points)
+{
+  struct sched_counters *counters= libmemcached_xcalloc(NULL, 1, struct sched_counters);
+  if (counters == NULL)
+  {
+    return NULL;
+  }
+
+  // whole cache lines, so the owner's slots never share a line with anyone else
+  size_t length= sizeof(struct sched_counter) * points;
+  length= (length + SCHED_CACHELINE - 1) & ~(size_t)(SCHED_CACHELINE - 1);
+
+  void *mem= NULL;
+  if (posix_memalign(&mem, SCHED_CACHELINE, length ? length : SCHED_CACHELINE))
+  {
+    libmemcached_free(NULL, counters);
+    return NULL;
+  }
+  memset(mem, 0, length);
+
+  counters->counter= (struct sched_counter *)mem;
+  counters->seen= libmemcached_xcalloc(NULL, points ? points : 1, struct sched_counter);
+  if (counters->seen == NULL)
+  {
+    sched_counters_free(counters);
+    return NULL;
+  }
+  counters->points= points;
+
+  return counters;
+}
+
+static void sched_counters_retire(struct sched_counters *volatile *retired, struct sched_counters *old)
+{
+  do {
+    old->next_retired= *retired;
+  } while (__sync_bool_compare_and_swap(retired, old->next_retired, old) == false);
+}
+
+struct sched_counters *sched_counters_renew(struct sched_reader *reader, const struct sched_ring *ring)
+{
+  struct sched_counters *counters= sched_counters_create(ring->continuum_points_counter);
+  if (counters == NULL)
+  {
+    return NULL;
+  }
+  counters->layout= ring->layout;
+
+  // the scheduler may still be reading the old shard; it frees it on its next merge
+  struct sched_counters *old= reader->counters;
+  reader->counters= counters;
+  if (old)
+  {
+    sched_counters_retire(&reader->retired, old);
+  }
+
+  return counters;
+}
+
+struct sched_counters *sched_counters_grow(struct sched_reader *reader, uint32_t servers)
+{
+  struct sched_counters *counters= sched_counters_create(servers);
+  if (counters == NULL)
+  {
+    return NULL;
+  }
+
+  // the servers keep their numbers, the old shard is merged once more before it is freed
+  struct sched_counters *old= reader->ketama;
+  reader->ketama= counters;
+  if (old)
+  {
+    sched_counters_retire(&reader->ketama_retired, old);
+  }
+
+  return counters;
+}
+
+void sched_counters_merge(struct sched_dynamic *dynamic, struct sched_ring *ring)
+{
+  for (struct sched_reader *reader= dynamic->readers; reader; reader= reader->next)
+  {
+    sched_counters_free(__sync_lock_test_and_set(&reader->retired, NULL));
+
+    struct sched_counters *counters= reader->counters;
+    if (counters == NULL or counters->layout != ring->layout)
+    {
+      continue;
+    }
+
+    volatile struct sched_counter *counter= counters->counter;
+    for (uint32_t x= 0; x < counters->points; x++)
+    {
+      uint32_t get= counter[x].get;
+      uint32_t set= counter[x].set;
+      uint32_t hit= counter[x].hit;
+      uint32_t bytes= counter[x].bytes;
+      uint32_t usec= counter[x].usec;
+
+      ring->stats[x].get+= get - counters->seen[x].get;
+      ring->stats[x].set+= set - counters->seen[x].set;
+      ring->stats[x].hit+= hit - counters->seen[x].hit;
+      ring->stats[x].bytes+= bytes - counters->seen[x].bytes;
+      ring->stats[x].usec+= usec - counters->seen[x].usec;
+      counters->seen[x].get= get;
+      counters->seen[x].set= set;
+      counters->seen[x].hit= hit;
+      counters->seen[x].bytes= bytes;
+      counters->seen[x].usec= usec;
+    }
+  }
+}
+
+static void sched_counters_fold(struct sched_counters *counters, struct sched_context *servers, uint32_t count)
+{
+  volatile struct sched_counter *counter= counters->counter;
+  for (uint32_t x= 0; x < counters->points and x < count; x++)
+  {
+    uint32_t get= counter[x].get;
+    uint32_t set= counter[x].set;
+    uint32_t hit= counter[x].hit;
+
+    servers[x].get+= get - counters->seen[x].get;
+    servers[x].set+= set - counters->seen[x].set;
+    servers[x].hit+= hit - counters->seen[x].hit;
+    counters->seen[x].get= get;
+    counters->seen[x].set= set;
+    counters->seen[x].hit= hit;
+  }
+}
+
+void sched_counters_merge_ketama(struct sched_dynamic *dynamic, struct ketama_stat *ketama_stat)
+{
+  for (struct sched_reader *reader= dynamic->readers; reader; reader= reader->next)
+  {
+    // the owner no longer counts in an outgrown shard, what is left in it is final
+    struct sched_counters *retired= __sync_lock_test_and_set(&reader->ketama_retired, NULL);
+    for (struct sched_counters *counters= retired; counters; counters= counters->next_retired)
+    {
+      sched_counters_fold(counters, ketama_stat->servers, ketama_stat->continuum_count);
+    }
+    sched_counters_free(retired);
+
+    if (reader->ketama)
+    {
+      sched_counters_fold(reader->ketama, ketama_stat->servers, ketama_stat->continuum_count);
+    }
+  }
+}
+
+void sched_stats_decay(struct sched_dynamic *dynamic, struct sched_ring *ring)
+{
+  // the weight of one tick's counts after another tick
+  double keep= dynamic->half_life > 0 ? pow(0.5, 1.0 / dynamic->half_life) : 1.0;
+  double max= 0;
+  double max_bytes= 0;
+  double max_usec= 0;
+
+  // the load of a point counts per unit of capacity of its owner
+  for (uint32_t x= 0; x < ring->continuum_points_counter; x++)
+  {
+    uint32_t owner= ring->indices[x];
+    ring->stats[x].capacity= owner < dynamic->continuum_count ? dynamic->servers[owner].capacity : 1;
+  }
+
+  for (uint32_t x= 0; x < ring->continuum_points_counter; x++)
+  {
+    struct sched_context *sched= &ring->stats[x];
+
+    sched->rget= sched->rget * keep + sched->get;
+    sched->rset= sched->rset * keep + sched->set;
+    sched->rhit= sched->rhit * keep + sched->hit;
+    sched->rbytes= sched->rbytes * keep + sched->bytes;
+    sched->rusec= sched->rusec * keep + sched->usec;
+    sched->sum= sched->get + sched->set; // this tick's alone, what the controller compares against its steps
+    sched->get= 0;
+    sched->set= 0;
+    sched->hit= 0;
+    sched->bytes= 0;
+    sched->usec= 0;
+
+    if (sched->rget > 0)
+    {
+      sched->hitrate= get_hitrate(sched->rget, sched->rhit);
+      sched->nhitrate= sched->hitrate;
+    }
+
+    if ((sched->rget + sched->rset) / sched->capacity > max)
+    {
+      max= (sched->rget + sched->rset) / sched->capacity;
+    }
+    if (sched->rbytes / sched->capacity > max_bytes)
+    {
+      max_bytes= sched->rbytes / sched->capacity;
+    }
+    if (sched->rusec > max_usec)
+    {
+      max_usec= sched->rusec;
+    }
+  }
+
+  for (uint32_t x= 0; x < ring->continuum_points_counter; x++)
+  {
+    struct sched_context *sched= &ring->stats[x];
+    sched->usagerate= max ? (sched->rget + sched->rset) / sched->capacity / max : 0;
+    sched->byterate= max_bytes ? sched->rbytes / sched->capacity / max_bytes : 0;
+    sched->latencyrate= max_usec ? sched->rusec / max_usec : 0;
+  }
+}
+
+static uint64_t sched_feedback_delta(uint64_t now, uint64_t before)
+{
+  // a restarted server counts from 0 again
+  return now >= before ? now - before : now;
+}
+
+void sched_servers_feedback(struct sched_dynamic *dynamic, const struct sched_feedback *feedback, uint32_t count)
+{
+  double max= 0;
+
+  for (uint32_t x= 0; x < count and x < dynamic->continuum_count; x++)
+  {
+    struct sched_context *host= dynamic->servers + x;
+    const struct sched_feedback *report= feedback + x;
+
+    if (report->reported == false)
+    {
+      continue;
+    }
+
+    // the first report only sets the baseline, whatever was evicted before is history;
+    // items evicted before anyone read them count twice: the server is thrashing
+    uint64_t evicted= 0;
+    if (host->feedback++)
+    {
+      evicted= sched_feedback_delta(report->evictions, host->evictions) +
+               sched_feedback_delta(report->evicted_unfetched, host->evicted_unfetched);
+    }
+    host->evictions= report->evictions;
+    host->evicted_unfetched= report->evicted_unfetched;
+
+    host->fill= report->limit_maxbytes ? (double)report->bytes / (double)report->limit_maxbytes : 0;
+    host->pressure= evicted ? (double)evicted / (double)(report->curr_items + evicted) : 0;
+
+    // a server close to full is about to evict, whether it has yet or not
+    if (host->fill > SCHED_FILL_HIGH)
+    {
+      double fill= host->fill < 1 ? host->fill : 1;
+      double filling= SCHED_FILL_PRESSURE * (fill - SCHED_FILL_HIGH) / (1 - SCHED_FILL_HIGH);
+      if (filling > host->pressure)
+      {
+        host->pressure= filling;
+      }
+    }
+  }
+
+  for (uint32_t x= 0; x < dynamic->continuum_count; x++)
+  {
+    if (dynamic->servers[x].pressure > max)
+    {
+      max= dynamic->servers[x].pressure;
+    }
+  }
+
+  for (uint32_t x= 0; x < dynamic->continuum_count; x++)
+  {
+    dynamic->servers[x].pressurerate= max ? dynamic->servers[x].pressure / max : 0;
+  }
+}
@@ -1,57 +1,780 @@
 /*
- * sched.h 
+ * sched.h
  * jinho added
  */
 
 #pragma once
 
+#include <pthread.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+/*
+ * The ketama statistics of every handle. Lookups count in the ketama shard
+ * of their handle's sched_reader; only update_ketama_stat() and
+ * mem_hs_sched_ketama(), which folds the shards into servers[], take lock.
+ */
 struct ketama_stat {
     uint32_t ref;
     bool initialized_;
+    pthread_mutex_t lock; // servers and continuum
     uint32_t continuum_count; // server counts
-    uint32_t max; // max usage
-    uint32_t maxid; // max usage index
     struct sched_context *servers;
 
     // for statistics
-    // Ketama: one of reference from one of downstream
+    // Ketama: a copy of the continuum last built by any handle
     uint32_t continuum_points_counter; // Ketama
     struct memcached_continuum_item_st *continuum;
 };
 
+/*
+ * One version of the dynamic continuum. Once published through
+ * sched_dynamic->ring the boundaries and owners never change; the writer
+ * builds a new ring and swaps the pointer instead.
+ *
+ * Point x is values[x] (its upper boundary), indices[x] (its server) and
+ * stats[x]. The lookup only touches search and one indices[] slot, so the
+ * scheduling statistics live in their own array.
+ *
+ * While a server is auto-ejected its points stay where they are and only
+ * indices[] sends them to the next live server clockwise; owners[] keeps
+ * who they belong to, so the server gets the same segments back.
+ */
+struct sched_ring {
+    uint64_t version;
+    uint64_t layout; // changes only when points are added or removed
+    uint32_t continuum_points_counter; // total
+    uint32_t *values;  // sorted, cache line aligned
+    uint32_t *indices;
+    uint32_t *owners; // learned owners while points of ejected servers are detoured, else NULL
+    struct sched_context *stats; // scheduler side only
+    struct memcached_continuum_search_st *search; // lookup structure over values[]
+
+    // reclamation: freed once no reader can still see it
+    uint64_t retired_epoch;
+    struct sched_ring *next_retired;
+
+    // hand-off: the next older kept ring, and until when this one is asked, see sched_ring_keep()
+    struct sched_ring *volatile next_kept;
+    time_t kept_until;
+};
+
+#define SCHED_CACHELINE 64
+
+/* one counter slot per continuum point */
+struct sched_counter {
+    uint32_t get;
+    uint32_t set;
+    uint32_t hit;
+    uint32_t bytes;
+    uint32_t usec;
+};
+
+/*
+ * Request counters of one memcached_st for one ring layout, indexed by point
+ * position. Only the owning handle increments counter[]; the scheduler folds
+ * the difference to seen[] into the ring stats, so nothing is ever reset
+ * under the owner's feet.
+ */
+struct sched_counters {
+    uint64_t layout;
+    uint32_t points;
+    struct sched_counter *counter; // owner side
+    struct sched_counter *seen;    // scheduler side
+    struct sched_counters *next_retired;
+};
+
+/*
+ * Epoch record and counter shards of one memcached_st. epoch is 0 while the
+ * handle is not inside a lookup, otherwise the global epoch it observed on
+ * entry. Records are cache line aligned so handles never share a line.
+ * counters is by point of the dynamic ring, ketama by server of the
+ * handle's own ketama continuum.
+ */
+struct sched_reader {
+    volatile uint64_t epoch;
+    struct sched_counters *counters;
+    struct sched_counters *ketama;
+    uint32_t sampled; // hits since the last hot key sample
+    uint32_t routed;  // keys routed since the last heavy hitter sample
+    uint32_t route;        // point dispatch_host() routed the last key to, see memcached_sched_sent()
+    uint64_t route_layout; // layout of the ring it was routed on
+    struct sched_counters *volatile retired; // superseded layouts, freed by the scheduler
+    struct sched_counters *volatile ketama_retired; // outgrown, merged and freed by mem_hs_sched_ketama()
+    volatile uint32_t in_use;
+    struct sched_reader *next;
+} __attribute__((aligned(SCHED_CACHELINE)));
+
+/* routes that are not a point: sent without routing its key, so nothing is
+ * attributed, or several points in flight at once, found again by key */
+#define SCHED_ROUTE_NONE UINT32_MAX
+#define SCHED_ROUTE_KEY  (UINT32_MAX - 1)
+
+/*
+ * One boundary move: values[point] grows towards values[peer] (cw) or
+ * shrinks towards it, by amount. Moves are computed against the published
+ * ring and applied to its clone.
+ */
+struct sched_move {
+    uint32_t point;
+    uint32_t peer;
+    uint32_t amount;
+    bool cw;
+};
+
+/*
+ * A scheduling policy. mem_hs_sched_dynamic() merges the request counters
+ * and derives per server get/set/hitrate/usagerate/byterate/latencyrate,
+ * then:
+ *
+ *   cost   scores one server (or point) from those statistics
+ *   pick   fills moves[] (at most max_moves) from the published ring and
+ *          returns how many it wants; 0 means the ring stays as it is
+ *   apply  carries the moves out on next, a clone of ring, keeping
+ *          next->search in step
+ *
+ * If pick returned anything the clone is published, even when apply turned
+ * every move down. The statistics are decayed counts (sched_stats_decay()),
+ * so they carry over to the new ring; only without a half-life do they
+ * start over after a move.
+ */
+struct sched_dynamic;
+
+struct sched_policy {
+    const char *name;
+    double (*cost)(const struct sched_dynamic *dynamic, const struct sched_context *stat);
+    uint32_t (*pick)(const struct sched_dynamic *dynamic, const struct sched_ring *ring,
+                     struct sched_move *moves, uint32_t max_moves);
+    void (*apply)(const struct sched_dynamic *dynamic, const struct sched_ring *ring, struct sched_ring *next,
+                  const struct sched_move *moves, uint32_t nmoves);
+};
+
+/*
+ * Warm migration. Hits are sampled into a direct mapped table of hot keys;
+ * when a published move hands the hash of a recently hot key to another
+ * server, the key is queued, and memcached_sched_migrate() later copies it
+ * from the old owner to the new one, unless the key was written through a
+ * handle since it was queued. A later hit on the new owner counts as a miss
+ * avoided.
+ */
+#define SCHED_HOTKEY_SAMPLE 16 // one in this many hits of a handle is sampled
+#define SCHED_HOTKEY_TICKS  8  // a key sampled within this many ticks is still hot
+#define SCHED_HOTKEY_MAX    (1U << 20) // keys a hot key or heavy hitter table is asked to hold, at most
+
+struct sched_hotkey {
+    uint32_t hash;
+    volatile uint32_t migrated; // server + 1 the key was copied to, 0 if none
+    uint64_t seen;              // tick of the last sample
+    uint8_t length;             // 0: empty
+    char key[MEMCACHED_MAX_KEY];
+};
+
+struct sched_migration {
+    uint32_t hash;
+    uint32_t from;
+    uint32_t to;
+    uint32_t written; // sched_migrator.written of the key's slot when it was queued
+    uint8_t length;
+    char key[MEMCACHED_MAX_KEY];
+};
+
+struct sched_migrator {
+    pthread_mutex_t lock; // never held across I/O, only tried on the hit path
+    volatile bool enabled;
+    uint32_t mask;        // hot keys - 1, also the queue size - 1
+    struct sched_hotkey *hot;
+    struct sched_migration *queue;
+    volatile uint32_t *written; // writes of the keys whose hash & mask is the slot
+    uint32_t head;
+    volatile uint32_t count;
+    time_t ttl;           // expiration of the copies
+    uint64_t migrated;
+    uint64_t avoided;
+    uint64_t dropped;     // queued moves lost to a full queue
+};
+
+/*
+ * Heavy hitters: Space-Saving over one in sample keys a handle routes
+ * through memcached_generate_hash_with_redistribution(). The monitored keys
+ * form a min-heap on count, found by hash through an open addressing index;
+ * an unmonitored key takes the place of the minimum and inherits its count
+ * as error. Every scheduler tick fades the counts by the half-life.
+ */
+struct sched_hitter {
+    double count;
+    double error;
+    uint32_t hash;
+    uint32_t slot; // its entry in the index
+    uint8_t length;
+    char key[MEMCACHED_MAX_KEY];
+};
+
+struct sched_hitters {
+    pthread_mutex_t lock; // only tried on the routing path
+    volatile bool enabled;
+    uint32_t sample;
+    uint32_t capacity;
+    uint32_t used;
+    struct sched_hitter *heap; // heap[0] counts least
+    uint32_t *index;           // heap position + 1 by hash, 0: free
+    uint32_t mask;             // index size - 1
+    double total;              // everything counted, faded like the counts
+};
+
+/*
+ * Adaptive replication of the heavy hitters. A key with at least share of
+ * everything counted is hot: its sets also go to the next replicas - 1
+ * distinct servers clockwise from its owner, and a get goes to any of
+ * them, falling back to the owner and filling the copy on a miss. A key
+ * that cooled down has its writes replicated, but not its reads, for ttl
+ * more seconds, until the copies it left behind have expired.
+ *
+ * slots[] is direct mapped by hash, hash << 32 | state, and read without a
+ * lock; the scheduler tick writes it, and a write that failed to refresh
+ * or drop a copy turns its slot cooling and stale: gets go to the owner
+ * alone, and the key is not found hot again before ttl, by when the copy
+ * it may have left behind expired. Until then a copy can be stale.
+ *
+ * holders[] keeps, by slot, the servers copies were written to, so writes
+ * still reach them after the ring moved them off the successors.
+ */
+#define SCHED_REPLICA_HOT     1
+#define SCHED_REPLICA_COOLING 2
+#define SCHED_REPLICA_STALE   4
+#define SCHED_REPLICA_MAX     8 // servers a hot key can be on, its owner included
+#define SCHED_REPLICA_HOLDERS (2 * (SCHED_REPLICA_MAX - 1)) // servers a slot remembers copies on
+
+struct sched_replication {
+    volatile uint64_t *slots;
+    volatile uint32_t *holders; // SCHED_REPLICA_HOLDERS per slot: server + 1, 0 if none
+    time_t *until;    // end of the cooling
+    uint64_t *marked; // tick a slot was last found hot
+    uint32_t mask;
+    volatile uint32_t replicas;
+    volatile uint32_t widest; // most replicas ever set
+    double share;
+    time_t ttl;       // expiration of the copies
+    volatile uint32_t hot;
+    volatile uint64_t spread; // gets answered by a copy
+    volatile uint64_t filled; // copies written after a miss
+};
+
+/*
+ * Near cache: the values memcached_get() returned, kept in the process for
+ * ttl so the next get of the key needs no round trip. Keys are hashed into
+ * SCHED_NEAR_SHARDS shards, each with a lock, chained buckets, and a CLOCK
+ * ring: the hand passes over entries read since it last came by, clearing
+ * the mark, and evicts the first one it finds unread. A drop bumps the
+ * shard's generation; a get stores what the servers answered only if the
+ * generation is still the one its lookup saw, so a value read before a
+ * write cannot come back after the write dropped it.
+ *
+ * Like the ring, the cache describes one cluster: only handles with the
+ * dynamic distribution read and store it. Any handle's writes drop keys.
+ */
+#define SCHED_NEAR_SHARDS 16
+
+struct sched_near_entry {
+    struct sched_near_entry *chain;      // next in the bucket
+    struct sched_near_entry *prev, *next; // clock ring
+    uint64_t expires; // usec
+    uint32_t hash;
+    uint32_t flags;
+    size_t key_length;   // namespace included
+    size_t value_length;
+    bool referenced;
+    char data[1];        // key, then value and a NUL
+};
+
+struct sched_near_shard {
+    pthread_mutex_t lock;
+    struct sched_near_entry **buckets;
+    struct sched_near_entry *hand; // next to look at, NULL when empty
+    size_t bytes;
+    uint64_t generation; // drops so far
+};
+
+struct sched_near {
+    struct sched_near_shard shards[SCHED_NEAR_SHARDS];
+    uint32_t mask;              // buckets per shard - 1
+    volatile size_t capacity;   // bytes per shard, 0: off
+    volatile uint64_t ttl;      // usec
+    volatile uint64_t hits;
+    volatile uint64_t misses;
+};
+
+/*
+ * Consistent hashing with bounded loads, one per handle: a key whose server
+ * has taken ceil((1 + epsilon) * (total + 1) / live) of the requests counted
+ * goes to the first server clockwise from its ketama point that has not, so
+ * one always has room. Where it went is kept in placed[], and every request
+ * for the key, a write as much as a get, goes there after it, so no value is
+ * left behind on another server. A key that finds its probe run of placed[]
+ * taken stays on its own server. The counts are halved every
+ * SCHED_BOUNDED_WINDOW requests; placed[] is only emptied when the continuum
+ * is rebuilt. Handles bounded each on their own bound their sum alike.
+ */
+#define SCHED_BOUNDED_WINDOW 1024
+#define SCHED_BOUNDED_KEYS   16384 // keys placed away from their own server, at most
+#define SCHED_BOUNDED_PROBE  4
+
+struct sched_bounded {
+    double epsilon;
+    uint32_t count;    // servers in load[]
+    uint32_t live;     // servers on the continuum
+    uint32_t routed;   // requests since the last halving
+    uint32_t total;    // sum of load[]
+    uint32_t *load;
+    uint64_t *placed;  // by hash: hash << 32 | server + 1, 0 is empty
+    uint64_t requests;
+    uint64_t overflowed; // requests that went to another server than their own
+};
+
+/*
+ * MEMCACHED_DISTRIBUTION_MAGLEV and MEMCACHED_DISTRIBUTION_JUMP, one per
+ * handle; either way a lookup is an index into entry[].
+ *
+ * Maglev: entry[] has a prime number of slots, filled in turns by the live
+ * servers, each taking the next free slot of its own permutation
+ * (offset + j * skip) % size, both from its name. A server takes a turn per
+ * weight / heaviest weight rounds. Table sizes start at SCHED_MAGLEV_SIZE
+ * and double while a server would get fewer than SCHED_MAGLEV_SLOTS.
+ *
+ * Jump: entry[] has weight buckets per server, in list order, at most
+ * SCHED_JUMP_BUCKETS in all; a key jumps to one. Growing the table only
+ * moves keys into the new buckets at its end, so a server added at the end
+ * of the list takes its share from the others and nothing else moves; one
+ * put anywhere else, as use_sort_hosts does, or a change of weight shifts
+ * the buckets behind it. A bucket of an ejected server carries
+ * SCHED_JUMP_DOWN and the key jumps again with a rehash, so only that
+ * server's keys move.
+ */
+#define SCHED_MAGLEV_SIZE 65537
+#define SCHED_MAGLEV_SLOTS 100
+#define SCHED_JUMP_RETRIES 8
+#define SCHED_JUMP_DOWN 0x80000000U
+#define SCHED_JUMP_BUCKETS (1U << 20)
+
+struct sched_table {
+    uint32_t size;     // slots or buckets in use
+    uint32_t capacity; // of entry[]
+    uint32_t *entry;   // server by slot or bucket
+};
+
+/* periodic snapshot of the continuum, see sched_snapshot.cc */
+struct sched_snapshot {
+    char *path;
+    uint32_t every;        // scheduler ticks between writes
+    char *servers;         // server section of the file, numbered as the ring
+    size_t servers_length;
+    uint32_t count;
+    uint64_t written;      // files written, and writes that failed
+    uint64_t failed;
+    int error;             // errno of the last failed write, 0 if none
+};
+
 // jinho added
 struct sched_dynamic {
     uint32_t ref;
-    // XXX lock should be added for this because this is shared
 
     bool initialized_;
     bool weighted_;
 
-    // Servers
+    // Servers (writer side only)
     uint32_t continuum_count; // # servers
     struct sched_context *servers;
 
-    // Sections
-    uint32_t continuum_points_counter; // total
-    struct memcached_continuum_item_st *continuum; // { u32 index, value }
+    // Sections: current ring, read lock-free by dispatch_host()
+    struct sched_ring *volatile ring;
+    uint64_t version;
+    uint64_t layout;
+
+    // epoch-based reclamation of retired rings
+    volatile uint64_t epoch;
+    struct sched_reader *volatile readers;
+    struct sched_ring *retired;
+
+    // serializes writers: update_dynamic(), mem_hs_sched_dynamic() and stats
+    pthread_mutex_t lock;
 
     // Supplements
-    time_t next_distribution_rebuild; // not used yet..
-    uint32_t max; // max usage
-    uint32_t maxid; // max usage index
+    time_t next_distribution_rebuild; // earliest retry of an ejected server
 
     // sched info from user
     double alpha;
     double beta;
+    const struct sched_policy *policy;
+    double load_ops; // weights of usagerate, byterate and latencyrate in the load
+    double load_bytes;
+    double load_latency;
+    double gamma; // weight of pressurerate in the cost
+    double half_life; // in scheduler ticks; 0: plain counts, reset after every move
 
     // delivering info
     int removing_idx;
+
+    uint64_t tick; // mem_hs_sched_dynamic() runs so far
+    struct sched_migrator *volatile migrator; // NULL until memcached_sched_set_migration()
+
+    // hand-off: the rings before the last changes, newest first, each asked on a miss until its kept_until
+    struct sched_ring *volatile previous;
+    time_t grace;       // seconds; 0 retires every ring at once
+    time_t handoff_ttl; // expiration of the values written back
+    volatile uint64_t handoff_tries;
+    volatile uint64_t handoff_hits;
+    // by hash, until when a miss is not handed off: a write could not drop the previous owners' copy
+    volatile time_t *handoff_skip; // SCHED_HANDOFF_SKIP slots, NULL until memcached_sched_set_handoff()
+
+    struct sched_snapshot *snapshot; // NULL until memcached_sched_set_snapshot()
+    struct sched_thread *thread; // NULL until memcached_sched_start()
+
+    // servers the thread asks for feedback, see memcached_sched_set_feedback()
+    uint32_t feedback_every; // ticks of the thread between polls; 0: never
+    memcached_server_list_st feedback_servers; // the servers of the ring, in its order; NULL if never
+    uint64_t feedback_layout; // bumped whenever feedback_servers is rebuilt
+    struct sched_hitters *volatile hitters; // NULL until memcached_sched_set_hot_keys()
+    struct sched_replication *volatile replication; // NULL until memcached_sched_set_replication()
+    struct sched_near *volatile near; // NULL until memcached_sched_set_near_cache()
+};
+
+/*
+ * Background scheduler, see memcached_sched_start(). A run is skipped until
+ * the ring has been asked SCHED_THREAD_SAMPLES times per point since the
+ * last tick. The wait halves after a tick that moved a boundary and doubles
+ * after one that did not, or a skip, within [min_interval, max_interval].
+ * dynamic->thread is set and cleared, and read by the stats, only under the
+ * lock of sched_thread.cc.
+ */
+#define SCHED_THREAD_SAMPLES 16
+
+struct sched_thread {
+    pthread_t thread;
+    struct sched_dynamic *dynamic;
+    memcached_st *poll;    // the thread's own handle on dynamic->feedback_servers, only it uses both
+    uint64_t poll_layout;  // the feedback_layout poll was built for
+    pthread_mutex_t lock; // guards stop, the wake-ups, interval and the counts
+    pthread_cond_t wake;
+    bool stop;
+    uint32_t min_interval; // milliseconds
+    uint32_t max_interval;
+    uint32_t interval;
+    uint64_t ticks;
+    uint64_t skipped;
+};
+
+/* sched.cc */
+struct sched_ring *sched_ring_create(uint32_t points);
+struct sched_ring *sched_ring_clone(const struct sched_ring *ring);
+void sched_ring_free(struct sched_ring *ring);
+
+/* orders the points by value, keeping indices[] and stats[] in step */
+bool sched_ring_sort(struct sched_ring *ring);
+
+/* (re)builds ring->search from values[]; clones inherit it */
+void sched_ring_index(struct sched_ring *ring);
+
+/*
+ * must hold dynamic->lock; the previous ring is retired, not freed, or with
+ * a grace period kept as dynamic->previous
+ */
+void sched_ring_publish(struct sched_dynamic *dynamic, struct sched_ring *ring);
+
+/*
+ * Rings kept for hand-off at most: moves can follow each other within one
+ * grace period, and each keeps the ring it replaced.
+ */
+#define SCHED_KEPT_MAX 4
+
+/*
+ * Keys whose hand-off is skipped, direct mapped by hash: two keys in one
+ * slot only cost the other a warm read, never a stale one.
+ */
+#define SCHED_HANDOFF_SKIP 1024
+
+/* must hold dynamic->lock; ring goes in front of dynamic->previous for dynamic->grace */
+void sched_ring_keep(struct sched_dynamic *dynamic, struct sched_ring *ring);
+
+/* must hold dynamic->lock; retires the kept rings whose grace period is over, or all of them */
+void sched_ring_expire(struct sched_dynamic *dynamic, bool all);
+
+/* must hold dynamic->lock; the kept rings number the servers as they are after server removed went */
+void sched_ring_renumber_kept(struct sched_dynamic *dynamic, uint32_t removed);
+void sched_ring_reclaim(struct sched_dynamic *dynamic, bool force);
+
+struct sched_reader *sched_reader_register(struct sched_dynamic *dynamic);
+void sched_reader_unregister(struct sched_reader *reader);
+void sched_reader_free(struct sched_reader *reader);
+
+/* owner side: start counting against a new ring layout */
+struct sched_counters *sched_counters_renew(struct sched_reader *reader, const struct sched_ring *ring);
+
+/* must hold dynamic->lock; folds every handle's new requests into ring */
+void sched_counters_merge(struct sched_dynamic *dynamic, struct sched_ring *ring);
+
+/* owner side: a ketama shard for at least servers servers, the counts so far kept for the merge */
+struct sched_counters *sched_counters_grow(struct sched_reader *reader, uint32_t servers);
+
+/* must hold ketama_stat->lock; folds every handle's new ketama requests into ketama_stat->servers */
+void sched_counters_merge_ketama(struct sched_dynamic *dynamic, struct ketama_stat *ketama_stat);
+
+/*
+ * must hold dynamic->lock; once per scheduler tick, folds the counts merged
+ * since the last tick into the decayed rget/rset/rhit/rbytes/rusec of every
+ * point and derives hitrate, usagerate, byterate and latencyrate from them;
+ * sum keeps the gets and sets of this tick alone
+ */
+void sched_stats_decay(struct sched_dynamic *dynamic, struct sched_ring *ring);
+
+/*
+ * A server that filled more than SCHED_FILL_HIGH of its limit_maxbytes is
+ * about to evict: it counts as evicting up to SCHED_FILL_PRESSURE of its
+ * items, reached when it is full, unless it really evicts more.
+ */
+#define SCHED_FILL_HIGH 0.9
+#define SCHED_FILL_PRESSURE 0.01
+
+/* milliseconds the scheduler thread waits for a server to connect or answer its stats */
+#define SCHED_FEEDBACK_TIMEOUT 100
+
+/* what one cache server reported about itself, see memcached_sched_feedback() */
+struct sched_feedback {
+    bool reported;
+    uint64_t evictions;
+    uint64_t evicted_unfetched;
+    uint64_t bytes;
+    uint64_t limit_maxbytes;
+    uint64_t curr_items;
 };
 
+/* must hold dynamic->lock; feedback[x] is about server x */
+void sched_servers_feedback(struct sched_dynamic *dynamic, const struct sched_feedback *feedback, uint32_t count);
+
+/* stats.cc; must hold dynamic->lock, the servers of ptr were renumbered (update_dynamic()) */
+void sched_feedback_renumber(struct sched_dynamic *dynamic, memcached_st *ptr);
+
+/*
+ * the scheduler thread, before its tick number ticks: every feedback_every
+ * ticks asks the servers of dynamic->feedback_servers for feedback through
+ * thread->poll, built anew whenever they change, and hands it to
+ * sched_servers_feedback(); call without dynamic->lock
+ */
+void sched_feedback_poll(struct sched_thread *thread, uint64_t ticks);
+
+/* sched_migrate.cc */
+void sched_migrator_free(struct sched_migrator *migrator);
+
+/* hit path: maybe samples key as hot, and counts a hit on a migrated copy */
+void sched_migrator_hit(struct sched_dynamic *dynamic, struct sched_reader *reader,
+                        uint32_t hash, uint32_t server, const char *key, size_t key_length);
+
+/* must hold dynamic->lock; queues the hot keys that change owner from ring to next */
+void sched_migrator_plan(struct sched_dynamic *dynamic, const struct sched_ring *ring, const struct sched_ring *next);
+
+/* write path: key, of hash, was written through a handle */
+void sched_migrator_written(struct sched_migrator *migrator, uint32_t hash);
+
+/* takes at most max queued migrations; done() marks one as copied */
+uint32_t sched_migrator_pop(struct sched_dynamic *dynamic, struct sched_migration *migrations, uint32_t max);
+void sched_migrator_done(struct sched_dynamic *dynamic, const struct sched_migration *migration);
+
+/* memcached_get() miss path: the value from the previous owner, or NULL */
+char *memcached_sched_handoff(memcached_st *ptr, const char *key, size_t key_length,
+                              size_t *value_length, uint32_t *flags, memcached_return_t *error);
+
+/* a write to key went to its owner: drop the previous owners' copy, or skip its hand-off */
+void memcached_sched_handoff_drop(memcached_st *ptr, const char *key, size_t key_length);
+
+/* sched_hitters.cc */
+void sched_hitters_free(struct sched_hitters *hitters);
+
+/* routing path: maybe samples key */
+void sched_hitters_route(struct sched_dynamic *dynamic, struct sched_reader *reader,
+                         uint32_t hash, const char *key, size_t key_length);
+
+/* must hold dynamic->lock; one scheduler tick went by */
+void sched_hitters_decay(struct sched_dynamic *dynamic);
+
+/* sched_replica.cc */
+void sched_replication_free(struct sched_replication *replication);
+
+/* must hold dynamic->lock; marks the keys hot or cooling after a tick */
+void sched_replication_update(struct sched_dynamic *dynamic);
+
+/* must hold dynamic->lock; the holders number the servers as they are after server removed went */
+void sched_replication_renumber(struct sched_dynamic *dynamic, uint32_t removed);
+
+/*
+ * memcached_get() path: the value from one of the copies of a hot key, or
+ * NULL. *missed is the server whose copy was missing, else UINT32_MAX;
+ * fill() writes the value the owner had there.
+ */
+char *memcached_sched_spread(memcached_st *ptr, const char *key, size_t key_length,
+                             size_t *value_length, uint32_t *flags, memcached_return_t *error, uint32_t *missed);
+void memcached_sched_fill(memcached_st *ptr, uint32_t server, const char *key, size_t key_length,
+                          const char *value, size_t value_length, uint32_t flags);
+
+/* a write to key went to its owner: set the copies too, or drop them (set false); a failure turns key stale */
+void memcached_sched_replicate(memcached_st *ptr, const char *key, size_t key_length,
+                               const char *value, size_t value_length,
+                               time_t expiration, uint32_t flags, bool set);
+
+/* sched_near.cc */
+void sched_near_free(struct sched_near *near);
+
+/*
+ * memcached_get() path: a copy of the value cached for key, allocated for
+ * ptr, or NULL, and the generation to hand store() for what the servers
+ * answer instead. drop() forgets key after a write to it, clear()
+ * everything after a flush.
+ */
+char *memcached_sched_near_get(memcached_st *ptr, const char *key, size_t key_length,
+                               size_t *value_length, uint32_t *flags, uint64_t *generation);
+void memcached_sched_near_store(memcached_st *ptr, const char *key, size_t key_length,
+                                const char *value, size_t value_length, uint32_t flags, uint64_t generation);
+void memcached_sched_near_drop(memcached_st *ptr, const char *key, size_t key_length);
+void memcached_sched_near_clear(memcached_st *ptr);
+
+/* sched_snapshot.cc */
+void sched_snapshot_free(struct sched_snapshot *snapshot);
+
+/* must hold dynamic->lock; the servers of ptr were renumbered (update_dynamic()) */
+void sched_snapshot_renumber(struct sched_dynamic *dynamic, memcached_st *ptr);
+
+/*
+ * must hold dynamic->lock; the file image (and a copy of its path) when this
+ * tick writes one, else NULL. flush() writes it without the lock, counts how
+ * that went under it and frees both.
+ */
+char *sched_snapshot_due(struct sched_dynamic *dynamic, char **path, size_t *length);
+void sched_snapshot_flush(struct sched_dynamic *dynamic, char *path, char *image, size_t length);
+
+/* sched_bounded.cc */
+void sched_bounded_free(struct sched_bounded *bounded);
+
+/* after the continuum was rebuilt: counts for the servers it has now, all 0, and no key placed */
+memcached_return_t sched_bounded_reset(memcached_st *ptr);
+
+/* after clone took the servers of source: the keys source placed away stay where their values are */
+void sched_bounded_clone(memcached_st *clone, const memcached_st *source);
+
+/* the server for a key of hash whose ketama point is point */
+uint32_t sched_bounded_route(memcached_st *ptr, uint32_t hash, uint32_t point);
+
+/* sched_table.cc */
+void sched_table_free(struct sched_table *table);
+
+/* the Maglev table or the jump buckets for the servers live now */
+memcached_return_t sched_table_build(memcached_st *ptr);
+
+/* the server for hash */
+uint32_t sched_maglev_route(const memcached_st *ptr, uint32_t hash);
+uint32_t sched_jump_route(const memcached_st *ptr, uint32_t hash);
+
+/* sched_thread.cc; call without dynamic->lock, waits for the thread to finish */
+void sched_thread_stop(struct sched_dynamic *dynamic);
+
+/* memcached.cc; a handle of the library's own, outside the state shared by every other one: modula routing only */
+memcached_st *sched_handle_create(void);
+
+/* hosts.cc */
+double abs_double(double val);
+uint32_t abs_int(int val);
+
+/* must hold dynamic->lock; detours the points of the servers of ptr in their retry delay, as update_dynamic() does */
+memcached_return_t sched_ring_detour_down(memcached_st *ptr, struct sched_ring *ring);
+
+/* one run of mem_hs_sched_dynamic(); true if it published a new ring */
+bool sched_dynamic_tick(struct sched_dynamic *dynamic);
+
+/* sched_policy.cc; NULL for an unknown policy */
+const struct sched_policy *sched_policy_get(memcached_sched_policy_t policy);
+
+static inline struct sched_ring *sched_reader_enter(struct sched_dynamic *dynamic, struct sched_reader *reader)
+{
+  reader->epoch= dynamic->epoch;
+  __sync_synchronize(); // epoch must be visible before we look at the ring
+  return dynamic->ring;
+}
+
+static inline struct sched_counters *sched_reader_counters(struct sched_reader *reader, const struct sched_ring *ring)
+{
+  struct sched_counters *counters= reader->counters;
+
+  if (counters == NULL || counters->layout != ring->layout)
+    counters= sched_counters_renew(reader, ring);
+
+  return counters;
+}
+
+static inline void sched_reader_count(struct sched_reader *reader, const struct sched_ring *ring, uint32_t point, uint32_t cmd)
+{
+  struct sched_counters *counters= sched_reader_counters(reader, ring);
+  if (counters == NULL)
+    return;
+
+  if (cmd == MEMCACHED_CMD_GET)
+    counters->counter[point].get++;
+  else if (cmd == MEMCACHED_CMD_SET)
+    counters->counter[point].set++;
+}
+
+/* ketama: the shard of the handle by server, servers being how many it has */
+static inline struct sched_counters *sched_reader_ketama(struct sched_reader *reader, uint32_t server, uint32_t servers)
+{
+  struct sched_counters *counters= reader->ketama;
+
+  if (counters == NULL || server >= counters->points)
+    counters= sched_counters_grow(reader, server < servers ? servers : server + 1);
+
+  return counters;
+}
+
+static inline void sched_reader_count_server(struct sched_reader *reader, uint32_t server, uint32_t servers, uint32_t cmd)
+{
+  struct sched_counters *counters= sched_reader_ketama(reader, server, servers);
+  if (counters == NULL)
+    return;
+
+  if (cmd == MEMCACHED_CMD_GET)
+    counters->counter[server].get++;
+  else if (cmd == MEMCACHED_CMD_SET)
+    counters->counter[server].set++;
+}
+
+static inline void sched_reader_hit_server(struct sched_reader *reader, uint32_t server, uint32_t servers)
+{
+  struct sched_counters *counters= sched_reader_ketama(reader, server, servers);
+  if (counters != NULL)
+    counters->counter[server].hit++;
+}
+
+/*
+ * response side: a request routed to point of layout was answered (or sent
+ * without a reply). Only the owner replaces its counters, so no epoch is
+ * needed; a reply to a layout routed away from is dropped. false if so.
+ */
+static inline bool sched_reader_reply(struct sched_reader *reader, uint64_t layout, uint32_t point,
+                                      bool hit, uint32_t bytes, uint32_t usec)
+{
+  struct sched_counters *counters= reader->counters;
+  if (counters == NULL || counters->layout != layout || point >= counters->points)
+    return false;
+
+  if (hit)
+    counters->counter[point].hit++;
+  counters->counter[point].bytes+= bytes;
+  counters->counter[point].usec+= usec;
+
+  return true;
+}
+
+static inline void sched_reader_exit(struct sched_reader *reader)
+{
+  __sync_lock_release(&reader->epoch);
+}
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,193 @@
+/*
+ * sched_bounded.cc
+ *
+ * MEMCACHED_DISTRIBUTION_CONSISTENT_BOUNDED, see struct sched_bounded.
+ * Where the dynamic distribution moves boundaries after the fact, this caps
+ * every server as each key is placed; only the keys that find their server
+ * full move, and only as far as the next server with room.
+ */
+
+#include <libmemcached/common.h>
+
+#include <cmath>
+
+void sched_bounded_free(struct sched_bounded *bounded)
+{
+  if (bounded)
+  {
+    libmemcached_free(NULL, bounded->load);
+    libmemcached_free(NULL, bounded->placed);
+    libmemcached_free(NULL, bounded);
+  }
+}
+
+static struct sched_bounded *sched_bounded_get(memcached_st *ptr)
+{
+  if (ptr->bounded == NULL and (ptr->bounded= libmemcached_xcalloc(NULL, 1, struct sched_bounded)))
+  {
+    ptr->bounded->epsilon= MEMCACHED_SCHED_BOUND;
+  }
+
+  return ptr->bounded;
+}
+
+memcached_return_t sched_bounded_reset(memcached_st *ptr)
+{
+  struct sched_bounded *bounded= sched_bounded_get(ptr);
+  if (bounded == NULL)
+  {
+    return memcached_set_error(*ptr, MEMCACHED_MEMORY_ALLOCATION_FAILURE, MEMCACHED_AT);
+  }
+
+  if (bounded->placed == NULL
+      and (bounded->placed= libmemcached_xcalloc(NULL, SCHED_BOUNDED_KEYS, uint64_t)) == NULL)
+  {
+    return memcached_set_error(*ptr, MEMCACHED_MEMORY_ALLOCATION_FAILURE, MEMCACHED_AT);
+  }
+  // the servers are numbered anew: a key placed away goes back to its own
+  memset(bounded->placed, 0, sizeof(uint64_t) * SCHED_BOUNDED_KEYS);
+
+  uint32_t count= memcached_server_count(ptr);
+  if (count > bounded->count)
+  {
+    uint32_t *load= libmemcached_xcalloc(NULL, count, uint32_t);
+    if (load == NULL)
+    {
+      return memcached_set_error(*ptr, MEMCACHED_MEMORY_ALLOCATION_FAILURE, MEMCACHED_AT);
+    }
+    libmemcached_free(NULL, bounded->load);
+    bounded->load= load;
+  }
+  bounded->count= count;
+  memset(bounded->load, 0, sizeof(uint32_t) * count);
+  bounded->routed= 0;
+  bounded->total= 0;
+
+  // the servers auto_eject left on the continuum share the load; load[] marks the ones seen
+  bounded->live= 0;
+  for (uint32_t x= 0; x < ptr->ketama.continuum_points_counter; x++)
+  {
+    uint32_t server= ptr->ketama.continuum[x].index;
+    if (server < count and bounded->load[server] == 0)
+    {
+      bounded->load[server]= 1;
+      bounded->live++;
+    }
+  }
+  memset(bounded->load, 0, sizeof(uint32_t) * count);
+
+  return MEMCACHED_SUCCESS;
+}
+
+void sched_bounded_clone(memcached_st *clone, const memcached_st *source)
+{
+  if (source->bounded and source->bounded->placed and clone->bounded and clone->bounded->placed
+      and clone->bounded->count == source->bounded->count)
+  {
+    memcpy(clone->bounded->placed, source->bounded->placed, sizeof(uint64_t) * SCHED_BOUNDED_KEYS);
+  }
+}
+
+/* the entry of hash in placed[], or the empty one it would take; NULL if its probe run is taken */
+static uint64_t *sched_bounded_entry(struct sched_bounded *bounded, uint32_t hash)
+{
+  // nothing is removed but all at once, so a key is never past an empty entry
+  for (uint32_t x= 0; x < SCHED_BOUNDED_PROBE; x++)
+  {
+    uint64_t *entry= &bounded->placed[(hash + x) & (SCHED_BOUNDED_KEYS - 1)];
+    if (*entry == 0 or uint32_t(*entry >> 32) == hash)
+    {
+      return entry;
+    }
+  }
+
+  return NULL;
+}
+
+uint32_t sched_bounded_route(memcached_st *ptr, uint32_t hash, uint32_t point)
+{
+  memcached_continuum_item_st *continuum= ptr->ketama.continuum;
+  struct sched_bounded *bounded= ptr->bounded;
+  uint32_t server= continuum[point].index;
+
+  if (bounded == NULL or bounded->placed == NULL or bounded->live < 2 or server >= bounded->count)
+  {
+    return server;
+  }
+
+  if (++bounded->routed > SCHED_BOUNDED_WINDOW)
+  {
+    bounded->routed= 0;
+    bounded->total= 0;
+    for (uint32_t x= 0; x < bounded->count; x++)
+    {
+      bounded->load[x]>>= 1;
+      bounded->total+= bounded->load[x];
+    }
+  }
+
+  // a key placed away stays there: its writes went there, and so must its reads
+  uint64_t *entry= sched_bounded_entry(bounded, hash);
+  if (entry and *entry)
+  {
+    server= uint32_t(*entry) - 1;
+  }
+  else if (entry)
+  {
+    uint32_t cap= (uint32_t)ceil((1 + bounded->epsilon) * (double)(bounded->total + 1) / (double)bounded->live);
+    uint32_t points= ptr->ketama.continuum_points_counter;
+    for (uint32_t step= 1; step < points and bounded->load[server] >= cap; step++)
+    {
+      server= continuum[(point + step) % points].index;
+    }
+    if (server != continuum[point].index)
+    {
+      *entry= uint64_t(hash) << 32 | (server + 1);
+    }
+  }
+
+  bounded->requests++;
+  if (server != continuum[point].index)
+  {
+    bounded->overflowed++;
+  }
+  bounded->load[server]++;
+  bounded->total++;
+
+  return server;
+}
+
+memcached_return_t memcached_sched_set_bound(memcached_st *ptr, double epsilon)
+{
+  if (ptr == NULL or epsilon <= 0)
+  {
+    return MEMCACHED_INVALID_ARGUMENTS;
+  }
+
+  if (sched_bounded_get(ptr) == NULL)
+  {
+    return MEMCACHED_MEMORY_ALLOCATION_FAILURE;
+  }
+  ptr->bounded->epsilon= epsilon;
+
+  return MEMCACHED_SUCCESS;
+}
+
+memcached_return_t memcached_sched_bound_stat(memcached_st *ptr, uint64_t *requests, uint64_t *overflowed)
+{
+  if (ptr == NULL)
+  {
+    return MEMCACHED_INVALID_ARGUMENTS;
+  }
+
+  if (requests)
+  {
+    *requests= ptr->bounded ? ptr->bounded->requests : 0;
+  }
+  if (overflowed)
+  {
+    *overflowed= ptr->bounded ? ptr->bounded->overflowed : 0;
+  }
+
+  return MEMCACHED_SUCCESS;
+}
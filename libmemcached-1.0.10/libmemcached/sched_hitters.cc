@@ -0,0 +1,382 @@
+/*
+ * sched_hitters.cc
+ *
+ * The most requested keys, see struct sched_hitters. Range scheduling
+ * cannot split the load of a single key; these are the keys worth handling
+ * one by one.
+ */
+
+#include <libmemcached/common.h>
+
+#include <algorithm>
+#include <cmath>
+
+/* a heap of keys and its index, twice as large; keys is at most SCHED_HOTKEY_MAX */
+static bool sched_hitters_alloc(uint32_t keys, struct sched_hitter **heap, uint32_t **index, uint32_t *mask)
+{
+  uint32_t size= 2;
+  while (size < keys * 2)
+  {
+    size<<= 1;
+  }
+
+  *heap= libmemcached_xcalloc(NULL, keys, struct sched_hitter);
+  *index= libmemcached_xcalloc(NULL, size, uint32_t);
+  if (*heap == NULL or *index == NULL)
+  {
+    libmemcached_free(NULL, *heap);
+    libmemcached_free(NULL, *index);
+    return false;
+  }
+  *mask= size - 1;
+
+  return true;
+}
+
+static struct sched_hitters *sched_hitters_create(uint32_t keys, uint32_t sample)
+{
+  struct sched_hitters *hitters= libmemcached_xcalloc(NULL, 1, struct sched_hitters);
+  if (hitters == NULL)
+  {
+    return NULL;
+  }
+
+  if (sched_hitters_alloc(keys, &hitters->heap, &hitters->index, &hitters->mask) == false)
+  {
+    libmemcached_free(NULL, hitters);
+    return NULL;
+  }
+
+  pthread_mutex_init(&hitters->lock, NULL);
+  hitters->capacity= keys;
+  hitters->sample= sample ? sample : 1;
+
+  return hitters;
+}
+
+void sched_hitters_free(struct sched_hitters *hitters)
+{
+  if (hitters)
+  {
+    pthread_mutex_destroy(&hitters->lock);
+    libmemcached_free(NULL, hitters->heap);
+    libmemcached_free(NULL, hitters->index);
+    libmemcached_free(NULL, hitters);
+  }
+}
+
+/* the index slot holding key, or the free slot where it would go */
+static uint32_t sched_hitters_find(const struct sched_hitters *hitters, uint32_t hash, const char *key, size_t key_length)
+{
+  uint32_t slot= hash & hitters->mask;
+
+  while (hitters->index[slot])
+  {
+    const struct sched_hitter *hitter= hitters->heap + hitters->index[slot] - 1;
+    if (hitter->hash == hash and hitter->length == key_length and memcmp(hitter->key, key, key_length) == 0)
+    {
+      break;
+    }
+    slot= (slot + 1) & hitters->mask;
+  }
+
+  return slot;
+}
+
+/* empties slot, moving later entries of the probe run back into the gap */
+static void sched_hitters_unindex(struct sched_hitters *hitters, uint32_t slot)
+{
+  uint32_t next= slot;
+
+  hitters->index[slot]= 0;
+  for (;;)
+  {
+    next= (next + 1) & hitters->mask;
+    if (hitters->index[next] == 0)
+    {
+      return;
+    }
+
+    // an entry whose home lies cyclically in (slot, next] is still reachable
+    uint32_t home= hitters->heap[hitters->index[next] - 1].hash & hitters->mask;
+    if (slot <= next ? (slot < home and home <= next) : (slot < home or home <= next))
+    {
+      continue;
+    }
+
+    hitters->index[slot]= hitters->index[next];
+    hitters->heap[hitters->index[slot] - 1].slot= slot;
+    hitters->index[next]= 0;
+    slot= next;
+  }
+}
+
+static void sched_hitters_swap(struct sched_hitters *hitters, uint32_t a, uint32_t b)
+{
+  struct sched_hitter hitter= hitters->heap[a];
+  hitters->heap[a]= hitters->heap[b];
+  hitters->heap[b]= hitter;
+  hitters->index[hitters->heap[a].slot]= a + 1;
+  hitters->index[hitters->heap[b].slot]= b + 1;
+}
+
+static void sched_hitters_up(struct sched_hitters *hitters, uint32_t x)
+{
+  while (x > 0 and hitters->heap[(x - 1) / 2].count > hitters->heap[x].count)
+  {
+    sched_hitters_swap(hitters, x, (x - 1) / 2);
+    x= (x - 1) / 2;
+  }
+}
+
+static void sched_hitters_down(struct sched_hitters *hitters, uint32_t x)
+{
+  for (;;)
+  {
+    uint32_t least= x;
+    uint32_t left= 2 * x + 1;
+    uint32_t right= left + 1;
+
+    if (left < hitters->used and hitters->heap[left].count < hitters->heap[least].count)
+    {
+      least= left;
+    }
+    if (right < hitters->used and hitters->heap[right].count < hitters->heap[least].count)
+    {
+      least= right;
+    }
+    if (least == x)
+    {
+      return;
+    }
+
+    sched_hitters_swap(hitters, x, least);
+    x= least;
+  }
+}
+
+/* must hold hitters->lock; one sample stands for sample requests */
+static void sched_hitters_observe(struct sched_hitters *hitters, uint32_t hash, const char *key, size_t key_length)
+{
+  uint32_t slot= sched_hitters_find(hitters, hash, key, key_length);
+
+  hitters->total+= hitters->sample;
+  if (hitters->index[slot])
+  {
+    uint32_t x= hitters->index[slot] - 1;
+    hitters->heap[x].count+= hitters->sample;
+    sched_hitters_down(hitters, x);
+    return;
+  }
+
+  uint32_t x;
+  double error= 0;
+  if (hitters->used < hitters->capacity)
+  {
+    x= hitters->used++;
+  }
+  else
+  {
+    // the key takes over the least counted one, and may have been it
+    x= 0;
+    error= hitters->heap[0].count;
+    sched_hitters_unindex(hitters, hitters->heap[0].slot);
+    slot= sched_hitters_find(hitters, hash, key, key_length);
+  }
+
+  struct sched_hitter *hitter= hitters->heap + x;
+  hitter->count= error + hitters->sample;
+  hitter->error= error;
+  hitter->hash= hash;
+  hitter->slot= slot;
+  hitter->length= (uint8_t)key_length;
+  memcpy(hitter->key, key, key_length);
+  hitters->index[slot]= x + 1;
+
+  if (error > 0)
+  {
+    sched_hitters_down(hitters, x);
+  }
+  else
+  {
+    sched_hitters_up(hitters, x);
+  }
+}
+
+void sched_hitters_route(struct sched_dynamic *dynamic, struct sched_reader *reader,
+                         uint32_t hash, const char *key, size_t key_length)
+{
+  struct sched_hitters *hitters= dynamic->hitters;
+  if (hitters == NULL or hitters->enabled == false or reader == NULL or
+      key_length == 0 or key_length >= MEMCACHED_MAX_KEY)
+  {
+    return;
+  }
+
+  if (++reader->routed < hitters->sample)
+  {
+    return;
+  }
+  reader->routed= 0;
+
+  if (pthread_mutex_trylock(&hitters->lock))
+  {
+    return;
+  }
+  sched_hitters_observe(hitters, hash, key, key_length);
+  (void)pthread_mutex_unlock(&hitters->lock);
+}
+
+void sched_hitters_decay(struct sched_dynamic *dynamic)
+{
+  struct sched_hitters *hitters= dynamic->hitters;
+  if (hitters == NULL or dynamic->half_life <= 0)
+  {
+    return;
+  }
+
+  // scaling every count alike keeps the heap in order
+  double keep= pow(0.5, 1.0 / dynamic->half_life);
+
+  (void)pthread_mutex_lock(&hitters->lock);
+  for (uint32_t x= 0; x < hitters->used; x++)
+  {
+    hitters->heap[x].count*= keep;
+    hitters->heap[x].error*= keep;
+  }
+  hitters->total*= keep;
+  (void)pthread_mutex_unlock(&hitters->lock);
+}
+
+memcached_return_t memcached_sched_set_hot_keys(memcached_st *ptr, uint32_t keys, uint32_t sample)
+{
+  if (ptr == NULL or ptr->dynamic == NULL or keys > SCHED_HOTKEY_MAX)
+  {
+    return MEMCACHED_INVALID_ARGUMENTS;
+  }
+
+  memcached_return_t rc= MEMCACHED_SUCCESS;
+
+  (void)pthread_mutex_lock(&ptr->dynamic->lock);
+  struct sched_hitters *hitters= ptr->dynamic->hitters;
+  if (hitters == NULL and keys)
+  {
+    if ((hitters= sched_hitters_create(keys, sample)) == NULL)
+    {
+      rc= MEMCACHED_MEMORY_ALLOCATION_FAILURE;
+    }
+    ptr->dynamic->hitters= hitters;
+  }
+  else if (hitters and keys and keys != hitters->capacity)
+  {
+    // another size: the tables are swapped under the lock every use takes, and the counts start over
+    struct sched_hitter *heap;
+    uint32_t *index;
+    uint32_t mask;
+    if (sched_hitters_alloc(keys, &heap, &index, &mask))
+    {
+      (void)pthread_mutex_lock(&hitters->lock);
+      std::swap(hitters->heap, heap);
+      std::swap(hitters->index, index);
+      hitters->mask= mask;
+      hitters->capacity= keys;
+      hitters->used= 0;
+      hitters->total= 0;
+      (void)pthread_mutex_unlock(&hitters->lock);
+      libmemcached_free(NULL, heap);
+      libmemcached_free(NULL, index);
+    }
+    else
+    {
+      rc= MEMCACHED_MEMORY_ALLOCATION_FAILURE;
+    }
+  }
+
+  if (hitters)
+  {
+    (void)pthread_mutex_lock(&hitters->lock);
+    hitters->enabled= (keys != 0);
+    hitters->sample= sample ? sample : 1;
+    if (hitters->enabled == false)
+    {
+      hitters->used= 0;
+      hitters->total= 0;
+      memset(hitters->index, 0, sizeof(uint32_t) * (hitters->mask + 1));
+    }
+    (void)pthread_mutex_unlock(&hitters->lock);
+  }
+  (void)pthread_mutex_unlock(&ptr->dynamic->lock);
+
+  return rc;
+}
+
+static int sched_hitter_cmp(const void *t1, const void *t2)
+{
+  const struct sched_hitter *a= (const struct sched_hitter *)t1;
+  const struct sched_hitter *b= (const struct sched_hitter *)t2;
+
+  if (a->count == b->count)
+  {
+    return 0;
+  }
+
+  return a->count > b->count ? -1 : 1;
+}
+
+memcached_return_t memcached_sched_hot_keys(memcached_st *ptr, memcached_sched_hot_key_st *keys, uint32_t max, uint32_t *count)
+{
+  if (count)
+  {
+    *count= 0;
+  }
+
+  if (ptr == NULL or ptr->dynamic == NULL or ptr->dynamic->hitters == NULL or (keys == NULL and max))
+  {
+    return MEMCACHED_INVALID_ARGUMENTS;
+  }
+
+  // the size can change with memcached_sched_set_hot_keys(), only the lock holds it
+  struct sched_hitters *hitters= ptr->dynamic->hitters;
+  (void)pthread_mutex_lock(&hitters->lock);
+  uint32_t used= hitters->used;
+  struct sched_hitter *top= libmemcached_xcalloc(NULL, used ? used : 1, struct sched_hitter);
+  if (top)
+  {
+    memcpy(top, hitters->heap, sizeof(struct sched_hitter) * used);
+  }
+  (void)pthread_mutex_unlock(&hitters->lock);
+  if (top == NULL)
+  {
+    return MEMCACHED_MEMORY_ALLOCATION_FAILURE;
+  }
+
+  qsort(top, used, sizeof(struct sched_hitter), sched_hitter_cmp);
+  if (max > used)
+  {
+    max= used;
+  }
+
+  // owners in the ring handles see right now
+  struct sched_ring *ring= sched_reader_enter(ptr->dynamic, ptr->sched_reader);
+  for (uint32_t x= 0; x < max; x++)
+  {
+    memcpy(keys[x].key, top[x].key, top[x].length);
+    keys[x].key[top[x].length]= 0;
+    keys[x].key_length= top[x].length;
+    keys[x].hash= top[x].hash;
+    keys[x].count= top[x].count;
+    keys[x].error= top[x].error;
+    keys[x].server= (ring and memcached_server_count(ptr) > 1) ?
+                    ring->indices[continuum_search_find(ring->search, top[x].hash)] : 0;
+  }
+  sched_reader_exit(ptr->sched_reader);
+
+  libmemcached_free(NULL, top);
+
+  if (count)
+  {
+    *count= max;
+  }
+
+  return MEMCACHED_SUCCESS;
+}
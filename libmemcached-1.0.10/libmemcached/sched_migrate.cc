@@ -0,0 +1,483 @@
+/*
+ * sched_migrate.cc
+ *
+ * Warm migration of hot keys when the dynamic distribution moves a
+ * boundary, see struct sched_migrator, and the cheaper hand-off: a GET that
+ * misses asks the owner of the key in the ring before the last change.
+ */
+
+#include <libmemcached/common.h>
+
+/* keys is at most SCHED_HOTKEY_MAX, the power of two above it does not wrap */
+static struct sched_migrator *sched_migrator_create(uint32_t keys, time_t ttl)
+{
+  uint32_t size= 1;
+  while (size < keys)
+  {
+    size<<= 1;
+  }
+
+  struct sched_migrator *migrator= libmemcached_xcalloc(NULL, 1, struct sched_migrator);
+  if (migrator == NULL)
+  {
+    return NULL;
+  }
+
+  migrator->hot= libmemcached_xcalloc(NULL, size, struct sched_hotkey);
+  migrator->queue= libmemcached_xcalloc(NULL, size, struct sched_migration);
+  migrator->written= libmemcached_xcalloc(NULL, size, uint32_t);
+  if (migrator->hot == NULL or migrator->queue == NULL or migrator->written == NULL)
+  {
+    libmemcached_free(NULL, migrator->hot);
+    libmemcached_free(NULL, migrator->queue);
+    libmemcached_free(NULL, (void *)migrator->written);
+    libmemcached_free(NULL, migrator);
+    return NULL;
+  }
+
+  pthread_mutex_init(&migrator->lock, NULL);
+  migrator->mask= size - 1;
+  migrator->ttl= ttl;
+
+  return migrator;
+}
+
+void sched_migrator_free(struct sched_migrator *migrator)
+{
+  if (migrator)
+  {
+    pthread_mutex_destroy(&migrator->lock);
+    libmemcached_free(NULL, migrator->hot);
+    libmemcached_free(NULL, migrator->queue);
+    libmemcached_free(NULL, (void *)migrator->written);
+    libmemcached_free(NULL, migrator);
+  }
+}
+
+static inline bool sched_hotkey_is(const struct sched_hotkey *hot, uint32_t hash, const char *key, size_t key_length)
+{
+  return hot->hash == hash and hot->length == key_length and memcmp(hot->key, key, key_length) == 0;
+}
+
+void sched_migrator_hit(struct sched_dynamic *dynamic, struct sched_reader *reader,
+                        uint32_t hash, uint32_t server, const char *key, size_t key_length)
+{
+  struct sched_migrator *migrator= dynamic->migrator;
+  if (migrator == NULL or migrator->enabled == false or key_length == 0 or key_length >= MEMCACHED_MAX_KEY)
+  {
+    return;
+  }
+
+  struct sched_hotkey *hot= migrator->hot + (hash & migrator->mask);
+  bool sample= (++reader->sampled >= SCHED_HOTKEY_SAMPLE);
+
+  // most hits touch neither the lock nor the slot's key
+  if (sample == false and hot->migrated != server + 1)
+  {
+    return;
+  }
+
+  if (pthread_mutex_trylock(&migrator->lock))
+  {
+    return;
+  }
+
+  if (hot->migrated == server + 1 and sched_hotkey_is(hot, hash, key, key_length))
+  {
+    hot->migrated= 0;
+    migrator->avoided++;
+  }
+
+  if (sample)
+  {
+    reader->sampled= 0;
+    if (sched_hotkey_is(hot, hash, key, key_length) == false)
+    {
+      hot->hash= hash;
+      hot->migrated= 0;
+      hot->length= (uint8_t)key_length;
+      memcpy(hot->key, key, key_length);
+    }
+    hot->seen= dynamic->tick;
+  }
+
+  (void)pthread_mutex_unlock(&migrator->lock);
+}
+
+void sched_migrator_plan(struct sched_dynamic *dynamic, const struct sched_ring *ring, const struct sched_ring *next)
+{
+  struct sched_migrator *migrator= dynamic->migrator;
+
+  if (migrator == NULL or migrator->enabled == false)
+  {
+    return;
+  }
+
+  (void)pthread_mutex_lock(&migrator->lock);
+  for (uint32_t x= 0; x <= migrator->mask; x++)
+  {
+    struct sched_hotkey *hot= migrator->hot + x;
+    if (hot->length == 0 or hot->seen + SCHED_HOTKEY_TICKS < dynamic->tick)
+    {
+      continue;
+    }
+
+    uint32_t from= ring->indices[continuum_search_find(ring->search, hot->hash)];
+    uint32_t to= next->indices[continuum_search_find(next->search, hot->hash)];
+    if (from == to)
+    {
+      continue;
+    }
+
+    // a full queue gives up its oldest entry, the newest moves matter most
+    if (migrator->count > migrator->mask)
+    {
+      migrator->head= (migrator->head + 1) & migrator->mask;
+      migrator->count--;
+      migrator->dropped++;
+    }
+
+    struct sched_migration *migration= migrator->queue + ((migrator->head + migrator->count) & migrator->mask);
+    migration->hash= hot->hash;
+    migration->from= from;
+    migration->to= to;
+    migration->written= migrator->written[hot->hash & migrator->mask];
+    migration->length= hot->length;
+    memcpy(migration->key, hot->key, hot->length);
+    migrator->count++;
+  }
+  (void)pthread_mutex_unlock(&migrator->lock);
+}
+
+/*
+  Keys that share a slot share the count, so a write to one of them only
+  costs the others their migration.
+*/
+void sched_migrator_written(struct sched_migrator *migrator, uint32_t hash)
+{
+  (void)__sync_fetch_and_add(migrator->written + (hash & migrator->mask), 1);
+}
+
+uint32_t sched_migrator_pop(struct sched_dynamic *dynamic, struct sched_migration *migrations, uint32_t max)
+{
+  struct sched_migrator *migrator= dynamic->migrator;
+  uint32_t count= 0;
+
+  if (migrator == NULL)
+  {
+    return 0;
+  }
+
+  (void)pthread_mutex_lock(&migrator->lock);
+  while (count < max and migrator->count)
+  {
+    migrations[count++]= migrator->queue[migrator->head];
+    migrator->head= (migrator->head + 1) & migrator->mask;
+    migrator->count--;
+  }
+  (void)pthread_mutex_unlock(&migrator->lock);
+
+  return count;
+}
+
+void sched_migrator_done(struct sched_dynamic *dynamic, const struct sched_migration *migration)
+{
+  struct sched_migrator *migrator= dynamic->migrator;
+  if (migrator == NULL)
+  {
+    return;
+  }
+
+  (void)pthread_mutex_lock(&migrator->lock);
+  struct sched_hotkey *hot= migrator->hot + (migration->hash & migrator->mask);
+  if (sched_hotkey_is(hot, migration->hash, migration->key, migration->length))
+  {
+    hot->migrated= migration->to + 1;
+  }
+  migrator->migrated++;
+  (void)pthread_mutex_unlock(&migrator->lock);
+}
+
+/*
+  The hit path reads dynamic->migrator without a lock, so once created the
+  migrator stays until the dynamic state goes away; later calls only turn
+  it on or off and change the ttl.
+*/
+memcached_return_t memcached_sched_set_migration(memcached_st *ptr, uint32_t hot_keys, time_t ttl)
+{
+  if (ptr == NULL or ptr->dynamic == NULL or hot_keys > SCHED_HOTKEY_MAX)
+  {
+    return MEMCACHED_INVALID_ARGUMENTS;
+  }
+
+  memcached_return_t rc= MEMCACHED_SUCCESS;
+
+  (void)pthread_mutex_lock(&ptr->dynamic->lock);
+  struct sched_migrator *migrator= ptr->dynamic->migrator;
+  if (migrator == NULL and hot_keys)
+  {
+    if ((migrator= sched_migrator_create(hot_keys, ttl)) == NULL)
+    {
+      rc= MEMCACHED_MEMORY_ALLOCATION_FAILURE;
+    }
+    ptr->dynamic->migrator= migrator;
+  }
+
+  if (migrator)
+  {
+    (void)pthread_mutex_lock(&migrator->lock);
+    migrator->enabled= (hot_keys != 0);
+    migrator->ttl= ttl;
+    if (migrator->enabled == false)
+    {
+      migrator->count= 0;
+    }
+    (void)pthread_mutex_unlock(&migrator->lock);
+  }
+  (void)pthread_mutex_unlock(&ptr->dynamic->lock);
+
+  return rc;
+}
+
+memcached_return_t memcached_sched_migrate(memcached_st *ptr, uint32_t max_keys, uint32_t *migrated)
+{
+  uint32_t copied= 0;
+  uint32_t tried= 0;
+
+  if (migrated)
+  {
+    *migrated= 0;
+  }
+
+  if (ptr == NULL or ptr->dynamic == NULL)
+  {
+    return MEMCACHED_INVALID_ARGUMENTS;
+  }
+
+  if (memcached_server_count(ptr) == 0)
+  {
+    return MEMCACHED_NO_SERVERS;
+  }
+
+  memcached_result_st result;
+  if (memcached_result_create(ptr, &result) == NULL)
+  {
+    return MEMCACHED_MEMORY_ALLOCATION_FAILURE;
+  }
+
+  struct sched_migrator *migrator= ptr->dynamic->migrator;
+  time_t ttl= migrator ? migrator->ttl : 0;
+  struct sched_migration migration;
+  while (tried < max_keys and sched_migrator_pop(ptr->dynamic, &migration, 1))
+  {
+    tried++;
+    if (migration.from >= memcached_server_count(ptr) or migration.to >= memcached_server_count(ptr))
+    {
+      continue;
+    }
+
+    // only what the old owner still has, and never over a newer value on the new one,
+    // nor over a delete or an expiration of a value written since the move
+    org::libmemcached::Instance* instance= memcached_instance_fetch(ptr, migration.from);
+    if (memcached_instance_get(instance, migration.key, migration.length, &result) != MEMCACHED_SUCCESS or
+        migrator->written[migration.hash & migrator->mask] != migration.written)
+    {
+      continue;
+    }
+
+    // straight to the new owner, a copy is neither traffic of its own nor a write of the key
+    if (memcached_success(memcached_instance_store(memcached_instance_fetch(ptr, migration.to), true,
+                                                   migration.key, migration.length,
+                                                   memcached_result_value(&result), memcached_result_length(&result),
+                                                   ttl, memcached_result_flags(&result))))
+    {
+      sched_migrator_done(ptr->dynamic, &migration);
+      copied++;
+    }
+  }
+
+  memcached_result_free(&result);
+
+  if (migrated)
+  {
+    *migrated= copied;
+  }
+
+  return MEMCACHED_SUCCESS;
+}
+
+memcached_return_t memcached_sched_migration_stat(memcached_st *ptr, uint64_t *migrated, uint64_t *avoided, uint64_t *pending)
+{
+  if (ptr == NULL or ptr->dynamic == NULL or ptr->dynamic->migrator == NULL)
+  {
+    return MEMCACHED_INVALID_ARGUMENTS;
+  }
+
+  struct sched_migrator *migrator= ptr->dynamic->migrator;
+  (void)pthread_mutex_lock(&migrator->lock);
+  if (migrated)
+  {
+    *migrated= migrator->migrated;
+  }
+  if (avoided)
+  {
+    *avoided= migrator->avoided;
+  }
+  if (pending)
+  {
+    *pending= migrator->count;
+  }
+  (void)pthread_mutex_unlock(&migrator->lock);
+
+  return MEMCACHED_SUCCESS;
+}
+
+memcached_return_t memcached_sched_set_handoff(memcached_st *ptr, time_t grace, time_t ttl)
+{
+  if (ptr == NULL or ptr->dynamic == NULL or grace < 0)
+  {
+    return MEMCACHED_INVALID_ARGUMENTS;
+  }
+
+  (void)pthread_mutex_lock(&ptr->dynamic->lock);
+  if (grace > 0 and ptr->dynamic->handoff_skip == NULL)
+  {
+    ptr->dynamic->handoff_skip= libmemcached_xcalloc(NULL, SCHED_HANDOFF_SKIP, time_t);
+    if (ptr->dynamic->handoff_skip == NULL)
+    {
+      (void)pthread_mutex_unlock(&ptr->dynamic->lock);
+      return MEMCACHED_MEMORY_ALLOCATION_FAILURE;
+    }
+  }
+  ptr->dynamic->grace= grace;
+  ptr->dynamic->handoff_ttl= ttl;
+  if (grace == 0)
+  {
+    sched_ring_expire(ptr->dynamic, true);
+  }
+  (void)pthread_mutex_unlock(&ptr->dynamic->lock);
+
+  return MEMCACHED_SUCCESS;
+}
+
+/*
+  A GET of key missed on its owner; if the key changed owner within the
+  grace period, ask its previous owners, the latest first: writes since a
+  move went to the owner after it. A value found is written back to the
+  current owner. add, so a value set in the meantime stays. Not while the
+  key is marked skipped: a write could not drop its copy there.
+*/
+char *memcached_sched_handoff(memcached_st *ptr, const char *key, size_t key_length,
+                              size_t *value_length, uint32_t *flags, memcached_return_t *error)
+{
+  uint32_t owner;
+  uint32_t previous[SCHED_KEPT_MAX];
+  uint32_t count= memcached_sched_previous(ptr, key, key_length, &owner, previous, SCHED_KEPT_MAX);
+  if (count == 0)
+  {
+    return NULL;
+  }
+
+  volatile time_t *skip= ptr->dynamic->handoff_skip;
+  if (skip != NULL
+      and skip[memcached_sched_key_hash(ptr, key, key_length) & (SCHED_HANDOFF_SKIP - 1)] > time(NULL))
+  {
+    return NULL;
+  }
+
+  memcached_result_st result;
+  if (memcached_result_create(ptr, &result) == NULL)
+  {
+    return NULL;
+  }
+
+  (void)__sync_fetch_and_add(&ptr->dynamic->handoff_tries, 1);
+
+  char *value= NULL;
+  for (uint32_t x= 0; x < count and value == NULL; x++)
+  {
+    org::libmemcached::Instance* instance= memcached_instance_fetch(ptr, previous[x]);
+    if (memcached_instance_get(instance, key, key_length, &result) != MEMCACHED_SUCCESS)
+    {
+      continue;
+    }
+
+    (void)__sync_fetch_and_add(&ptr->dynamic->handoff_hits, 1);
+    (void)memcached_instance_store(memcached_instance_fetch(ptr, owner), true, key, key_length,
+                                   memcached_result_value(&result), memcached_result_length(&result),
+                                   ptr->dynamic->handoff_ttl, memcached_result_flags(&result));
+
+    if (value_length)
+    {
+      *value_length= memcached_result_length(&result);
+    }
+    if (flags)
+    {
+      *flags= memcached_result_flags(&result);
+    }
+    *error= MEMCACHED_SUCCESS;
+    value= memcached_string_take_value(&result.value);
+  }
+
+  memcached_result_free(&result);
+
+  return value;
+}
+
+/*
+  A write, delete, incr or decr only reached the owner of key. While the
+  grace period runs the previous owners still have the old value, and the
+  next miss would hand it back, even after a set: its value may expire or
+  be evicted first. Drop it there too; where that fails, e.g. replies are
+  still pending on the previous owner, the key is not handed off for a
+  grace period, which outlives every ring kept now.
+*/
+void memcached_sched_handoff_drop(memcached_st *ptr, const char *key, size_t key_length)
+{
+  uint32_t owner;
+  uint32_t previous[SCHED_KEPT_MAX];
+  uint32_t count= memcached_sched_previous(ptr, key, key_length, &owner, previous, SCHED_KEPT_MAX);
+  bool dropped= true;
+  for (uint32_t x= 0; x < count; x++)
+  {
+    memcached_return_t rc= memcached_instance_delete(memcached_instance_fetch(ptr, previous[x]), key, key_length);
+    if (rc != MEMCACHED_SUCCESS and rc != MEMCACHED_NOTFOUND)
+    {
+      dropped= false;
+    }
+  }
+
+  if (dropped == false and ptr->dynamic->handoff_skip != NULL)
+  {
+    ptr->dynamic->handoff_skip[memcached_sched_key_hash(ptr, key, key_length) & (SCHED_HANDOFF_SKIP - 1)]= time(NULL) + ptr->dynamic->grace;
+  }
+}
+
+/*
+  The requests to one server that are not routed by key wait for their own
+  reply. While instance still owes replies to earlier ones, they would take
+  the first of those for theirs, so they are not sent at all.
+*/
+bool memcached_sched_instance_busy(org::libmemcached::Instance* instance)
+{
+  return memcached_instance_response_count(instance) != 0;
+}
+
+memcached_return_t memcached_sched_handoff_stat(memcached_st *ptr, uint64_t *tries, uint64_t *hits)
+{
+  if (ptr == NULL or ptr->dynamic == NULL)
+  {
+    return MEMCACHED_INVALID_ARGUMENTS;
+  }
+
+  if (tries)
+  {
+    *tries= ptr->dynamic->handoff_tries;
+  }
+  if (hits)
+  {
+    *hits= ptr->dynamic->handoff_hits;
+  }
+
+  return MEMCACHED_SUCCESS;
+}
@@ -0,0 +1,387 @@
+/*
+ * sched_near.cc
+ *
+ * The near cache, see struct sched_near. A hot key read from here costs
+ * its server nothing, so it is the one load no placement has to balance.
+ * A value is at most ttl old, or as old as the last write to the key made
+ * through this process.
+ */
+
+#include <libmemcached/common.h>
+
+#include <sys/time.h>
+
+static uint64_t sched_near_clock(void)
+{
+  struct timeval now;
+  (void)gettimeofday(&now, NULL);
+
+  return (uint64_t)now.tv_sec * 1000000 + (uint64_t)now.tv_usec;
+}
+
+/* FNV-1a over the namespace and the key, as the servers see the name */
+static uint32_t sched_near_hash(const memcached_st *ptr, const char *key, size_t key_length)
+{
+  const char *prefix= memcached_array_string(ptr->_namespace);
+  size_t prefix_length= memcached_array_size(ptr->_namespace);
+  uint32_t hash= 2166136261U;
+
+  for (size_t x= 0; x < prefix_length; x++)
+  {
+    hash= (hash ^ (uint8_t)prefix[x]) * 16777619U;
+  }
+  for (size_t x= 0; x < key_length; x++)
+  {
+    hash= (hash ^ (uint8_t)key[x]) * 16777619U;
+  }
+
+  return hash;
+}
+
+static bool sched_near_match(const memcached_st *ptr, const struct sched_near_entry *entry,
+                             uint32_t hash, const char *key, size_t key_length)
+{
+  size_t prefix_length= memcached_array_size(ptr->_namespace);
+
+  return entry->hash == hash and entry->key_length == prefix_length + key_length and
+         memcmp(entry->data, memcached_array_string(ptr->_namespace), prefix_length) == 0 and
+         memcmp(entry->data + prefix_length, key, key_length) == 0;
+}
+
+/* the cache holds the cluster of the shared ring; a handle that routes otherwise may point anywhere */
+static inline bool sched_near_scoped(const memcached_st *ptr)
+{
+  return ptr->distribution == MEMCACHED_DISTRIBUTION_DYNAMIC or
+         ptr->distribution == MEMCACHED_DISTRIBUTION_DYNAMIC_WEIGHTED;
+}
+
+static inline struct sched_near_shard *sched_near_shard_of(struct sched_near *near, uint32_t hash)
+{
+  return near->shards + (hash % SCHED_NEAR_SHARDS);
+}
+
+static inline size_t sched_near_size(const struct sched_near_entry *entry)
+{
+  return sizeof(struct sched_near_entry) + entry->key_length + entry->value_length;
+}
+
+/* must hold shard->lock; takes entry out of its bucket and the clock ring, and frees it */
+static void sched_near_remove(struct sched_near *near, struct sched_near_shard *shard, struct sched_near_entry *entry)
+{
+  struct sched_near_entry **link= shard->buckets + ((entry->hash / SCHED_NEAR_SHARDS) & near->mask);
+  while (*link != entry)
+  {
+    link= &(*link)->chain;
+  }
+  *link= entry->chain;
+
+  if (entry->next == entry)
+  {
+    shard->hand= NULL;
+  }
+  else
+  {
+    entry->prev->next= entry->next;
+    entry->next->prev= entry->prev;
+    if (shard->hand == entry)
+    {
+      shard->hand= entry->next;
+    }
+  }
+
+  shard->bytes-= sched_near_size(entry);
+  libmemcached_free(NULL, entry);
+}
+
+/* must hold shard->lock */
+static struct sched_near_entry *sched_near_find(const memcached_st *ptr, struct sched_near *near, struct sched_near_shard *shard,
+                                                uint32_t hash, const char *key, size_t key_length)
+{
+  struct sched_near_entry *entry= shard->buckets[(hash / SCHED_NEAR_SHARDS) & near->mask];
+  while (entry and sched_near_match(ptr, entry, hash, key, key_length) == false)
+  {
+    entry= entry->chain;
+  }
+
+  return entry;
+}
+
+/* must hold shard->lock, and the ring must not be empty: the hand evicts the first entry not read since its last pass */
+static void sched_near_evict(struct sched_near *near, struct sched_near_shard *shard)
+{
+  struct sched_near_entry *entry= shard->hand;
+  while (entry->referenced)
+  {
+    entry->referenced= false;
+    entry= entry->next;
+  }
+
+  shard->hand= entry->next;
+  sched_near_remove(near, shard, entry);
+}
+
+static void sched_near_empty(struct sched_near *near)
+{
+  for (uint32_t x= 0; x < SCHED_NEAR_SHARDS; x++)
+  {
+    struct sched_near_shard *shard= near->shards + x;
+
+    (void)pthread_mutex_lock(&shard->lock);
+    while (shard->hand)
+    {
+      sched_near_remove(near, shard, shard->hand);
+    }
+    shard->generation++;
+    (void)pthread_mutex_unlock(&shard->lock);
+  }
+}
+
+void sched_near_free(struct sched_near *near)
+{
+  if (near)
+  {
+    sched_near_empty(near);
+    for (uint32_t x= 0; x < SCHED_NEAR_SHARDS; x++)
+    {
+      pthread_mutex_destroy(&near->shards[x].lock);
+      libmemcached_free(NULL, near->shards[x].buckets);
+    }
+    libmemcached_free(NULL, near);
+  }
+}
+
+/* buckets for about one entry of 256 bytes each */
+static struct sched_near *sched_near_create(size_t capacity)
+{
+  uint32_t buckets= 16;
+  while (buckets < capacity / 256 and buckets < (1U << 20))
+  {
+    buckets<<= 1;
+  }
+
+  struct sched_near *near= libmemcached_xcalloc(NULL, 1, struct sched_near);
+  if (near == NULL)
+  {
+    return NULL;
+  }
+
+  for (uint32_t x= 0; x < SCHED_NEAR_SHARDS; x++)
+  {
+    pthread_mutex_init(&near->shards[x].lock, NULL);
+  }
+  for (uint32_t x= 0; x < SCHED_NEAR_SHARDS; x++)
+  {
+    if ((near->shards[x].buckets= libmemcached_xcalloc(NULL, buckets, struct sched_near_entry *)) == NULL)
+    {
+      sched_near_free(near);
+      return NULL;
+    }
+  }
+  near->mask= buckets - 1;
+
+  return near;
+}
+
+char *memcached_sched_near_get(memcached_st *ptr, const char *key, size_t key_length,
+                               size_t *value_length, uint32_t *flags, uint64_t *generation)
+{
+  struct sched_near *near= ptr->dynamic->near;
+  *generation= 0;
+  if (near == NULL or near->capacity == 0 or sched_near_scoped(ptr) == false)
+  {
+    return NULL;
+  }
+
+  uint32_t hash= sched_near_hash(ptr, key, key_length);
+  struct sched_near_shard *shard= sched_near_shard_of(near, hash);
+  char *value= NULL;
+
+  (void)pthread_mutex_lock(&shard->lock);
+  *generation= shard->generation;
+  struct sched_near_entry *entry= sched_near_find(ptr, near, shard, hash, key, key_length);
+  if (entry and entry->expires <= sched_near_clock())
+  {
+    sched_near_remove(near, shard, entry);
+    entry= NULL;
+  }
+
+  if (entry and (value= (char *)libmemcached_malloc(ptr, entry->value_length + 1)))
+  {
+    entry->referenced= true;
+    memcpy(value, entry->data + entry->key_length, entry->value_length + 1);
+    *value_length= entry->value_length;
+    *flags= entry->flags;
+  }
+  (void)pthread_mutex_unlock(&shard->lock);
+
+  (void)__sync_fetch_and_add(value ? &near->hits : &near->misses, 1);
+
+  return value;
+}
+
+void memcached_sched_near_store(memcached_st *ptr, const char *key, size_t key_length,
+                                const char *value, size_t value_length, uint32_t flags, uint64_t generation)
+{
+  struct sched_near *near= ptr->dynamic->near;
+  if (near == NULL or near->capacity == 0 or sched_near_scoped(ptr) == false)
+  {
+    return;
+  }
+
+  size_t prefix_length= memcached_array_size(ptr->_namespace);
+  size_t size= sizeof(struct sched_near_entry) + prefix_length + key_length + value_length;
+  if (size > near->capacity)
+  {
+    return;
+  }
+
+  struct sched_near_entry *entry= (struct sched_near_entry *)libmemcached_malloc(NULL, size);
+  if (entry == NULL)
+  {
+    return;
+  }
+
+  entry->hash= sched_near_hash(ptr, key, key_length);
+  entry->flags= flags;
+  entry->key_length= prefix_length + key_length;
+  entry->value_length= value_length;
+  entry->expires= sched_near_clock() + near->ttl;
+  entry->referenced= false;
+  memcpy(entry->data, memcached_array_string(ptr->_namespace), prefix_length);
+  memcpy(entry->data + prefix_length, key, key_length);
+  memcpy(entry->data + entry->key_length, value, value_length);
+  entry->data[entry->key_length + value_length]= 0;
+
+  struct sched_near_shard *shard= sched_near_shard_of(near, entry->hash);
+
+  (void)pthread_mutex_lock(&shard->lock);
+  if (shard->generation != generation)
+  {
+    // a write dropped something here since the lookup; value may be older than it
+    (void)pthread_mutex_unlock(&shard->lock);
+    libmemcached_free(NULL, entry);
+    return;
+  }
+
+  struct sched_near_entry *old= sched_near_find(ptr, near, shard, entry->hash, key, key_length);
+  if (old)
+  {
+    sched_near_remove(near, shard, old);
+  }
+  while (shard->hand and shard->bytes + size > near->capacity)
+  {
+    sched_near_evict(near, shard);
+  }
+
+  struct sched_near_entry **bucket= shard->buckets + ((entry->hash / SCHED_NEAR_SHARDS) & near->mask);
+  entry->chain= *bucket;
+  *bucket= entry;
+
+  // just behind the hand: the last one it looks at
+  if (shard->hand)
+  {
+    entry->next= shard->hand;
+    entry->prev= shard->hand->prev;
+    entry->prev->next= entry;
+    shard->hand->prev= entry;
+  }
+  else
+  {
+    entry->next= entry->prev= entry;
+    shard->hand= entry;
+  }
+  shard->bytes+= size;
+  (void)pthread_mutex_unlock(&shard->lock);
+}
+
+void memcached_sched_near_drop(memcached_st *ptr, const char *key, size_t key_length)
+{
+  struct sched_near *near= ptr->dynamic->near;
+  if (near == NULL)
+  {
+    return;
+  }
+
+  uint32_t hash= sched_near_hash(ptr, key, key_length);
+  struct sched_near_shard *shard= sched_near_shard_of(near, hash);
+
+  (void)pthread_mutex_lock(&shard->lock);
+  struct sched_near_entry *entry= sched_near_find(ptr, near, shard, hash, key, key_length);
+  if (entry)
+  {
+    sched_near_remove(near, shard, entry);
+  }
+  shard->generation++;
+  (void)pthread_mutex_unlock(&shard->lock);
+}
+
+void memcached_sched_near_clear(memcached_st *ptr)
+{
+  if (ptr->dynamic->near)
+  {
+    sched_near_empty(ptr->dynamic->near);
+  }
+}
+
+memcached_return_t memcached_sched_set_near_cache(memcached_st *ptr, size_t bytes, uint32_t ttl_ms)
+{
+  if (ptr == NULL or ptr->dynamic == NULL or (bytes and ttl_ms == 0))
+  {
+    return MEMCACHED_INVALID_ARGUMENTS;
+  }
+
+  memcached_return_t rc= MEMCACHED_SUCCESS;
+
+  (void)pthread_mutex_lock(&ptr->dynamic->lock);
+  struct sched_near *near= ptr->dynamic->near;
+  if (near == NULL and bytes)
+  {
+    if ((near= sched_near_create(bytes / SCHED_NEAR_SHARDS)) == NULL)
+    {
+      rc= MEMCACHED_MEMORY_ALLOCATION_FAILURE;
+    }
+    ptr->dynamic->near= near;
+  }
+
+  if (near)
+  {
+    // a smaller cap is reached by the next stores; off, nothing is kept
+    near->ttl= (uint64_t)ttl_ms * 1000;
+    near->capacity= bytes / SCHED_NEAR_SHARDS;
+    if (bytes == 0)
+    {
+      sched_near_empty(near);
+    }
+  }
+  (void)pthread_mutex_unlock(&ptr->dynamic->lock);
+
+  return rc;
+}
+
+memcached_return_t memcached_sched_near_stat(memcached_st *ptr, uint64_t *hits, uint64_t *misses, uint64_t *bytes)
+{
+  if (ptr == NULL or ptr->dynamic == NULL)
+  {
+    return MEMCACHED_INVALID_ARGUMENTS;
+  }
+
+  struct sched_near *near= ptr->dynamic->near;
+  if (hits)
+  {
+    *hits= near ? near->hits : 0;
+  }
+  if (misses)
+  {
+    *misses= near ? near->misses : 0;
+  }
+  if (bytes)
+  {
+    *bytes= 0;
+    for (uint32_t x= 0; near and x < SCHED_NEAR_SHARDS; x++)
+    {
+      *bytes+= near->shards[x].bytes;
+    }
+  }
+
+  return MEMCACHED_SUCCESS;
+}
@@ -0,0 +1,280 @@
+/*
+ * sched_policy.cc
+ *
+ * Scheduling policies of the dynamic distribution, see struct sched_policy.
+ *
+ *   pair      the original algorithm: per tick, move the one boundary with
+ *             the largest cost difference between the most and the least
+ *             loaded server
+ *   gradient  per tick, move every boundary between two different servers
+ *             towards the cheaper one, by the same rule as pair
+ */
+
+#include <libmemcached/common.h>
+
+// usagerate, byterate and latencyrate mixed by the weights of memcached_sched_set_load()
+static double sched_load(const struct sched_dynamic *dynamic, const struct sched_context *stat)
+{
+  double weights= dynamic->load_ops + dynamic->load_bytes + dynamic->load_latency;
+  if (weights <= 0)
+  {
+    return stat->usagerate;
+  }
+
+  return (dynamic->load_ops * stat->usagerate +
+          dynamic->load_bytes * stat->byterate +
+          dynamic->load_latency * stat->latencyrate) / weights;
+}
+
+// pressurerate stays 0 until the servers report, see sched_feedback_poll() and memcached_sched_feedback()
+static double sched_cost(const struct sched_dynamic *dynamic, const struct sched_context *stat)
+{
+  return dynamic->alpha * (1.0 - stat->nhitrate) + (1 - dynamic->alpha) * sched_load(dynamic, stat) +
+         dynamic->gamma * stat->pressurerate;
+}
+
+/*
+ * pair
+ */
+static uint32_t pair_pick(const struct sched_dynamic *dynamic, const struct sched_ring *ring,
+                          struct sched_move *moves, uint32_t max_moves)
+{
+  double max_cost=0;
+  double max_cost_i=0, max_cost_j=0, max_cost_k=0;
+  uint32_t max_i=0, max_j=0, max_k=0;
+  bool schedulable = false;
+
+  if ( max_moves == 0 )
+    return 0;
+
+#define point_cost(_i) (dynamic->policy->cost(dynamic, &ring->stats[_i]))
+
+  // find min-max
+  uint32_t srv_min_id = 0;
+  uint32_t srv_max_id = 0;
+  double maxcost = 0;
+  double mincost = 1000;
+  bool srv_succ = true;
+
+  // server level: min-max servers
+  for(uint32_t j=0; j < dynamic->continuum_count; j++) {
+      struct sched_context *host = dynamic->servers + j;
+      double cost = dynamic->policy->cost(dynamic, host);
+
+      if ( cost > maxcost ) {
+        maxcost = cost;
+        srv_max_id = j;
+      }
+
+      if ( cost < mincost ) {
+        mincost = cost;
+        srv_min_id = j;
+      }
+  }
+
+  if ( srv_max_id == srv_min_id )
+    srv_succ = false;
+
+  // virtual node level: find a location
+  bool cw = true;
+  bool max_cw = true;
+
+  if ( srv_succ ) {
+    // find maxdiff from selected servers
+    for(uint32_t j=0; j < ring->continuum_points_counter; j++) {
+      uint32_t i = (j - 1 + ring->continuum_points_counter) % ring->continuum_points_counter;
+      uint32_t k = (j + 1) % ring->continuum_points_counter;
+      double cost;
+
+      if ( (srv_max_id == ring->indices[j] && srv_min_id == ring->indices[k]) ||
+            (srv_min_id == ring->indices[j] && srv_max_id == ring->indices[k]) ) {
+        cost = point_cost(j) - point_cost(k);
+
+        cw = (srv_min_id == ring->indices[j]);
+        cost = abs_double(cost);
+
+        if ( cost > max_cost ) {
+          max_cost = cost;
+          max_cost_i = point_cost(i);
+          max_cost_j = point_cost(j);
+          max_cost_k = point_cost(k);
+          max_i = i;
+          max_j = j;
+          max_k = k;
+          max_cw = cw;
+          schedulable = true;
+        }
+      }
+    }
+  } else {
+    // just find maxdiff cost
+    for(uint32_t j=0; j < ring->continuum_points_counter; j++) {
+        uint32_t i = (j - 1 + ring->continuum_points_counter) % ring->continuum_points_counter;
+        uint32_t k = (j + 1) % ring->continuum_points_counter;
+        double cost = point_cost(j) - point_cost(k);
+        cw = (cost < 0); // true: clockwise, false: counter-
+        cost = abs_double(cost);
+
+        if ( cost > max_cost ) {
+          max_cost = cost;
+          max_cost_i = point_cost(i);
+          max_cost_j = point_cost(j);
+          max_cost_k = point_cost(k);
+          max_i = i;
+          max_j = j;
+          max_k = k;
+          max_cw = cw;
+          schedulable = true;
+        }
+    }
+  }
+
+#undef point_cost
+
+  if ( ! schedulable )
+    return 0;
+
+  double rate;
+  struct sched_move *move = moves;
+  move->point = max_j;
+  move->cw = max_cw;
+  if ( max_cw ) {
+    rate = (max_cost_k > max_cost_j) ? max_cost_j/max_cost_k : max_cost_k/max_cost_j;
+    move->peer = max_k;
+    move->amount = dynamic->beta * (1.0 - rate) *
+            abs_int(ring->values[max_j] - ring->values[max_k]);
+  } else {
+    rate = (max_cost_j > max_cost_i) ? max_cost_i/max_cost_j : max_cost_j/max_cost_i;
+    move->peer = max_i;
+    move->amount = dynamic->beta * (1.0 - rate) *
+            abs_int(ring->values[max_i] - ring->values[max_j]);
+  }
+
+  return 1;
+}
+
+// carries out one move unless it would reach the neighbouring boundary
+static bool sched_move_apply(const struct sched_ring *ring, struct sched_ring *next, const struct sched_move *move)
+{
+  if ( move->cw ) {
+    if ( abs_int(ring->values[move->peer] - ring->values[move->point]) > move->amount ) {
+      next->values[move->point] += move->amount;
+      return true;
+    }
+  } else {
+    if ( abs_int(ring->values[move->point] - ring->values[move->peer]) > move->amount ) {
+      next->values[move->point] -= move->amount;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+static void pair_apply(const struct sched_dynamic *, const struct sched_ring *ring, struct sched_ring *next,
+                       const struct sched_move *moves, uint32_t nmoves)
+{
+  for (uint32_t x= 0; x < nmoves; x++) {
+    const struct sched_move *move = moves + x;
+
+    if ( sched_move_apply(ring, next, move) )
+      continuum_search_move(next->search, move->point, ring->values[move->point]);
+  }
+}
+
+/*
+ * gradient
+ *
+ * Boundary j separates point j (hashes up to values[j]) from point j + 1.
+ * It moves towards the more expensive server by beta * (1 - cheap/dear) of
+ * the range that server gives up, like a pair move, but every such boundary
+ * moves in the same tick. A range is eaten from both ends at once, so each
+ * side takes less than half of it and no two boundaries can cross. The last
+ * point is never searched, so neither is the boundary in front of it.
+ */
+static uint32_t gradient_pick(const struct sched_dynamic *dynamic, const struct sched_ring *ring,
+                              struct sched_move *moves, uint32_t max_moves)
+{
+  uint32_t nmoves = 0;
+
+  if ( ring->continuum_points_counter < 3 )
+    return 0;
+
+  for (uint32_t j= 0; j + 2 < ring->continuum_points_counter and nmoves < max_moves; j++) {
+    uint32_t k = j + 1;
+    if ( ring->indices[j] == ring->indices[k] )
+      continue;
+
+    double cost_j = dynamic->policy->cost(dynamic, dynamic->servers + ring->indices[j]);
+    double cost_k = dynamic->policy->cost(dynamic, dynamic->servers + ring->indices[k]);
+    double dear = (cost_j > cost_k) ? cost_j : cost_k;
+    double cheap = (cost_j > cost_k) ? cost_k : cost_j;
+    if ( dear <= 0 or cheap == dear )
+      continue;
+
+    struct sched_move *move = moves + nmoves;
+    uint32_t range;
+    move->point = j;
+    move->cw = (cost_j < cost_k);
+    if ( move->cw ) {
+      // j grows into k
+      move->peer = k;
+      range = ring->values[k] - ring->values[j];
+    } else {
+      // j gives way to k; point 0 starts at hash 0
+      move->peer = j ? j - 1 : j;
+      range = ring->values[j] - (j ? ring->values[j - 1] : 0);
+    }
+
+    move->amount = dynamic->beta * (1.0 - cheap / dear) * range;
+    if ( move->amount > (range - 1) / 2 )
+      move->amount = (range - 1) / 2;
+
+    if ( move->amount )
+      nmoves++;
+  }
+
+  return nmoves;
+}
+
+static void gradient_apply(const struct sched_dynamic *, const struct sched_ring *ring, struct sched_ring *next,
+                           const struct sched_move *moves, uint32_t nmoves)
+{
+  uint32_t moved = 0;
+
+  for (uint32_t x= 0; x < nmoves; x++) {
+    const struct sched_move *move = moves + x;
+
+    // the point 0 range is measured from hash 0, not from its peer
+    if ( move->cw == false and move->point == 0 ) {
+      if ( ring->values[0] > move->amount ) {
+        next->values[0] -= move->amount;
+      } else {
+        continue;
+      }
+    } else if ( sched_move_apply(ring, next, move) == false ) {
+      continue;
+    }
+
+    moved++;
+  }
+
+  if ( moved ) {
+    sched_ring_index(next);
+  }
+}
+
+static const struct sched_policy sched_policies[MEMCACHED_SCHED_POLICY_MAX]= {
+  { "pair", sched_cost, pair_pick, pair_apply },
+  { "gradient", sched_cost, gradient_pick, gradient_apply }
+};
+
+const struct sched_policy *sched_policy_get(memcached_sched_policy_t policy)
+{
+  if ((unsigned)policy >= MEMCACHED_SCHED_POLICY_MAX)
+  {
+    return NULL;
+  }
+
+  return &sched_policies[policy];
+}
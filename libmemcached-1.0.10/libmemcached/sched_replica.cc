@@ -0,0 +1,393 @@
+/*
+ * sched_replica.cc
+ *
+ * Copies of the hottest keys on more than one server, see struct
+ * sched_replication. Moving boundaries spreads the load of a range over
+ * servers, never the load of one key; a copy of the key does.
+ */
+
+#include <libmemcached/common.h>
+
+void sched_replication_free(struct sched_replication *replication)
+{
+  if (replication)
+  {
+    libmemcached_free(NULL, (void *)replication->slots);
+    libmemcached_free(NULL, (void *)replication->holders);
+    libmemcached_free(NULL, replication->until);
+    libmemcached_free(NULL, replication->marked);
+    libmemcached_free(NULL, replication);
+  }
+}
+
+/* keys is at most SCHED_HOTKEY_MAX, the slots for four times as many do not wrap */
+static struct sched_replication *sched_replication_create(uint32_t keys)
+{
+  uint32_t size= 2;
+  while (size < keys * 4)
+  {
+    size<<= 1;
+  }
+
+  struct sched_replication *replication= libmemcached_xcalloc(NULL, 1, struct sched_replication);
+  if (replication == NULL)
+  {
+    return NULL;
+  }
+
+  replication->slots= libmemcached_xcalloc(NULL, size, uint64_t);
+  replication->holders= libmemcached_xcalloc(NULL, (size_t)size * SCHED_REPLICA_HOLDERS, uint32_t);
+  replication->until= libmemcached_xcalloc(NULL, size, time_t);
+  replication->marked= libmemcached_xcalloc(NULL, size, uint64_t);
+  if (replication->slots == NULL or replication->holders == NULL or replication->until == NULL or replication->marked == NULL)
+  {
+    sched_replication_free(replication);
+    return NULL;
+  }
+  replication->mask= size - 1;
+
+  return replication;
+}
+
+static volatile uint32_t *sched_replica_holders(struct sched_replication *replication, uint32_t hash)
+{
+  return replication->holders + (size_t)(hash & replication->mask) * SCHED_REPLICA_HOLDERS;
+}
+
+/* before a copy is written to server; false if the slot has no room left for it */
+static bool sched_replica_hold(volatile uint32_t *holders, uint32_t server)
+{
+  for (uint32_t x= 0; x < SCHED_REPLICA_HOLDERS; x++)
+  {
+    if (holders[x] == server + 1)
+    {
+      return true;
+    }
+  }
+
+  for (uint32_t x= 0; x < SCHED_REPLICA_HOLDERS; x++)
+  {
+    if (__sync_bool_compare_and_swap(&holders[x], 0, server + 1) or holders[x] == server + 1)
+    {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+/* once the copy on server is known to be gone */
+static void sched_replica_release(volatile uint32_t *holders, uint32_t server)
+{
+  for (uint32_t x= 0; x < SCHED_REPLICA_HOLDERS; x++)
+  {
+    (void)__sync_bool_compare_and_swap(&holders[x], server + 1, 0);
+  }
+}
+
+/* a copy of the key of hash may have kept an older value: its gets stay with the owner until it expired */
+static void sched_replica_stale(struct sched_replication *replication, uint32_t hash)
+{
+  uint32_t slot= hash & replication->mask;
+  uint64_t state= replication->slots[slot];
+  if ((uint32_t)(state >> 32) != hash or (state & SCHED_REPLICA_STALE))
+  {
+    return;
+  }
+
+  replication->until[slot]= time(NULL) + replication->ttl;
+  (void)__sync_bool_compare_and_swap(&replication->slots[slot], state,
+                                     (uint64_t)hash << 32 | SCHED_REPLICA_COOLING | SCHED_REPLICA_STALE);
+}
+
+void sched_replication_update(struct sched_dynamic *dynamic)
+{
+  struct sched_replication *replication= dynamic->replication;
+  struct sched_hitters *hitters= dynamic->hitters;
+  if (replication == NULL)
+  {
+    return;
+  }
+
+  time_t now= time(NULL);
+
+  if (replication->replicas > 1 and hitters)
+  {
+    (void)pthread_mutex_lock(&hitters->lock);
+    for (uint32_t x= 0; hitters->enabled and x < hitters->used; x++)
+    {
+      // counted for sure, not what it may have inherited from the key it replaced
+      const struct sched_hitter *hitter= hitters->heap + x;
+      if (hitter->count - hitter->error < replication->share * hitters->total)
+      {
+        continue;
+      }
+
+      // a slot taken by another key stays so until that one has cooled down, a stale one until it expired
+      uint32_t slot= hitter->hash & replication->mask;
+      if (replication->slots[slot] and ((uint32_t)(replication->slots[slot] >> 32) != hitter->hash or
+                                        (replication->slots[slot] & SCHED_REPLICA_STALE)))
+      {
+        continue;
+      }
+
+      replication->slots[slot]= (uint64_t)hitter->hash << 32 | SCHED_REPLICA_HOT;
+      replication->marked[slot]= dynamic->tick;
+    }
+    (void)pthread_mutex_unlock(&hitters->lock);
+  }
+
+  uint32_t hot= 0;
+  for (uint32_t slot= 0; slot <= replication->mask; slot++)
+  {
+    uint64_t state= replication->slots[slot];
+    if ((state & SCHED_REPLICA_HOT) and replication->marked[slot] != dynamic->tick)
+    {
+      replication->slots[slot]= (state >> 32) << 32 | SCHED_REPLICA_COOLING;
+      replication->until[slot]= now + replication->ttl;
+    }
+    else if ((state & SCHED_REPLICA_COOLING) and now >= replication->until[slot])
+    {
+      // every copy expired by now
+      replication->slots[slot]= 0;
+      memset((void *)(replication->holders + (size_t)slot * SCHED_REPLICA_HOLDERS), 0,
+             sizeof(uint32_t) * SCHED_REPLICA_HOLDERS);
+    }
+    else if (state & SCHED_REPLICA_HOT)
+    {
+      hot++;
+    }
+  }
+  replication->hot= hot;
+}
+
+void sched_replication_renumber(struct sched_dynamic *dynamic, uint32_t removed)
+{
+  struct sched_replication *replication= dynamic->replication;
+  if (replication == NULL)
+  {
+    return;
+  }
+
+  // the copies on the server that went are out of reach, and gone with it for the handles
+  size_t entries= (size_t)(replication->mask + 1) * SCHED_REPLICA_HOLDERS;
+  for (size_t x= 0; x < entries; x++)
+  {
+    uint32_t server;
+    uint32_t renumbered;
+    do {
+      server= replication->holders[x];
+      renumbered= server == removed + 1 ? 0 : server > removed + 1 ? server - 1 : server;
+    } while (renumbered != server and
+             __sync_bool_compare_and_swap(&replication->holders[x], server, renumbered) == false);
+  }
+}
+
+memcached_return_t memcached_sched_set_replication(memcached_st *ptr, uint32_t replicas, double share, time_t ttl)
+{
+  if (ptr == NULL or ptr->dynamic == NULL or replicas == 0 or replicas > SCHED_REPLICA_MAX or
+      share <= 0 or share > 1 or ttl <= 0)
+  {
+    return MEMCACHED_INVALID_ARGUMENTS;
+  }
+
+  memcached_return_t rc= MEMCACHED_SUCCESS;
+
+  (void)pthread_mutex_lock(&ptr->dynamic->lock);
+  struct sched_replication *replication= ptr->dynamic->replication;
+  if (replicas > 1 and ptr->dynamic->hitters == NULL)
+  {
+    rc= MEMCACHED_INVALID_ARGUMENTS; // nothing would ever be found hot
+  }
+  else if (replication == NULL and replicas > 1 and ptr->dynamic->hitters->capacity > SCHED_HOTKEY_MAX)
+  {
+    rc= MEMCACHED_INVALID_ARGUMENTS;
+  }
+  else if (replication == NULL and replicas > 1)
+  {
+    if ((replication= sched_replication_create(ptr->dynamic->hitters->capacity)) == NULL)
+    {
+      rc= MEMCACHED_MEMORY_ALLOCATION_FAILURE;
+    }
+    ptr->dynamic->replication= replication;
+  }
+
+  if (replication and memcached_success(rc))
+  {
+    // with replicas 1 the keys hot so far cool down at the next tick
+    replication->share= share;
+    replication->ttl= ttl;
+    replication->replicas= replicas;
+    if (replicas > replication->widest)
+    {
+      replication->widest= replicas;
+    }
+  }
+  (void)pthread_mutex_unlock(&ptr->dynamic->lock);
+
+  return rc;
+}
+
+/*
+  A get of key that can go to the owner or to any copy: one of them at
+  random, NULL for the owner. A copy that is missing is left to the caller
+  to fill in once the owner answered, see memcached_sched_fill().
+*/
+char *memcached_sched_spread(memcached_st *ptr, const char *key, size_t key_length,
+                             size_t *value_length, uint32_t *flags, memcached_return_t *error, uint32_t *missed)
+{
+  *missed= UINT32_MAX;
+
+  uint32_t servers[SCHED_REPLICA_MAX];
+  uint32_t count= memcached_sched_replicas(ptr, key, key_length, true, servers, SCHED_REPLICA_MAX - 1, NULL);
+  if (count == 0)
+  {
+    return NULL;
+  }
+
+  uint32_t pick= (uint32_t)random() % (count + 1);
+  if (pick == count)
+  {
+    return NULL;
+  }
+
+  memcached_result_st result;
+  if (memcached_result_create(ptr, &result) == NULL)
+  {
+    return NULL;
+  }
+
+  memcached_sched_counted(ptr, key, key_length);
+
+  char *value= NULL;
+  org::libmemcached::Instance* instance= memcached_instance_fetch(ptr, servers[pick]);
+  memcached_return_t rc= memcached_instance_get(instance, key, key_length, &result);
+  if (rc == MEMCACHED_SUCCESS)
+  {
+    (void)__sync_fetch_and_add(&ptr->dynamic->replication->spread, 1);
+
+    if (value_length)
+    {
+      *value_length= memcached_result_length(&result);
+    }
+    if (flags)
+    {
+      *flags= memcached_result_flags(&result);
+    }
+    *error= MEMCACHED_SUCCESS;
+    value= memcached_string_take_value(&result.value);
+  }
+  else if (rc == MEMCACHED_NOTFOUND)
+  {
+    *missed= servers[pick];
+  }
+
+  memcached_result_free(&result);
+
+  return value;
+}
+
+/* add, so a copy a set wrote since the owner answered stays */
+void memcached_sched_fill(memcached_st *ptr, uint32_t server, const char *key, size_t key_length,
+                          const char *value, size_t value_length, uint32_t flags)
+{
+  struct sched_replication *replication= ptr->dynamic->replication;
+  if (replication == NULL or server >= memcached_server_count(ptr))
+  {
+    return;
+  }
+
+  if (sched_replica_hold(sched_replica_holders(replication, memcached_sched_key_hash(ptr, key, key_length)), server) == false)
+  {
+    return;
+  }
+
+  org::libmemcached::Instance* instance= memcached_instance_fetch(ptr, server);
+  if (memcached_success(memcached_instance_store(instance, true, key, key_length,
+                                                 value, value_length, replication->ttl, flags)))
+  {
+    (void)__sync_fetch_and_add(&replication->filled, 1);
+  }
+}
+
+/*
+  Only a set of a hot key refreshes its copies. Any other write, and any
+  write once the key cooled down, drops them, so no copy outlives the ttl
+  it was written with. A copy that could not be refreshed or dropped, for
+  instance on a server still owing replies to this handle, may keep the
+  old value: the key turns stale.
+*/
+void memcached_sched_replicate(memcached_st *ptr, const char *key, size_t key_length,
+                               const char *value, size_t value_length,
+                               time_t expiration, uint32_t flags, bool set)
+{
+  uint32_t servers[SCHED_REPLICA_MAX - 1 + SCHED_REPLICA_HOLDERS];
+  bool hot= false;
+  uint32_t count= memcached_sched_replicas(ptr, key, key_length, false, servers,
+                                           SCHED_REPLICA_MAX - 1 + SCHED_REPLICA_HOLDERS, &hot);
+  if (count == 0)
+  {
+    return;
+  }
+
+  struct sched_replication *replication= ptr->dynamic->replication;
+  uint32_t hash= memcached_sched_key_hash(ptr, key, key_length);
+  volatile uint32_t *holders= sched_replica_holders(replication, hash);
+
+  // a shorter relative expiration of the value holds for its copies too
+  time_t ttl= replication->ttl;
+  if (expiration > 0 and expiration <= 60 * 60 * 24 * 30 and expiration < ttl)
+  {
+    ttl= expiration;
+  }
+
+  for (uint32_t x= 0; x < count; x++)
+  {
+    org::libmemcached::Instance* instance= memcached_instance_fetch(ptr, servers[x]);
+    if (set and hot)
+    {
+      // recorded first, so a write racing with this one reaches the copy as well
+      if (sched_replica_hold(holders, servers[x]) and
+          memcached_failed(memcached_instance_store(instance, false, key, key_length, value, value_length, ttl, flags)))
+      {
+        sched_replica_stale(replication, hash);
+      }
+    }
+    else
+    {
+      memcached_return_t rc= memcached_instance_delete(instance, key, key_length);
+      if (rc == MEMCACHED_SUCCESS or rc == MEMCACHED_NOTFOUND)
+      {
+        sched_replica_release(holders, servers[x]);
+      }
+      else
+      {
+        sched_replica_stale(replication, hash);
+      }
+    }
+  }
+}
+
+memcached_return_t memcached_sched_replication_stat(memcached_st *ptr, uint32_t *hot, uint64_t *spread, uint64_t *filled)
+{
+  if (ptr == NULL or ptr->dynamic == NULL)
+  {
+    return MEMCACHED_INVALID_ARGUMENTS;
+  }
+
+  struct sched_replication *replication= ptr->dynamic->replication;
+  if (hot)
+  {
+    *hot= replication ? replication->hot : 0;
+  }
+  if (spread)
+  {
+    *spread= replication ? replication->spread : 0;
+  }
+  if (filled)
+  {
+    *filled= replication ? replication->filled : 0;
+  }
+
+  return MEMCACHED_SUCCESS;
+}
@@ -0,0 +1,614 @@
+/*
+ * sched_snapshot.cc
+ *
+ * Saves the dynamic continuum (boundaries, owners, decayed statistics and
+ * alpha/beta/half-life) to a file and loads it back, so a restarted client
+ * routes every key exactly as before instead of starting over from the even
+ * split of update_dynamic().
+ *
+ * The file is written in host byte order:
+ *
+ *   struct sched_snapshot_header
+ *   servers times: uint16_t length, hostname (length bytes), uint16_t port
+ *   points times:  struct sched_snapshot_point
+ *
+ * checksum is FNV-1a over the whole file with the checksum field zeroed.
+ * Owners are positions in the server section; load maps them to the
+ * servers of the loading handle by hostname and port.
+ */
+
+#include <libmemcached/common.h>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define SCHED_SNAPSHOT_MAGIC "DHTSCHED"
+#define SCHED_SNAPSHOT_VERSION 1
+
+struct sched_snapshot_header {
+  char magic[8];
+  uint32_t version;
+  uint32_t length;   // of the whole file
+  uint32_t checksum;
+  uint32_t servers;
+  uint32_t points;
+  uint32_t servers_length; // bytes of the server section
+  double alpha;
+  double beta;
+  double half_life;
+};
+
+struct sched_snapshot_point {
+  uint32_t value;
+  uint32_t owner;
+  double rget;
+  double rset;
+  double rhit;
+  double rbytes;
+  double rusec;
+};
+
+static uint32_t sched_snapshot_checksum(const char *image, size_t length)
+{
+  struct sched_snapshot_header header;
+  memcpy(&header, image, sizeof(header));
+  header.checksum= 0;
+
+  // FNV-1a, carried on from the header to the rest
+  uint32_t hash= 2166136261UL;
+  const unsigned char *bytes= (const unsigned char *)&header;
+  for (size_t x= 0; x < sizeof(header); x++)
+  {
+    hash^= bytes[x];
+    hash*= 16777619;
+  }
+
+  bytes= (const unsigned char *)image + sizeof(header);
+  for (size_t x= 0; x < length - sizeof(header); x++)
+  {
+    hash^= bytes[x];
+    hash*= 16777619;
+  }
+
+  return hash;
+}
+
+/* the server section for the servers of ptr, as they are numbered now */
+static char *sched_snapshot_servers(memcached_st *ptr, size_t *length)
+{
+  size_t size= 0;
+  for (uint32_t x= 0; x < memcached_server_count(ptr); x++)
+  {
+    size+= sizeof(uint16_t) * 2 + strlen(memcached_instance_fetch(ptr, x)->hostname);
+  }
+
+  char *servers= (char *)libmemcached_malloc(NULL, size ? size : 1);
+  if (servers == NULL)
+  {
+    return NULL;
+  }
+
+  char *p= servers;
+  for (uint32_t x= 0; x < memcached_server_count(ptr); x++)
+  {
+    org::libmemcached::Instance* instance= memcached_instance_fetch(ptr, x);
+    uint16_t hostname_length= (uint16_t)strlen(instance->hostname);
+    uint16_t port= (uint16_t)instance->port();
+
+    memcpy(p, &hostname_length, sizeof(uint16_t)); p+= sizeof(uint16_t);
+    memcpy(p, instance->hostname, hostname_length); p+= hostname_length;
+    memcpy(p, &port, sizeof(uint16_t)); p+= sizeof(uint16_t);
+  }
+
+  *length= size;
+  return servers;
+}
+
+/* must hold dynamic->lock */
+static char *sched_snapshot_build(struct sched_dynamic *dynamic, const char *servers, size_t servers_length,
+                                  uint32_t count, size_t *length)
+{
+  struct sched_ring *ring= dynamic->ring;
+  if (ring == NULL)
+  {
+    return NULL;
+  }
+
+  size_t size= sizeof(struct sched_snapshot_header) + servers_length +
+               sizeof(struct sched_snapshot_point) * ring->continuum_points_counter;
+  char *image= (char *)libmemcached_malloc(NULL, size);
+  if (image == NULL)
+  {
+    return NULL;
+  }
+
+  struct sched_snapshot_header header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, SCHED_SNAPSHOT_MAGIC, sizeof(header.magic));
+  header.version= SCHED_SNAPSHOT_VERSION;
+  header.length= (uint32_t)size;
+  header.servers= count;
+  header.points= ring->continuum_points_counter;
+  header.servers_length= (uint32_t)servers_length;
+  header.alpha= dynamic->alpha;
+  header.beta= dynamic->beta;
+  header.half_life= dynamic->half_life;
+  memcpy(image, &header, sizeof(header));
+  memcpy(image + sizeof(header), servers, servers_length);
+
+  char *p= image + sizeof(header) + servers_length;
+  for (uint32_t x= 0; x < ring->continuum_points_counter; x++)
+  {
+    struct sched_snapshot_point point;
+    point.value= ring->values[x];
+    point.owner= ring->owners ? ring->owners[x] : ring->indices[x];
+    point.rget= ring->stats[x].rget;
+    point.rset= ring->stats[x].rset;
+    point.rhit= ring->stats[x].rhit;
+    point.rbytes= ring->stats[x].rbytes;
+    point.rusec= ring->stats[x].rusec;
+    memcpy(p, &point, sizeof(point));
+    p+= sizeof(point);
+  }
+
+  header.checksum= sched_snapshot_checksum(image, size);
+  memcpy(image, &header, sizeof(header));
+
+  *length= size;
+  return image;
+}
+
+/* writes a sibling file and renames it over path, so readers see the old or the new file */
+static int sched_snapshot_write(const char *path, const char *image, size_t length)
+{
+  size_t path_length= strlen(path);
+  char *temp= (char *)libmemcached_malloc(NULL, path_length + sizeof(".tmp"));
+  if (temp == NULL)
+  {
+    return ENOMEM;
+  }
+  memcpy(temp, path, path_length);
+  memcpy(temp + path_length, ".tmp", sizeof(".tmp"));
+
+  int error= 0;
+  int fd= open(temp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd == -1)
+  {
+    error= errno;
+    libmemcached_free(NULL, temp);
+    return error;
+  }
+
+  size_t written= 0;
+  while (written < length)
+  {
+    ssize_t n= write(fd, image + written, length - written);
+    if (n == -1 and errno == EINTR)
+    {
+      continue;
+    }
+    if (n <= 0)
+    {
+      error= n ? errno : EIO;
+      break;
+    }
+    written+= (size_t)n;
+  }
+
+  if (error == 0 and fsync(fd) == -1)
+  {
+    error= errno;
+  }
+  if (close(fd) == -1 and error == 0)
+  {
+    error= errno;
+  }
+  if (error == 0 and rename(temp, path) == -1)
+  {
+    error= errno;
+  }
+  if (error)
+  {
+    (void)unlink(temp);
+  }
+
+  libmemcached_free(NULL, temp);
+  return error;
+}
+
+void sched_snapshot_free(struct sched_snapshot *snapshot)
+{
+  if (snapshot)
+  {
+    libmemcached_free(NULL, snapshot->path);
+    libmemcached_free(NULL, snapshot->servers);
+    libmemcached_free(NULL, snapshot);
+  }
+}
+
+void sched_snapshot_renumber(struct sched_dynamic *dynamic, memcached_st *ptr)
+{
+  struct sched_snapshot *snapshot= dynamic->snapshot;
+  if (snapshot == NULL)
+  {
+    return;
+  }
+
+  size_t length;
+  char *servers= sched_snapshot_servers(ptr, &length);
+  if (servers)
+  {
+    libmemcached_free(NULL, snapshot->servers);
+    snapshot->servers= servers;
+    snapshot->servers_length= length;
+    snapshot->count= memcached_server_count(ptr);
+  }
+}
+
+char *sched_snapshot_due(struct sched_dynamic *dynamic, char **path, size_t *length)
+{
+  struct sched_snapshot *snapshot= dynamic->snapshot;
+  if (snapshot == NULL or snapshot->servers == NULL or dynamic->tick % snapshot->every)
+  {
+    return NULL;
+  }
+
+  char *image= sched_snapshot_build(dynamic, snapshot->servers, snapshot->servers_length, snapshot->count, length);
+  if (image == NULL)
+  {
+    return NULL;
+  }
+
+  size_t path_length= strlen(snapshot->path) + 1;
+  if ((*path= (char *)libmemcached_malloc(NULL, path_length)) == NULL)
+  {
+    libmemcached_free(NULL, image);
+    return NULL;
+  }
+  memcpy(*path, snapshot->path, path_length);
+
+  return image;
+}
+
+void sched_snapshot_flush(struct sched_dynamic *dynamic, char *path, char *image, size_t length)
+{
+  int error= sched_snapshot_write(path, image, length);
+
+  // counted only if memcached_sched_set_snapshot() did not change the path meanwhile
+  (void)pthread_mutex_lock(&dynamic->lock);
+  struct sched_snapshot *snapshot= dynamic->snapshot;
+  if (snapshot and strcmp(snapshot->path, path) == 0)
+  {
+    if (error)
+    {
+      snapshot->failed++;
+      snapshot->error= error;
+    }
+    else
+    {
+      snapshot->written++;
+    }
+  }
+  (void)pthread_mutex_unlock(&dynamic->lock);
+
+  libmemcached_free(NULL, path);
+  libmemcached_free(NULL, image);
+}
+
+memcached_return_t memcached_sched_save(memcached_st *ptr, const char *path)
+{
+  if (ptr == NULL or ptr->dynamic == NULL or path == NULL)
+  {
+    return MEMCACHED_INVALID_ARGUMENTS;
+  }
+
+  size_t servers_length;
+  char *servers= sched_snapshot_servers(ptr, &servers_length);
+  if (servers == NULL)
+  {
+    return MEMCACHED_MEMORY_ALLOCATION_FAILURE;
+  }
+
+  size_t length= 0;
+  (void)pthread_mutex_lock(&ptr->dynamic->lock);
+  char *image= sched_snapshot_build(ptr->dynamic, servers, servers_length, memcached_server_count(ptr), &length);
+  (void)pthread_mutex_unlock(&ptr->dynamic->lock);
+  libmemcached_free(NULL, servers);
+
+  if (image == NULL)
+  {
+    return ptr->dynamic->ring ? MEMCACHED_MEMORY_ALLOCATION_FAILURE : MEMCACHED_NO_SERVERS;
+  }
+
+  int error= sched_snapshot_write(path, image, length);
+  libmemcached_free(NULL, image);
+
+  if (error)
+  {
+    return memcached_set_errno(*ptr, error, MEMCACHED_AT);
+  }
+
+  return MEMCACHED_SUCCESS;
+}
+
+/*
+  Turns the server section into a map from saved position to the position
+  of the same hostname and port in ptr. Every saved server must be there
+  exactly once.
+*/
+static bool sched_snapshot_map(memcached_st *ptr, const char *p, const char *end, uint32_t count, uint32_t *map)
+{
+  if (count != memcached_server_count(ptr))
+  {
+    return false;
+  }
+
+  for (uint32_t x= 0; x < count; x++)
+  {
+    uint16_t hostname_length, port;
+    if (p + sizeof(uint16_t) > end)
+    {
+      return false;
+    }
+    memcpy(&hostname_length, p, sizeof(uint16_t)); p+= sizeof(uint16_t);
+    if (p + hostname_length + sizeof(uint16_t) > end)
+    {
+      return false;
+    }
+    const char *hostname= p; p+= hostname_length;
+    memcpy(&port, p, sizeof(uint16_t)); p+= sizeof(uint16_t);
+
+    map[x]= UINT32_MAX;
+    for (uint32_t y= 0; y < count; y++)
+    {
+      org::libmemcached::Instance* instance= memcached_instance_fetch(ptr, y);
+      if (instance->port() == port and strlen(instance->hostname) == hostname_length and
+          memcmp(instance->hostname, hostname, hostname_length) == 0)
+      {
+        map[x]= y;
+        break;
+      }
+    }
+
+    if (map[x] == UINT32_MAX)
+    {
+      return false;
+    }
+    for (uint32_t y= 0; y < x; y++)
+    {
+      if (map[y] == map[x])
+      {
+        return false;
+      }
+    }
+  }
+
+  return p == end;
+}
+
+static struct sched_ring *sched_snapshot_ring(const char *p, uint32_t points, const uint32_t *map, uint32_t count)
+{
+  struct sched_ring *ring= sched_ring_create(points);
+  if (ring == NULL)
+  {
+    return NULL;
+  }
+
+  for (uint32_t x= 0; x < points; x++)
+  {
+    struct sched_snapshot_point point;
+    memcpy(&point, p, sizeof(point));
+    p+= sizeof(point);
+
+    if (point.owner >= count or (x and point.value < ring->values[x - 1]))
+    {
+      sched_ring_free(ring);
+      return NULL;
+    }
+
+    ring->values[x]= point.value;
+    ring->indices[x]= map[point.owner];
+    ring->stats[x].rget= point.rget;
+    ring->stats[x].rset= point.rset;
+    ring->stats[x].rhit= point.rhit;
+    ring->stats[x].rbytes= point.rbytes;
+    ring->stats[x].rusec= point.rusec;
+  }
+
+  sched_ring_index(ring);
+  return ring;
+}
+
+memcached_return_t memcached_sched_load(memcached_st *ptr, const char *path)
+{
+  if (ptr == NULL or ptr->dynamic == NULL or path == NULL)
+  {
+    return MEMCACHED_INVALID_ARGUMENTS;
+  }
+
+  if (memcached_server_count(ptr) == 0)
+  {
+    return MEMCACHED_NO_SERVERS;
+  }
+
+  int fd= open(path, O_RDONLY);
+  if (fd == -1)
+  {
+    return memcached_set_errno(*ptr, errno, MEMCACHED_AT);
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) == -1)
+  {
+    int error= errno;
+    (void)close(fd);
+    return memcached_set_errno(*ptr, error, MEMCACHED_AT);
+  }
+
+  if ((size_t)st.st_size < sizeof(struct sched_snapshot_header))
+  {
+    (void)close(fd);
+    return memcached_set_error(*ptr, MEMCACHED_PARSE_ERROR, MEMCACHED_AT,
+                               memcached_literal_param("snapshot is too short"));
+  }
+
+  size_t length= (size_t)st.st_size;
+  void *mapped= mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+  (void)close(fd);
+  if (mapped == MAP_FAILED)
+  {
+    return memcached_set_errno(*ptr, errno, MEMCACHED_AT);
+  }
+
+  const char *image= (const char *)mapped;
+  struct sched_snapshot_header header;
+  memcpy(&header, image, sizeof(header));
+
+  memcached_return_t rc= MEMCACHED_SUCCESS;
+  if (memcmp(header.magic, SCHED_SNAPSHOT_MAGIC, sizeof(header.magic)) or
+      header.version != SCHED_SNAPSHOT_VERSION or header.length != length or header.points == 0 or
+      (uint64_t)sizeof(header) + header.servers_length + (uint64_t)sizeof(struct sched_snapshot_point) * header.points != length or
+      header.checksum != sched_snapshot_checksum(image, length))
+  {
+    rc= memcached_set_error(*ptr, MEMCACHED_PARSE_ERROR, MEMCACHED_AT,
+                            memcached_literal_param("not a snapshot of this version, or damaged"));
+  }
+
+  uint32_t *map= NULL;
+  if (memcached_success(rc))
+  {
+    const char *servers= image + sizeof(header);
+    map= libmemcached_xcalloc(NULL, header.servers ? header.servers : 1, uint32_t);
+    if (map == NULL)
+    {
+      rc= MEMCACHED_MEMORY_ALLOCATION_FAILURE;
+    }
+    else if (sched_snapshot_map(ptr, servers, servers + header.servers_length, header.servers, map) == false)
+    {
+      rc= memcached_set_error(*ptr, MEMCACHED_INVALID_ARGUMENTS, MEMCACHED_AT,
+                              memcached_literal_param("snapshot was taken with other servers"));
+    }
+  }
+
+  struct sched_ring *ring= NULL;
+  if (memcached_success(rc))
+  {
+    ring= sched_snapshot_ring(image + sizeof(header) + header.servers_length, header.points, map, header.servers);
+    if (ring == NULL)
+    {
+      rc= memcached_set_error(*ptr, MEMCACHED_PARSE_ERROR, MEMCACHED_AT,
+                              memcached_literal_param("snapshot has a broken continuum"));
+    }
+  }
+
+  libmemcached_free(NULL, map);
+  (void)munmap(mapped, length);
+
+  if (memcached_failed(rc))
+  {
+    return rc;
+  }
+
+  (void)pthread_mutex_lock(&ptr->dynamic->lock);
+  if (ptr->dynamic->continuum_count != header.servers)
+  {
+    (void)pthread_mutex_unlock(&ptr->dynamic->lock);
+    sched_ring_free(ring);
+    return memcached_set_error(*ptr, MEMCACHED_INVALID_ARGUMENTS, MEMCACHED_AT,
+                               memcached_literal_param("snapshot was taken with other servers"));
+  }
+
+  // saved with the real owners: the servers ejected right now are detoured again
+  rc= sched_ring_detour_down(ptr, ring);
+  if (memcached_failed(rc))
+  {
+    (void)pthread_mutex_unlock(&ptr->dynamic->lock);
+    sched_ring_free(ring);
+    return rc;
+  }
+
+  ptr->dynamic->alpha= header.alpha;
+  ptr->dynamic->beta= header.beta;
+  ptr->dynamic->half_life= header.half_life;
+
+  ring->layout= ++ptr->dynamic->layout;
+  sched_ring_publish(ptr->dynamic, ring);
+  (void)pthread_mutex_unlock(&ptr->dynamic->lock);
+
+  return MEMCACHED_SUCCESS;
+}
+
+memcached_return_t memcached_sched_set_snapshot(memcached_st *ptr, const char *path, uint32_t every)
+{
+  if (ptr == NULL or ptr->dynamic == NULL)
+  {
+    return MEMCACHED_INVALID_ARGUMENTS;
+  }
+
+  struct sched_snapshot *snapshot= NULL;
+  if (path and every)
+  {
+    size_t path_length= strlen(path) + 1;
+    snapshot= libmemcached_xcalloc(NULL, 1, struct sched_snapshot);
+    if (snapshot == NULL or (snapshot->path= (char *)libmemcached_malloc(NULL, path_length)) == NULL)
+    {
+      sched_snapshot_free(snapshot);
+      return MEMCACHED_MEMORY_ALLOCATION_FAILURE;
+    }
+    memcpy(snapshot->path, path, path_length);
+    snapshot->every= every;
+  }
+
+  memcached_return_t rc= MEMCACHED_SUCCESS;
+  (void)pthread_mutex_lock(&ptr->dynamic->lock);
+  struct sched_snapshot *old= ptr->dynamic->snapshot;
+  ptr->dynamic->snapshot= snapshot;
+  sched_snapshot_renumber(ptr->dynamic, ptr);
+  if (snapshot and snapshot->servers == NULL)
+  {
+    rc= MEMCACHED_MEMORY_ALLOCATION_FAILURE; // stays set, written once update_dynamic() renumbers
+  }
+  (void)pthread_mutex_unlock(&ptr->dynamic->lock);
+
+  sched_snapshot_free(old);
+
+  return rc;
+}
+
+memcached_return_t memcached_sched_snapshot_stat(memcached_st *ptr, uint64_t *written, uint64_t *failed, int *error)
+{
+  if (ptr == NULL or ptr->dynamic == NULL)
+  {
+    return MEMCACHED_INVALID_ARGUMENTS;
+  }
+
+  uint64_t snapshot_written= 0;
+  uint64_t snapshot_failed= 0;
+  int snapshot_error= 0;
+
+  (void)pthread_mutex_lock(&ptr->dynamic->lock);
+  struct sched_snapshot *snapshot= ptr->dynamic->snapshot;
+  if (snapshot)
+  {
+    snapshot_written= snapshot->written;
+    snapshot_failed= snapshot->failed;
+    snapshot_error= snapshot->error;
+  }
+  (void)pthread_mutex_unlock(&ptr->dynamic->lock);
+
+  if (written)
+  {
+    *written= snapshot_written;
+  }
+  if (failed)
+  {
+    *failed= snapshot_failed;
+  }
+  if (error)
+  {
+    *error= snapshot_error;
+  }
+
+  return MEMCACHED_SUCCESS;
+}
@@ -0,0 +1,296 @@
+/*
+ * sched_table.cc
+ *
+ * MEMCACHED_DISTRIBUTION_MAGLEV and MEMCACHED_DISTRIBUTION_JUMP, see struct
+ * sched_table. Ketama searches its points for every key; these only index a
+ * table, Maglev after one multiply, jump hashing after a few per doubling
+ * of the buckets. Both still move few keys when a server comes or goes.
+ */
+
+#include <libmemcached/common.h>
+
+void sched_table_free(struct sched_table *table)
+{
+  if (table)
+  {
+    libmemcached_free(NULL, table->entry);
+    libmemcached_free(NULL, table);
+  }
+}
+
+static inline uint32_t sched_table_weight(const org::libmemcached::Instance* instance)
+{
+  return instance->weight ? instance->weight : 1;
+}
+
+/* size slots in ptr->table, which is created on first use */
+static struct sched_table *sched_table_reserve(memcached_st *ptr, uint32_t size)
+{
+  if (ptr->table == NULL and (ptr->table= libmemcached_xcalloc(NULL, 1, struct sched_table)) == NULL)
+  {
+    return NULL;
+  }
+
+  struct sched_table *table= ptr->table;
+  if (size > table->capacity)
+  {
+    uint32_t *entry= libmemcached_xcalloc(NULL, size, uint32_t);
+    if (entry == NULL)
+    {
+      return NULL;
+    }
+    libmemcached_free(NULL, table->entry);
+    table->entry= entry;
+    table->capacity= size;
+  }
+  table->size= size;
+
+  return table;
+}
+
+/*
+  The servers auto_eject has not taken out, and when the first of those that
+  were is due back; with none left, all of them.
+*/
+static uint32_t sched_table_live(memcached_st *ptr, bool *live)
+{
+  org::libmemcached::Instance* list= memcached_instance_list(ptr);
+  uint32_t count= memcached_server_count(ptr);
+  bool is_auto_ejecting= _is_auto_eject_host(ptr);
+  time_t now= time(NULL);
+  uint32_t alive= 0;
+
+  ptr->ketama.next_distribution_rebuild= 0;
+  for (uint32_t x= 0; x < count; x++)
+  {
+    live[x]= is_auto_ejecting == false or list[x].next_retry <= now;
+    if (live[x])
+    {
+      alive++;
+    }
+    else if (ptr->ketama.next_distribution_rebuild == 0 or list[x].next_retry < ptr->ketama.next_distribution_rebuild)
+    {
+      ptr->ketama.next_distribution_rebuild= list[x].next_retry;
+    }
+  }
+
+  if (alive == 0)
+  {
+    for (uint32_t x= 0; x < count; x++)
+    {
+      live[x]= true;
+    }
+    alive= count;
+  }
+
+  return alive;
+}
+
+static bool sched_maglev_prime(uint32_t n)
+{
+  for (uint32_t d= 3; d * d <= n; d+= 2)
+  {
+    if (n % d == 0)
+    {
+      return false;
+    }
+  }
+
+  return n % 2 == 1;
+}
+
+/* the same for any number of servers up to size / SCHED_MAGLEV_SLOTS, so adding one moves little */
+static uint32_t sched_maglev_size(uint32_t live)
+{
+  uint32_t size= SCHED_MAGLEV_SIZE;
+
+  while ((uint64_t)size < (uint64_t)live * SCHED_MAGLEV_SLOTS and size < (1U << 30))
+  {
+    for (size= size * 2 + 1; sched_maglev_prime(size) == false; size+= 2) { }
+  }
+
+  return size;
+}
+
+static memcached_return_t sched_maglev_build(memcached_st *ptr, const bool *live, uint32_t alive)
+{
+  org::libmemcached::Instance* list= memcached_instance_list(ptr);
+  uint32_t count= memcached_server_count(ptr);
+  uint32_t size= sched_maglev_size(alive);
+
+  struct sched_table *table= sched_table_reserve(ptr, size);
+  uint32_t *turns= libmemcached_xcalloc(NULL, count * 4, uint32_t);
+  if (table == NULL or turns == NULL)
+  {
+    libmemcached_free(NULL, turns);
+    return memcached_set_error(*ptr, MEMCACHED_MEMORY_ALLOCATION_FAILURE, MEMCACHED_AT);
+  }
+  uint32_t *offset= turns;
+  uint32_t *skip= turns + count;
+  uint32_t *next= turns + count * 2;
+  uint32_t *credit= turns + count * 3;
+
+  // a permutation by name, not by place in the list, is the same whichever servers are around it
+  uint32_t heaviest= 1;
+  for (uint32_t x= 0; x < count; x++)
+  {
+    char name[MEMCACHED_NI_MAXHOST + 16];
+    int length= snprintf(name, sizeof(name), "%s:%u", list[x].hostname, (uint32_t)list[x].port());
+
+    offset[x]= libhashkit_fnv1a_32(name, (size_t)length) % size;
+    skip[x]= libhashkit_jenkins(name, (size_t)length) % (size - 1) + 1;
+    if (live[x] and sched_table_weight(list + x) > heaviest)
+    {
+      heaviest= sched_table_weight(list + x);
+    }
+  }
+
+  for (uint32_t slot= 0; slot < size; slot++)
+  {
+    table->entry[slot]= UINT32_MAX;
+  }
+
+  uint32_t filled= 0;
+  while (filled < size)
+  {
+    for (uint32_t x= 0; x < count and filled < size; x++)
+    {
+      if (live[x] == false)
+      {
+        continue;
+      }
+
+      credit[x]+= sched_table_weight(list + x);
+      if (credit[x] < heaviest)
+      {
+        continue;
+      }
+      credit[x]-= heaviest;
+
+      uint32_t slot;
+      do
+      {
+        slot= (uint32_t)(((uint64_t)offset[x] + (uint64_t)next[x] * skip[x]) % size);
+        next[x]++;
+      } while (table->entry[slot] != UINT32_MAX);
+
+      table->entry[slot]= x;
+      filled++;
+    }
+  }
+
+  libmemcached_free(NULL, turns);
+
+  return MEMCACHED_SUCCESS;
+}
+
+static memcached_return_t sched_jump_build(memcached_st *ptr, const bool *live)
+{
+  org::libmemcached::Instance* list= memcached_instance_list(ptr);
+  uint32_t count= memcached_server_count(ptr);
+
+  // one bucket per unit of weight, so a join leaves the others' buckets alone
+  uint64_t buckets= 0;
+  for (uint32_t x= 0; x < count; x++)
+  {
+    buckets+= sched_table_weight(list + x);
+  }
+  if (buckets > SCHED_JUMP_BUCKETS)
+  {
+    return memcached_set_error(*ptr, MEMCACHED_INVALID_ARGUMENTS, MEMCACHED_AT,
+                               memcached_literal_param("server weights too large for MEMCACHED_DISTRIBUTION_JUMP"));
+  }
+
+  struct sched_table *table= sched_table_reserve(ptr, (uint32_t)buckets);
+  if (table == NULL)
+  {
+    return memcached_set_error(*ptr, MEMCACHED_MEMORY_ALLOCATION_FAILURE, MEMCACHED_AT);
+  }
+
+  uint32_t bucket= 0;
+  for (uint32_t x= 0; x < count; x++)
+  {
+    for (uint32_t y= 0; y < sched_table_weight(list + x); y++)
+    {
+      table->entry[bucket++]= live[x] ? x : x | SCHED_JUMP_DOWN;
+    }
+  }
+
+  return MEMCACHED_SUCCESS;
+}
+
+memcached_return_t sched_table_build(memcached_st *ptr)
+{
+  uint32_t count= memcached_server_count(ptr);
+  if (count == 0)
+  {
+    return sched_table_reserve(ptr, 0) ? MEMCACHED_SUCCESS :
+           memcached_set_error(*ptr, MEMCACHED_MEMORY_ALLOCATION_FAILURE, MEMCACHED_AT);
+  }
+
+  bool *live= libmemcached_xcalloc(NULL, count, bool);
+  if (live == NULL)
+  {
+    return memcached_set_error(*ptr, MEMCACHED_MEMORY_ALLOCATION_FAILURE, MEMCACHED_AT);
+  }
+
+  uint32_t alive= sched_table_live(ptr, live);
+  memcached_return_t rc= ptr->distribution == MEMCACHED_DISTRIBUTION_MAGLEV ?
+                         sched_maglev_build(ptr, live, alive) : sched_jump_build(ptr, live);
+  libmemcached_free(NULL, live);
+
+  return rc;
+}
+
+uint32_t sched_maglev_route(const memcached_st *ptr, uint32_t hash)
+{
+  const struct sched_table *table= ptr->table;
+  if (table == NULL or table->size == 0)
+  {
+    return hash % memcached_server_count(ptr);
+  }
+
+  // hash scaled to the table, a multiply where hash % size would divide
+  return table->entry[((uint64_t)hash * table->size) >> 32];
+}
+
+/* Lamping and Veach, "A Fast, Minimal Memory, Consistent Hash Algorithm" */
+static inline uint32_t sched_jump(uint64_t key, uint32_t buckets)
+{
+  int64_t bucket= -1;
+  int64_t jump= 0;
+
+  while (jump < (int64_t)buckets)
+  {
+    bucket= jump;
+    key= key * 2862933555777941757ULL + 1;
+    jump= (int64_t)((double)(bucket + 1) * ((double)(1LL << 31) / (double)((key >> 33) + 1)));
+  }
+
+  return (uint32_t)bucket;
+}
+
+uint32_t sched_jump_route(const memcached_st *ptr, uint32_t hash)
+{
+  const struct sched_table *table= ptr->table;
+  if (table == NULL or table->size == 0)
+  {
+    return hash % memcached_server_count(ptr);
+  }
+
+  uint64_t key= hash;
+  uint32_t bucket= sched_jump(key, table->size);
+  for (uint32_t retry= 0; retry < SCHED_JUMP_RETRIES and (table->entry[bucket] & SCHED_JUMP_DOWN); retry++)
+  {
+    key= (key + 1) * 0x9E3779B97F4A7C15ULL;
+    bucket= sched_jump(key ^ (key >> 29), table->size);
+  }
+
+  // rarely left on an ejected server after all the retries; some bucket is live
+  while (table->entry[bucket] & SCHED_JUMP_DOWN)
+  {
+    bucket= (bucket + 1) % table->size;
+  }
+
+  return table->entry[bucket];
+}
@@ -0,0 +1,249 @@
+/*
+ * sched_thread.cc
+ *
+ * The scheduler on a thread of its own: instead of an outside caller
+ * driving mem_hs_sched_dynamic() on a fixed timer, the thread ticks only
+ * once enough requests were routed, and more often while the policy keeps
+ * finding boundaries to move, see struct sched_thread. Every so many ticks
+ * it also asks the servers for their eviction pressure first, see
+ * memcached_sched_set_feedback().
+ */
+
+#include <libmemcached/common.h>
+
+#include <sys/time.h>
+
+/* start, stop and stat of dynamic->thread, shared by every handle; the thread never takes it */
+static pthread_mutex_t sched_thread_LOCK= PTHREAD_MUTEX_INITIALIZER;
+
+/*
+  Requests routed through ring since the last tick, folded into its
+  statistics on the way so the tick that follows finds nothing new.
+*/
+static uint64_t sched_thread_samples(struct sched_dynamic *dynamic, uint32_t *points)
+{
+  uint64_t samples= 0;
+
+  (void)pthread_mutex_lock(&dynamic->lock);
+  struct sched_ring *ring= dynamic->ring;
+  *points= 0;
+  if (ring)
+  {
+    sched_counters_merge(dynamic, ring);
+    for (uint32_t x= 0; x < ring->continuum_points_counter; x++)
+    {
+      samples+= ring->stats[x].get + ring->stats[x].set;
+    }
+    *points= ring->continuum_points_counter;
+  }
+  (void)pthread_mutex_unlock(&dynamic->lock);
+
+  return samples;
+}
+
+static void *sched_thread_run(void *context)
+{
+  struct sched_thread *thread= (struct sched_thread *)context;
+  struct sched_dynamic *dynamic= thread->dynamic;
+  uint64_t ticks= 0; // run here, thread->ticks is for the stats
+
+  (void)pthread_mutex_lock(&thread->lock);
+  while (thread->stop == false)
+  {
+    struct timeval now;
+    struct timespec until;
+    (void)gettimeofday(&now, NULL);
+    uint64_t usec= (uint64_t)now.tv_usec + (uint64_t)thread->interval * 1000;
+    until.tv_sec= now.tv_sec + (time_t)(usec / 1000000);
+    until.tv_nsec= (long)(usec % 1000000) * 1000;
+
+    // one deadline per tick: a spurious wake-up goes back to waiting for the rest of it
+    int rc= 0;
+    while (thread->stop == false and rc != ETIMEDOUT)
+    {
+      rc= pthread_cond_timedwait(&thread->wake, &thread->lock, &until);
+    }
+    if (thread->stop)
+    {
+      break;
+    }
+    (void)pthread_mutex_unlock(&thread->lock);
+
+    uint32_t points;
+    bool ran= false;
+    bool moved= false;
+    if (sched_thread_samples(dynamic, &points) >= (uint64_t)SCHED_THREAD_SAMPLES * points and points >= 2)
+    {
+      ran= true;
+      sched_feedback_poll(thread, ticks++);
+      moved= sched_dynamic_tick(dynamic);
+    }
+
+    // the counts and the wait change under thread->lock, where memcached_sched_thread_stat() reads them
+    (void)pthread_mutex_lock(&thread->lock);
+    uint32_t interval= thread->interval;
+    if (ran == false)
+    {
+      thread->skipped++;
+    }
+    else
+    {
+      thread->ticks++;
+    }
+
+    // doubled no further than max_interval: a wrap would bring the wait back to min_interval
+    if (ran and moved)
+    {
+      interval/= 2;
+    }
+    else
+    {
+      interval= interval > thread->max_interval / 2 ? thread->max_interval : interval * 2;
+    }
+
+    if (interval < thread->min_interval)
+    {
+      interval= thread->min_interval;
+    }
+    else if (interval > thread->max_interval)
+    {
+      interval= thread->max_interval;
+    }
+    thread->interval= interval;
+  }
+  (void)pthread_mutex_unlock(&thread->lock);
+
+  memcached_free(thread->poll);
+  thread->poll= NULL;
+
+  return NULL;
+}
+
+/* must hold sched_thread_LOCK */
+static void sched_thread_stop_locked(struct sched_dynamic *dynamic)
+{
+  struct sched_thread *thread= dynamic->thread;
+  if (thread == NULL)
+  {
+    return;
+  }
+
+  (void)pthread_mutex_lock(&thread->lock);
+  thread->stop= true;
+  (void)pthread_cond_signal(&thread->wake);
+  (void)pthread_mutex_unlock(&thread->lock);
+
+  (void)pthread_join(thread->thread, NULL);
+  dynamic->thread= NULL;
+
+  pthread_cond_destroy(&thread->wake);
+  pthread_mutex_destroy(&thread->lock);
+  libmemcached_free(NULL, thread);
+}
+
+void sched_thread_stop(struct sched_dynamic *dynamic)
+{
+  (void)pthread_mutex_lock(&sched_thread_LOCK);
+  sched_thread_stop_locked(dynamic);
+  (void)pthread_mutex_unlock(&sched_thread_LOCK);
+}
+
+memcached_return_t memcached_sched_start(memcached_st *ptr, memcached_sched_policy_t policy,
+                                         uint32_t min_interval, uint32_t max_interval)
+{
+  if (ptr == NULL or ptr->dynamic == NULL or min_interval == 0 or min_interval > max_interval)
+  {
+    return MEMCACHED_INVALID_ARGUMENTS;
+  }
+
+  memcached_return_t rc= memcached_sched_set_policy(ptr, policy);
+  if (memcached_failed(rc))
+  {
+    return rc;
+  }
+
+  struct sched_thread *thread= libmemcached_xcalloc(NULL, 1, struct sched_thread);
+  if (thread == NULL)
+  {
+    return MEMCACHED_MEMORY_ALLOCATION_FAILURE;
+  }
+
+  pthread_mutex_init(&thread->lock, NULL);
+  pthread_cond_init(&thread->wake, NULL);
+  thread->dynamic= ptr->dynamic;
+  thread->min_interval= min_interval;
+  thread->max_interval= max_interval;
+  thread->interval= min_interval;
+
+  // one thread at a time, whichever handle starts it
+  (void)pthread_mutex_lock(&sched_thread_LOCK);
+  sched_thread_stop_locked(ptr->dynamic);
+  int error= pthread_create(&thread->thread, NULL, sched_thread_run, thread);
+  if (error == 0)
+  {
+    ptr->dynamic->thread= thread;
+  }
+  (void)pthread_mutex_unlock(&sched_thread_LOCK);
+
+  if (error)
+  {
+    pthread_cond_destroy(&thread->wake);
+    pthread_mutex_destroy(&thread->lock);
+    libmemcached_free(NULL, thread);
+    return memcached_set_errno(*ptr, error, MEMCACHED_AT);
+  }
+
+  return MEMCACHED_SUCCESS;
+}
+
+memcached_return_t memcached_sched_stop(memcached_st *ptr)
+{
+  if (ptr == NULL or ptr->dynamic == NULL)
+  {
+    return MEMCACHED_INVALID_ARGUMENTS;
+  }
+
+  sched_thread_stop(ptr->dynamic);
+
+  return MEMCACHED_SUCCESS;
+}
+
+memcached_return_t memcached_sched_thread_stat(memcached_st *ptr, uint64_t *ticks, uint64_t *skipped, uint32_t *interval)
+{
+  if (ptr == NULL or ptr->dynamic == NULL)
+  {
+    return MEMCACHED_INVALID_ARGUMENTS;
+  }
+
+  uint64_t thread_ticks= 0;
+  uint64_t thread_skipped= 0;
+  uint32_t thread_interval= 0;
+
+  // sched_thread_LOCK keeps the thread from being freed, its lock the counts from moving
+  (void)pthread_mutex_lock(&sched_thread_LOCK);
+  struct sched_thread *thread= ptr->dynamic->thread;
+  if (thread)
+  {
+    (void)pthread_mutex_lock(&thread->lock);
+    thread_ticks= thread->ticks;
+    thread_skipped= thread->skipped;
+    thread_interval= thread->interval;
+    (void)pthread_mutex_unlock(&thread->lock);
+  }
+  (void)pthread_mutex_unlock(&sched_thread_LOCK);
+
+  if (ticks)
+  {
+    *ticks= thread_ticks;
+  }
+  if (skipped)
+  {
+    *skipped= thread_skipped;
+  }
+  if (interval)
+  {
+    *interval= thread_interval;
+  }
+
+  return MEMCACHED_SUCCESS;
+}
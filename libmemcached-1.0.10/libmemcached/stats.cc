@@ -701,3 +701,184 @@ memcached_return_t memcached_stat_execute(memcached_st *memc, const char *args,
 
  return memcached_server_execute(memc, call_stat_fn, (void *)&check);
 }
+
+static memcached_return_t sched_feedback_fn(const memcached_server_instance_st server,
+                                            const char *key, size_t key_length,
+                                            const char *value, size_t value_length,
+                                            void *context)
+{
+  struct sched_feedback *report= (struct sched_feedback *)context + memcached_instance_position(server);
+  uint64_t *field= NULL;
+
+  if (key_length == sizeof("evictions") -1 and memcmp("evictions", key, key_length) == 0)
+  {
+    field= &report->evictions;
+  }
+  else if (key_length == sizeof("evicted_unfetched") -1 and memcmp("evicted_unfetched", key, key_length) == 0)
+  {
+    field= &report->evicted_unfetched;
+  }
+  else if (key_length == sizeof("bytes") -1 and memcmp("bytes", key, key_length) == 0)
+  {
+    field= &report->bytes;
+  }
+  else if (key_length == sizeof("limit_maxbytes") -1 and memcmp("limit_maxbytes", key, key_length) == 0)
+  {
+    field= &report->limit_maxbytes;
+  }
+  else if (key_length == sizeof("curr_items") -1 and memcmp("curr_items", key, key_length) == 0)
+  {
+    field= &report->curr_items;
+  }
+
+  if (field)
+  {
+    char buffer[SMALL_STRING_LEN];
+    size_t length= value_length < sizeof(buffer) -1 ? value_length : sizeof(buffer) -1;
+    memcpy(buffer, value, length);
+    buffer[length]= 0;
+
+    *field= strtoull(buffer, (char **)NULL, 10);
+    report->reported= true;
+  }
+
+  return MEMCACHED_SUCCESS;
+}
+
+/* the stats of every server of memc, indexed by position; a server that did not answer is not reported */
+static struct sched_feedback *sched_feedback_collect(memcached_st *memc, memcached_return_t *rc)
+{
+  struct sched_feedback *feedback= libmemcached_xcalloc(memc, memcached_server_count(memc), struct sched_feedback);
+  if (feedback == NULL)
+  {
+    *rc= MEMCACHED_MEMORY_ALLOCATION_FAILURE;
+    return NULL;
+  }
+
+  *rc= memcached_stat_execute(memc, NULL, sched_feedback_fn, feedback);
+
+  return feedback;
+}
+
+memcached_return_t memcached_sched_feedback(memcached_st *self)
+{
+  if (self == NULL or self->dynamic == NULL)
+  {
+    return MEMCACHED_INVALID_ARGUMENTS;
+  }
+
+  uint32_t count= memcached_server_count(self);
+  if (count == 0)
+  {
+    return MEMCACHED_NO_SERVERS;
+  }
+
+  // a server that did not answer is left as it was
+  memcached_return_t rc;
+  struct sched_feedback *feedback= sched_feedback_collect(self, &rc);
+  if (feedback == NULL)
+  {
+    return rc;
+  }
+
+  (void)pthread_mutex_lock(&self->dynamic->lock);
+  sched_servers_feedback(self->dynamic, feedback, count);
+  (void)pthread_mutex_unlock(&self->dynamic->lock);
+
+  libmemcached_free(self, feedback);
+
+  return rc;
+}
+
+void sched_feedback_renumber(struct sched_dynamic *dynamic, memcached_st *ptr)
+{
+  // left NULL when it cannot be built: the thread stops polling until the next renumbering
+  memcached_server_list_st servers= NULL;
+  if (dynamic->feedback_every)
+  {
+    for (uint32_t x= 0; x < memcached_server_count(ptr); x++)
+    {
+      org::libmemcached::Instance* instance= memcached_instance_fetch(ptr, x);
+      memcached_return_t rc;
+      memcached_server_list_st appended= memcached_server_list_append(servers, instance->hostname, instance->port(), &rc);
+      if (appended == NULL)
+      {
+        memcached_server_list_free(servers);
+        servers= NULL;
+        break;
+      }
+      servers= appended;
+    }
+  }
+
+  memcached_server_list_free(dynamic->feedback_servers);
+  dynamic->feedback_servers= servers;
+  dynamic->feedback_layout++;
+}
+
+void sched_feedback_poll(struct sched_thread *thread, uint64_t ticks)
+{
+  struct sched_dynamic *dynamic= thread->dynamic;
+  memcached_st **poll= &thread->poll;
+  uint64_t *layout= &thread->poll_layout;
+
+  // *poll shares nothing with the other handles, so it is built and freed under the lock
+  (void)pthread_mutex_lock(&dynamic->lock);
+  if (dynamic->feedback_every == 0 or ticks % dynamic->feedback_every)
+  {
+    (void)pthread_mutex_unlock(&dynamic->lock);
+    return;
+  }
+
+  uint64_t polled= dynamic->feedback_layout;
+  if (*poll == NULL or *layout != polled)
+  {
+    memcached_free(*poll);
+    *poll= NULL;
+
+    if (dynamic->feedback_servers)
+    {
+      // a server that does not answer delays the tick, by little and only until its retry timeout
+      *poll= sched_handle_create();
+      if (*poll)
+      {
+        (void)memcached_behavior_set(*poll, MEMCACHED_BEHAVIOR_CONNECT_TIMEOUT, SCHED_FEEDBACK_TIMEOUT);
+        (void)memcached_behavior_set(*poll, MEMCACHED_BEHAVIOR_POLL_TIMEOUT, SCHED_FEEDBACK_TIMEOUT);
+      }
+      if (*poll and memcached_failed(memcached_server_push(*poll, dynamic->feedback_servers)))
+      {
+        memcached_free(*poll);
+        *poll= NULL;
+      }
+    }
+
+    // built, or nothing to build: a failure is retried next time
+    if (*poll or dynamic->feedback_servers == NULL)
+    {
+      *layout= polled;
+    }
+  }
+  (void)pthread_mutex_unlock(&dynamic->lock);
+
+  if (*poll == NULL or memcached_server_count(*poll) == 0)
+  {
+    return;
+  }
+
+  memcached_return_t rc;
+  struct sched_feedback *feedback= sched_feedback_collect(*poll, &rc);
+  if (feedback == NULL)
+  {
+    return;
+  }
+
+  // the servers may have been renumbered while they were asked
+  (void)pthread_mutex_lock(&dynamic->lock);
+  if (dynamic->feedback_layout == polled)
+  {
+    sched_servers_feedback(dynamic, feedback, memcached_server_count(*poll));
+  }
+  (void)pthread_mutex_unlock(&dynamic->lock);
+
+  libmemcached_free(*poll, feedback);
+}
@@ -403,6 +403,7 @@ static inline memcached_return_t memcached_send(memcached_st *ptr,
     value_length= hashkit_string_length(destination);
   }
 
+  memcached_sched_sent(instance, memcached_sched_routed(ptr));
   if (memcached_is_binary(ptr))
   {
     rc= memcached_send_binary(ptr, instance, server_key,
@@ -418,11 +419,43 @@ static inline memcached_return_t memcached_send(memcached_st *ptr,
                              flags, cas, flush, reply, verb);
   }
 
+  if (memcached_success(rc) or rc == MEMCACHED_BUFFERED)
+  {
+    memcached_sched_reply(instance, group_key, group_key_length, false, key_length + value_length);
+  }
+
+  // jinho added
+  memcached_sched_after_write(ptr, group_key, group_key_length, key, key_length, rc,
+                              value, value_length, expiration, flags, verb == SET_OP);
+
   hashkit_string_free(destination);
 
   return rc;
 }
 
+memcached_return_t memcached_instance_store(org::libmemcached::Instance* instance, bool add,
+                                            const char *key, size_t key_length,
+                                            const char *value, size_t value_length,
+                                            time_t expiration, uint32_t flags)
+{
+  memcached_st *ptr= instance->root;
+  memcached_storage_action_t verb= add ? ADD_OP : SET_OP;
+
+  if (memcached_sched_instance_busy(instance))
+  {
+    return MEMCACHED_IN_PROGRESS;
+  }
+
+  if (memcached_is_binary(ptr))
+  {
+    return memcached_send_binary(ptr, instance, 0, key, key_length, value, value_length,
+                                 expiration, flags, 0, true, true, verb);
+  }
+
+  return memcached_send_ascii(ptr, instance, key, key_length, value, value_length,
+                              expiration, flags, 0, true, true, verb);
+}
+
 
 memcached_return_t memcached_set(memcached_st *ptr, const char *key, size_t key_length,
                                  const char *value, size_t value_length,
@@ -229,6 +229,8 @@ you will need to install %{name}-devel.
 %{_includedir}/libmemcached-1.0/types/connection.h
 %{_includedir}/libmemcached-1.0/types/hash.h
 %{_includedir}/libmemcached-1.0/types/return.h
+%{_includedir}/libmemcached-1.0/struct/sched_hot_key.h
+%{_includedir}/libmemcached-1.0/types/sched_policy.h
 %{_includedir}/libmemcached-1.0/types/server_distribution.h
 %{_includedir}/libmemcached-1.0/verbosity.h
 %{_includedir}/libmemcached-1.0/version.h
@@ -247,6 +247,8 @@ test_st replication_tests[]= {
   {"rand_mget", false, (test_callback_fn*)replication_randomize_mget_test },
   {"miss", false, (test_callback_fn*)replication_miss_test },
   {"fail", false, (test_callback_fn*)replication_randomize_mget_fail_test },
+  {"hot key", false, (test_callback_fn*)replication_hot_key_TEST },
+  {"stale copy", false, (test_callback_fn*)replication_stale_TEST },
   {0, 0, (test_callback_fn*)0}
 };
 
@@ -287,6 +289,118 @@ test_st ketama_compatibility[]= {
   {0, 0, (test_callback_fn*)0}
 };
 
+test_st maglev_TESTS[]= {
+  {"mapping", true, (test_callback_fn*)maglev_mapping_TEST },
+  {0, 0, (test_callback_fn*)0}
+};
+
+test_st jump_TESTS[]= {
+  {"mapping", true, (test_callback_fn*)jump_mapping_TEST },
+  {"auto_eject", true, (test_callback_fn*)jump_auto_eject_TEST },
+  {"join", true, (test_callback_fn*)jump_join_TEST },
+  {0, 0, (test_callback_fn*)0}
+};
+
+test_st bounded_TESTS[]= {
+  {"home", true, (test_callback_fn*)bounded_home_TEST },
+  {"cap", true, (test_callback_fn*)bounded_cap_TEST },
+  {"walk", true, (test_callback_fn*)bounded_walk_TEST },
+  {"delete", true, (test_callback_fn*)bounded_delete_TEST },
+  {0, 0, (test_callback_fn*)0}
+};
+
+test_st sched_snapshot_TESTS[]= {
+  {"round_trip", true, (test_callback_fn*)snapshot_round_trip_TEST },
+  {"other_servers", true, (test_callback_fn*)snapshot_other_servers_TEST },
+  {"ejected", true, (test_callback_fn*)snapshot_ejected_TEST },
+  {"failed", true, (test_callback_fn*)snapshot_failed_TEST },
+  {0, 0, (test_callback_fn*)0}
+};
+
+test_st hash_batch_TESTS[]= {
+  {"batch", true, (test_callback_fn*)hash_batch_TEST },
+  {0, 0, (test_callback_fn*)0}
+};
+
+test_st continuum_search_TESTS[]= {
+  {"equivalence", true, (test_callback_fn*)continuum_search_TEST },
+  {0, 0, (test_callback_fn*)0}
+};
+
+test_st dynamic_TESTS[]= {
+  {"weighted", true, (test_callback_fn*)dynamic_weighted_TEST },
+  {0, 0, (test_callback_fn*)0}
+};
+
+test_st dynamic_join_TESTS[]= {
+  {"join", true, (test_callback_fn*)dynamic_join_TEST },
+  {0, 0, (test_callback_fn*)0}
+};
+
+test_st dynamic_eject_TESTS[]= {
+  {"auto_eject", true, (test_callback_fn*)dynamic_auto_eject_TEST },
+  {0, 0, (test_callback_fn*)0}
+};
+
+test_st dynamic_idle_TESTS[]= {
+  {"gradient", true, (test_callback_fn*)dynamic_idle_TEST },
+  {0, 0, (test_callback_fn*)0}
+};
+
+test_st hot_keys_TESTS[]= {
+  {"report", true, (test_callback_fn*)hot_keys_TEST },
+  {"lone", true, (test_callback_fn*)hot_keys_lone_TEST },
+  {0, 0, (test_callback_fn*)0}
+};
+
+test_st handoff_TESTS[]= {
+  {"delete", true, (test_callback_fn*)handoff_delete_TEST },
+  {0, 0, (test_callback_fn*)0}
+};
+
+test_st handoff_twice_TESTS[]= {
+  {"two_moves", true, (test_callback_fn*)handoff_twice_TEST },
+  {0, 0, (test_callback_fn*)0}
+};
+
+test_st handoff_set_TESTS[]= {
+  {"expired", true, (test_callback_fn*)handoff_set_TEST },
+  {0, 0, (test_callback_fn*)0}
+};
+
+test_st migration_TESTS[]= {
+  {"migrate", true, (test_callback_fn*)migration_TEST },
+  {0, 0, (test_callback_fn*)0}
+};
+
+test_st near_cache_TESTS[]= {
+  {"invalidate", true, (test_callback_fn*)near_cache_TEST },
+  {0, 0, (test_callback_fn*)0}
+};
+
+test_st sched_thread_TESTS[]= {
+  {"start_stop", true, (test_callback_fn*)sched_thread_TEST },
+  {0, 0, (test_callback_fn*)0}
+};
+
+test_st sched_accounting_TESTS[]= {
+  {"routed_point", true, (test_callback_fn*)sched_accounting_TEST },
+  {"feedback", true, (test_callback_fn*)sched_feedback_TEST },
+  {0, 0, (test_callback_fn*)0}
+};
+
+test_st sched_readers_TESTS[]= {
+  {"publish", true, (test_callback_fn*)sched_readers_TEST },
+  {"ketama", true, (test_callback_fn*)sched_ketama_readers_TEST },
+  {0, 0, (test_callback_fn*)0}
+};
+
+test_st sched_decay_TESTS[]= {
+  {"half_life", true, (test_callback_fn*)sched_decay_TEST },
+  {"reset", true, (test_callback_fn*)sched_decay_reset_TEST },
+  {0, 0, (test_callback_fn*)0}
+};
+
 test_st generate_tests[] ={
   {"generate_data", true, (test_callback_fn*)generate_data },
   {"get_read", false, (test_callback_fn*)get_read },
@@ -491,6 +605,26 @@ collection_st collection[] ={
   {"consistent_ketama", (test_callback_fn*)pre_behavior_ketama, 0, consistent_tests},
   {"consistent_ketama_weighted", (test_callback_fn*)pre_behavior_ketama_weighted, 0, consistent_weighted_tests},
   {"ketama_compat", 0, 0, ketama_compatibility},
+  {"maglev", 0, 0, maglev_TESTS},
+  {"jump", 0, 0, jump_TESTS},
+  {"bounded", 0, 0, bounded_TESTS},
+  {"sched_snapshot", 0, 0, sched_snapshot_TESTS},
+  {"hash_batch", 0, 0, hash_batch_TESTS},
+  {"continuum_search", 0, 0, continuum_search_TESTS},
+  {"dynamic", 0, 0, dynamic_TESTS},
+  {"dynamic_join", 0, 0, dynamic_join_TESTS},
+  {"dynamic_eject", 0, 0, dynamic_eject_TESTS},
+  {"dynamic_idle", 0, 0, dynamic_idle_TESTS},
+  {"hot_keys", 0, 0, hot_keys_TESTS},
+  {"handoff", 0, 0, handoff_TESTS},
+  {"handoff_twice", 0, 0, handoff_twice_TESTS},
+  {"handoff_set", 0, 0, handoff_set_TESTS},
+  {"migration", 0, 0, migration_TESTS},
+  {"near_cache", 0, 0, near_cache_TESTS},
+  {"sched_thread", 0, 0, sched_thread_TESTS},
+  {"sched_accounting", 0, 0, sched_accounting_TESTS},
+  {"sched_decay", 0, 0, sched_decay_TESTS},
+  {"sched_readers", 0, 0, sched_readers_TESTS},
   {"test_hashes", 0, 0, hash_tests},
   {"replication", (test_callback_fn*)pre_replication, 0, replication_tests},
   {"replication_noblock", (test_callback_fn*)pre_replication_noblock, 0, replication_tests},
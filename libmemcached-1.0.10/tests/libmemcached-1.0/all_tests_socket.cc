@@ -55,6 +55,7 @@
 #include "tests/pool.h"
 #include "tests/print.h"
 #include "tests/replication.h"
+#include "tests/sched.h"
 #include "tests/server_add.h"
 #include "tests/virtual_buckets.h"
 
@@ -0,0 +1,2316 @@
+/*
+ * sched.cc
+ *
+ * jinho added: where the distributions of the scheduler put keys, and how
+ * the dynamic continuum moves, hands keys off and replicates them.
+ *
+ * Every handle of a process shares the dynamic continuum, so each of these
+ * tests starts from nothing only as the first test of its collection.
+ */
+
+#include <config.h>
+#include <libtest/test.hpp>
+
+#include <libmemcached/memcached.h>
+#include <libmemcached/server_instance.h>
+#include <libmemcached/continuum.hpp>
+#include <libmemcached/instance.h>
+#include <libmemcached/sched.h>
+
+#include <tests/ketama_test_cases.h>
+#include <tests/sched.h>
+#include <tests/sched_test_cases.h>
+
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <vector>
+
+static const char *sched_test_pool= "10.0.1.1:11211 600,10.0.1.2:11211 300,10.0.1.3:11211 200,10.0.1.4:11211 350,10.0.1.5:11211 1000,10.0.1.6:11211 800,10.0.1.7:11211 950,10.0.1.8:11211 100";
+
+static const char *sched_test_server(memcached_st *memc, const char *key)
+{
+  uint32_t server_idx= memcached_generate_hash(memc, key, strlen(key), 0);
+
+  return memcached_server_instance_by_position(memc, server_idx)->hostname;
+}
+
+/* every server takes its weight's share of many keys, to within 5% of it */
+static test_return_t sched_test_shares(memcached_st *memc)
+{
+  uint32_t count= memcached_server_count(memc);
+  uint32_t keys[8]= { 0 };
+  uint32_t weights= 0;
+  const uint32_t total= 100000;
+
+  test_true(count <= 8);
+  for (uint32_t x= 0; x < count; x++)
+  {
+    weights+= memcached_server_instance_by_position(memc, x)->weight;
+  }
+
+  for (uint32_t x= 0; x < total; x++)
+  {
+    char key[32];
+    int length= snprintf(key, sizeof(key), "share:%u", x);
+    uint32_t server_idx= memcached_generate_hash(memc, key, size_t(length), 0);
+    test_true(server_idx < count);
+    keys[server_idx]++;
+  }
+
+  for (uint32_t x= 0; x < count; x++)
+  {
+    double expected= double(total) * memcached_server_instance_by_position(memc, x)->weight / weights;
+    test_true(keys[x] > expected * 0.95 and keys[x] < expected * 1.05);
+  }
+
+  return TEST_SUCCESS;
+}
+
+/* the continuum point of key, the first at or after its hash */
+static uint32_t sched_test_point(memcached_st *memc, const char *key)
+{
+  uint32_t hash= hashkit_digest(memcached_get_hashkit(memc), key, strlen(key));
+
+  for (uint32_t x= 0; x < memc->ketama.continuum_points_counter; x++)
+  {
+    if (memc->ketama.continuum[x].value >= hash)
+    {
+      return x;
+    }
+  }
+
+  return 0;
+}
+
+/* ticks of skewed gets for the dynamic scheduler; skew picks the hot keys */
+static void sched_test_traffic(memcached_st *memc, uint32_t skew)
+{
+  for (uint32_t tick= 0; tick < 7; tick++)
+  {
+    for (uint32_t x= 0; x < 50000; x++)
+    {
+      char key[32];
+      int length= snprintf(key, sizeof(key), "snapshot:%u", (x * x) % (1000 + skew * 300 + tick * 100));
+      (void)memcached_generate_hash(memc, key, size_t(length), 1);
+    }
+    mem_hs_sched_dynamic();
+  }
+}
+
+static void sched_test_routes(memcached_st *memc, std::vector<std::string>& routes)
+{
+  routes.clear();
+  for (uint32_t x= 0; x < 1000; x++)
+  {
+    char key[32];
+    snprintf(key, sizeof(key), "route:%u", x);
+    routes.push_back(sched_test_server(memc, key));
+  }
+}
+
+/*
+  The routes of the keys of ketama_test_cases.h over the weighted servers
+  of the ketama tests, as tests/sched_test_cases.h holds them for maglev
+  and jump: a change to either distribution that moves a key fails here.
+*/
+test_return_t maglev_mapping_TEST(memcached_st *)
+{
+  memcached_st *memc= memcached_create(NULL);
+  test_true(memc);
+
+  test_compare(MEMCACHED_SUCCESS, memcached_behavior_set_distribution(memc, MEMCACHED_DISTRIBUTION_MAGLEV));
+  test_compare(MEMCACHED_DISTRIBUTION_MAGLEV, memcached_behavior_get_distribution(memc));
+
+  memcached_server_st *server_pool= memcached_servers_parse(sched_test_pool);
+  test_true(server_pool);
+  test_compare(MEMCACHED_SUCCESS, memcached_server_push(memc, server_pool));
+  test_compare(8U, memcached_server_count(memc));
+
+  for (uint32_t x= 0; x < 99; x++)
+  {
+    test_compare(std::string(maglev_test_cases[x].server),
+                 std::string(sched_test_server(memc, maglev_test_cases[x].key)));
+  }
+
+  test_compare(TEST_SUCCESS, sched_test_shares(memc));
+
+  memcached_server_list_free(server_pool);
+  memcached_free(memc);
+
+  return TEST_SUCCESS;
+}
+
+test_return_t jump_mapping_TEST(memcached_st *)
+{
+  memcached_st *memc= memcached_create(NULL);
+  test_true(memc);
+
+  test_compare(MEMCACHED_SUCCESS, memcached_behavior_set_distribution(memc, MEMCACHED_DISTRIBUTION_JUMP));
+  test_compare(MEMCACHED_DISTRIBUTION_JUMP, memcached_behavior_get_distribution(memc));
+
+  memcached_server_st *server_pool= memcached_servers_parse(sched_test_pool);
+  test_true(server_pool);
+  test_compare(MEMCACHED_SUCCESS, memcached_server_push(memc, server_pool));
+  test_compare(8U, memcached_server_count(memc));
+
+  for (uint32_t x= 0; x < 99; x++)
+  {
+    test_compare(std::string(jump_test_cases[x].server),
+                 std::string(sched_test_server(memc, jump_test_cases[x].key)));
+  }
+
+  test_compare(TEST_SUCCESS, sched_test_shares(memc));
+
+  memcached_server_list_free(server_pool);
+  memcached_free(memc);
+
+  return TEST_SUCCESS;
+}
+
+test_return_t jump_auto_eject_TEST(memcached_st *)
+{
+  memcached_st *memc= memcached_create(NULL);
+  test_true(memc);
+
+  test_compare(MEMCACHED_SUCCESS, memcached_behavior_set(memc, MEMCACHED_BEHAVIOR_AUTO_EJECT_HOSTS, 1));
+  test_compare(MEMCACHED_SUCCESS, memcached_behavior_set_distribution(memc, MEMCACHED_DISTRIBUTION_JUMP));
+
+  memcached_server_st *server_pool= memcached_servers_parse(sched_test_pool);
+  test_true(server_pool);
+  test_compare(MEMCACHED_SUCCESS, memcached_server_push(memc, server_pool));
+
+  /* 10.0.1.3 in its retry delay: its keys jump again, the others stay put */
+  memcached_server_instance_st instance= memcached_server_instance_by_position(memc, 2);
+  memcached_instance_next_retry(instance, time(NULL) +15);
+  test_compare(MEMCACHED_SUCCESS, memcached_behavior_set_distribution(memc, MEMCACHED_DISTRIBUTION_JUMP));
+
+  uint32_t moved= 0;
+  for (uint32_t x= 0; x < 99; x++)
+  {
+    std::string hostname(sched_test_server(memc, jump_test_cases[x].key));
+    test_true(hostname != "10.0.1.3");
+
+    if (strcmp(jump_test_cases[x].server, "10.0.1.3") == 0)
+    {
+      moved++;
+    }
+    else
+    {
+      test_compare(std::string(jump_test_cases[x].server), hostname);
+    }
+  }
+  test_true(moved > 0);
+
+  /* and every key goes back once it is */
+  memcached_instance_next_retry(instance, time(NULL) -1);
+  test_compare(MEMCACHED_SUCCESS, memcached_behavior_set_distribution(memc, MEMCACHED_DISTRIBUTION_JUMP));
+  for (uint32_t x= 0; x < 99; x++)
+  {
+    test_compare(std::string(jump_test_cases[x].server),
+                 std::string(sched_test_server(memc, jump_test_cases[x].key)));
+  }
+
+  memcached_server_list_free(server_pool);
+  memcached_free(memc);
+
+  return TEST_SUCCESS;
+}
+
+/*
+  A server of another weight joins: only the keys it takes move.
+*/
+test_return_t jump_join_TEST(memcached_st *)
+{
+  memcached_st *memc= memcached_create(NULL);
+  test_true(memc);
+
+  test_compare(MEMCACHED_SUCCESS, memcached_behavior_set_distribution(memc, MEMCACHED_DISTRIBUTION_JUMP));
+  test_compare(MEMCACHED_SUCCESS, memcached_server_add_with_weight(memc, "10.0.1.1", 11211, 2));
+  test_compare(MEMCACHED_SUCCESS, memcached_server_add_with_weight(memc, "10.0.1.2", 11211, 4));
+
+  std::vector<std::string> before;
+  sched_test_routes(memc, before);
+
+  /* a third of the weight joins at the end: it takes its share, nothing else moves */
+  test_compare(MEMCACHED_SUCCESS, memcached_server_add_with_weight(memc, "10.0.1.3", 11211, 3));
+
+  std::vector<std::string> after;
+  sched_test_routes(memc, after);
+
+  uint32_t moved= 0;
+  for (size_t x= 0; x < before.size(); x++)
+  {
+    if (before[x] != after[x])
+    {
+      test_compare(std::string("10.0.1.3"), after[x]);
+      moved++;
+    }
+  }
+  test_true(moved > 250 and moved < 420);
+
+  memcached_free(memc);
+
+  return TEST_SUCCESS;
+}
+
+/*
+  A key goes to the first server clockwise from its point that has taken
+  fewer than ceil((1 + epsilon) * (requests + 1) / servers); with a wide
+  bound that is its own.
+*/
+test_return_t bounded_home_TEST(memcached_st *)
+{
+  memcached_st *memc= memcached_create(NULL);
+  test_true(memc);
+
+  test_compare(MEMCACHED_SUCCESS, memcached_behavior_set_distribution(memc, MEMCACHED_DISTRIBUTION_CONSISTENT_BOUNDED));
+  test_compare(MEMCACHED_DISTRIBUTION_CONSISTENT_BOUNDED, memcached_behavior_get_distribution(memc));
+  test_compare(MEMCACHED_INVALID_ARGUMENTS, memcached_sched_set_bound(memc, 0));
+  test_compare(MEMCACHED_SUCCESS, memcached_sched_set_bound(memc, 1000));
+
+  memcached_server_st *server_pool= memcached_servers_parse(sched_test_pool);
+  test_true(server_pool);
+  test_compare(MEMCACHED_SUCCESS, memcached_server_push(memc, server_pool));
+
+  /* nobody is full: every key stays at its own point */
+  for (uint32_t x= 0; x < 99; x++)
+  {
+    const char *key= ketama_test_cases[x].key;
+    test_compare(memc->ketama.continuum[sched_test_point(memc, key)].index,
+                 memcached_generate_hash(memc, key, strlen(key), 0));
+  }
+
+  uint64_t requests, overflowed;
+  test_compare(MEMCACHED_SUCCESS, memcached_sched_bound_stat(memc, &requests, &overflowed));
+  test_compare(uint64_t(99), requests);
+  test_zero(overflowed);
+
+  memcached_server_list_free(server_pool);
+  memcached_free(memc);
+
+  return TEST_SUCCESS;
+}
+
+/*
+  Keys of one server, each routed once within a halving window: no server
+  goes over its cap, and a key placed away is sent there again.
+*/
+test_return_t bounded_cap_TEST(memcached_st *)
+{
+  memcached_st *memc= memcached_create(NULL);
+  test_true(memc);
+
+  test_compare(MEMCACHED_SUCCESS, memcached_behavior_set_distribution(memc, MEMCACHED_DISTRIBUTION_CONSISTENT_BOUNDED));
+
+  memcached_server_st *server_pool= memcached_servers_parse(sched_test_pool);
+  test_true(server_pool);
+  test_compare(MEMCACHED_SUCCESS, memcached_server_push(memc, server_pool));
+  test_compare(8U, memcached_server_count(memc));
+
+  std::vector<std::string> keys;
+  uint32_t home= memc->ketama.continuum[sched_test_point(memc, "bounded:0")].index;
+  for (uint32_t x= 0; keys.size() < 500; x++)
+  {
+    char key[32];
+    snprintf(key, sizeof(key), "bounded:%u", x);
+    if (memc->ketama.continuum[sched_test_point(memc, key)].index == home)
+    {
+      keys.push_back(key);
+    }
+  }
+
+  uint32_t load[8]= { 0 };
+  std::vector<uint32_t> placed;
+  for (uint32_t x= 0; x < keys.size(); x++)
+  {
+    uint32_t server_idx= memcached_generate_hash(memc, keys[x].c_str(), keys[x].size(), 0);
+    test_true(server_idx < 8);
+    load[server_idx]++;
+    test_true(load[server_idx] <= uint32_t(ceil((1 + MEMCACHED_SCHED_BOUND) * double(x + 1) / 8)));
+    placed.push_back(server_idx);
+  }
+
+  /* however full its server is now, a key placed away goes there again */
+  uint64_t away= keys.size() - load[home];
+  test_true(away > 0);
+  for (uint32_t x= 0; x < keys.size(); x++)
+  {
+    uint32_t server_idx= memcached_generate_hash(memc, keys[x].c_str(), keys[x].size(), MEMCACHED_CMD_SET);
+    if (placed[x] != home)
+    {
+      test_compare(placed[x], server_idx);
+    }
+    if (server_idx != home)
+    {
+      away++;
+    }
+  }
+
+  uint64_t requests, overflowed;
+  test_compare(MEMCACHED_SUCCESS, memcached_sched_bound_stat(memc, &requests, &overflowed));
+  test_compare(uint64_t(2 * keys.size()), requests);
+  test_compare(away, overflowed);
+
+  memcached_server_list_free(server_pool);
+  memcached_free(memc);
+
+  return TEST_SUCCESS;
+}
+
+/*
+  A few keys, skewed: a key walks clockwise past the servers that are full
+  the first time it finds its own full, and stays where it went.
+*/
+test_return_t bounded_walk_TEST(memcached_st *)
+{
+  memcached_st *memc= memcached_create(NULL);
+  test_true(memc);
+
+  test_compare(MEMCACHED_SUCCESS, memcached_behavior_set_distribution(memc, MEMCACHED_DISTRIBUTION_CONSISTENT_BOUNDED));
+  test_compare(MEMCACHED_SUCCESS, memcached_sched_set_bound(memc, 0.1));
+
+  memcached_server_st *server_pool= memcached_servers_parse(sched_test_pool);
+  test_true(server_pool);
+  test_compare(MEMCACHED_SUCCESS, memcached_server_push(memc, server_pool));
+
+  uint32_t points= memc->ketama.continuum_points_counter;
+  uint32_t load[8]= { 0 };
+  uint32_t placed[7];
+  uint32_t walked= 0;
+  std::fill(placed, placed + 7, UINT32_MAX);
+
+  for (uint32_t x= 0; x < 1000; x++)
+  {
+    char key[32];
+    uint32_t id= (x * x) % 7;
+    snprintf(key, sizeof(key), "bounded:%u", id);
+
+    uint32_t point= sched_test_point(memc, key);
+    uint32_t expected= placed[id];
+    if (expected == UINT32_MAX)
+    {
+      uint32_t cap= uint32_t(ceil(1.1 * double(x + 1) / 8));
+      expected= memc->ketama.continuum[point].index;
+      for (uint32_t step= 1; step < points and load[expected] >= cap; step++)
+      {
+        expected= memc->ketama.continuum[(point + step) % points].index;
+      }
+      if (expected != memc->ketama.continuum[point].index)
+      {
+        placed[id]= expected;
+      }
+    }
+    if (expected != memc->ketama.continuum[point].index)
+    {
+      walked++;
+    }
+
+    test_compare(expected, memcached_generate_hash(memc, key, strlen(key), x % 2 ? MEMCACHED_CMD_GET : MEMCACHED_CMD_SET));
+    load[expected]++;
+  }
+
+  uint64_t overflowed;
+  test_compare(MEMCACHED_SUCCESS, memcached_sched_bound_stat(memc, NULL, &overflowed));
+  test_compare(uint64_t(walked), overflowed);
+  test_true(walked > 0);
+
+  memcached_server_list_free(server_pool);
+  memcached_free(memc);
+
+  return TEST_SUCCESS;
+}
+
+/* gets of key in a row that did not return value, or a miss when value is NULL */
+static uint32_t sched_test_stale_reads(memcached_st *memc, const char *key, const char *value)
+{
+  uint32_t stale= 0;
+
+  for (uint32_t x= 0; x < 200; x++)
+  {
+    size_t value_length;
+    uint32_t flags;
+    memcached_return_t rc;
+    char *read= memcached_get(memc, key, strlen(key), &value_length, &flags, &rc);
+
+    if (value ? (read == NULL or value_length != strlen(value) or memcmp(read, value, value_length))
+              : (read or rc != MEMCACHED_NOTFOUND))
+    {
+      stale++;
+    }
+    free(read);
+  }
+
+  return stale;
+}
+
+/*
+  Against the servers of the main tests: a key a get placed past its full
+  server takes its writes and deletes there too.
+*/
+test_return_t bounded_delete_TEST(memcached_st *memc)
+{
+  memcached_st *memc_clone= memcached_clone(NULL, memc);
+  test_true(memc_clone);
+
+  test_compare(MEMCACHED_SUCCESS, memcached_behavior_set_distribution(memc_clone, MEMCACHED_DISTRIBUTION_CONSISTENT_BOUNDED));
+  test_compare(MEMCACHED_SUCCESS, memcached_sched_set_bound(memc_clone, 0.1));
+  test_true(memcached_server_count(memc_clone) > 1);
+
+  const char *key= "bounded:deleted";
+  uint32_t home= memcached_generate_hash(memc_clone, key, strlen(key), MEMCACHED_CMD_SET);
+  test_compare(MEMCACHED_SUCCESS, memcached_set(memc_clone, key, strlen(key), test_literal_param("v1"), 0, 0));
+
+  /* gets of the one key fill its server, until it is placed past it */
+  uint32_t away= home;
+  for (uint32_t x= 0; x < 1000 and away == home; x++)
+  {
+    away= memcached_generate_hash(memc_clone, key, strlen(key), MEMCACHED_CMD_GET);
+  }
+  test_true(away != home);
+
+  /* writes follow it there, also from a clone, and the copy left at home is never read */
+  memcached_st *memc_twin= memcached_clone(NULL, memc_clone);
+  test_true(memc_twin);
+  test_compare(away, memcached_generate_hash(memc_clone, key, strlen(key), MEMCACHED_CMD_SET));
+  test_compare(away, memcached_generate_hash(memc_twin, key, strlen(key), MEMCACHED_CMD_OTHER));
+  test_compare(MEMCACHED_SUCCESS, memcached_set(memc_clone, key, strlen(key), test_literal_param("v2"), 0, 0));
+  test_zero(sched_test_stale_reads(memc_clone, key, "v2"));
+  test_zero(sched_test_stale_reads(memc_twin, key, "v2"));
+
+  /* and no get finds it again once deleted */
+  test_compare(MEMCACHED_SUCCESS, memcached_delete(memc_twin, key, strlen(key), 0));
+  test_zero(sched_test_stale_reads(memc_clone, key, NULL));
+  test_compare(MEMCACHED_NOTFOUND, memcached_delete(memc_clone, key, strlen(key), 0));
+
+  memcached_free(memc_twin);
+  memcached_free(memc_clone);
+
+  return TEST_SUCCESS;
+}
+
+/*
+  The continuum is moved with skewed traffic, saved, moved again and loaded
+  back; a snapshot of other servers is refused.
+*/
+test_return_t snapshot_round_trip_TEST(memcached_st *)
+{
+  memcached_st *memc= memcached_create(NULL);
+  test_true(memc);
+
+  test_compare(MEMCACHED_SUCCESS, memcached_behavior_set_distribution(memc, MEMCACHED_DISTRIBUTION_DYNAMIC));
+  test_compare(MEMCACHED_SUCCESS, memcached_sched_set(memc, 0.3, 0.2));
+  test_compare(MEMCACHED_SUCCESS, memcached_sched_set_policy(memc, MEMCACHED_SCHED_POLICY_GRADIENT));
+
+  memcached_server_st *server_pool= memcached_servers_parse(sched_test_pool);
+  test_true(server_pool);
+  test_compare(MEMCACHED_SUCCESS, memcached_server_push(memc, server_pool));
+
+  sched_test_traffic(memc, 0);
+  std::vector<std::string> saved;
+  sched_test_routes(memc, saved);
+
+  std::string path= libtest::create_tmpfile("sched_snapshot");
+  test_compare(MEMCACHED_SUCCESS, memcached_sched_save(memc, path.c_str()));
+
+  /* the continuum keeps moving after the save */
+  sched_test_traffic(memc, 5);
+  std::vector<std::string> routes;
+  sched_test_routes(memc, routes);
+  test_true(routes != saved);
+
+  /* and routes every key as before once loaded */
+  test_compare(MEMCACHED_SUCCESS, memcached_sched_load(memc, path.c_str()));
+  sched_test_routes(memc, routes);
+  test_true(routes == saved);
+
+  /* a client pushing the same servers in another order routes the same, by name */
+  memcached_st *reversed= memcached_create(NULL);
+  test_true(reversed);
+  test_compare(MEMCACHED_SUCCESS, memcached_behavior_set_distribution(reversed, MEMCACHED_DISTRIBUTION_DYNAMIC));
+  memcached_server_st *reversed_pool= memcached_servers_parse("10.0.1.8:11211 100,10.0.1.7:11211 950,10.0.1.6:11211 800,10.0.1.5:11211 1000,10.0.1.4:11211 350,10.0.1.3:11211 200,10.0.1.2:11211 300,10.0.1.1:11211 600");
+  test_true(reversed_pool);
+  test_compare(MEMCACHED_SUCCESS, memcached_server_push(reversed, reversed_pool));
+
+  test_compare(MEMCACHED_SUCCESS, memcached_sched_load(reversed, path.c_str()));
+  sched_test_routes(reversed, routes);
+  test_true(routes == saved);
+
+  test_zero(unlink(path.c_str()));
+  memcached_server_list_free(reversed_pool);
+  memcached_free(reversed);
+  memcached_server_list_free(server_pool);
+  memcached_free(memc);
+
+  return TEST_SUCCESS;
+}
+
+test_return_t snapshot_other_servers_TEST(memcached_st *)
+{
+  memcached_st *memc= memcached_create(NULL);
+  test_true(memc);
+
+  test_compare(MEMCACHED_SUCCESS, memcached_behavior_set_distribution(memc, MEMCACHED_DISTRIBUTION_DYNAMIC));
+  test_compare(MEMCACHED_SUCCESS, memcached_sched_set(memc, 0.3, 0.2));
+
+  memcached_server_st *server_pool= memcached_servers_parse(sched_test_pool);
+  test_true(server_pool);
+  test_compare(MEMCACHED_SUCCESS, memcached_server_push(memc, server_pool));
+
+  sched_test_traffic(memc, 0);
+  std::string path= libtest::create_tmpfile("sched_snapshot");
+  test_compare(MEMCACHED_SUCCESS, memcached_sched_save(memc, path.c_str()));
+
+  std::vector<std::string> saved;
+  sched_test_routes(memc, saved);
+
+  /* as many servers, one of them another: refused, and the continuum is left alone */
+  memcached_st *other= memcached_create(NULL);
+  test_true(other);
+  test_compare(MEMCACHED_SUCCESS, memcached_behavior_set_distribution(other, MEMCACHED_DISTRIBUTION_DYNAMIC));
+  memcached_server_st *other_pool= memcached_servers_parse("10.0.1.1:11211 600,10.0.1.2:11211 300,10.0.1.3:11211 200,10.0.1.4:11211 350,10.0.1.5:11211 1000,10.0.1.6:11211 800,10.0.1.7:11211 950,10.0.1.9:11211 100");
+  test_true(other_pool);
+  test_compare(MEMCACHED_SUCCESS, memcached_server_push(other, other_pool));
+
+  test_compare(MEMCACHED_INVALID_ARGUMENTS, memcached_sched_load(other, path.c_str()));
+  std::vector<std::string> routes;
+  sched_test_routes(memc, routes);
+  test_true(routes == saved);
+  memcached_server_list_free(other_pool);
+  memcached_free(other);
+
+  /* one server fewer */
+  other= memcached_create(NULL);
+  test_true(other);
+  test_compare(MEMCACHED_SUCCESS, memcached_behavior_set_distribution(other, MEMCACHED_DISTRIBUTION_DYNAMIC));
+  other_pool= memcached_servers_parse("10.0.1.1:11211 600,10.0.1.2:11211 300,10.0.1.3:11211 200,10.0.1.4:11211 350,10.0.1.5:11211 1000,10.0.1.6:11211 800,10.0.1.7:11211 950");
+  test_true(other_pool);
+  test_compare(MEMCACHED_SUCCESS, memcached_server_push(other, other_pool));
+
+  test_compare(MEMCACHED_INVALID_ARGUMENTS, memcached_sched_load(other, path.c_str()));
+
+  test_zero(unlink(path.c_str()));
+  memcached_server_list_free(other_pool);
+  memcached_free(other);
+  memcached_server_list_free(server_pool);
+  memcached_free(memc);
+
+  return TEST_SUCCESS;
+}
+
+/*
+  As above, while a server is ejected.
+*/
+test_return_t snapshot_ejected_TEST(memcached_st *)
+{
+  memcached_st *memc= memcached_create(NULL);
+  test_true(memc);
+
+  test_compare(MEMCACHED_SUCCESS, memcached_behavior_set(memc, MEMCACHED_BEHAVIOR_AUTO_EJECT_HOSTS, 1));
+  test_compare(MEMCACHED_SUCCESS, memcached_behavior_set_distribution(memc, MEMCACHED_DISTRIBUTION_DYNAMIC));
+  test_compare(MEMCACHED_SUCCESS, memcached_sched_set(memc, 0.3, 0.2));
+
+  memcached_server_st *server_pool= memcached_servers_parse(sched_test_pool);
+  test_true(server_pool);
+  test_compare(MEMCACHED_SUCCESS, memcached_server_push(memc, server_pool));
+
+  sched_test_traffic(memc, 0);
+  std::vector<std::string> saved;
+  sched_test_routes(memc, saved);
+
+  std::string path= libtest::create_tmpfile("sched_snapshot");
+  test_compare(MEMCACHED_SUCCESS, memcached_sched_save(memc, path.c_str()));
+
+  /* loaded while 10.0.1.3 is in its retry delay: its points detour, the others are as saved */
+  memcached_server_instance_st instance= memcached_server_instance_by_position(memc, 2);
+  memcached_instance_next_retry(instance, time(NULL) +15);
+  test_compare(MEMCACHED_SUCCESS, memcached_behavior_set_distribution(memc, MEMCACHED_DISTRIBUTION_DYNAMIC));
+  sched_test_traffic(memc, 5);
+
+  test_compare(MEMCACHED_SUCCESS, memcached_sched_load(memc, path.c_str()));
+  std::vector<std::string> routes;
+  sched_test_routes(memc, routes);
+  uint32_t moved= 0;
+  for (size_t x= 0; x < routes.size(); x++)
+  {
+    test_true(routes[x] != "10.0.1.3");
+
+    if (saved[x] == "10.0.1.3")
+    {
+      moved++;
+    }
+    else
+    {
+      test_compare(saved[x], routes[x]);
+    }
+  }
+  test_true(moved > 0);
+
+  /* the loaded owners come back once it is due */
+  memcached_instance_next_retry(instance, time(NULL) -1);
+  test_compare(MEMCACHED_SUCCESS, memcached_behavior_set_distribution(memc, MEMCACHED_DISTRIBUTION_DYNAMIC));
+  sched_test_routes(memc, routes);
+  test_true(routes == saved);
+
+  test_zero(unlink(path.c_str()));
+  memcached_server_list_free(server_pool);
+  memcached_free(memc);
+
+  return TEST_SUCCESS;
+}
+
+/*
+  The periodic writes are counted, those that fail included, and a new
+  path counts over.
+*/
+test_return_t snapshot_failed_TEST(memcached_st *)
+{
+  memcached_st *memc= memcached_create(NULL);
+  test_true(memc);
+
+  test_compare(MEMCACHED_SUCCESS, memcached_behavior_set_distribution(memc, MEMCACHED_DISTRIBUTION_DYNAMIC));
+  test_compare(MEMCACHED_SUCCESS, memcached_sched_set(memc, 0.3, 0.2));
+
+  memcached_server_st *server_pool= memcached_servers_parse(sched_test_pool);
+  test_true(server_pool);
+  test_compare(MEMCACHED_SUCCESS, memcached_server_push(memc, server_pool));
+
+  /* a directory that is not there: every tick fails, and says why */
+  test_compare(MEMCACHED_SUCCESS, memcached_sched_set_snapshot(memc, "/nonexistent/sched_snapshot", 1));
+  sched_test_traffic(memc, 0);
+
+  uint64_t written, failed;
+  int error;
+  test_compare(MEMCACHED_SUCCESS, memcached_sched_snapshot_stat(memc, &written, &failed, &error));
+  test_zero(written);
+  test_compare(uint64_t(7), failed);
+  test_compare(ENOENT, error);
+
+  /* a new path starts counting over */
+  std::string path= libtest::create_tmpfile("sched_snapshot");
+  test_compare(MEMCACHED_SUCCESS, memcached_sched_set_snapshot(memc, path.c_str(), 1));
+  sched_test_traffic(memc, 5);
+  test_compare(MEMCACHED_SUCCESS, memcached_sched_snapshot_stat(memc, &written, &failed, &error));
+  test_compare(uint64_t(7), written);
+  test_zero(failed);
+  test_zero(error);
+  test_compare(MEMCACHED_SUCCESS, memcached_sched_load(memc, path.c_str()));
+
+  test_compare(MEMCACHED_SUCCESS, memcached_sched_set_snapshot(memc, NULL, 0));
+  test_compare(MEMCACHED_SUCCESS, memcached_sched_snapshot_stat(memc, &written, &failed, &error));
+  test_zero(written);
+
+  test_zero(unlink(path.c_str()));
+  memcached_server_list_free(server_pool);
+  memcached_free(memc);
+
+  return TEST_SUCCESS;
+}
+
+/*
+  The keys of ketama_test_cases.h routed together and one by one, under
+  every distribution that does not count what it routes.
+*/
+test_return_t hash_batch_TEST(memcached_st *)
+{
+  memcached_server_distribution_t distributions[]= {
+    MEMCACHED_DISTRIBUTION_MODULA,
+    MEMCACHED_DISTRIBUTION_CONSISTENT,
+    MEMCACHED_DISTRIBUTION_CONSISTENT_KETAMA,
+    MEMCACHED_DISTRIBUTION_MAGLEV,
+    MEMCACHED_DISTRIBUTION_JUMP,
+    MEMCACHED_DISTRIBUTION_DYNAMIC
+  };
+
+  const char *keys[99];
+  size_t key_length[99];
+  for (uint32_t x= 0; x < 99; x++)
+  {
+    keys[x]= ketama_test_cases[x].key;
+    key_length[x]= strlen(keys[x]);
+  }
+
+  for (size_t d= 0; d < sizeof(distributions) / sizeof(distributions[0]); d++)
+  {
+    memcached_st *memc= memcached_create(NULL);
+    test_true(memc);
+
+    uint32_t server_keys[99];
+    test_compare(MEMCACHED_NO_SERVERS,
+                 memcached_generate_hash_batch(memc, keys, key_length, 99, server_keys, MEMCACHED_CMD_GET));
+
+    test_compare(MEMCACHED_SUCCESS, memcached_behavior_set_distribution(memc, distributions[d]));
+
+    /* a lone server takes every key */
+    test_compare(MEMCACHED_SUCCESS, memcached_server_add(memc, "10.0.1.1", 11211));
+    test_compare(MEMCACHED_SUCCESS,
+                 memcached_generate_hash_batch(memc, keys, key_length, 99, server_keys, MEMCACHED_CMD_GET));
+    for (uint32_t x= 0; x < 99; x++)
+    {
+      test_zero(server_keys[x]);
+    }
+    memcached_servers_reset(memc);
+
+    memcached_server_st *server_pool= memcached_servers_parse(sched_test_pool);
+    test_true(server_pool);
+    test_compare(MEMCACHED_SUCCESS, memcached_server_push(memc, server_pool));
+
+    test_compare(MEMCACHED_INVALID_ARGUMENTS,
+                 memcached_generate_hash_batch(memc, NULL, key_length, 99, server_keys, MEMCACHED_CMD_GET));
+    test_compare(MEMCACHED_SUCCESS,
+                 memcached_generate_hash_batch(memc, keys, key_length, 99, server_keys, MEMCACHED_CMD_GET));
+    for (uint32_t x= 0; x < 99; x++)
+    {
+      test_compare(memcached_generate_hash(memc, keys[x], key_length[x], 0), server_keys[x]);
+    }
+
+    memcached_server_list_free(server_pool);
+    memcached_free(memc);
+  }
+
+  return TEST_SUCCESS;
+}
+
+static uint32_t sched_test_random(uint64_t &state)
+{
+  state^= state << 13;
+  state^= state >> 7;
+  state^= state << 17;
+
+  return uint32_t(state >> 32);
+}
+
+/* find() against std::lower_bound() over the sorted points, at one hash */
+static test_return_t sched_test_find(const memcached_continuum_search_st *search,
+                                     const std::vector<uint32_t> &sorted, uint32_t hash)
+{
+  uint32_t expected= uint32_t(std::lower_bound(sorted.begin(), sorted.end(), hash) - sorted.begin());
+  if (expected == sorted.size())
+  {
+    expected= 0; // wraps
+  }
+  test_compare(expected, continuum_search_find(search, hash));
+
+  return TEST_SUCCESS;
+}
+
+/* every point, its neighbours and its jump bucket, the ends of the hash space and random hashes */
+static test_return_t sched_test_search(const memcached_continuum_search_st *search,
+                                       const std::vector<uint32_t> &sorted, uint64_t &state)
+{
+  for (size_t x= 0; x < sorted.size(); x++)
+  {
+    uint32_t bucket= sorted[x] & ~((1U << CONTINUUM_JUMP_SHIFT) - 1);
+    test_compare(TEST_SUCCESS, sched_test_find(search, sorted, sorted[x] - 1));
+    test_compare(TEST_SUCCESS, sched_test_find(search, sorted, sorted[x]));
+    test_compare(TEST_SUCCESS, sched_test_find(search, sorted, sorted[x] + 1));
+    test_compare(TEST_SUCCESS, sched_test_find(search, sorted, bucket));
+    test_compare(TEST_SUCCESS, sched_test_find(search, sorted, bucket - 1));
+  }
+
+  test_compare(TEST_SUCCESS, sched_test_find(search, sorted, 0));
+  test_compare(TEST_SUCCESS, sched_test_find(search, sorted, UINT32_MAX));
+  for (uint32_t x= 0; x < 1000; x++)
+  {
+    test_compare(TEST_SUCCESS, sched_test_find(search, sorted, sched_test_random(state)));
+  }
+
+  return TEST_SUCCESS;
+}
+
+/* points spread over the ring, in clumps of duplicates, or crowded below the wrap */
+static void sched_test_points(std::vector<uint32_t> &sorted, uint32_t size, uint32_t shape, uint64_t &state)
+{
+  sorted.resize(size);
+  for (uint32_t x= 0; x < size; x++)
+  {
+    switch (shape)
+    {
+    case 0:
+      sorted[x]= sched_test_random(state);
+      break;
+
+    case 1:
+      sorted[x]= (sched_test_random(state) % (size / 4 + 1)) * 2654435761U;
+      break;
+
+    default:
+      sorted[x]= UINT32_MAX - sched_test_random(state) % (3U << CONTINUUM_JUMP_SHIFT);
+      break;
+    }
+  }
+  std::sort(sorted.begin(), sorted.end());
+}
+
+/* what the policy does: one point moves, at most onto a neighbour */
+static void sched_test_move(memcached_continuum_search_st *search, std::vector<uint32_t> &sorted,
+                            std::vector<uint32_t> &values, size_t stride, uint64_t &state)
+{
+  uint32_t position= sched_test_random(state) % uint32_t(sorted.size());
+  uint32_t low= position > 0 ? sorted[position - 1] : 0;
+  uint32_t high= position + 1 < sorted.size() ? sorted[position + 1] : UINT32_MAX;
+  uint32_t old_value= sorted[position];
+
+  switch (sched_test_random(state) % 4)
+  {
+  case 0:
+    sorted[position]= low;
+    break;
+
+  case 1:
+    sorted[position]= high;
+    break;
+
+  default:
+    sorted[position]= low + uint32_t(uint64_t(sched_test_random(state)) * (uint64_t(high - low) + 1) >> 32);
+    break;
+  }
+
+  values[position * stride + stride - 1]= sorted[position];
+  continuum_search_move(search, position, old_value);
+}
+
+/*
+  continuum_search_find() agrees with a plain lower bound over the sorted
+  points, wrapping to 0 past the last one, for rings searched through the
+  tree and through the jump table; after moves patch a copy, copied once
+  or twice; after a copy is rebuilt; and for the search it was copied
+  from, which a copy and its moves must not touch.
+*/
+test_return_t continuum_search_TEST(memcached_st *)
+{
+  uint64_t state= 0x9e3779b97f4a7c15ULL;
+  uint32_t sizes[]= { 1, 2, 3, 17, 200, MEMCACHED_CONTINUUM_JUMP_POINTS - 1, MEMCACHED_CONTINUUM_JUMP_POINTS, 1200, 5000 };
+
+  for (size_t s= 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+  {
+    for (uint32_t shape= 0; shape < 3; shape++)
+    {
+      uint32_t size= sizes[s];
+      size_t stride= 1 + (shape + s) % 2; // 2 is the dynamic continuum's { index, value }
+
+      std::vector<uint32_t> sorted;
+      sched_test_points(sorted, size, shape, state);
+      std::vector<uint32_t> values(size * stride);
+      for (uint32_t x= 0; x < size; x++)
+      {
+        values[x * stride + stride - 1]= sorted[x];
+      }
+
+      memcached_continuum_search_st *search= continuum_search_create(size);
+      test_true(search);
+      continuum_search_build(search, &values[stride - 1], stride, size);
+      test_compare(TEST_SUCCESS, sched_test_search(search, sorted, state));
+
+      std::vector<uint32_t> copy_sorted(sorted);
+      std::vector<uint32_t> copy_values(values);
+      memcached_continuum_search_st *copy= continuum_search_create(size);
+      test_true(copy);
+      continuum_search_copy(copy, search, &copy_values[stride - 1]);
+      test_compare(TEST_SUCCESS, sched_test_search(copy, copy_sorted, state));
+
+      for (uint32_t x= 0; x < 200; x++)
+      {
+        sched_test_move(copy, copy_sorted, copy_values, stride, state);
+      }
+      test_compare(TEST_SUCCESS, sched_test_search(copy, copy_sorted, state));
+      test_compare(TEST_SUCCESS, sched_test_search(search, sorted, state));
+
+      /* a copy again over the moved one, then moves over its spares */
+      continuum_search_copy(copy, search, &copy_values[stride - 1]);
+      copy_values= values;
+      copy_sorted= sorted;
+      for (uint32_t x= 0; x < 200; x++)
+      {
+        sched_test_move(copy, copy_sorted, copy_values, stride, state);
+      }
+      test_compare(TEST_SUCCESS, sched_test_search(copy, copy_sorted, state));
+      test_compare(TEST_SUCCESS, sched_test_search(search, sorted, state));
+
+      /* and a rebuild of a copy over new points */
+      continuum_search_copy(copy, search, &copy_values[stride - 1]);
+      sched_test_points(copy_sorted, size, shape, state);
+      for (uint32_t x= 0; x < size; x++)
+      {
+        copy_values[x * stride + stride - 1]= copy_sorted[x];
+      }
+      continuum_search_build(copy, &copy_values[stride - 1], stride, size);
+      test_compare(TEST_SUCCESS, sched_test_search(copy, copy_sorted, state));
+      test_compare(TEST_SUCCESS, sched_test_search(search, sorted, state));
+
+      continuum_search_free(copy);
+      continuum_search_free(search);
+    }
+  }
+
+  return TEST_SUCCESS;
+}
+
+/*
+  The dynamic continuum is laid out by weight, on a join, on an ejection
+  and, with no traffic, not at all.
+*/
+test_return_t dynamic_weighted_TEST(memcached_st *)
+{
+  memcached_st *memc= memcached_create(NULL);
+  test_true(memc);
+
+  test_compare(MEMCACHED_SUCCESS, memcached_behavior_set_distribution(memc, MEMCACHED_DISTRIBUTION_DYNAMIC_WEIGHTED));
+  test_compare(MEMCACHED_DISTRIBUTION_DYNAMIC_WEIGHTED, memcached_behavior_get_distribution(memc));
+
+  memcached_server_st *server_pool= memcached_servers_parse(sched_test_pool);
+  test_true(server_pool);
+  test_compare(MEMCACHED_SUCCESS, memcached_server_push(memc, server_pool));
+  test_compare(8U, memcached_server_count(memc));
+
+  /* before anything is counted every server holds its weight's share of the hash space */
+  test_compare(TEST_SUCCESS, sched_test_shares(memc));
+
+  memcached_server_list_free(server_pool);
+  memcached_free(memc);
+
+  return TEST_SUCCESS;
+}
+
+test_return_t dynamic_join_TEST(memcached_st *)
+{
+  memcached_st *memc= memcached_create(NULL);
+  test_true(memc);
+
+  test_compare(MEMCACHED_SUCCESS, memcached_behavior_set_distribution(memc, MEMCACHED_DISTRIBUTION_DYNAMIC_WEIGHTED));
+
+  /* a lone server, joined by all the weighted servers but 10.0.1.7 at once: each takes its weight's share */
+  test_compare(MEMCACHED_SUCCESS, memcached_server_add_with_weight(memc, "10.0.1.1", 11211, 600));
+  memcached_server_st *server_pool= memcached_servers_parse("10.0.1.2:11211 300,10.0.1.3:11211 200,10.0.1.4:11211 350,10.0.1.5:11211 1000,10.0.1.6:11211 800,10.0.1.8:11211 100");
+  test_true(server_pool);
+  test_compare(MEMCACHED_SUCCESS, memcached_server_push(memc, server_pool));
+  test_compare(7U, memcached_server_count(memc));
+  test_compare(TEST_SUCCESS, sched_test_shares(memc));
+
+  const uint32_t total= 100000;
+  std::vector<uint32_t> before(total);
+  uint32_t had[7]= { 0 };
+  for (uint32_t x= 0; x < total; x++)
+  {
+    char key[32];
+    int length= snprintf(key, sizeof(key), "share:%u", x);
+    before[x]= memcached_generate_hash(memc, key, size_t(length), 0);
+    had[before[x]]++;
+  }
+
+  memcached_server_st *joining= memcached_servers_parse("10.0.1.7:11211 950");
+  test_true(joining);
+  test_compare(MEMCACHED_SUCCESS, memcached_server_push(memc, joining));
+  test_compare(8U, memcached_server_count(memc));
+  test_compare(std::string("10.0.1.7"), std::string(memcached_server_instance_by_position(memc, 7)->hostname));
+
+  /* then 10.0.1.7: keys only move to it, and every server gives it its share of what it had */
+  uint32_t lost[7]= { 0 };
+  for (uint32_t x= 0; x < total; x++)
+  {
+    char key[32];
+    int length= snprintf(key, sizeof(key), "share:%u", x);
+    uint32_t server_idx= memcached_generate_hash(memc, key, size_t(length), 0);
+    if (server_idx != before[x])
+    {
+      test_compare(7U, server_idx);
+      lost[before[x]]++;
+    }
+  }
+
+  double share= 950.0 / 4300.0;
+  for (uint32_t x= 0; x < 7; x++)
+  {
+    test_true(lost[x] > had[x] * share * 0.85 and lost[x] < had[x] * share * 1.15);
+  }
+
+  test_compare(TEST_SUCCESS, sched_test_shares(memc));
+
+  memcached_server_list_free(joining);
+  memcached_server_list_free(server_pool);
+  memcached_free(memc);
+
+  return TEST_SUCCESS;
+}
+
+test_return_t dynamic_auto_eject_TEST(memcached_st *)
+{
+  memcached_st *memc= memcached_create(NULL);
+  test_true(memc);
+
+  test_compare(MEMCACHED_SUCCESS, memcached_behavior_set(memc, MEMCACHED_BEHAVIOR_AUTO_EJECT_HOSTS, 1));
+  test_compare(MEMCACHED_SUCCESS, memcached_behavior_set_distribution(memc, MEMCACHED_DISTRIBUTION_DYNAMIC));
+  test_compare(MEMCACHED_SUCCESS, memcached_sched_set(memc, 0.3, 0.2));
+
+  memcached_server_st *server_pool= memcached_servers_parse(sched_test_pool);
+  test_true(server_pool);
+  test_compare(MEMCACHED_SUCCESS, memcached_server_push(memc, server_pool));
+
+  /* boundaries the scheduler learned */
+  sched_test_traffic(memc, 0);
+  std::vector<std::string> learned;
+  sched_test_routes(memc, learned);
+
+  /* 10.0.1.3 in its retry delay: its points detour to live servers, the others stay put */
+  memcached_server_instance_st instance= memcached_server_instance_by_position(memc, 2);
+  memcached_instance_next_retry(instance, time(NULL) +15);
+  test_compare(MEMCACHED_SUCCESS, memcached_behavior_set_distribution(memc, MEMCACHED_DISTRIBUTION_DYNAMIC));
+
+  std::vector<std::string> routes;
+  sched_test_routes(memc, routes);
+  uint32_t moved= 0;
+  for (size_t x= 0; x < routes.size(); x++)
+  {
+    test_true(routes[x] != "10.0.1.3");
+
+    if (learned[x] == "10.0.1.3")
+    {
+      moved++;
+    }
+    else
+    {
+      test_compare(learned[x], routes[x]);
+    }
+  }
+  test_true(moved > 0);
+
+  /* and gets exactly its segments back once it is due */
+  memcached_instance_next_retry(instance, time(NULL) -1);
+  test_compare(MEMCACHED_SUCCESS, memcached_behavior_set_distribution(memc, MEMCACHED_DISTRIBUTION_DYNAMIC));
+  sched_test_routes(memc, routes);
+  test_true(routes == learned);
+
+  memcached_server_list_free(server_pool);
+  memcached_free(memc);
+
+  return TEST_SUCCESS;
+}
+
+test_return_t dynamic_idle_TEST(memcached_st *)
+{
+  memcached_st *memc= memcached_create(NULL);
+  test_true(memc);
+
+  test_compare(MEMCACHED_SUCCESS, memcached_behavior_set_distribution(memc, MEMCACHED_DISTRIBUTION_DYNAMIC));
+  test_compare(MEMCACHED_SUCCESS, memcached_sched_set(memc, 0.3, 0.2));
+  test_compare(MEMCACHED_SUCCESS, memcached_sched_set_policy(memc, MEMCACHED_SCHED_POLICY_GRADIENT));
+
+  memcached_server_st *server_pool= memcached_servers_parse(sched_test_pool);
+  test_true(server_pool);
+  test_compare(MEMCACHED_SUCCESS, memcached_server_push(memc, server_pool));
+
+  std::vector<std::string> laid_out;
+  sched_test_routes(memc, laid_out);
+
+  /* every server equally idle: no cost to even out, so no boundary moves */
+  for (uint32_t tick= 0; tick < 7; tick++)
+  {
+    mem_hs_sched_dynamic();
+  }
+
+  std::vector<std::string> routes;
+  sched_test_routes(memc, routes);
+  test_true(routes == laid_out);
+
+  memcached_server_list_free(server_pool);
+  memcached_free(memc);
+
+  return TEST_SUCCESS;
+}
+
+/*
+  A few keys among many routed through the batch path are read back from
+  the heavy hitters.
+*/
+test_return_t hot_keys_TEST(memcached_st *)
+{
+  memcached_st *memc= memcached_create(NULL);
+  test_true(memc);
+
+  test_compare(MEMCACHED_SUCCESS, memcached_behavior_set_distribution(memc, MEMCACHED_DISTRIBUTION_DYNAMIC));
+
+  memcached_server_st *server_pool= memcached_servers_parse(sched_test_pool);
+  test_true(server_pool);
+  test_compare(MEMCACHED_SUCCESS, memcached_server_push(memc, server_pool));
+
+  memcached_sched_hot_key_st hot[8];
+  uint32_t count;
+  test_compare(MEMCACHED_INVALID_ARGUMENTS, memcached_sched_hot_keys(memc, hot, 8, &count));
+  test_compare(MEMCACHED_SUCCESS, memcached_sched_set_hot_keys(memc, 32, 1));
+
+  /* hot:0 to hot:3 asked 1000, 800, 600 and 400 times, among 5000 keys asked once */
+  for (uint32_t round= 0; round < 1000; round++)
+  {
+    char buffer[9][32];
+    const char *keys[9];
+    size_t key_length[9];
+    uint32_t server_keys[9];
+    size_t number_of_keys= 0;
+
+    for (uint32_t x= 0; x < 4; x++)
+    {
+      if (round % 5 < 5 - x)
+      {
+        key_length[number_of_keys]= size_t(snprintf(buffer[number_of_keys], sizeof(buffer[0]), "hot:%u", x));
+        number_of_keys++;
+      }
+    }
+    for (uint32_t x= 0; x < 5; x++)
+    {
+      key_length[number_of_keys]= size_t(snprintf(buffer[number_of_keys], sizeof(buffer[0]), "cold:%u", round * 5 + x));
+      number_of_keys++;
+    }
+    for (size_t x= 0; x < number_of_keys; x++)
+    {
+      keys[x]= buffer[x];
+    }
+
+    test_compare(MEMCACHED_SUCCESS,
+                 memcached_generate_hash_batch(memc, keys, key_length, number_of_keys, server_keys, MEMCACHED_CMD_GET));
+  }
+
+  /* they come first, most requested first, with the server they are routed to */
+  test_compare(MEMCACHED_SUCCESS, memcached_sched_hot_keys(memc, hot, 8, &count));
+  test_compare(8U, count);
+  for (uint32_t x= 0; x < 4; x++)
+  {
+    char key[32];
+    snprintf(key, sizeof(key), "hot:%u", x);
+    test_compare(std::string(key), std::string(hot[x].key, hot[x].key_length));
+    test_compare(memcached_generate_hash(memc, key, strlen(key), 0), hot[x].server);
+    test_true(hot[x].count - hot[x].error <= 1000 - 200 * x);
+    test_true(hot[x].count >= 1000 - 200 * x);
+  }
+
+  for (uint32_t x= 4; x < count; x++)
+  {
+    test_true(hot[x].count < hot[3].count);
+  }
+
+  memcached_server_list_free(server_pool);
+  memcached_free(memc);
+
+  return TEST_SUCCESS;
+}
+
+/*
+  A lone server routes every key by 0, but the hitters report it by its
+  own hash. A table of another size starts over.
+*/
+test_return_t hot_keys_lone_TEST(memcached_st *)
+{
+  memcached_st *memc= memcached_create(NULL);
+  test_true(memc);
+
+  test_compare(MEMCACHED_SUCCESS, memcached_behavior_set_distribution(memc, MEMCACHED_DISTRIBUTION_DYNAMIC));
+
+  memcached_server_st *server_pool= memcached_servers_parse("10.0.1.1:11211");
+  test_true(server_pool);
+  test_compare(MEMCACHED_SUCCESS, memcached_server_push(memc, server_pool));
+  test_compare(MEMCACHED_SUCCESS, memcached_sched_set_hot_keys(memc, 32, 1));
+
+  for (uint32_t round= 0; round < 1000; round++)
+  {
+    char buffer[3][32];
+    const char *keys[3];
+    size_t key_length[3];
+    uint32_t server_keys[3];
+
+    for (uint32_t x= 0; x < 3; x++)
+    {
+      key_length[x]= size_t(snprintf(buffer[x], sizeof(buffer[0]), x ? "lone:%u" : "lone:hot", round * 2 + x));
+      keys[x]= buffer[x];
+    }
+
+    test_compare(MEMCACHED_SUCCESS,
+                 memcached_generate_hash_batch(memc, keys, key_length, 3, server_keys, MEMCACHED_CMD_GET));
+  }
+
+  /* every key in its own slot, reported by the hash of the key */
+  memcached_sched_hot_key_st hot[32];
+  uint32_t count;
+  test_compare(MEMCACHED_SUCCESS, memcached_sched_hot_keys(memc, hot, 32, &count));
+  test_true(count > 1);
+  test_compare(std::string("lone:hot"), std::string(hot[0].key, hot[0].key_length));
+  for (uint32_t x= 0; x < count; x++)
+  {
+    test_compare(hashkit_digest(memcached_get_hashkit(memc), hot[x].key, hot[x].key_length), hot[x].hash);
+    test_zero(hot[x].server);
+  }
+
+  /* another size builds the table anew; one too large is refused */
+  test_compare(MEMCACHED_INVALID_ARGUMENTS, memcached_sched_set_hot_keys(memc, UINT32_MAX, 1));
+  test_compare(MEMCACHED_SUCCESS, memcached_sched_set_hot_keys(memc, 4, 1));
+  test_compare(MEMCACHED_SUCCESS, memcached_sched_hot_keys(memc, hot, 32, &count));
+  test_zero(count);
+  for (uint32_t round= 0; round < 100; round++)
+  {
+    const char *keys[]= { "lone:hot" };
+    size_t key_length[]= { strlen(keys[0]) };
+    uint32_t server_keys[1];
+    test_compare(MEMCACHED_SUCCESS,
+                 memcached_generate_hash_batch(memc, keys, key_length, 1, server_keys, MEMCACHED_CMD_GET));
+  }
+  test_compare(MEMCACHED_SUCCESS, memcached_sched_hot_keys(memc, hot, 32, &count));
+  test_compare(1U, count);
+  test_compare(std::string("lone:hot"), std::string(hot[0].key, hot[0].key_length));
+  test_compare(MEMCACHED_SUCCESS, memcached_sched_set_hot_keys(memc, 32, 1));
+
+  memcached_server_list_free(server_pool);
+  memcached_free(memc);
+
+  return TEST_SUCCESS;
+}
+
+/* a dynamic handle on the servers of memc that replicates hot keys */
+static memcached_st *sched_test_replicating(memcached_st *memc)
+{
+  memcached_st *memc_clone= memcached_clone(NULL, memc);
+  if (memc_clone == NULL or
+      memcached_behavior_set(memc_clone, MEMCACHED_BEHAVIOR_NUMBER_OF_REPLICAS, 0) != MEMCACHED_SUCCESS or
+      memcached_behavior_set_distribution(memc_clone, MEMCACHED_DISTRIBUTION_DYNAMIC) != MEMCACHED_SUCCESS or
+      memcached_sched_set_hot_keys(memc_clone, 64, 1) != MEMCACHED_SUCCESS or
+      memcached_sched_set_replication(memc_clone, std::min(memcached_server_count(memc_clone), 4U), 0.05, 30) != MEMCACHED_SUCCESS)
+  {
+    memcached_free(memc_clone);
+    return NULL;
+  }
+
+  return memc_clone;
+}
+
+/* key asked as often as 100 others together, then a tick that finds it hot */
+static void sched_test_heat(memcached_st *memc, const char *key)
+{
+  for (uint32_t x= 0; x < 1000; x++)
+  {
+    char cold[32];
+    const char *keys[]= { key, cold };
+    size_t key_length[]= { strlen(key), size_t(snprintf(cold, sizeof(cold), "cold:%u", x % 100)) };
+    uint32_t server_keys[2];
+    (void)memcached_generate_hash_batch(memc, keys, key_length, 2, server_keys, MEMCACHED_CMD_GET);
+  }
+  mem_hs_sched_dynamic();
+}
+
+/*
+  Against the servers of the replication collection: the copies of a hot
+  key answer gets, and never with a value that a later write through the
+  handle replaced or deleted.
+*/
+test_return_t replication_hot_key_TEST(memcached_st *memc)
+{
+  memcached_st *memc_clone= sched_test_replicating(memc);
+  test_true(memc_clone);
+  test_true(memcached_server_count(memc_clone) > 1);
+
+  test_compare(MEMCACHED_SUCCESS, memcached_set(memc_clone, test_literal_param("hot"), test_literal_param("v1"), 0, 0));
+  sched_test_heat(memc_clone, "hot");
+
+  uint32_t hot;
+  uint64_t spread;
+  test_compare(MEMCACHED_SUCCESS, memcached_sched_replication_stat(memc_clone, &hot, NULL, NULL));
+  test_compare(1U, hot);
+
+  /* its copies answer some of the gets, and each answer is the last write */
+  test_compare(MEMCACHED_SUCCESS, memcached_set(memc_clone, test_literal_param("hot"), test_literal_param("v1"), 0, 0));
+  test_zero(sched_test_stale_reads(memc_clone, "hot", "v1"));
+  test_compare(MEMCACHED_SUCCESS, memcached_sched_replication_stat(memc_clone, NULL, &spread, NULL));
+  test_true(spread > 0);
+
+  test_compare(MEMCACHED_SUCCESS, memcached_set(memc_clone, test_literal_param("hot"), test_literal_param("v2"), 0, 0));
+  test_zero(sched_test_stale_reads(memc_clone, "hot", "v2"));
+
+  test_compare(MEMCACHED_SUCCESS, memcached_append(memc_clone, test_literal_param("hot"), test_literal_param("+"), 0, 0));
+  test_zero(sched_test_stale_reads(memc_clone, "hot", "v2+"));
+
+  test_compare(MEMCACHED_SUCCESS, memcached_delete(memc_clone, test_literal_param("hot"), 0));
+  test_zero(sched_test_stale_reads(memc_clone, "hot", NULL));
+
+  memcached_free(memc_clone);
+
+  return TEST_SUCCESS;
+}
+
+/* the state of the replication slot of key, and the servers it holds copies on */
+static uint64_t sched_test_replica_slot(memcached_st *memc, const char *key, std::vector<uint32_t> &holders)
+{
+  struct sched_replication *replication= memc->dynamic->replication;
+  uint32_t slot= hashkit_digest(memcached_get_hashkit(memc), key, strlen(key)) & replication->mask;
+
+  holders.clear();
+  for (uint32_t x= 0; x < SCHED_REPLICA_HOLDERS; x++)
+  {
+    if (replication->holders[slot * SCHED_REPLICA_HOLDERS + x])
+    {
+      holders.push_back(replication->holders[slot * SCHED_REPLICA_HOLDERS + x] - 1);
+    }
+  }
+
+  return replication->slots[slot];
+}
+
+/*
+  A copy that a set could not refresh, here on a server still owing the
+  handle the replies to an mget, turns its key stale: gets go to the owner
+  alone, the key is not found hot again meanwhile, and the next write still
+  drops the copy.
+*/
+test_return_t replication_stale_TEST(memcached_st *memc)
+{
+  memcached_st *memc_clone= sched_test_replicating(memc);
+  test_true(memc_clone);
+  test_true(memcached_server_count(memc_clone) > 1);
+
+  const char *key= "stale";
+  test_compare(MEMCACHED_SUCCESS, memcached_set(memc_clone, key, strlen(key), test_literal_param("v1"), 0, 0));
+  sched_test_heat(memc_clone, key);
+
+  /* the set writes the copies and remembers where */
+  std::vector<uint32_t> holders;
+  test_compare(MEMCACHED_SUCCESS, memcached_set(memc_clone, key, strlen(key), test_literal_param("v1"), 0, 0));
+  test_true(sched_test_replica_slot(memc_clone, key, holders) & SCHED_REPLICA_HOT);
+  test_false(holders.empty());
+  uint32_t owner= memcached_generate_hash(memc_clone, key, strlen(key), 0);
+  for (uint32_t x= 0; x < holders.size(); x++)
+  {
+    test_true(holders[x] != owner);
+  }
+
+  /* replies pending on one of them */
+  char group[32];
+  int group_length= 0;
+  for (uint32_t x= 0; x < 10000; x++)
+  {
+    group_length= snprintf(group, sizeof(group), "group:%u", x);
+    if (memcached_generate_hash(memc_clone, group, size_t(group_length), 0) == holders[0])
+    {
+      break;
+    }
+  }
+  test_compare(holders[0], memcached_generate_hash(memc_clone, group, size_t(group_length), 0));
+  const char *keys[]= { "pending:1", "pending:2" };
+  size_t key_length[]= { strlen(keys[0]), strlen(keys[1]) };
+  test_compare(MEMCACHED_SUCCESS, memcached_mget_by_key(memc_clone, group, size_t(group_length), keys, key_length, 2));
+
+  /* the owner takes the set, the copy there keeps v1 */
+  test_compare(MEMCACHED_SUCCESS, memcached_set(memc_clone, key, strlen(key), test_literal_param("v2"), 0, 0));
+  test_compare(uint64_t(SCHED_REPLICA_COOLING | SCHED_REPLICA_STALE), sched_test_replica_slot(memc_clone, key, holders) & 0xffffffff);
+  memcached_quit(memc_clone);
+
+  uint64_t spread;
+  test_compare(MEMCACHED_SUCCESS, memcached_sched_replication_stat(memc_clone, NULL, &spread, NULL));
+  test_zero(sched_test_stale_reads(memc_clone, key, "v2"));
+  uint64_t spread_stale;
+  test_compare(MEMCACHED_SUCCESS, memcached_sched_replication_stat(memc_clone, NULL, &spread_stale, NULL));
+  test_compare(spread, spread_stale);
+
+  sched_test_heat(memc_clone, key);
+  test_false(sched_test_replica_slot(memc_clone, key, holders) & SCHED_REPLICA_HOT);
+
+  /* a write while it cools drops every copy it left */
+  test_compare(MEMCACHED_SUCCESS, memcached_set(memc_clone, key, strlen(key), test_literal_param("v3"), 0, 0));
+  (void)sched_test_replica_slot(memc_clone, key, holders);
+  test_true(holders.empty());
+  test_zero(sched_test_stale_reads(memc_clone, key, "v3"));
+
+  memcached_free(memc_clone);
+
+  return TEST_SUCCESS;
+}
+
+/*
+  A second server joins one that holds some keys: the keys it takes are
+  read from their previous owner, unless they were deleted since, also
+  while the delete could not reach it.
+*/
+test_return_t handoff_delete_TEST(memcached_st *memc)
+{
+  test_true(memcached_server_count(memc) > 1);
+  memcached_server_instance_st first= memcached_server_instance_by_position(memc, 0);
+  memcached_server_instance_st second= memcached_server_instance_by_position(memc, 1);
+  test_compare(MEMCACHED_SUCCESS, memcached_flush(memc, 0));
+
+  memcached_st *memc_clone= memcached_create(NULL);
+  test_true(memc_clone);
+  test_compare(MEMCACHED_SUCCESS, memcached_behavior_set_distribution(memc_clone, MEMCACHED_DISTRIBUTION_DYNAMIC));
+  test_compare(MEMCACHED_SUCCESS, memcached_sched_set_handoff(memc_clone, 60, 60));
+
+  /* keys written while the first server is alone */
+  test_compare(MEMCACHED_SUCCESS,
+               memcached_server_add(memc_clone, first->hostname, first->port()));
+  for (uint32_t x= 0; x < 100; x++)
+  {
+    char key[32];
+    int length= snprintf(key, sizeof(key), "handoff:%u", x);
+    test_compare(MEMCACHED_SUCCESS, memcached_set(memc_clone, key, size_t(length), key, size_t(length), 0, 0));
+  }
+
+  /* the second joins: the keys it takes are still on the first */
+  test_compare(MEMCACHED_SUCCESS,
+               memcached_server_add(memc_clone, second->hostname, second->port()));
+  uint64_t hits;
+  test_compare(MEMCACHED_SUCCESS, memcached_sched_handoff_stat(memc_clone, NULL, &hits));
+
+  uint32_t moved= 0;
+  char kept[32]= "";
+  for (uint32_t x= 0; x < 100; x++)
+  {
+    char key[32];
+    int length= snprintf(key, sizeof(key), "handoff:%u", x);
+    if (memcached_generate_hash(memc_clone, key, size_t(length), 0) != 1)
+    {
+      continue;
+    }
+
+    if (moved++ % 2)
+    {
+      /* deleted after the change: the first must not hand it back */
+      test_compare(MEMCACHED_NOTFOUND, memcached_delete(memc_clone, key, size_t(length), 0));
+      test_zero(sched_test_stale_reads(memc_clone, key, NULL));
+    }
+    else
+    {
+      /* asked of the first, and written back to the second */
+      test_zero(sched_test_stale_reads(memc_clone, key, key));
+      memcpy(kept, key, sizeof(kept));
+    }
+  }
+  test_true(moved > 1);
+
+  uint64_t handed;
+  test_compare(MEMCACHED_SUCCESS, memcached_sched_handoff_stat(memc_clone, NULL, &handed));
+  test_compare(hits + (moved + 1) / 2, handed);
+
+  /* replies pending on the first: the delete cannot reach it, so its copy is not handed back */
+  char group[32];
+  int group_length= 0;
+  for (uint32_t x= 0; x < 10000; x++)
+  {
+    group_length= snprintf(group, sizeof(group), "group:%u", x);
+    if (memcached_generate_hash(memc_clone, group, size_t(group_length), 0) == 0)
+    {
+      break;
+    }
+  }
+  test_zero(memcached_generate_hash(memc_clone, group, size_t(group_length), 0));
+  const char *keys[]= { "pending:1", "pending:2" };
+  size_t key_length[]= { strlen(keys[0]), strlen(keys[1]) };
+  test_compare(MEMCACHED_SUCCESS, memcached_mget_by_key(memc_clone, group, size_t(group_length), keys, key_length, 2));
+  test_compare(MEMCACHED_SUCCESS, memcached_delete(memc_clone, kept, strlen(kept), 0));
+  memcached_quit(memc_clone);
+  test_zero(sched_test_stale_reads(memc_clone, kept, NULL));
+
+  test_compare(MEMCACHED_SUCCESS, memcached_sched_set_handoff(memc_clone, 0, 0));
+  memcached_free(memc_clone);
+
+  return TEST_SUCCESS;
+}
+
+/*
+  As above, with a third server joining within the same grace period.
+*/
+test_return_t handoff_twice_TEST(memcached_st *memc)
+{
+  test_true(memcached_server_count(memc) > 2);
+  test_compare(MEMCACHED_SUCCESS, memcached_flush(memc, 0));
+
+  memcached_st *memc_clone= memcached_create(NULL);
+  test_true(memc_clone);
+  test_compare(MEMCACHED_SUCCESS, memcached_behavior_set_distribution(memc_clone, MEMCACHED_DISTRIBUTION_DYNAMIC));
+  test_compare(MEMCACHED_SUCCESS, memcached_sched_set_handoff(memc_clone, 60, 60));
+
+  /* keys written while the first server is alone */
+  memcached_server_instance_st instance= memcached_server_instance_by_position(memc, 0);
+  test_compare(MEMCACHED_SUCCESS,
+               memcached_server_add(memc_clone, instance->hostname, instance->port()));
+  for (uint32_t x= 0; x < 200; x++)
+  {
+    char key[32];
+    int length= snprintf(key, sizeof(key), "handoff:%u", x);
+    test_compare(MEMCACHED_SUCCESS, memcached_set(memc_clone, key, size_t(length), key, size_t(length), 0, 0));
+  }
+
+  /* two joins within one grace period, nothing read in between */
+  uint32_t between[200];
+  instance= memcached_server_instance_by_position(memc, 1);
+  test_compare(MEMCACHED_SUCCESS,
+               memcached_server_add(memc_clone, instance->hostname, instance->port()));
+  for (uint32_t x= 0; x < 200; x++)
+  {
+    char key[32];
+    int length= snprintf(key, sizeof(key), "handoff:%u", x);
+    between[x]= memcached_generate_hash(memc_clone, key, size_t(length), 0);
+  }
+  instance= memcached_server_instance_by_position(memc, 2);
+  test_compare(MEMCACHED_SUCCESS,
+               memcached_server_add(memc_clone, instance->hostname, instance->port()));
+
+  /* a key the second took and the third took from it is still found on the first */
+  uint32_t moved= 0;
+  for (uint32_t x= 0; x < 200; x++)
+  {
+    char key[32];
+    int length= snprintf(key, sizeof(key), "handoff:%u", x);
+    if (between[x] != 1 or memcached_generate_hash(memc_clone, key, size_t(length), 0) != 2)
+    {
+      continue;
+    }
+
+    if (moved++ % 2)
+    {
+      /* and a delete drops it from every server that owned it */
+      test_compare(MEMCACHED_NOTFOUND, memcached_delete(memc_clone, key, size_t(length), 0));
+      test_zero(sched_test_stale_reads(memc_clone, key, NULL));
+    }
+    else
+    {
+      test_zero(sched_test_stale_reads(memc_clone, key, key));
+    }
+  }
+  test_true(moved > 1);
+
+  test_compare(MEMCACHED_SUCCESS, memcached_sched_set_handoff(memc_clone, 0, 0));
+  memcached_free(memc_clone);
+
+  return TEST_SUCCESS;
+}
+
+/*
+  A key set again with a value that expired is not read back from its
+  previous owner.
+*/
+test_return_t handoff_set_TEST(memcached_st *memc)
+{
+  test_true(memcached_server_count(memc) > 1);
+  memcached_server_instance_st first= memcached_server_instance_by_position(memc, 0);
+  memcached_server_instance_st second= memcached_server_instance_by_position(memc, 1);
+  test_compare(MEMCACHED_SUCCESS, memcached_flush(memc, 0));
+
+  memcached_st *memc_clone= memcached_create(NULL);
+  test_true(memc_clone);
+  test_compare(MEMCACHED_SUCCESS, memcached_behavior_set_distribution(memc_clone, MEMCACHED_DISTRIBUTION_DYNAMIC));
+  test_compare(MEMCACHED_SUCCESS, memcached_sched_set_handoff(memc_clone, 60, 60));
+
+  /* keys written while the first server is alone */
+  test_compare(MEMCACHED_SUCCESS,
+               memcached_server_add(memc_clone, first->hostname, first->port()));
+  for (uint32_t x= 0; x < 100; x++)
+  {
+    char key[32];
+    int length= snprintf(key, sizeof(key), "handoff:%u", x);
+    test_compare(MEMCACHED_SUCCESS, memcached_set(memc_clone, key, size_t(length), key, size_t(length), 0, 0));
+  }
+
+  /* the second joins, and the keys it takes are set again for a second */
+  test_compare(MEMCACHED_SUCCESS,
+               memcached_server_add(memc_clone, second->hostname, second->port()));
+  uint32_t moved= 0;
+  for (uint32_t x= 0; x < 100; x++)
+  {
+    char key[32];
+    int length= snprintf(key, sizeof(key), "handoff:%u", x);
+    if (memcached_generate_hash(memc_clone, key, size_t(length), 0) == 1)
+    {
+      test_compare(MEMCACHED_SUCCESS, memcached_set(memc_clone, key, size_t(length), test_literal_param("short"), 1, 0));
+      moved++;
+    }
+  }
+  test_true(moved > 0);
+
+  /* once that expired, the first must not hand the older value back */
+  test_zero(sleep(3));
+  for (uint32_t x= 0; x < 100; x++)
+  {
+    char key[32];
+    int length= snprintf(key, sizeof(key), "handoff:%u", x);
+    if (memcached_generate_hash(memc_clone, key, size_t(length), 0) == 1)
+    {
+      test_zero(sched_test_stale_reads(memc_clone, key, NULL));
+    }
+  }
+
+  test_compare(MEMCACHED_SUCCESS, memcached_sched_set_handoff(memc_clone, 0, 0));
+  memcached_free(memc_clone);
+
+  return TEST_SUCCESS;
+}
+
+/*
+  The continuum moves under keys that were just hit, and they are copied
+  to their new owners, all but those deleted in between.
+*/
+test_return_t migration_TEST(memcached_st *memc)
+{
+  test_true(memcached_server_count(memc) > 1);
+  test_compare(MEMCACHED_SUCCESS, memcached_flush(memc, 0));
+
+  memcached_st *memc_clone= memcached_clone(NULL, memc);
+  test_true(memc_clone);
+  test_compare(MEMCACHED_SUCCESS, memcached_behavior_set_distribution(memc_clone, MEMCACHED_DISTRIBUTION_DYNAMIC));
+  test_compare(MEMCACHED_SUCCESS, memcached_sched_set(memc_clone, 0.3, 0.2));
+  test_compare(MEMCACHED_SUCCESS, memcached_sched_set_policy(memc_clone, MEMCACHED_SCHED_POLICY_GRADIENT));
+  test_compare(MEMCACHED_INVALID_ARGUMENTS, memcached_sched_set_migration(memc_clone, UINT32_MAX, 60));
+  test_compare(MEMCACHED_SUCCESS, memcached_sched_set_migration(memc_clone, 1024, 60));
+  uint64_t copied, avoided;
+  test_compare(MEMCACHED_SUCCESS, memcached_sched_migration_stat(memc_clone, &copied, &avoided, NULL));
+
+  /* every key hit as often as a handle samples, so each is hot */
+  const uint32_t total= 200;
+  std::vector<uint32_t> before(total);
+  for (uint32_t x= 0; x < total; x++)
+  {
+    char key[32];
+    int length= snprintf(key, sizeof(key), "migrate:%u", x);
+    test_compare(MEMCACHED_SUCCESS, memcached_set(memc_clone, key, size_t(length), key, size_t(length), 0, 0));
+    test_zero(sched_test_stale_reads(memc_clone, key, key));
+    before[x]= memcached_generate_hash(memc_clone, key, size_t(length), 0);
+  }
+
+  /* the continuum moves under some of them */
+  sched_test_traffic(memc_clone, 0);
+  uint64_t pending;
+  test_compare(MEMCACHED_SUCCESS, memcached_sched_migration_stat(memc_clone, NULL, NULL, &pending));
+  test_true(pending > 0);
+
+  /* half of those that moved are deleted before they are copied */
+  uint32_t moved= 0;
+  for (uint32_t x= 0; x < total; x++)
+  {
+    char key[32];
+    int length= snprintf(key, sizeof(key), "migrate:%u", x);
+    if (memcached_generate_hash(memc_clone, key, size_t(length), 0) != before[x] and moved++ % 2)
+    {
+      test_compare(MEMCACHED_NOTFOUND, memcached_delete(memc_clone, key, size_t(length), 0));
+    }
+  }
+  test_true(moved > 1);
+
+  uint32_t migrated;
+  test_compare(MEMCACHED_SUCCESS, memcached_sched_migrate(memc_clone, uint32_t(pending), &migrated));
+  test_true(migrated > 0);
+  uint64_t now_copied, now_avoided;
+  test_compare(MEMCACHED_SUCCESS, memcached_sched_migration_stat(memc_clone, &now_copied, &now_avoided, &pending));
+  test_compare(copied + migrated, now_copied);
+  test_compare(avoided, now_avoided);
+  test_zero(pending);
+
+  /* no deleted key comes back; the copies answer on the new owners */
+  moved= 0;
+  for (uint32_t x= 0; x < total; x++)
+  {
+    char key[32];
+    int length= snprintf(key, sizeof(key), "migrate:%u", x);
+    if (memcached_generate_hash(memc_clone, key, size_t(length), 0) == before[x])
+    {
+      continue;
+    }
+
+    if (moved++ % 2)
+    {
+      test_zero(sched_test_stale_reads(memc_clone, key, NULL));
+    }
+    else
+    {
+      // one that lost its hot key slot to another was not copied
+      (void)sched_test_stale_reads(memc_clone, key, key);
+    }
+  }
+  test_compare(MEMCACHED_SUCCESS, memcached_sched_migration_stat(memc_clone, NULL, &now_avoided, NULL));
+  test_true(now_avoided > avoided and now_avoided - avoided <= uint64_t(migrated));
+
+  test_compare(MEMCACHED_SUCCESS, memcached_sched_set_migration(memc_clone, 0, 0));
+  test_compare(MEMCACHED_SUCCESS, memcached_sched_set_policy(memc_clone, MEMCACHED_SCHED_POLICY_PAIR));
+  memcached_free(memc_clone);
+
+  return TEST_SUCCESS;
+}
+
+/* near cache hits so far */
+static uint64_t sched_test_near_hits(memcached_st *memc)
+{
+  uint64_t hits= 0;
+  (void)memcached_sched_near_stat(memc, &hits, NULL, NULL);
+
+  return hits;
+}
+
+/*
+  A key read from the near cache: a write or a flush through the handle
+  takes effect at the next get.
+*/
+test_return_t near_cache_TEST(memcached_st *memc)
+{
+  memcached_st *memc_clone= memcached_clone(NULL, memc);
+  test_true(memc_clone);
+
+  test_compare(MEMCACHED_SUCCESS, memcached_behavior_set_distribution(memc_clone, MEMCACHED_DISTRIBUTION_DYNAMIC));
+
+  /* entries live a minute: only a drop explains a fresh read */
+  test_compare(MEMCACHED_SUCCESS, memcached_sched_set_near_cache(memc_clone, 1 << 20, 60000));
+
+  test_compare(MEMCACHED_SUCCESS, memcached_set(memc_clone, test_literal_param("near"), test_literal_param("v1"), 0, 0));
+  test_zero(sched_test_stale_reads(memc_clone, "near", "v1"));
+  uint64_t hits= sched_test_near_hits(memc_clone);
+  test_zero(sched_test_stale_reads(memc_clone, "near", "v1"));
+  test_compare(hits + 200, sched_test_near_hits(memc_clone));
+
+  /* the first get after each write asks the server */
+  test_compare(MEMCACHED_SUCCESS, memcached_set(memc_clone, test_literal_param("near"), test_literal_param("v2"), 0, 0));
+  test_zero(sched_test_stale_reads(memc_clone, "near", "v2"));
+  test_compare(hits + 399, sched_test_near_hits(memc_clone));
+
+  test_compare(MEMCACHED_SUCCESS, memcached_append(memc_clone, test_literal_param("near"), test_literal_param("+"), 0, 0));
+  test_zero(sched_test_stale_reads(memc_clone, "near", "v2+"));
+
+  test_compare(MEMCACHED_SUCCESS, memcached_delete(memc_clone, test_literal_param("near"), 0));
+  test_zero(sched_test_stale_reads(memc_clone, "near", NULL));
+
+  test_compare(MEMCACHED_SUCCESS, memcached_set(memc_clone, test_literal_param("near"), test_literal_param("v3"), 0, 0));
+  test_zero(sched_test_stale_reads(memc_clone, "near", "v3"));
+  test_compare(MEMCACHED_SUCCESS, memcached_flush(memc_clone, 0));
+  test_zero(sched_test_stale_reads(memc_clone, "near", NULL));
+
+  test_compare(MEMCACHED_SUCCESS, memcached_sched_set_near_cache(memc_clone, 0, 0));
+  memcached_free(memc_clone);
+
+  return TEST_SUCCESS;
+}
+
+/* requests for the scheduler thread to find on its next wake-up */
+static void sched_test_thread_traffic(memcached_st *memc, uint32_t round)
+{
+  for (uint32_t x= 0; x < 5000; x++)
+  {
+    char key[32];
+    int length= snprintf(key, sizeof(key), "thread:%u", (x * x) % (1000 + round * 10));
+    (void)memcached_generate_hash(memc, key, size_t(length), 1);
+  }
+}
+
+/*
+  The scheduler runs on its own thread while keys are routed, and stops.
+*/
+test_return_t sched_thread_TEST(memcached_st *)
+{
+  memcached_st *memc= memcached_create(NULL);
+  test_true(memc);
+
+  test_compare(MEMCACHED_SUCCESS, memcached_behavior_set_distribution(memc, MEMCACHED_DISTRIBUTION_DYNAMIC));
+  test_compare(MEMCACHED_SUCCESS, memcached_sched_set(memc, 0.3, 0.2));
+
+  memcached_server_st *server_pool= memcached_servers_parse(sched_test_pool);
+  test_true(server_pool);
+  test_compare(MEMCACHED_SUCCESS, memcached_server_push(memc, server_pool));
+
+  test_compare(MEMCACHED_INVALID_ARGUMENTS, memcached_sched_start(memc, MEMCACHED_SCHED_POLICY_PAIR, 0, 80));
+  test_compare(MEMCACHED_INVALID_ARGUMENTS, memcached_sched_start(memc, MEMCACHED_SCHED_POLICY_PAIR, 80, 10));
+  test_compare(MEMCACHED_SUCCESS, memcached_sched_start(memc, MEMCACHED_SCHED_POLICY_PAIR, 10, 80));
+
+  /* ticks with the traffic, waiting within [10, 80] milliseconds throughout */
+  uint64_t ticks= 0;
+  uint64_t skipped;
+  uint32_t interval;
+  for (uint32_t round= 0; round < 500 and ticks < 3; round++)
+  {
+    sched_test_thread_traffic(memc, round);
+    test_zero(usleep(10000));
+    test_compare(MEMCACHED_SUCCESS, memcached_sched_thread_stat(memc, &ticks, &skipped, &interval));
+    test_true(interval >= 10 and interval <= 80);
+  }
+  test_true(ticks >= 3);
+
+  /* stop joins it; nothing is left to report, and a second stop is harmless */
+  test_compare(MEMCACHED_SUCCESS, memcached_sched_stop(memc));
+  test_compare(MEMCACHED_SUCCESS, memcached_sched_thread_stat(memc, &ticks, &skipped, &interval));
+  test_zero(ticks);
+  test_zero(skipped);
+  test_zero(interval);
+  test_compare(MEMCACHED_SUCCESS, memcached_sched_stop(memc));
+
+  /* a handle that starts and stops it can be freed while others keep the ring */
+  memcached_st *starter= memcached_clone(NULL, memc);
+  test_true(starter);
+  test_compare(MEMCACHED_SUCCESS, memcached_sched_start(starter, MEMCACHED_SCHED_POLICY_GRADIENT, 10, 80));
+  sched_test_thread_traffic(starter, 0);
+  test_compare(MEMCACHED_SUCCESS, memcached_sched_thread_stat(memc, NULL, NULL, &interval));
+  test_true(interval >= 10 and interval <= 80);
+  test_compare(MEMCACHED_SUCCESS, memcached_sched_stop(starter));
+  memcached_free(starter);
+  test_compare(MEMCACHED_SUCCESS, memcached_sched_thread_stat(memc, NULL, NULL, &interval));
+  test_zero(interval);
+
+  /* one still running when the last handle goes is stopped with the ring */
+  test_compare(MEMCACHED_SUCCESS, memcached_sched_start(memc, MEMCACHED_SCHED_POLICY_PAIR, 10, 80));
+  sched_test_thread_traffic(memc, 0);
+  test_zero(usleep(20000));
+
+  memcached_server_list_free(server_pool);
+  memcached_free(memc);
+
+  return TEST_SUCCESS;
+}
+
+/* what the replies credited so far to point, in the counters of memc */
+static struct sched_counter sched_test_counter(memcached_st *memc, uint32_t point)
+{
+  struct sched_counter counter;
+  memset(&counter, 0, sizeof(counter));
+
+  struct sched_counters *counters= memc->sched_reader->counters;
+  if (counters and counters->layout == memc->sched_reader->route_layout and point < counters->points)
+  {
+    counter= counters->counter[point];
+  }
+
+  return counter;
+}
+
+/*
+  Known keys set and got: their requests, hits, bytes and reply time are in
+  the counters of the points they were routed to.
+*/
+test_return_t sched_accounting_TEST(memcached_st *memc)
+{
+  memcached_st *memc_clone= memcached_clone(NULL, memc);
+  test_true(memc_clone);
+
+  test_compare(MEMCACHED_SUCCESS, memcached_behavior_set_distribution(memc_clone, MEMCACHED_DISTRIBUTION_DYNAMIC));
+  /* a latency weight, so that replies are timed */
+  test_compare(MEMCACHED_SUCCESS, memcached_sched_set_load(memc_clone, 1, 1, 1));
+
+  char value[100];
+  memset(value, 'v', sizeof(value));
+
+  uint64_t usec= 0;
+  for (uint32_t x= 0; x < 20; x++)
+  {
+    char key[32];
+    int length= snprintf(key, sizeof(key), "account:%u", x);
+    (void)memcached_generate_hash(memc_clone, key, size_t(length), 0);
+    uint32_t point= memc_clone->sched_reader->route;
+
+    /* a set is counted where it is routed, and its bytes when it is stored */
+    struct sched_counter before= sched_test_counter(memc_clone, point);
+    test_compare(MEMCACHED_SUCCESS, memcached_set(memc_clone, key, size_t(length), value, sizeof(value), 0, 0));
+    struct sched_counter after= sched_test_counter(memc_clone, point);
+    test_compare(before.set + 1, after.set);
+    test_compare(before.get, after.get);
+    test_compare(before.hit, after.hit);
+    test_compare(before.bytes + uint32_t(length) + uint32_t(sizeof(value)), after.bytes);
+    usec+= after.usec - before.usec;
+
+    /* a get that finds it is a hit, with the key and value read */
+    before= after;
+    size_t value_length;
+    uint32_t flags;
+    memcached_return_t rc;
+    char *fetched= memcached_get(memc_clone, key, size_t(length), &value_length, &flags, &rc);
+    test_compare(MEMCACHED_SUCCESS, rc);
+    test_compare(sizeof(value), value_length);
+    free(fetched);
+    after= sched_test_counter(memc_clone, point);
+    test_compare(before.get + 1, after.get);
+    test_compare(before.hit + 1, after.hit);
+    test_compare(before.bytes + uint32_t(length) + uint32_t(sizeof(value)), after.bytes);
+    usec+= after.usec - before.usec;
+
+    /* one that does not is a get alone */
+    length= snprintf(key, sizeof(key), "account:missing:%u", x);
+    (void)memcached_generate_hash(memc_clone, key, size_t(length), 0);
+    point= memc_clone->sched_reader->route;
+    before= sched_test_counter(memc_clone, point);
+    fetched= memcached_get(memc_clone, key, size_t(length), &value_length, &flags, &rc);
+    test_compare(MEMCACHED_NOTFOUND, rc);
+    test_null(fetched);
+    after= sched_test_counter(memc_clone, point);
+    test_compare(before.get + 1, after.get);
+    test_compare(before.hit, after.hit);
+    test_compare(before.bytes, after.bytes);
+  }
+  test_true(usec > 0);
+
+  /* every server reports on itself; the stats round trip is credited to no point */
+  uint32_t points= memc_clone->sched_reader->counters->points;
+  std::vector<struct sched_counter> before;
+  for (uint32_t x= 0; x < points; x++)
+  {
+    before.push_back(sched_test_counter(memc_clone, x));
+  }
+
+  test_compare(MEMCACHED_SUCCESS, memcached_sched_feedback(memc_clone));
+  for (uint32_t x= 0; x < memcached_server_count(memc_clone); x++)
+  {
+    test_true(memc_clone->dynamic->servers[x].feedback > 0);
+  }
+
+  for (uint32_t x= 0; x < points; x++)
+  {
+    struct sched_counter after= sched_test_counter(memc_clone, x);
+    test_compare(before[x].get, after.get);
+    test_compare(before[x].hit, after.hit);
+    test_compare(before[x].bytes, after.bytes);
+  }
+
+  test_compare(MEMCACHED_SUCCESS, memcached_sched_set_load(memc_clone, 1, 0, 0));
+  memcached_free(memc_clone);
+
+  return TEST_SUCCESS;
+}
+
+/*
+  The scheduler thread asks the servers for their eviction pressure: a
+  server close to full counts as pressed.
+*/
+test_return_t sched_feedback_TEST(memcached_st *memc)
+{
+  memcached_st *memc_clone= memcached_clone(NULL, memc);
+  test_true(memc_clone);
+
+  test_compare(MEMCACHED_SUCCESS, memcached_behavior_set_distribution(memc_clone, MEMCACHED_DISTRIBUTION_DYNAMIC));
+  test_compare(MEMCACHED_SUCCESS, memcached_sched_set_feedback(memc_clone, 1));
+  test_compare(MEMCACHED_SUCCESS, memcached_sched_start(memc_clone, MEMCACHED_SCHED_POLICY_PAIR, 1, 10));
+
+  /* the thread asks every server on its own, nobody calls memcached_sched_feedback() */
+  struct sched_dynamic *dynamic= memc_clone->dynamic;
+  uint32_t count= memcached_server_count(memc_clone);
+  uint32_t reported= 0;
+  for (uint32_t round= 0; round < 500 and reported < count; round++)
+  {
+    sched_test_thread_traffic(memc_clone, round);
+    test_zero(usleep(10000));
+
+    reported= 0;
+    (void)pthread_mutex_lock(&dynamic->lock);
+    for (uint32_t x= 0; x < count; x++)
+    {
+      if (dynamic->servers[x].feedback)
+      {
+        reported++;
+      }
+    }
+    (void)pthread_mutex_unlock(&dynamic->lock);
+  }
+  test_compare(count, reported);
+  test_compare(MEMCACHED_SUCCESS, memcached_sched_stop(memc_clone));
+
+  /* the first server is nearly full but has not evicted yet: it is the most pressed */
+  std::vector<struct sched_feedback> feedback(count);
+  (void)pthread_mutex_lock(&dynamic->lock);
+  for (uint32_t x= 0; x < count; x++)
+  {
+    feedback[x].reported= true;
+    feedback[x].evictions= dynamic->servers[x].evictions;
+    feedback[x].evicted_unfetched= dynamic->servers[x].evicted_unfetched;
+    feedback[x].bytes= x ? 100 : 950;
+    feedback[x].limit_maxbytes= 1000;
+    feedback[x].curr_items= 10;
+  }
+  sched_servers_feedback(dynamic, &feedback[0], count);
+  double pressure= dynamic->servers[0].pressure;
+  double pressurerate= dynamic->servers[0].pressurerate;
+  double others= 0;
+  for (uint32_t x= 1; x < count; x++)
+  {
+    others+= dynamic->servers[x].pressurerate;
+  }
+  (void)pthread_mutex_unlock(&dynamic->lock);
+
+  test_true(std::fabs(pressure - SCHED_FILL_PRESSURE / 2) < 1e-9);
+  test_true(pressurerate == 1);
+  test_true(others == 0);
+
+  test_compare(MEMCACHED_SUCCESS, memcached_sched_set_feedback(memc_clone, MEMCACHED_SCHED_FEEDBACK));
+  memcached_free(memc_clone);
+
+  return TEST_SUCCESS;
+}
+
+/* gets of one key in a tick of the dynamic scheduler; the point they went to */
+static uint32_t sched_test_decay_tick(memcached_st *memc, uint32_t gets)
+{
+  uint32_t point= 0;
+  for (uint32_t x= 0; x < gets; x++)
+  {
+    (void)memcached_generate_hash(memc, test_literal_param("decay:hot"), MEMCACHED_CMD_GET);
+    point= memc->sched_reader->route;
+  }
+  mem_hs_sched_dynamic();
+
+  return point;
+}
+
+/*
+  Gets routed to one point are halved every half-life in its statistics.
+*/
+test_return_t sched_decay_TEST(memcached_st *)
+{
+  memcached_st *memc= memcached_create(NULL);
+  test_true(memc);
+
+  test_compare(MEMCACHED_SUCCESS, memcached_behavior_set_distribution(memc, MEMCACHED_DISTRIBUTION_DYNAMIC));
+  memcached_server_st *server_pool= memcached_servers_parse(sched_test_pool);
+  test_true(server_pool);
+  test_compare(MEMCACHED_SUCCESS, memcached_server_push(memc, server_pool));
+  test_compare(MEMCACHED_SUCCESS, memcached_sched_set_half_life(memc, 2));
+
+  /* the gets of one tick, then half of them for every two ticks without any */
+  uint32_t point= sched_test_decay_tick(memc, 1000);
+  test_true(point < memc->dynamic->ring->continuum_points_counter);
+  for (uint32_t tick= 0; tick <= 6; tick++)
+  {
+    double expected= 1000 * std::pow(0.5, tick / 2.0);
+    test_true(std::fabs(memc->dynamic->ring->stats[point].rget - expected) < expected * 1e-9);
+    (void)sched_test_decay_tick(memc, 0);
+  }
+
+  test_compare(MEMCACHED_SUCCESS, memcached_sched_set_half_life(memc, MEMCACHED_SCHED_HALF_LIFE));
+  memcached_server_list_free(server_pool);
+  memcached_free(memc);
+
+  return TEST_SUCCESS;
+}
+
+/*
+  Without a half-life, they are gone after the next move.
+*/
+test_return_t sched_decay_reset_TEST(memcached_st *)
+{
+  memcached_st *memc= memcached_create(NULL);
+  test_true(memc);
+
+  test_compare(MEMCACHED_SUCCESS, memcached_behavior_set_distribution(memc, MEMCACHED_DISTRIBUTION_DYNAMIC));
+  memcached_server_st *server_pool= memcached_servers_parse(sched_test_pool);
+  test_true(server_pool);
+  test_compare(MEMCACHED_SUCCESS, memcached_server_push(memc, server_pool));
+  test_compare(MEMCACHED_SUCCESS, memcached_sched_set_half_life(memc, 0));
+  test_compare(0.0, memcached_sched_get_half_life(memc));
+
+  /* the gets move a boundary, and the ring after it starts from nothing */
+  uint64_t version= memc->dynamic->ring->version;
+  (void)sched_test_decay_tick(memc, 1000);
+  test_true(memc->dynamic->ring->version > version);
+  for (uint32_t x= 0; x < memc->dynamic->ring->continuum_points_counter; x++)
+  {
+    test_compare(0.0, memc->dynamic->ring->stats[x].rget);
+  }
+
+  /* and without requests there is nothing to move */
+  version= memc->dynamic->ring->version;
+  (void)sched_test_decay_tick(memc, 0);
+  test_compare(version, memc->dynamic->ring->version);
+
+  test_compare(MEMCACHED_SUCCESS, memcached_sched_set_half_life(memc, MEMCACHED_SCHED_HALF_LIFE));
+  memcached_server_list_free(server_pool);
+  memcached_free(memc);
+
+  return TEST_SUCCESS;
+}
+
+/* a thread routing keys on its own handle until told to stop */
+struct sched_test_reader {
+  memcached_st *memc;
+  volatile bool *stop;
+  uint64_t routed;
+  uint64_t invalid;
+};
+
+static void *sched_test_reader_run(void *context)
+{
+  struct sched_test_reader *reader= (struct sched_test_reader *)context;
+  uint32_t count= memcached_server_count(reader->memc);
+
+  for (uint32_t x= 0; *reader->stop == false; x++)
+  {
+    char key[32];
+    int length= snprintf(key, sizeof(key), "reader:%u", x % 10000);
+    if (memcached_generate_hash(reader->memc, key, size_t(length), MEMCACHED_CMD_GET) >= count)
+    {
+      reader->invalid++;
+    }
+    reader->routed++;
+  }
+
+  return NULL;
+}
+
+/* reader records of dynamic still taken by a handle */
+static uint32_t sched_test_readers_in_use(struct sched_dynamic *dynamic)
+{
+  uint32_t in_use= 0;
+  for (struct sched_reader *reader= dynamic->readers; reader; reader= reader->next)
+  {
+    in_use+= reader->in_use ? 1 : 0;
+  }
+
+  return in_use;
+}
+
+/*
+  Several threads route keys, each on its own handle, while another lays
+  the continuum out anew and moves it: every route is one of the servers,
+  and no ring or reader stays taken once the handles are freed.
+*/
+test_return_t sched_readers_TEST(memcached_st *memc)
+{
+  test_compare(3U, memcached_server_count(memc));
+  struct sched_dynamic *dynamic= memc->dynamic;
+  uint32_t in_use= sched_test_readers_in_use(dynamic);
+
+  volatile bool stop= false;
+  struct sched_test_reader readers[4];
+  pthread_t threads[4];
+  for (uint32_t x= 0; x < 4; x++)
+  {
+    readers[x].memc= memcached_clone(NULL, memc);
+    test_true(readers[x].memc);
+    test_compare(MEMCACHED_SUCCESS, memcached_behavior_set_distribution(readers[x].memc, MEMCACHED_DISTRIBUTION_DYNAMIC));
+    readers[x].stop= &stop;
+    readers[x].routed= 0;
+    readers[x].invalid= 0;
+  }
+  test_compare(in_use + 4, sched_test_readers_in_use(dynamic));
+
+  for (uint32_t x= 0; x < 4; x++)
+  {
+    test_zero(pthread_create(threads + x, NULL, sched_test_reader_run, readers + x));
+  }
+
+  /* the servers join one by one, and the continuum moves with every tick */
+  uint64_t version= dynamic->version;
+  for (uint32_t round= 0; round < 20; round++)
+  {
+    memcached_st *writer= memcached_create(NULL);
+    test_true(writer);
+    test_compare(MEMCACHED_SUCCESS, memcached_behavior_set_distribution(writer, MEMCACHED_DISTRIBUTION_DYNAMIC));
+    for (uint32_t x= 0; x < 3; x++)
+    {
+      memcached_server_instance_st instance= memcached_server_instance_by_position(memc, x);
+      test_compare(MEMCACHED_SUCCESS, memcached_server_add(writer, instance->hostname, instance->port()));
+      for (uint32_t key= 0; key < 1000; key++)
+      {
+        char buffer[32];
+        int length= snprintf(buffer, sizeof(buffer), "writer:%u", (key * key) % (500 + round * 50));
+        (void)memcached_generate_hash(writer, buffer, size_t(length), MEMCACHED_CMD_GET);
+      }
+      mem_hs_sched_dynamic();
+    }
+    memcached_free(writer);
+  }
+  test_true(dynamic->version > version + 20);
+
+  stop= true;
+  for (uint32_t x= 0; x < 4; x++)
+  {
+    test_zero(pthread_join(threads[x], NULL));
+    test_true(readers[x].routed > 0);
+    test_zero(readers[x].invalid);
+    memcached_free(readers[x].memc);
+  }
+
+  /* the readers are given back, and with none reading every retired ring goes */
+  test_compare(in_use, sched_test_readers_in_use(dynamic));
+  (void)pthread_mutex_lock(&dynamic->lock);
+  sched_ring_reclaim(dynamic, false);
+  bool retired= (dynamic->retired != NULL);
+  (void)pthread_mutex_unlock(&dynamic->lock);
+  test_false(retired);
+
+  return TEST_SUCCESS;
+}
+
+/* the gets the ketama statistics hold once every handle's shard is merged */
+static uint64_t sched_test_ketama_gets(memcached_st *memc)
+{
+  struct ketama_stat *ketama_stat= memc->ketama_stat;
+  uint64_t gets= 0;
+
+  (void)pthread_mutex_lock(&ketama_stat->lock);
+  sched_counters_merge_ketama(memc->dynamic, ketama_stat);
+  for (uint32_t x= 0; x < ketama_stat->continuum_count; x++)
+  {
+    gets+= ketama_stat->servers[x].get;
+  }
+  (void)pthread_mutex_unlock(&ketama_stat->lock);
+
+  return gets;
+}
+
+/*
+  Ketama handles route keys from several threads while others of more and
+  more servers grow the shared statistics and the scheduler merges them:
+  every route is one of the servers, and the gets routed afterwards are all
+  found in the statistics.
+*/
+test_return_t sched_ketama_readers_TEST(memcached_st *memc)
+{
+  test_compare(3U, memcached_server_count(memc));
+  test_true(memc->ketama_stat);
+
+  volatile bool stop= false;
+  struct sched_test_reader readers[4];
+  pthread_t threads[4];
+  for (uint32_t x= 0; x < 4; x++)
+  {
+    readers[x].memc= memcached_clone(NULL, memc);
+    test_true(readers[x].memc);
+    test_compare(MEMCACHED_SUCCESS, memcached_behavior_set_distribution(readers[x].memc, MEMCACHED_DISTRIBUTION_CONSISTENT_KETAMA));
+    readers[x].stop= &stop;
+    readers[x].routed= 0;
+    readers[x].invalid= 0;
+  }
+
+  for (uint32_t x= 0; x < 4; x++)
+  {
+    test_zero(pthread_create(threads + x, NULL, sched_test_reader_run, readers + x));
+  }
+
+  for (uint32_t round= 0; round < 20; round++)
+  {
+    memcached_st *writer= memcached_create(NULL);
+    test_true(writer);
+    test_compare(MEMCACHED_SUCCESS, memcached_behavior_set_distribution(writer, MEMCACHED_DISTRIBUTION_CONSISTENT_KETAMA));
+    for (uint32_t x= 0; x < 4 + round; x++)
+    {
+      // a server is connected to as it is added; nothing listens there, which is quickly known
+      test_compare(MEMCACHED_SUCCESS, memcached_server_add(writer, "127.0.0.1", in_port_t(1 + x)));
+      for (uint32_t key= 0; key < 100; key++)
+      {
+        char buffer[32];
+        int length= snprintf(buffer, sizeof(buffer), "writer:%u", key);
+        (void)memcached_generate_hash(writer, buffer, size_t(length), MEMCACHED_CMD_GET);
+      }
+      mem_hs_sched_ketama();
+    }
+    memcached_free(writer);
+  }
+
+  stop= true;
+  for (uint32_t x= 0; x < 4; x++)
+  {
+    test_zero(pthread_join(threads[x], NULL));
+    test_true(readers[x].routed > 0);
+    test_zero(readers[x].invalid);
+  }
+
+  /* from nothing, the gets of every handle add up */
+  mem_hs_sched_ketama();
+  test_zero(sched_test_ketama_gets(memc));
+  for (uint32_t x= 0; x < 4; x++)
+  {
+    for (uint32_t key= 0; key < 1000; key++)
+    {
+      char buffer[32];
+      int length= snprintf(buffer, sizeof(buffer), "reader:%u", key);
+      (void)memcached_generate_hash(readers[x].memc, buffer, size_t(length), MEMCACHED_CMD_GET);
+    }
+  }
+  test_compare(uint64_t(4000), sched_test_ketama_gets(memc));
+
+  for (uint32_t x= 0; x < 4; x++)
+  {
+    memcached_free(readers[x].memc);
+  }
+
+  return TEST_SUCCESS;
+}
@@ -0,0 +1,43 @@
+/*
+ * sched.h
+ *
+ * jinho added: mapping tests of the distributions the scheduler added, see
+ * tests/libmemcached-1.0/sched.cc
+ */
+
+#pragma once
+
+test_return_t maglev_mapping_TEST(memcached_st *);
+test_return_t jump_mapping_TEST(memcached_st *);
+test_return_t jump_auto_eject_TEST(memcached_st *);
+test_return_t jump_join_TEST(memcached_st *);
+test_return_t bounded_home_TEST(memcached_st *);
+test_return_t bounded_cap_TEST(memcached_st *);
+test_return_t bounded_walk_TEST(memcached_st *);
+test_return_t bounded_delete_TEST(memcached_st *);
+test_return_t snapshot_round_trip_TEST(memcached_st *);
+test_return_t snapshot_other_servers_TEST(memcached_st *);
+test_return_t snapshot_ejected_TEST(memcached_st *);
+test_return_t snapshot_failed_TEST(memcached_st *);
+test_return_t hash_batch_TEST(memcached_st *);
+test_return_t continuum_search_TEST(memcached_st *);
+test_return_t dynamic_weighted_TEST(memcached_st *);
+test_return_t dynamic_join_TEST(memcached_st *);
+test_return_t dynamic_auto_eject_TEST(memcached_st *);
+test_return_t dynamic_idle_TEST(memcached_st *);
+test_return_t hot_keys_TEST(memcached_st *);
+test_return_t hot_keys_lone_TEST(memcached_st *);
+test_return_t replication_hot_key_TEST(memcached_st *);
+test_return_t replication_stale_TEST(memcached_st *);
+test_return_t handoff_delete_TEST(memcached_st *);
+test_return_t handoff_twice_TEST(memcached_st *);
+test_return_t handoff_set_TEST(memcached_st *);
+test_return_t migration_TEST(memcached_st *);
+test_return_t near_cache_TEST(memcached_st *);
+test_return_t sched_thread_TEST(memcached_st *);
+test_return_t sched_accounting_TEST(memcached_st *);
+test_return_t sched_feedback_TEST(memcached_st *);
+test_return_t sched_decay_TEST(memcached_st *);
+test_return_t sched_decay_reset_TEST(memcached_st *);
+test_return_t sched_readers_TEST(memcached_st *);
+test_return_t sched_ketama_readers_TEST(memcached_st *);
@@ -0,0 +1,181 @@
+/*
+ * sched_bench.cc
+ *
+ * Microbenchmark of the client side key -> server lookup. For ketama, ketama
+ * with bounded loads, Maglev, jump hashing and the dynamic distribution it
+ * times memcached_generate_hash() over rings of growing size; no server is
+ * contacted. The hash column is the cost of
+ * hashing the key alone, so lookup - hash is what dispatch_host() adds.
+ * The batch column routes the same keys through memcached_generate_hash_batch()
+ * BENCH_BATCH at a time.
+ * Servers are closed ports on localhost, so pushing them fails fast.
+ *
+ *   tests/sched_bench [lookups]
+ */
+
+#include <config.h>
+
+#include <libmemcached-1.0/memcached.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sys/time.h>
+
+#define BENCH_KEYS 4096
+#define BENCH_SIZES 7 // 2 .. 128 servers
+#define BENCH_PORT 39000
+#define BENCH_BATCH 64
+
+static char keys[BENCH_KEYS][32];
+static size_t lengths[BENCH_KEYS];
+static const char *key_ptrs[BENCH_KEYS];
+
+static double now_ns(void)
+{
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return (double)tv.tv_sec * 1e9 + (double)tv.tv_usec * 1e3;
+}
+
+static memcached_st *create(memcached_server_distribution_t distribution, uint32_t servers)
+{
+  memcached_st *memc= memcached_create(NULL);
+  if (memc == NULL)
+  {
+    return NULL;
+  }
+
+  if (memcached_failed(memcached_behavior_set_distribution(memc, distribution)))
+  {
+    memcached_free(memc);
+    return NULL;
+  }
+
+  if (distribution == MEMCACHED_DISTRIBUTION_DYNAMIC)
+  {
+    memcached_sched_set(memc, 0.5, 0.05);
+  }
+
+  memcached_server_st *list= NULL;
+  for (uint32_t x= 0; x < servers; x++)
+  {
+    memcached_return_t rc;
+    list= memcached_server_list_append(list, "localhost", (in_port_t)(BENCH_PORT + x), &rc);
+  }
+
+  memcached_return_t rc= memcached_server_push(memc, list);
+  memcached_server_list_free(list);
+  if (memcached_failed(rc))
+  {
+    memcached_free(memc);
+    return NULL;
+  }
+
+  return memc;
+}
+
+static double bench_hash(unsigned long lookups)
+{
+  volatile uint32_t sink= 0;
+
+  double start= now_ns();
+  for (unsigned long x= 0; x < lookups; x++)
+  {
+    size_t k= x % BENCH_KEYS;
+    sink+= memcached_generate_hash_value(keys[k], lengths[k], MEMCACHED_HASH_DEFAULT);
+  }
+  (void)sink;
+
+  return (now_ns() - start) / (double)lookups;
+}
+
+static double bench_lookup(memcached_st *memc, unsigned long lookups)
+{
+  volatile uint32_t sink= 0;
+
+  double start= now_ns();
+  for (unsigned long x= 0; x < lookups; x++)
+  {
+    size_t k= x % BENCH_KEYS;
+    sink+= memcached_generate_hash(memc, keys[k], lengths[k], (x & 3) ? MEMCACHED_CMD_GET : MEMCACHED_CMD_SET);
+  }
+  (void)sink;
+
+  return (now_ns() - start) / (double)lookups;
+}
+
+static double bench_batch(memcached_st *memc, unsigned long lookups)
+{
+  uint32_t server_keys[BENCH_BATCH];
+  volatile uint32_t sink= 0;
+
+  double start= now_ns();
+  for (unsigned long x= 0; x < lookups; x+= BENCH_BATCH)
+  {
+    size_t k= x % BENCH_KEYS; // BENCH_KEYS is a multiple of BENCH_BATCH
+    (void)memcached_generate_hash_batch(memc, key_ptrs + k, lengths + k, BENCH_BATCH, server_keys, MEMCACHED_CMD_GET);
+    sink+= server_keys[0];
+  }
+  (void)sink;
+
+  return (now_ns() - start) / (double)lookups;
+}
+
+int main(int argc, char *argv[])
+{
+  unsigned long lookups= 2000000;
+  if (argc > 1)
+  {
+    lookups= strtoul(argv[1], NULL, 10);
+  }
+  if (lookups == 0)
+  {
+    fprintf(stderr, "usage: %s [lookups]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  for (size_t x= 0; x < BENCH_KEYS; x++)
+  {
+    lengths[x]= (size_t)snprintf(keys[x], sizeof(keys[x]), "key:%lu", (unsigned long)(x * 2654435761UL));
+    key_ptrs[x]= keys[x];
+  }
+
+  double hash= bench_hash(lookups);
+
+  const struct {
+    const char *name;
+    memcached_server_distribution_t distribution;
+  } distributions[]= {
+    { "ketama", MEMCACHED_DISTRIBUTION_CONSISTENT_KETAMA },
+    { "bounded", MEMCACHED_DISTRIBUTION_CONSISTENT_BOUNDED },
+    { "maglev", MEMCACHED_DISTRIBUTION_MAGLEV },
+    { "jump", MEMCACHED_DISTRIBUTION_JUMP },
+    { "dynamic", MEMCACHED_DISTRIBUTION_DYNAMIC }
+  };
+
+  printf("%-8s %8s %12s %10s %10s %10s\n", "dist", "servers", "ns/lookup", "ns/hash", "ns/search", "ns/batch");
+  for (size_t d= 0; d < sizeof(distributions) / sizeof(distributions[0]); d++)
+  {
+    for (uint32_t x= 0; x < BENCH_SIZES; x++)
+    {
+      uint32_t servers= 2U << x;
+      memcached_st *memc= create(distributions[d].distribution, servers);
+      if (memc == NULL)
+      {
+        fprintf(stderr, "%s: could not set up %u servers\n", distributions[d].name, servers);
+        return EXIT_FAILURE;
+      }
+
+      (void)bench_lookup(memc, lookups / 10 + 1); // warm up caches and counter shards
+      double lookup= bench_lookup(memc, lookups);
+      double batch= bench_batch(memc, lookups);
+      printf("%-8s %8u %12.1f %10.1f %10.1f %10.1f\n", distributions[d].name, servers, lookup, hash, lookup - hash, batch);
+      fflush(stdout);
+
+      memcached_free(memc);
+    }
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,690 @@
+/*
+ * sched_sim.cc
+ *
+ * Offline simulator for the dynamic distribution. Keys are routed with the
+ * real library code (memcached_server_push() -> update_dynamic(),
+ * memcached_generate_hash() -> dispatch_host(), mem_hs_sched_dynamic()),
+ * but every server is a local LRU of fixed capacity instead of a memcached
+ * process. A hit is reported with memcached_sched_account(), as response.cc
+ * does for a real reply, and a GET that misses is followed by a SET, as a
+ * read-through client would do.
+ *
+ * The workload is a Zipf distribution over a fixed key space or a trace
+ * file with one key per line. With -W the servers get the comma separated
+ * weights in turn, each cache holds capacity items per unit of the mean
+ * weight, and the distribution is the weighted one. Every -r requests are one tick: the caches
+ * report their evictions as memcached_sched_feedback() would, the
+ * scheduler runs, and the tick is reported as
+ *
+ *   hit rate     hits / gets during the tick
+ *   imbalance    requests of the busiest server / mean requests per server,
+ *                both per unit of weight
+ *   moved        share of the hash space that changed owner in the tick
+ *
+ * Only the report goes to stdout: a # line with the settings, the column
+ * header, one row per tick, then # lines with the totals: hit rate and
+ * hash space moved, for bounded the requests sent away from their own
+ * server, and the keys migrated. Errors go to stderr.
+ *
+ *   tests/sched_sim [-n servers] [-c capacity] [-k keys] [-z zipf]
+ *                   [-r requests] [-t ticks] [-q alpha] [-w beta] [-e pressure]
+ *                   [-p pair|gradient] [-d dynamic|ketama|bounded|maglev|jump]
+ *                   [-f trace]
+ *                   [-h half-life] [-m migrations/tick] [-W weights] [-s seed]
+ *                   [-b epsilon]
+ *
+ * bounded is ketama with bounded loads, -b its epsilon; it has no weighted
+ * form, so -W leaves its servers equal. A key it places past a full server
+ * stays there, the SET after a miss included, so only its first GET there
+ * misses; that shows in the hit rate.
+ * maglev and jump take -W as they are; like ketama they never move the
+ * hash space on a tick.
+ */
+
+#include <config.h>
+
+#include <libmemcached/common.h>
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+#define SIM_PORT 39000
+#define SIM_NONE UINT32_MAX
+
+/*
+ * LRU of key ids: a doubly linked list over slots plus a linear probing
+ * table from key id to slot.
+ */
+struct sim_lru {
+  uint32_t capacity;
+  uint32_t count;
+  uint32_t head;
+  uint32_t tail;
+  uint32_t *key;
+  uint32_t *prev;
+  uint32_t *next;
+  uint32_t *table; // slot + 1, 0 is empty
+  uint32_t mask;
+  uint8_t *fetched; // read since it was set
+  uint64_t evictions;
+  uint64_t evicted_unfetched;
+};
+
+static inline uint32_t sim_mix(uint32_t x)
+{
+  x^= x >> 16;
+  x*= 0x7feb352dU;
+  x^= x >> 15;
+  x*= 0x846ca68bU;
+  x^= x >> 16;
+  return x;
+}
+
+static bool sim_lru_init(struct sim_lru *lru, uint32_t capacity)
+{
+  uint32_t size= 2;
+  while (size < capacity * 2)
+  {
+    size<<= 1;
+  }
+
+  memset(lru, 0, sizeof(struct sim_lru));
+  lru->capacity= capacity;
+  lru->head= lru->tail= SIM_NONE;
+  lru->mask= size - 1;
+  lru->key= (uint32_t *)calloc(capacity, sizeof(uint32_t));
+  lru->prev= (uint32_t *)calloc(capacity, sizeof(uint32_t));
+  lru->next= (uint32_t *)calloc(capacity, sizeof(uint32_t));
+  lru->table= (uint32_t *)calloc(size, sizeof(uint32_t));
+  lru->fetched= (uint8_t *)calloc(capacity, sizeof(uint8_t));
+
+  return lru->key and lru->prev and lru->next and lru->table and lru->fetched;
+}
+
+static void sim_lru_free(struct sim_lru *lru)
+{
+  free(lru->key);
+  free(lru->prev);
+  free(lru->next);
+  free(lru->table);
+  free(lru->fetched);
+}
+
+static uint32_t sim_lru_find(const struct sim_lru *lru, uint32_t key)
+{
+  for (uint32_t x= sim_mix(key) & lru->mask; lru->table[x]; x= (x + 1) & lru->mask)
+  {
+    if (lru->key[lru->table[x] - 1] == key)
+    {
+      return x;
+    }
+  }
+
+  return SIM_NONE;
+}
+
+static void sim_lru_unlink(struct sim_lru *lru, uint32_t slot)
+{
+  if (lru->prev[slot] != SIM_NONE) lru->next[lru->prev[slot]]= lru->next[slot];
+  else lru->head= lru->next[slot];
+
+  if (lru->next[slot] != SIM_NONE) lru->prev[lru->next[slot]]= lru->prev[slot];
+  else lru->tail= lru->prev[slot];
+}
+
+static void sim_lru_push(struct sim_lru *lru, uint32_t slot)
+{
+  lru->prev[slot]= SIM_NONE;
+  lru->next[slot]= lru->head;
+  if (lru->head != SIM_NONE) lru->prev[lru->head]= slot;
+  lru->head= slot;
+  if (lru->tail == SIM_NONE) lru->tail= slot;
+}
+
+// backward shift deletion, keeps every probe chain unbroken
+static void sim_lru_erase(struct sim_lru *lru, uint32_t x)
+{
+  lru->table[x]= 0;
+  for (uint32_t y= (x + 1) & lru->mask; lru->table[y]; y= (y + 1) & lru->mask)
+  {
+    uint32_t home= sim_mix(lru->key[lru->table[y] - 1]) & lru->mask;
+    if (((y - home) & lru->mask) >= ((y - x) & lru->mask))
+    {
+      lru->table[x]= lru->table[y];
+      lru->table[y]= 0;
+      x= y;
+    }
+  }
+}
+
+static bool sim_lru_get(struct sim_lru *lru, uint32_t key)
+{
+  uint32_t x= sim_lru_find(lru, key);
+  if (x == SIM_NONE)
+  {
+    return false;
+  }
+
+  uint32_t slot= lru->table[x] - 1;
+  sim_lru_unlink(lru, slot);
+  sim_lru_push(lru, slot);
+  lru->fetched[slot]= 1;
+
+  return true;
+}
+
+static void sim_lru_set(struct sim_lru *lru, uint32_t key)
+{
+  if (sim_lru_get(lru, key))
+  {
+    return;
+  }
+
+  uint32_t slot;
+  if (lru->count < lru->capacity)
+  {
+    slot= lru->count++;
+  }
+  else
+  {
+    slot= lru->tail;
+    sim_lru_erase(lru, sim_lru_find(lru, lru->key[slot]));
+    sim_lru_unlink(lru, slot);
+    lru->evictions++;
+    if (lru->fetched[slot] == 0)
+    {
+      lru->evicted_unfetched++;
+    }
+  }
+
+  lru->key[slot]= key;
+  lru->fetched[slot]= 0;
+  sim_lru_push(lru, slot);
+
+  uint32_t x= sim_mix(key) & lru->mask;
+  while (lru->table[x])
+  {
+    x= (x + 1) & lru->mask;
+  }
+  lru->table[x]= slot + 1;
+}
+
+/* owner of the hash space up to and including end */
+struct sim_segment {
+  uint64_t end;
+  uint32_t server;
+};
+
+/*
+ * Ownership of the published dynamic ring: point x covers
+ * (values[x - 1], values[x]], and like dispatch_host() the last point is
+ * never searched, so everything past values[points - 2] wraps to point 0.
+ */
+static uint32_t sim_ownership(std::vector<struct sim_segment>& segments)
+{
+  struct sched_dynamic *dynamic= get_dynamic();
+  uint32_t count= 0;
+
+  if (dynamic == NULL)
+  {
+    return 0;
+  }
+
+  (void)pthread_mutex_lock(&dynamic->lock);
+  struct sched_ring *ring= dynamic->ring;
+  if (ring and ring->continuum_points_counter > 1)
+  {
+    segments.resize(ring->continuum_points_counter);
+    for (uint32_t x= 0; x + 1 < ring->continuum_points_counter; x++)
+    {
+      segments[count].end= ring->values[x];
+      segments[count].server= ring->indices[x];
+      count++;
+    }
+    segments[count].end= UINT32_MAX;
+    segments[count].server= ring->indices[0];
+    count++;
+  }
+  (void)pthread_mutex_unlock(&dynamic->lock);
+
+  return count;
+}
+
+static double sim_moved(const struct sim_segment *a, uint32_t na, const struct sim_segment *b, uint32_t nb)
+{
+  uint64_t moved= 0;
+  uint64_t start= 0;
+  uint32_t x= 0, y= 0;
+
+  if (na == 0 or nb == 0)
+  {
+    return 0;
+  }
+
+  while (x < na and y < nb)
+  {
+    uint64_t end= (a[x].end < b[y].end) ? a[x].end : b[y].end;
+    if (end + 1 > start and a[x].server != b[y].server)
+    {
+      moved+= end + 1 - start;
+    }
+    if (end + 1 > start)
+    {
+      start= end + 1;
+    }
+
+    if (a[x].end == end) x++;
+    if (b[y].end == end) y++;
+  }
+
+  return (double)moved / 4294967296.0;
+}
+
+/* what memcached_sched_feedback() would collect from the caches */
+static void sim_feedback(const std::vector<struct sim_lru>& caches)
+{
+  struct sched_dynamic *dynamic= get_dynamic();
+  std::vector<struct sched_feedback> feedback(caches.size());
+
+  for (size_t x= 0; x < caches.size(); x++)
+  {
+    feedback[x].reported= true;
+    feedback[x].evictions= caches[x].evictions;
+    feedback[x].evicted_unfetched= caches[x].evicted_unfetched;
+    feedback[x].bytes= caches[x].count;
+    feedback[x].limit_maxbytes= caches[x].capacity;
+    feedback[x].curr_items= caches[x].count;
+  }
+
+  (void)pthread_mutex_lock(&dynamic->lock);
+  sched_servers_feedback(dynamic, &feedback[0], (uint32_t)feedback.size());
+  (void)pthread_mutex_unlock(&dynamic->lock);
+}
+
+/* what memcached_sched_migrate() would do, straight between the caches */
+static void sim_migrate(std::vector<struct sim_lru>& caches, const std::map<std::string, uint32_t> *interned, uint32_t max)
+{
+  struct sched_dynamic *dynamic= get_dynamic();
+  struct sched_migration migration;
+
+  for (uint32_t x= 0; x < max and sched_migrator_pop(dynamic, &migration, 1); x++)
+  {
+    std::string name(migration.key, migration.length);
+    uint32_t key;
+    if (interned)
+    {
+      std::map<std::string, uint32_t>::const_iterator it= interned->find(name);
+      if (it == interned->end())
+      {
+        continue;
+      }
+      key= it->second;
+    }
+    else
+    {
+      key= (uint32_t)strtoul(name.c_str() + sizeof("key:") - 1, NULL, 10);
+    }
+
+    if (migration.from >= caches.size() or migration.to >= caches.size() or
+        sim_lru_find(&caches[migration.from], key) == SIM_NONE or
+        sim_lru_find(&caches[migration.to], key) != SIM_NONE)
+    {
+      continue;
+    }
+
+    sim_lru_set(&caches[migration.to], key);
+    sched_migrator_done(dynamic, &migration);
+  }
+}
+
+static uint64_t sim_state= 88172645463325252ULL;
+
+static double sim_random(void)
+{
+  sim_state^= sim_state << 13;
+  sim_state^= sim_state >> 7;
+  sim_state^= sim_state << 17;
+  return (double)(sim_state >> 11) / 9007199254740992.0;
+}
+
+static void usage(const char *name)
+{
+  fprintf(stderr, "usage: %s [-n servers] [-c capacity] [-k keys] [-z zipf] [-r requests] [-t ticks]\n"
+                  "       [-q alpha] [-w beta] [-e pressure] [-p pair|gradient] [-d dynamic|ketama|bounded|maglev|jump] [-f trace]\n"
+                  "       [-h half-life] [-m migrations/tick] [-W weights] [-s seed] [-b epsilon]\n", name);
+}
+
+int main(int argc, char *argv[])
+{
+  uint32_t servers= 8;
+  uint32_t capacity= 10000;
+  uint32_t keys= 200000;
+  double zipf= 0.99;
+  uint32_t requests= 200000;
+  uint32_t ticks= 50;
+  double alpha= 0.5;
+  double beta= 0.05;
+  double half_life= MEMCACHED_SCHED_HALF_LIFE;
+  double pressure= MEMCACHED_SCHED_PRESSURE;
+  double epsilon= MEMCACHED_SCHED_BOUND;
+  uint32_t migrate= 0;
+  memcached_sched_policy_t policy= MEMCACHED_SCHED_POLICY_PAIR;
+  memcached_server_distribution_t distribution= MEMCACHED_DISTRIBUTION_DYNAMIC;
+  const char *trace= NULL;
+  const char *weights= NULL;
+
+  int c;
+  while ((c= getopt(argc, argv, "n:c:k:z:r:t:q:w:e:m:p:d:f:h:W:s:b:")) != -1)
+  {
+    switch (c)
+    {
+    case 'n': servers= (uint32_t)strtoul(optarg, NULL, 10); break;
+    case 'c': capacity= (uint32_t)strtoul(optarg, NULL, 10); break;
+    case 'k': keys= (uint32_t)strtoul(optarg, NULL, 10); break;
+    case 'z': zipf= strtod(optarg, NULL); break;
+    case 'r': requests= (uint32_t)strtoul(optarg, NULL, 10); break;
+    case 't': ticks= (uint32_t)strtoul(optarg, NULL, 10); break;
+    case 'q': alpha= strtod(optarg, NULL); break;
+    case 'w': beta= strtod(optarg, NULL); break;
+    case 'e': pressure= strtod(optarg, NULL); break;
+    case 'm': migrate= (uint32_t)strtoul(optarg, NULL, 10); break;
+    case 'f': trace= optarg; break;
+    case 'h': half_life= strtod(optarg, NULL); break;
+    case 'W': weights= optarg; break;
+    case 's': sim_state= strtoull(optarg, NULL, 10) | 1; break;
+    case 'b': epsilon= strtod(optarg, NULL); break;
+    case 'p':
+      if (strcmp(optarg, "pair") == 0) policy= MEMCACHED_SCHED_POLICY_PAIR;
+      else if (strcmp(optarg, "gradient") == 0) policy= MEMCACHED_SCHED_POLICY_GRADIENT;
+      else { usage(argv[0]); return EXIT_FAILURE; }
+      break;
+    case 'd':
+      if (strcmp(optarg, "dynamic") == 0) distribution= MEMCACHED_DISTRIBUTION_DYNAMIC;
+      else if (strcmp(optarg, "ketama") == 0) distribution= MEMCACHED_DISTRIBUTION_CONSISTENT_KETAMA;
+      else if (strcmp(optarg, "bounded") == 0) distribution= MEMCACHED_DISTRIBUTION_CONSISTENT_BOUNDED;
+      else if (strcmp(optarg, "maglev") == 0) distribution= MEMCACHED_DISTRIBUTION_MAGLEV;
+      else if (strcmp(optarg, "jump") == 0) distribution= MEMCACHED_DISTRIBUTION_JUMP;
+      else { usage(argv[0]); return EXIT_FAILURE; }
+      break;
+    default:
+      usage(argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+
+  if (servers == 0 or capacity == 0 or keys == 0 or requests == 0)
+  {
+    usage(argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  // the key space: a trace is interned to ids in order of first appearance
+  std::map<std::string, uint32_t> interned;
+  std::vector<std::string> names;
+  std::vector<uint32_t> replay;
+  if (trace)
+  {
+    FILE *file= fopen(trace, "r");
+    if (file == NULL)
+    {
+      perror(trace);
+      return EXIT_FAILURE;
+    }
+
+    char line[MEMCACHED_MAX_KEY + 2];
+    while (fgets(line, sizeof(line), file))
+    {
+      size_t length= strcspn(line, "\r\n");
+      if (length == 0)
+      {
+        continue;
+      }
+
+      std::string key(line, length);
+      std::map<std::string, uint32_t>::iterator it= interned.find(key);
+      if (it == interned.end())
+      {
+        it= interned.insert(std::make_pair(key, (uint32_t)names.size())).first;
+        names.push_back(key);
+      }
+      replay.push_back(it->second);
+    }
+    fclose(file);
+
+    if (replay.empty())
+    {
+      fprintf(stderr, "%s: no keys\n", trace);
+      return EXIT_FAILURE;
+    }
+    ticks= (uint32_t)((replay.size() + requests - 1) / requests);
+  }
+  else
+  {
+    names.reserve(keys);
+    for (uint32_t x= 0; x < keys; x++)
+    {
+      char key[32];
+      snprintf(key, sizeof(key), "key:%u", x);
+      names.push_back(key);
+    }
+  }
+
+  // Zipf: rank x is drawn with probability proportional to 1 / (x + 1)^zipf
+  std::vector<double> cdf;
+  if (trace == NULL)
+  {
+    cdf.resize(keys);
+    double sum= 0;
+    for (uint32_t x= 0; x < keys; x++)
+    {
+      sum+= 1.0 / pow((double)(x + 1), zipf);
+      cdf[x]= sum;
+    }
+    for (uint32_t x= 0; x < keys; x++)
+    {
+      cdf[x]/= sum;
+    }
+  }
+
+  std::vector<uint32_t> weight(servers, 1);
+  if (weights)
+  {
+    const char *p= weights;
+    for (uint32_t x= 0; x < servers; x++)
+    {
+      weight[x]= (uint32_t)strtoul(p, NULL, 10);
+      if (weight[x] == 0)
+      {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+      }
+      p= strchr(p, ',') ? strchr(p, ',') + 1 : weights;
+    }
+
+    if (distribution == MEMCACHED_DISTRIBUTION_DYNAMIC)
+    {
+      distribution= MEMCACHED_DISTRIBUTION_DYNAMIC_WEIGHTED;
+    }
+    else if (distribution == MEMCACHED_DISTRIBUTION_CONSISTENT_KETAMA)
+    {
+      distribution= MEMCACHED_DISTRIBUTION_CONSISTENT_WEIGHTED;
+    }
+  }
+
+  double mean_weight= 0;
+  for (uint32_t x= 0; x < servers; x++)
+  {
+    mean_weight+= (double)weight[x] / servers;
+  }
+
+  memcached_st *memc= memcached_create(NULL);
+  if (memc == NULL or memcached_failed(memcached_behavior_set_distribution(memc, distribution)))
+  {
+    fprintf(stderr, "could not create a client\n");
+    return EXIT_FAILURE;
+  }
+
+  if (distribution == MEMCACHED_DISTRIBUTION_DYNAMIC or distribution == MEMCACHED_DISTRIBUTION_DYNAMIC_WEIGHTED)
+  {
+    memcached_sched_set(memc, alpha, beta);
+    memcached_sched_set_policy(memc, policy);
+    memcached_sched_set_half_life(memc, half_life);
+    memcached_sched_set_pressure(memc, pressure);
+    if (migrate)
+    {
+      memcached_sched_set_migration(memc, capacity, 0);
+    }
+  }
+
+  if (distribution == MEMCACHED_DISTRIBUTION_CONSISTENT_BOUNDED and memcached_failed(memcached_sched_set_bound(memc, epsilon)))
+  {
+    usage(argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  memcached_server_st *list= NULL;
+  for (uint32_t x= 0; x < servers; x++)
+  {
+    memcached_return_t rc;
+    list= memcached_server_list_append_with_weight(list, "localhost", (in_port_t)(SIM_PORT + x), weight[x], &rc);
+  }
+  memcached_return_t rc= memcached_server_push(memc, list);
+  memcached_server_list_free(list);
+  if (memcached_failed(rc))
+  {
+    fprintf(stderr, "could not add %u servers: %s\n", servers, memcached_strerror(memc, rc));
+    memcached_free(memc);
+    return EXIT_FAILURE;
+  }
+
+  std::vector<struct sim_lru> caches(servers);
+  for (uint32_t x= 0; x < servers; x++)
+  {
+    if (sim_lru_init(&caches[x], (uint32_t)(capacity * weight[x] / mean_weight + 0.5)) == false)
+    {
+      fprintf(stderr, "out of memory\n");
+      return EXIT_FAILURE;
+    }
+  }
+
+  std::vector<struct sim_segment> before, after;
+  std::vector<uint64_t> load(servers);
+
+  printf("# %s, %u servers x %u items, %s, %u requests/tick, alpha %.3f, beta %.3f, pressure %.2f, half-life %.1f, %s\n",
+         libmemcached_string_distribution(distribution), servers, capacity,
+         trace ? trace : "zipf", requests, alpha, beta, pressure, half_life,
+         distribution == MEMCACHED_DISTRIBUTION_DYNAMIC or distribution == MEMCACHED_DISTRIBUTION_DYNAMIC_WEIGHTED ? (policy == MEMCACHED_SCHED_POLICY_GRADIENT ? "gradient" : "pair") : "-");
+  printf("%6s %10s %10s %10s\n", "tick", "hitrate", "imbalance", "moved");
+  fflush(stdout);
+
+  double total_moved= 0;
+  uint64_t total_hits= 0, total_gets= 0;
+  size_t cursor= 0;
+  for (uint32_t tick= 0; tick < ticks; tick++)
+  {
+    uint64_t hits= 0, gets= 0;
+    for (uint32_t x= 0; x < servers; x++)
+    {
+      load[x]= 0;
+    }
+
+    for (uint32_t x= 0; x < requests; x++)
+    {
+      uint32_t key;
+      if (trace)
+      {
+        if (cursor == replay.size())
+        {
+          break;
+        }
+        key= replay[cursor++];
+      }
+      else
+      {
+        double u= sim_random();
+        uint32_t lo= 0, hi= keys - 1;
+        while (lo < hi)
+        {
+          uint32_t mid= lo + (hi - lo) / 2;
+          if (cdf[mid] < u) lo= mid + 1;
+          else hi= mid;
+        }
+        key= lo;
+      }
+
+      const std::string& name= names[key];
+      uint32_t server= memcached_generate_hash(memc, name.c_str(), name.size(), MEMCACHED_CMD_GET);
+      gets++;
+      load[server]++;
+      if (sim_lru_get(&caches[server], key))
+      {
+        memcached_sched_account(memc, server, memcached_sched_routed(memc), memc->sched_reader->route_layout,
+                                name.c_str(), name.size(), true, 0, 0);
+        hits++;
+        continue;
+      }
+
+      server= memcached_generate_hash(memc, name.c_str(), name.size(), MEMCACHED_CMD_SET);
+      load[server]++;
+      sim_lru_set(&caches[server], key);
+    }
+
+    uint32_t nbefore= sim_ownership(before);
+    if (distribution == MEMCACHED_DISTRIBUTION_DYNAMIC or distribution == MEMCACHED_DISTRIBUTION_DYNAMIC_WEIGHTED)
+    {
+      sim_feedback(caches);
+      mem_hs_sched_dynamic();
+      sim_migrate(caches, trace ? &interned : NULL, migrate);
+    }
+    uint32_t nafter= sim_ownership(after);
+    double moved= nbefore and nafter ? sim_moved(&before[0], nbefore, &after[0], nafter) : 0;
+
+    // per unit of weight, the busiest server against the mean
+    double busiest= 0;
+    uint64_t sum= 0;
+    for (uint32_t x= 0; x < servers; x++)
+    {
+      sum+= load[x];
+      if ((double)load[x] / weight[x] > busiest) busiest= (double)load[x] / weight[x];
+    }
+
+    printf("%6u %10.4f %10.4f %10.6f\n", tick, gets ? (double)hits / (double)gets : 0,
+           sum ? busiest * mean_weight * servers / (double)sum : 0, moved);
+    fflush(stdout);
+
+    total_hits+= hits;
+    total_gets+= gets;
+    total_moved+= moved;
+  }
+
+  printf("# hitrate %.4f, moved %.6f of the hash space in total\n",
+         total_gets ? (double)total_hits / (double)total_gets : 0, total_moved);
+
+  uint64_t routed, overflowed;
+  if (distribution == MEMCACHED_DISTRIBUTION_CONSISTENT_BOUNDED and
+      memcached_success(memcached_sched_bound_stat(memc, &routed, &overflowed)))
+  {
+    printf("# epsilon %.3f, %llu of %llu requests away from their own server\n", epsilon,
+           (unsigned long long)overflowed, (unsigned long long)routed);
+  }
+
+  uint64_t migrated, avoided;
+  if (memcached_success(memcached_sched_migration_stat(memc, &migrated, &avoided, NULL)))
+  {
+    printf("# migrated %llu keys, %llu misses avoided\n", (unsigned long long)migrated, (unsigned long long)avoided);
+  }
+
+  for (uint32_t x= 0; x < servers; x++)
+  {
+    sim_lru_free(&caches[x]);
+  }
+  memcached_free(memc);
+
+  return EXIT_SUCCESS;
+}
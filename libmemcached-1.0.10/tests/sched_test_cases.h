@@ -0,0 +1,220 @@
+/*
+ * jinho added: where MEMCACHED_DISTRIBUTION_MAGLEV and
+ * MEMCACHED_DISTRIBUTION_JUMP put the keys of ketama_test_cases.h, with the
+ * weighted 10.0.1.x servers of the ketama tests and the default hash.
+ *
+ * Use and distribution licensed under the BSD license.  See
+ * the COPYING file in the parent directory for full text.
+ */
+
+#pragma once
+
+static struct {
+    const char *key;
+    const char *server;
+} maglev_test_cases[99]= {
+  { "SVa_]_V41)", "10.0.1.1" },
+  { "*/Z;?V(.\\8", "10.0.1.7" },
+  { "30C1*Z*S/_", "10.0.1.6" },
+  { "ERR:EC58G>", "10.0.1.5" },
+  { "1I=cTMNTKF", "10.0.1.5" },
+  { "]VG<`I*Z8)", "10.0.1.7" },
+  { "UUTC`-V159", "10.0.1.1" },
+  { "@7RU6C6T+Z", "10.0.1.6" },
+  { "/XLN0@+36;", "10.0.1.6" },
+  { "4(`X;\\V.^c", "10.0.1.5" },
+  { "726bW=9*a4", "10.0.1.5" },
+  { "\\`)<B)UE,c", "10.0.1.6" },
+  { "P1[Ma3=K1/", "10.0.1.5" },
+  { "C89I.-V?cT", "10.0.1.7" },
+  { "D[HE+cFXDK", "10.0.1.5" },
+  { "P1L?NAB[)K", "10.0.1.7" },
+  { "cDT0)Z5P6,", "10.0.1.1" },
+  { "@JW`+[WAO8", "10.0.1.5" },
+  { "\\39DKW^)N_", "10.0.1.6" },
+  { "EM75N0+[X1", "10.0.1.6" },
+  { "`,SS]NBP,b", "10.0.1.5" },
+  { "XX1a9LT+F?", "10.0.1.7" },
+  { "Zc\\-,F-c6V", "10.0.1.5" },
+  { "1*RTMC7,03", "10.0.1.7" },
+  { "*Xc+V0P>32", "10.0.1.7" },
+  { "U))Fb-(`,.", "10.0.1.6" },
+  { "R-08RNTaRT", "10.0.1.1" },
+  { "(LHcO203I3", "10.0.1.5" },
+  { "=256P+;Qc8", "10.0.1.5" },
+  { "OI5XZ_BBT(", "10.0.1.1" },
+  { "2TLRL/UL;:", "10.0.1.7" },
+  { "WHD\\O1`ZRW", "10.0.1.6" },
+  { ".=54)_c;=T", "10.0.1.1" },
+  { ";G<W-XWZ@b", "10.0.1.1" },
+  { "(,>E`)FT\\4", "10.0.1.7" },
+  { "HZAU*;P*N]", "10.0.1.1" },
+  { "NZ@ZE=O84_", "10.0.1.5" },
+  { "6,cEI`F_P>", "10.0.1.7" },
+  { "c,5AQ/T5)6", "10.0.1.4" },
+  { ".O,>>BT)RX", "10.0.1.3" },
+  { "XY\\X::LX50", "10.0.1.1" },
+  { "+550F^/.01", "10.0.1.2" },
+  { "<.X9E2S5+9", "10.0.1.2" },
+  { "]\\.UH8_0a1", "10.0.1.2" },
+  { "8(6=(T0/Z0", "10.0.1.5" },
+  { "8*6a;Sc*X+", "10.0.1.5" },
+  { "<QW:;3K6;H", "10.0.1.6" },
+  { "7C@EY@-Y?_", "10.0.1.6" },
+  { "aPb3E1WD4K", "10.0.1.7" },
+  { "?@12R<=1BH", "10.0.1.5" },
+  { "QR(a+Q=1FU", "10.0.1.7" },
+  { "`C9^FV,960", "10.0.1.6" },
+  { "UNHVP..^8H", "10.0.1.6" },
+  { ":Y.2W2[(35", "10.0.1.1" },
+  { "M/HV^_HZ4O", "10.0.1.7" },
+  { "ZY16KQ<ICD", "10.0.1.6" },
+  { "bV2,`a.PY9", "10.0.1.6" },
+  { "U;9:-+5N]9", "10.0.1.6" },
+  { "1S/:aJ[1(;", "10.0.1.2" },
+  { "Nb-X^]M)I:", "10.0.1.2" },
+  { "2;M;ES>J5/", "10.0.1.5" },
+  { "[>RZHG97Q9", "10.0.1.5" },
+  { "J3/G[)9<^Z", "10.0.1.6" },
+  { "N-)88>[O`,", "10.0.1.2" },
+  { "NP:=FR\\OaA", "10.0.1.3" },
+  { "`@L+W;a,O[", "10.0.1.5" },
+  { "W2`P:-+1T[", "10.0.1.5" },
+  { "-6G7K^YDIN", "10.0.1.5" },
+  { "U>*>9ZI6V5", "10.0.1.5" },
+  { ".I?^6Ic9RK", "10.0.1.4" },
+  { "0OZH^9BKM[", "10.0.1.6" },
+  { "5?50UGZ:ML", "10.0.1.6" },
+  { "?K2NF@3=IU", "10.0.1.5" },
+  { "YI@G-2X?UB", "10.0.1.4" },
+  { "7cY</BSaL=", "10.0.1.6" },
+  { "A(`KF:[RH8", "10.0.1.6" },
+  { ";=ZT\\W^P+H", "10.0.1.4" },
+  { "b2?WFF56;R", "10.0.1.4" },
+  { "CTR74,J+N.", "10.0.1.6" },
+  { "<b;*R+QDST", "10.0.1.7" },
+  { "\\R^7=9UCG`", "10.0.1.5" },
+  { "1bQS5]WOXB", "10.0.1.7" },
+  { "M(@X^b[L:K", "10.0.1.6" },
+  { "431cBF8,YO", "10.0.1.4" },
+  { "(bEIQJ:E./", "10.0.1.6" },
+  { "WS/3H*)7F;", "10.0.1.5" },
+  { "ZJF[Ia6Q)+", "10.0.1.5" },
+  { "<]*QCK8U,>", "10.0.1.6" },
+  { "\\[a\\^=V_M0", "10.0.1.1" },
+  { "7;RM+8J9YC", "10.0.1.5" },
+  { "4*=.SPR[AV", "10.0.1.4" },
+  { "-2F+^88P4U", "10.0.1.1" },
+  { "X;-F`(N?9D", "10.0.1.2" },
+  { "R=F_D-K2a]", "10.0.1.1" },
+  { "X*+2aaC.EG", "10.0.1.4" },
+  { "[1ZXONX2]a", "10.0.1.4" },
+  { "FL;\\GWacaV", "10.0.1.5" },
+  { "\\MQ_XNT7L-", "10.0.1.6" },
+  { "VD6D0]ba_\\", "10.0.1.7" },
+};
+
+static struct {
+    const char *key;
+    const char *server;
+} jump_test_cases[99]= {
+  { "SVa_]_V41)", "10.0.1.6" },
+  { "*/Z;?V(.\\8", "10.0.1.4" },
+  { "30C1*Z*S/_", "10.0.1.7" },
+  { "ERR:EC58G>", "10.0.1.7" },
+  { "1I=cTMNTKF", "10.0.1.6" },
+  { "]VG<`I*Z8)", "10.0.1.7" },
+  { "UUTC`-V159", "10.0.1.6" },
+  { "@7RU6C6T+Z", "10.0.1.6" },
+  { "/XLN0@+36;", "10.0.1.7" },
+  { "4(`X;\\V.^c", "10.0.1.6" },
+  { "726bW=9*a4", "10.0.1.8" },
+  { "\\`)<B)UE,c", "10.0.1.2" },
+  { "P1[Ma3=K1/", "10.0.1.4" },
+  { "C89I.-V?cT", "10.0.1.7" },
+  { "D[HE+cFXDK", "10.0.1.6" },
+  { "P1L?NAB[)K", "10.0.1.7" },
+  { "cDT0)Z5P6,", "10.0.1.5" },
+  { "@JW`+[WAO8", "10.0.1.1" },
+  { "\\39DKW^)N_", "10.0.1.6" },
+  { "EM75N0+[X1", "10.0.1.5" },
+  { "`,SS]NBP,b", "10.0.1.5" },
+  { "XX1a9LT+F?", "10.0.1.6" },
+  { "Zc\\-,F-c6V", "10.0.1.7" },
+  { "1*RTMC7,03", "10.0.1.7" },
+  { "*Xc+V0P>32", "10.0.1.5" },
+  { "U))Fb-(`,.", "10.0.1.2" },
+  { "R-08RNTaRT", "10.0.1.4" },
+  { "(LHcO203I3", "10.0.1.6" },
+  { "=256P+;Qc8", "10.0.1.6" },
+  { "OI5XZ_BBT(", "10.0.1.8" },
+  { "2TLRL/UL;:", "10.0.1.7" },
+  { "WHD\\O1`ZRW", "10.0.1.6" },
+  { ".=54)_c;=T", "10.0.1.5" },
+  { ";G<W-XWZ@b", "10.0.1.2" },
+  { "(,>E`)FT\\4", "10.0.1.5" },
+  { "HZAU*;P*N]", "10.0.1.1" },
+  { "NZ@ZE=O84_", "10.0.1.6" },
+  { "6,cEI`F_P>", "10.0.1.5" },
+  { "c,5AQ/T5)6", "10.0.1.5" },
+  { ".O,>>BT)RX", "10.0.1.2" },
+  { "XY\\X::LX50", "10.0.1.7" },
+  { "+550F^/.01", "10.0.1.2" },
+  { "<.X9E2S5+9", "10.0.1.6" },
+  { "]\\.UH8_0a1", "10.0.1.5" },
+  { "8(6=(T0/Z0", "10.0.1.7" },
+  { "8*6a;Sc*X+", "10.0.1.6" },
+  { "<QW:;3K6;H", "10.0.1.6" },
+  { "7C@EY@-Y?_", "10.0.1.5" },
+  { "aPb3E1WD4K", "10.0.1.6" },
+  { "?@12R<=1BH", "10.0.1.6" },
+  { "QR(a+Q=1FU", "10.0.1.3" },
+  { "`C9^FV,960", "10.0.1.5" },
+  { "UNHVP..^8H", "10.0.1.4" },
+  { ":Y.2W2[(35", "10.0.1.7" },
+  { "M/HV^_HZ4O", "10.0.1.7" },
+  { "ZY16KQ<ICD", "10.0.1.6" },
+  { "bV2,`a.PY9", "10.0.1.1" },
+  { "U;9:-+5N]9", "10.0.1.6" },
+  { "1S/:aJ[1(;", "10.0.1.6" },
+  { "Nb-X^]M)I:", "10.0.1.4" },
+  { "2;M;ES>J5/", "10.0.1.1" },
+  { "[>RZHG97Q9", "10.0.1.5" },
+  { "J3/G[)9<^Z", "10.0.1.5" },
+  { "N-)88>[O`,", "10.0.1.6" },
+  { "NP:=FR\\OaA", "10.0.1.2" },
+  { "`@L+W;a,O[", "10.0.1.5" },
+  { "W2`P:-+1T[", "10.0.1.4" },
+  { "-6G7K^YDIN", "10.0.1.7" },
+  { "U>*>9ZI6V5", "10.0.1.5" },
+  { ".I?^6Ic9RK", "10.0.1.5" },
+  { "0OZH^9BKM[", "10.0.1.6" },
+  { "5?50UGZ:ML", "10.0.1.2" },
+  { "?K2NF@3=IU", "10.0.1.5" },
+  { "YI@G-2X?UB", "10.0.1.5" },
+  { "7cY</BSaL=", "10.0.1.3" },
+  { "A(`KF:[RH8", "10.0.1.5" },
+  { ";=ZT\\W^P+H", "10.0.1.7" },
+  { "b2?WFF56;R", "10.0.1.5" },
+  { "CTR74,J+N.", "10.0.1.4" },
+  { "<b;*R+QDST", "10.0.1.6" },
+  { "\\R^7=9UCG`", "10.0.1.5" },
+  { "1bQS5]WOXB", "10.0.1.5" },
+  { "M(@X^b[L:K", "10.0.1.4" },
+  { "431cBF8,YO", "10.0.1.7" },
+  { "(bEIQJ:E./", "10.0.1.7" },
+  { "WS/3H*)7F;", "10.0.1.5" },
+  { "ZJF[Ia6Q)+", "10.0.1.6" },
+  { "<]*QCK8U,>", "10.0.1.6" },
+  { "\\[a\\^=V_M0", "10.0.1.1" },
+  { "7;RM+8J9YC", "10.0.1.6" },
+  { "4*=.SPR[AV", "10.0.1.7" },
+  { "-2F+^88P4U", "10.0.1.7" },
+  { "X;-F`(N?9D", "10.0.1.5" },
+  { "R=F_D-K2a]", "10.0.1.6" },
+  { "X*+2aaC.EG", "10.0.1.8" },
+  { "[1ZXONX2]a", "10.0.1.5" },
+  { "FL;\\GWacaV", "10.0.1.5" },
+  { "\\MQ_XNT7L-", "10.0.1.1" },
+  { "VD6D0]ba_\\", "10.0.1.2" },
+};